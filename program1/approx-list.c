@@ -0,0 +1,411 @@
+#include "token-list.h"
+
+/*! Napier's constant, for the error bound of the sketch */
+#define SKETCH_E 2.718281828459045
+
+static void approx_hash(const char *np, int len, unsigned long *h1, unsigned long *h2);
+static struct TOP_ID *approx_search(struct APPROX_TABLE *tab, const char *np, int len, unsigned long hash);
+static void approx_index(struct APPROX_TABLE *tab, int pos);
+static void approx_unindex(struct APPROX_TABLE *tab, int pos);
+static void approx_sift_down(struct APPROX_TABLE *tab, int pos);
+static void approx_swap(struct APPROX_TABLE *tab, int a, int b);
+static int approx_set_name(struct TOP_ID *p, const char *np, int len, unsigned long hash);
+static int compare_top_ids(const void *a, const void *b);
+
+/*!
+ * @brief Initialise a table counting the names approximately in fixed memory
+ * @param[out] tab Table
+ * @param[in] k The number of the most frequent names to be kept
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int approx_init(struct APPROX_TABLE *tab, int k) {
+    memset(tab, 0, sizeof(*tab));
+    if (k < 1) {
+        k = 1;
+    }
+    tab->k = k;
+    for (tab->nslots = 4; tab->nslots < k * 2; tab->nslots *= 2) {
+    }
+    tab->sketch = (long *)calloc((size_t)SKETCH_DEPTH * SKETCH_WIDTH, sizeof(long));
+    tab->heap = (struct TOP_ID *)calloc(k, sizeof(struct TOP_ID));
+    tab->slots = (int *)calloc(tab->nslots, sizeof(int));
+    if (tab->sketch == NULL || tab->heap == NULL || tab->slots == NULL) {
+        error("can not malloc in approx_init");
+        approx_release(tab);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief Count up the name of length len pointed by np
+ * @details The Count-Min sketch is updated conservatively, and Space-Saving replaces the least
+ * frequent name kept with the name if it is not kept.
+ * @param[in] tab Table
+ * @param[in] np Name, which need not be null-terminated
+ * @param[in] len Length of the name
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int approx_countup(struct APPROX_TABLE *tab, const char *np, int len) {
+    unsigned long h1, h2;
+    long estimate = -1, *counter;
+    struct TOP_ID *p;
+    int row;
+
+    approx_hash(np, len, &h1, &h2);
+    for (row = 0; row < SKETCH_DEPTH; row++) {
+        counter = &tab->sketch[row * SKETCH_WIDTH + ((h1 + row * h2) & (SKETCH_WIDTH - 1))];
+        if (estimate == -1 || *counter < estimate) {
+            estimate = *counter;
+        }
+    }
+    for (row = 0; row < SKETCH_DEPTH; row++) {
+        counter = &tab->sketch[row * SKETCH_WIDTH + ((h1 + row * h2) & (SKETCH_WIDTH - 1))];
+        if (*counter == estimate) {
+            *counter = estimate + 1;
+        }
+    }
+    tab->total++;
+
+    if ((p = approx_search(tab, np, len, h1)) != NULL) {
+        p->count++;
+        approx_sift_down(tab, (int)(p - tab->heap));
+        return 0;
+    }
+    if (tab->nheap < tab->k) {
+        /* every name is kept until the heap is full, whose count is exact */
+        p = &tab->heap[tab->nheap];
+        if (approx_set_name(p, np, len, h1) == -1) {
+            return -1;
+        }
+        p->count = 1;
+        p->error = 0;
+        approx_index(tab, tab->nheap++);
+        for (row = tab->nheap - 1; row > 0 && tab->heap[(row - 1) / 2].count > tab->heap[row].count;
+             row = (row - 1) / 2) {
+            approx_swap(tab, row, (row - 1) / 2);
+        }
+        return 0;
+    }
+    /* the least frequent name gives way */
+    p = &tab->heap[0];
+    approx_unindex(tab, 0);
+    if (approx_set_name(p, np, len, h1) == -1) {
+        return -1;
+    }
+    p->error = p->count;
+    p->count++;
+    approx_index(tab, 0);
+    approx_sift_down(tab, 0);
+    return 0;
+}
+
+/*!
+ * @brief Add the counts of a table to another with the same k
+ * @details The sketches are added up. A name kept by only one of the Space-Saving summaries may
+ * have been counted by the other as many times as its least count, which is added to both the
+ * count and the error (Agarwal et al., Mergeable Summaries). Then the k largest are kept.
+ * @param[in,out] tab Table to be added to
+ * @param[in] from Table to add
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int approx_merge(struct APPROX_TABLE *tab, struct APPROX_TABLE *from) {
+    struct TOP_ID *all, *p, *q;
+    long min_tab = (tab->nheap == tab->k) ? tab->heap[0].count : 0;
+    long min_from = (from->nheap == from->k) ? from->heap[0].count : 0;
+    int n = 0, i, ret = 0;
+
+    for (i = 0; i < SKETCH_DEPTH * SKETCH_WIDTH; i++) {
+        tab->sketch[i] += from->sketch[i];
+    }
+    tab->total += from->total;
+
+    if ((all = (struct TOP_ID *)calloc(tab->nheap + from->nheap + 1, sizeof(struct TOP_ID))) == NULL) {
+        error("can not malloc in approx_merge");
+        return -1;
+    }
+    for (i = 0; i < tab->nheap; i++) {
+        p = &tab->heap[i];
+        all[n] = *p;
+        if ((q = approx_search(from, p->name, p->len, p->hash)) != NULL) {
+            all[n].count += q->count;
+            all[n].error += q->error;
+        } else {
+            all[n].count += min_from;
+            all[n].error += min_from;
+        }
+        n++;
+    }
+    for (i = 0; i < from->nheap; i++) {
+        q = &from->heap[i];
+        if (approx_search(tab, q->name, q->len, q->hash) == NULL) {
+            all[n] = *q;
+            all[n].name = NULL;
+            all[n].size = 0;
+            if (approx_set_name(&all[n], q->name, q->len, q->hash) == -1) {
+                ret = -1;
+                break;
+            }
+            all[n].count += min_tab;
+            all[n].error += min_tab;
+            n++;
+        }
+    }
+
+    if (ret == 0) {
+        qsort(all, n, sizeof(struct TOP_ID), compare_top_ids);
+        memset(tab->slots, 0, sizeof(int) * tab->nslots);
+        /* a list in descending order is a heap turned over */
+        tab->nheap = (n < tab->k) ? n : tab->k;
+        for (i = 0; i < tab->nheap; i++) {
+            tab->heap[i] = all[tab->nheap - 1 - i];
+            approx_index(tab, i);
+        }
+        for (i = tab->nheap; i < n; i++) {
+            free(all[i].name);
+        }
+    } else {
+        /* only the names copied from the other are freed, and tab keeps its own */
+        for (i = tab->nheap; i < n; i++) {
+            free(all[i].name);
+        }
+    }
+    free(all);
+    return ret;
+}
+
+/*!
+ * @brief Estimate the count of a name by the Count-Min sketch
+ * @param[in] tab Table
+ * @param[in] np Name, which need not be null-terminated
+ * @param[in] len Length of the name
+ * @return long Returns the estimate, which is never less than the real count
+ */
+long approx_estimate(struct APPROX_TABLE *tab, const char *np, int len) {
+    unsigned long h1, h2;
+    long estimate = -1, counter;
+    int row;
+
+    approx_hash(np, len, &h1, &h2);
+    for (row = 0; row < SKETCH_DEPTH; row++) {
+        counter = tab->sketch[row * SKETCH_WIDTH + ((h1 + row * h2) & (SKETCH_WIDTH - 1))];
+        if (estimate == -1 || counter < estimate) {
+            estimate = counter;
+        }
+    }
+    return estimate;
+}
+
+/*!
+ * @brief Return the bounds of the real count of a name kept by a table
+ * @param[in] tab Table
+ * @param[in] p Name kept by the table
+ * @param[out] lower The least possible count
+ * @param[out] upper The greatest possible count
+ */
+void approx_bounds(struct APPROX_TABLE *tab, struct TOP_ID *p, long *lower, long *upper) {
+    long estimate = approx_estimate(tab, p->name, p->len);
+
+    *lower = p->count - p->error;
+    *upper = (estimate < p->count) ? estimate : p->count;
+}
+
+/*!
+ * @brief Output the most frequent names kept by a table, with the bounds of their counts
+ * @details The Count-Min sketch overestimates a count by at most e/SKETCH_WIDTH of the total
+ * with probability 1 - exp(-SKETCH_DEPTH).
+ * @param[in] tab Table
+ */
+void approx_print(struct APPROX_TABLE *tab) {
+    struct TOP_ID *top;
+    double confidence = 1.0;
+    long lower, upper;
+    int i;
+
+    if ((top = (struct TOP_ID *)malloc(sizeof(struct TOP_ID) * (tab->nheap + 1))) == NULL) {
+        error("can not malloc in approx_print");
+        return;
+    }
+    memcpy(top, tab->heap, sizeof(struct TOP_ID) * tab->nheap);
+    qsort(top, tab->nheap, sizeof(struct TOP_ID), compare_top_ids);
+    for (i = 0; i < SKETCH_DEPTH; i++) {
+        confidence /= SKETCH_E;
+    }
+    printf("\t(the %d most frequent of %ld names, sketch error <= %.1f with probability %.3f)\n", tab->nheap,
+           tab->total, SKETCH_E * tab->total / SKETCH_WIDTH, 1.0 - confidence);
+    for (i = 0; i < tab->nheap; i++) {
+        approx_bounds(tab, &top[i], &lower, &upper);
+        printf("\t\"Identifier\" \"%s\"\t%ld\t%ld..%ld\n", top[i].name, top[i].count, lower, upper);
+    }
+    free(top);
+}
+
+/*!
+ * @brief Release a table
+ * @param[in] tab Table
+ */
+void approx_release(struct APPROX_TABLE *tab) {
+    int i;
+
+    if (tab->heap != NULL) {
+        for (i = 0; i < tab->k; i++) {
+            free(tab->heap[i].name);
+        }
+    }
+    free(tab->sketch);
+    free(tab->heap);
+    free(tab->slots);
+    memset(tab, 0, sizeof(*tab));
+}
+
+/*!
+ * @brief Hash a name twice, by FNV-1a and by djb2, which give the rows of the sketch
+ * @param[in] np Name
+ * @param[in] len Length of the name
+ * @param[out] h1 FNV-1a hash
+ * @param[out] h2 djb2 hash, which is odd
+ */
+static void approx_hash(const char *np, int len, unsigned long *h1, unsigned long *h2) {
+    int i;
+
+    *h1 = 2166136261UL;
+    *h2 = 5381;
+    for (i = 0; i < len; i++) {
+        *h1 = ((*h1 ^ (unsigned char)np[i]) * 16777619UL) & 0xffffffffUL;
+        *h2 = ((*h2 << 5) + *h2 + (unsigned char)np[i]) & 0xffffffffUL;
+    }
+    *h2 |= 1;
+}
+
+/*!
+ * @brief Search the names kept by a table
+ * @param[in] tab Table
+ * @param[in] np Name
+ * @param[in] len Length of the name
+ * @param[in] hash FNV-1a hash of the name
+ * @return struct TOP_ID* Returns the name kept, or NULL if not kept.
+ */
+static struct TOP_ID *approx_search(struct APPROX_TABLE *tab, const char *np, int len, unsigned long hash) {
+    struct TOP_ID *p;
+    int slot;
+
+    for (slot = (int)(hash & (tab->nslots - 1)); tab->slots[slot] != 0; slot = (slot + 1) & (tab->nslots - 1)) {
+        p = &tab->heap[tab->slots[slot] - 1];
+        if (p->hash == hash && p->len == len && memcmp(p->name, np, len) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/*!
+ * @brief Put a name of the heap in the slots
+ * @param[in] tab Table
+ * @param[in] pos Position in the heap
+ */
+static void approx_index(struct APPROX_TABLE *tab, int pos) {
+    int slot;
+
+    for (slot = (int)(tab->heap[pos].hash & (tab->nslots - 1)); tab->slots[slot] != 0;
+         slot = (slot + 1) & (tab->nslots - 1)) {
+    }
+    tab->slots[slot] = pos + 1;
+    tab->heap[pos].slot = slot;
+}
+
+/*!
+ * @brief Remove a name of the heap from the slots, shifting the names after it back
+ * @param[in] tab Table
+ * @param[in] pos Position in the heap
+ */
+static void approx_unindex(struct APPROX_TABLE *tab, int pos) {
+    int mask = tab->nslots - 1, hole = tab->heap[pos].slot, slot, home;
+
+    tab->slots[hole] = 0;
+    for (slot = (hole + 1) & mask; tab->slots[slot] != 0; slot = (slot + 1) & mask) {
+        home = (int)(tab->heap[tab->slots[slot] - 1].hash & mask);
+        /* move it to the hole unless its home lies cyclically in (hole, slot] */
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            tab->slots[hole] = tab->slots[slot];
+            tab->heap[tab->slots[hole] - 1].slot = hole;
+            tab->slots[slot] = 0;
+            hole = slot;
+        }
+    }
+}
+
+/*!
+ * @brief Move a name down the heap until its children are not less frequent
+ * @param[in] tab Table
+ * @param[in] pos Position in the heap
+ */
+static void approx_sift_down(struct APPROX_TABLE *tab, int pos) {
+    int child;
+
+    while ((child = pos * 2 + 1) < tab->nheap) {
+        if (child + 1 < tab->nheap && tab->heap[child + 1].count < tab->heap[child].count) {
+            child++;
+        }
+        if (tab->heap[pos].count <= tab->heap[child].count) {
+            break;
+        }
+        approx_swap(tab, pos, child);
+        pos = child;
+    }
+}
+
+/*!
+ * @brief Swap two names of the heap, keeping the slots pointing to them
+ * @param[in] tab Table
+ * @param[in] a Position in the heap
+ * @param[in] b Position in the heap
+ */
+static void approx_swap(struct APPROX_TABLE *tab, int a, int b) {
+    struct TOP_ID tmp = tab->heap[a];
+
+    tab->heap[a] = tab->heap[b];
+    tab->heap[b] = tmp;
+    tab->slots[tab->heap[a].slot] = a + 1;
+    tab->slots[tab->heap[b].slot] = b + 1;
+}
+
+/*!
+ * @brief Set the name of a name kept, reusing its buffer
+ * @param[in,out] p Name kept
+ * @param[in] np Name
+ * @param[in] len Length of the name
+ * @param[in] hash FNV-1a hash of the name
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int approx_set_name(struct TOP_ID *p, const char *np, int len, unsigned long hash) {
+    char *cp;
+
+    if (len + 1 > p->size) {
+        if ((cp = (char *)realloc(p->name, len + 1)) == NULL) {
+            error("can not malloc in approx_set_name");
+            return -1;
+        }
+        p->name = cp;
+        p->size = len + 1;
+    }
+    memcpy(p->name, np, len);
+    p->name[len] = '\0';
+    p->len = len;
+    p->hash = hash;
+    return 0;
+}
+
+/*!
+ * @brief Compare two names kept for qsort(), the more frequent first and then in the order of the names
+ * @param[in] a Pointer to a name kept
+ * @param[in] b Pointer to a name kept
+ * @return int Returns the order of them
+ */
+static int compare_top_ids(const void *a, const void *b) {
+    const struct TOP_ID *p = (const struct TOP_ID *)a, *q = (const struct TOP_ID *)b;
+
+    if (p->count != q->count) {
+        return (p->count > q->count) ? -1 : 1;
+    }
+    return strcmp(p->name, q->name);
+}
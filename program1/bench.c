@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <time.h>
+
+/* Source Files */
+#include "approx-list.c"
+#include "dfa-scan.c"
+#include "id-list.c"
+#include "scan.c"
+#include "token-list.c"
+#include "token-list.h"
+
+/*! number of words collected from the sample */
+#define BENCH_MAXWORDS 4096
+/*! number of lookups for each word */
+#define BENCH_ROUNDS 20000
+
+static char bench_words[BENCH_MAXWORDS][MAXSTRSIZE];
+static int bench_lens[BENCH_MAXWORDS];
+
+/*!
+ * @brief Keyword lookup by linear search (the former implementation)
+ * @param[in] token token to be determined, which need not be null-terminated
+ * @param[in] len Length of the token
+ * @return int If it is a keyword, it returns its token code, otherwise it returns the Name token code
+ */
+static int linear_keyword_token_code(const char *token, int len) {
+    int index;
+    for (index = 0; index < KEYWORDSIZE; index++) {
+        if (strncmp(token, key[index].keyword, len) == 0 && key[index].keyword[len] == '\0') {
+            return key[index].keytoken;
+        }
+    }
+    return TNAME;
+}
+
+/*!
+ * @brief Measure a keyword lookup function
+ * @param[in] lookup Function to be measured
+ * @param[in] nwords The number of words
+ * @param[out] sum Sum of the token codes, to keep the calls from being optimized out
+ * @return double Returns nanoseconds per lookup
+ */
+static double bench_lookup(int (*lookup)(const char *, int), int nwords, long *sum) {
+    clock_t begin, end;
+    int round, i;
+
+    *sum = 0;
+    begin = clock();
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        for (i = 0; i < nwords; i++) {
+            *sum += lookup(bench_words[i], bench_lens[i]);
+        }
+    }
+    end = clock();
+    return (double)(end - begin) / CLOCKS_PER_SEC * 1e9 / ((double)BENCH_ROUNDS * nwords);
+}
+
+/*!
+ * @brief Compare the perfect hash keyword lookup with the linear search
+ * @param[in] nc The number of arguments
+ * @param[in] np File name to read words from (samples/sample11pp.mpl by default)
+ * @return int Returns 0 on success and 1 on failure.
+ */
+#undef main
+int main(int nc, char *np[]) {
+    char *filename = (nc < 2) ? "samples/sample11pp.mpl" : np[1];
+    int token, nwords = 0, i;
+    long sum_hash, sum_linear;
+    double ns_hash, ns_linear;
+
+    if (init_scan(filename) < 0) {
+        fprintf(stderr, "File %s can not open.\n", filename);
+        return EXIT_FAILURE;
+    }
+    /* Collect the names and keywords, which are what get_keyword_token_code() sees */
+    while ((token = scan()) >= 0 && nwords < BENCH_MAXWORDS) {
+        if ((token == TNAME || token < TNUMBER || token > TSEMI) && strlen(get_string_attr()) < MAXSTRSIZE) {
+            strcpy(bench_words[nwords], get_string_attr());
+            bench_lens[nwords++] = token_span.len;
+        }
+    }
+    end_scan();
+    if (nwords == 0) {
+        fprintf(stderr, "File %s has no words.\n", filename);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < nwords; i++) {
+        if (get_keyword_token_code(bench_words[i], bench_lens[i]) !=
+            linear_keyword_token_code(bench_words[i], bench_lens[i])) {
+            fprintf(stderr, "Mismatch at \"%s\"\n", bench_words[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    ns_linear = bench_lookup(linear_keyword_token_code, nwords, &sum_linear);
+    ns_hash = bench_lookup(get_keyword_token_code, nwords, &sum_hash);
+
+    fprintf(stdout, "%d words from %s\n", nwords, filename);
+    fprintf(stdout, "%12s: %8.2f ns/lookup\n", "linear", ns_linear);
+    fprintf(stdout, "%12s: %8.2f ns/lookup\n", "perfect hash", ns_hash);
+    fprintf(stdout, "%12s: %8.2fx\n", "speedup", ns_linear / ns_hash);
+
+    return sum_hash == sum_linear ? 0 : EXIT_FAILURE;
+}
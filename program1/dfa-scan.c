@@ -0,0 +1,150 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lex-tables.h"
+#include "token-list.h"
+
+static int dfa_token(struct SCANNER *sc, long begin, long end, int accept_code);
+static void dfa_seek(struct SCANNER *sc, long pos);
+static int dfa_count_lines(const unsigned char *p, const unsigned char *end);
+
+/*!
+ * @brief Scan the next token with a scanner, driven by the tables generated by lexgen
+ * @details It gives the same tokens and attributes as scanner_next(), which calls it instead of
+ * scanning by hand if sc->dfa is set. The source must be loaded into memory; otherwise it falls
+ * back to scanner_next().
+ * @param[in] sc Scanner
+ * @return int Returns token code on success and -1 on failure.
+ */
+int dfa_scanner_next(struct SCANNER *sc) {
+    const unsigned char *src = (const unsigned char *)sc->src_head;
+    long size, pos, i;
+    int state, next, accept_code;
+
+    if (src == NULL) {
+        return scanner_next(sc);
+    }
+    size = (long)(sc->src_end - sc->src_head);
+    pos = sc->current_offset;
+
+    while (1) {
+        if (pos >= size) { /* End Of File */
+            dfa_seek(sc, size);
+            return -1;
+        }
+        /* the longest match, no backtracking is needed for MPPL */
+        state = DFA_START;
+        for (i = pos; i < size; i++) {
+            if ((next = dfa_transition[state][dfa_char_class[src[i]]]) == 0) {
+                break;
+            }
+            state = next;
+        }
+        accept_code = dfa_accept[state];
+
+        if (accept_code == DFA_ACCEPT_NONE) {
+            dfa_seek(sc, i);
+            if (i == pos && !isprint(src[pos])) {
+                scanner_error(sc, "function dfa_scanner_next()", "[%c]0x%x is not graphic character.\n", src[pos],
+                              src[pos]);
+            } else if (i == pos || (i == pos + 1 && src[pos] == '/')) {
+                scanner_error(sc, "function dfa_scanner_next()", "[%c]0x%x is undefined symbol.\n", src[pos],
+                              src[pos]);
+            } else if (src[pos] == '\'') {
+                scanner_error(sc, "function dfa_scanner_next()", "[%c]0x%x is not graphic character.\n",
+                              (i < size) ? src[i] : EOF, (i < size) ? src[i] : EOF);
+            }
+            /* an unterminated comment ends the scan as EOF does */
+            sc->linenum += dfa_count_lines(src + pos, src + i);
+            sc->token_linenum = sc->linenum;
+            return -1;
+        } else if (accept_code == DFA_ACCEPT_NEWLINE) {
+            sc->linenum++;
+        } else if (accept_code == DFA_ACCEPT_SKIP && (src[pos] == '{' || src[pos] == '/')) {
+            /* the ends of line in a comment */
+            sc->linenum += dfa_count_lines(src + pos, src + i);
+        } else if (accept_code != DFA_ACCEPT_SKIP) {
+            return dfa_token(sc, pos, i, accept_code);
+        }
+        pos = i;
+    }
+}
+
+/*!
+ * @brief Set the attributes of a token accepted by the DFA
+ * @param[in] sc Scanner
+ * @param[in] begin Offset of the head of the token
+ * @param[in] end Offset just after the token
+ * @param[in] accept_code Token code or DFA_ACCEPT_* of the accepting state
+ * @return int Returns token code on success and -1 on failure.
+ */
+static int dfa_token(struct SCANNER *sc, long begin, long end, int accept_code) {
+    int token_code = accept_code, num = 0;
+    long i;
+
+    dfa_seek(sc, end);
+    sc->token_offset = begin;
+    sc->token_linenum = sc->linenum;
+    sc->span.escaped = 0;
+    sc->string_value_len = -1;
+    if (accept_code == DFA_ACCEPT_STRING) {
+        /* exclude the enclosing quotes */
+        begin++;
+        end--;
+        sc->span.escaped = (memchr(sc->src_head + begin, '\'', end - begin) != NULL);
+        token_code = TSTRING;
+    }
+    sc->span.offset = begin;
+    sc->span.len = (int)(end - begin);
+    sc->span.ptr = sc->src_head + begin;
+    sc->string_attr_valid = 0;
+
+    if (accept_code == DFA_ACCEPT_NUMBER) {
+        for (i = 0; i < sc->span.len && num <= MAX_NUM_ATTR; i++) {
+            num = num * 10 + (sc->span.ptr[i] - '0');
+        }
+        if (num > MAX_NUM_ATTR) {
+            /* Buffer Overflow */
+            scanner_error(sc, "function dfa_token", "num_attr: Buffer Overflow.");
+            return -1;
+        }
+        sc->num_attr = num;
+        token_code = TNUMBER;
+    }
+    return token_code;
+}
+
+/*!
+ * @brief Move current_char of a scanner to an offset, so that scanner_next() can continue
+ * @param[in] sc Scanner
+ * @param[in] pos Offset of the new current_char
+ */
+static void dfa_seek(struct SCANNER *sc, long pos) {
+    long size = (long)(sc->src_end - sc->src_head);
+
+    sc->current_offset = pos;
+    sc->current_char = (pos < size) ? (unsigned char)sc->src_head[pos] : EOF;
+    sc->next_char = (pos + 1 < size) ? (unsigned char)sc->src_head[pos + 1] : EOF;
+    sc->src_pos = sc->src_head + ((pos + 2 < size) ? pos + 2 : size);
+}
+
+/*!
+ * @brief Count the ends of line (\r, \n, \r\n or \n\r) in a part of the source
+ * @param[in] p Head of the part
+ * @param[in] end End of the part
+ * @return int Returns the number of the ends of line
+ */
+static int dfa_count_lines(const unsigned char *p, const unsigned char *end) {
+    int lines = 0;
+
+    for (; p < end; p++) {
+        if (*p == '\r' || *p == '\n') {
+            if (p + 1 < end && (p[1] == '\r' || p[1] == '\n') && p[1] != *p) {
+                p++;
+            }
+            lines++;
+        }
+    }
+    return lines;
+}
@@ -1,63 +1,269 @@
 ﻿#include "token-list.h"
 
-struct ID {
-    char *name;
-    int count;
-    struct ID *nextp;
-} * idroot;
+/*! size of a block of the arena of the names */
+#define NAME_BLOCK_SIZE (64 * 1024)
+
+/*! Table used by init_idtab(), id_countup(), print_idtab() and release_idtab() */
+static struct ID_TABLE default_idtab;
+
+static unsigned long id_hash(const char *np, int len);
+static int idtab_grow_slots(struct ID_TABLE *tab);
+static char *idtab_alloc_name(struct ID_TABLE *tab, const char *np, int len);
+static int compare_ids(const void *a, const void *b);
 
 void init_idtab() { /* Initialise the table */
-    idroot = NULL;
+    idtab_init(&default_idtab);
+}
+
+struct ID *search_idtab(const char *np, int len) { /* search the name of length len pointed by np */
+    return idtab_search(&default_idtab, np, len);
+}
+
+void id_countup(const char *np, int len) { /* Register and count up the name of length len pointed by np */
+    idtab_countup(&default_idtab, np, len);
+}
+
+void print_idtab() { /* Output the registered data */
+    idtab_print(&default_idtab);
+}
+
+void release_idtab() { /* Release tha data structure */
+    idtab_release(&default_idtab);
+}
+
+/*!
+ * @brief Initialise a table
+ * @param[out] tab Table
+ */
+void idtab_init(struct ID_TABLE *tab) {
+    tab->ids = NULL;
+    tab->nids = tab->capacity = 0;
+    tab->slots = NULL;
+    tab->nslots = 0;
+    tab->names = NULL;
 }
 
-struct ID *search_idtab(char *np) { /* search the name pointed by np */
+/*!
+ * @brief Search a table for the name of length len pointed by np
+ * @param[in] tab Table
+ * @param[in] np Name, which need not be null-terminated
+ * @param[in] len Length of the name
+ * @return struct ID* Returns the name registered, or NULL if not found.
+ */
+struct ID *idtab_search(struct ID_TABLE *tab, const char *np, int len) {
+    unsigned long hash = id_hash(np, len);
     struct ID *p;
+    int slot;
 
-    for (p = idroot; p != NULL; p = p->nextp) {
-        if (strcmp(np, p->name) == 0) return (p);
+    if (tab->nslots == 0) {
+        return NULL;
     }
-    return (NULL);
+    for (slot = (int)(hash & (tab->nslots - 1)); tab->slots[slot] != 0; slot = (slot + 1) & (tab->nslots - 1)) {
+        p = &tab->ids[tab->slots[slot] - 1];
+        if (p->hash == hash && p->len == len && memcmp(p->name, np, len) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/*!
+ * @brief Register and count up the name of length len pointed by np
+ * @param[in] tab Table
+ * @param[in] np Name, which need not be null-terminated
+ * @param[in] len Length of the name
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int idtab_countup(struct ID_TABLE *tab, const char *np, int len) {
+    return idtab_add(tab, np, len, 1);
+}
+
+/*!
+ * @brief Add the counts of the names in a table to another
+ * @param[in,out] tab Table to be added to
+ * @param[in] from Table to add, whose names are registered in the order of it
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int idtab_merge(struct ID_TABLE *tab, struct ID_TABLE *from) {
+    int i;
+
+    for (i = 0; i < from->nids; i++) {
+        if (idtab_add(tab, from->ids[i].name, from->ids[i].len, from->ids[i].count) == -1) {
+            return -1;
+        }
+    }
+    return 0;
 }
 
-void id_countup(char *np) { /* Register and count up the name pointed by np */
+/*!
+ * @brief Register the name of length len pointed by np and add to its count
+ * @param[in] tab Table
+ * @param[in] np Name, which need not be null-terminated
+ * @param[in] len Length of the name
+ * @param[in] count Count to add
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int idtab_add(struct ID_TABLE *tab, const char *np, int len, int count) {
     struct ID *p;
-    char *cp;
+    int slot, capacity;
 
-    if ((p = search_idtab(np)) != NULL)
-        p->count++;
-    else {
-        if ((p = (struct ID *)malloc(sizeof(struct ID))) == NULL) {
+    if ((p = idtab_search(tab, np, len)) != NULL) {
+        p->count += count;
+        return 0;
+    }
+    /* keep the load factor at most 1/2 */
+    if ((tab->nids + 1) * 2 > tab->nslots && idtab_grow_slots(tab) == -1) {
+        return -1;
+    }
+    if (tab->nids == tab->capacity) {
+        capacity = (tab->capacity > 0) ? tab->capacity * 2 : 256;
+        if ((p = (struct ID *)realloc(tab->ids, sizeof(struct ID) * capacity)) == NULL) {
             printf("can not malloc in id_countup\n");
-            return;
-        }
-        if ((cp = (char *)malloc(strlen(np) + 1)) == NULL) {
-            printf("can not malloc-2 in id_countup\n");
-            return;
+            return -1;
         }
-        strcpy(cp, np);
-        p->name = cp;
-        p->count = 1;
-        p->nextp = idroot;
-        idroot = p;
+        tab->ids = p;
+        tab->capacity = capacity;
+    }
+    p = &tab->ids[tab->nids];
+    if ((p->name = idtab_alloc_name(tab, np, len)) == NULL) {
+        printf("can not malloc-2 in id_countup\n");
+        return -1;
     }
+    p->len = len;
+    p->hash = id_hash(np, len);
+    p->count = count;
+    for (slot = (int)(p->hash & (tab->nslots - 1)); tab->slots[slot] != 0; slot = (slot + 1) & (tab->nslots - 1)) {
+    }
+    tab->slots[slot] = ++tab->nids;
+    return 0;
 }
 
-void print_idtab() { /* Output the registered data */
-    struct ID *p;
+/*!
+ * @brief Output the names registered in a table and their counts
+ * @details The latest name comes first, as the former list did.
+ * @param[in] tab Table
+ */
+void idtab_print(struct ID_TABLE *tab) {
+    int i;
 
-    for (p = idroot; p != NULL; p = p->nextp) {
-        if (p->count != 0)
-            printf("\t\"Identifier\" \"%s\"\t%d\n", p->name, p->count);
+    for (i = tab->nids - 1; i >= 0; i--) {
+        if (tab->ids[i].count != 0) printf("\t\"Identifier\" \"%s\"\t%d\n", tab->ids[i].name, tab->ids[i].count);
     }
 }
 
-void release_idtab() { /* Release tha data structure */
-    struct ID *p, *q;
+/*!
+ * @brief Output the names registered in a table and their counts in the order of the names
+ * @param[in] tab Table
+ */
+void idtab_print_sorted(struct ID_TABLE *tab) {
+    struct ID **ids;
+    int i;
+
+    if ((ids = (struct ID **)malloc(sizeof(struct ID *) * (tab->nids + 1))) == NULL) {
+        printf("can not malloc in idtab_print_sorted\n");
+        return;
+    }
+    for (i = 0; i < tab->nids; i++) {
+        ids[i] = &tab->ids[i];
+    }
+    qsort(ids, tab->nids, sizeof(struct ID *), compare_ids);
+    for (i = 0; i < tab->nids; i++) {
+        if (ids[i]->count != 0) printf("\t\"Identifier\" \"%s\"\t%d\n", ids[i]->name, ids[i]->count);
+    }
+    free(ids);
+}
+
+/*!
+ * @brief Release a table
+ * @param[in] tab Table
+ */
+void idtab_release(struct ID_TABLE *tab) {
+    struct NAME_BLOCK *block, *next;
+
+    for (block = tab->names; block != NULL; block = next) {
+        next = block->next;
+        free(block);
+    }
+    free(tab->ids);
+    free(tab->slots);
+    idtab_init(tab);
+}
+
+/*!
+ * @brief Hash a name by FNV-1a
+ * @param[in] np Name
+ * @param[in] len Length of the name
+ * @return unsigned long Returns the hash
+ */
+static unsigned long id_hash(const char *np, int len) {
+    unsigned long hash = 2166136261UL;
+    int i;
 
-    for (p = idroot; p != NULL; p = q) {
-        free(p->name);
-        q = p->nextp;
-        free(p);
+    for (i = 0; i < len; i++) {
+        hash = ((hash ^ (unsigned char)np[i]) * 16777619UL) & 0xffffffffUL;
     }
-    init_idtab();
+    return hash;
+}
+
+/*!
+ * @brief Double the slots of a table and put the names in them again
+ * @param[in] tab Table
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int idtab_grow_slots(struct ID_TABLE *tab) {
+    int nslots = (tab->nslots > 0) ? tab->nslots * 2 : 1024;
+    int *slots, i, slot;
+
+    if ((slots = (int *)calloc(nslots, sizeof(int))) == NULL) {
+        printf("can not malloc in idtab_grow_slots\n");
+        return -1;
+    }
+    for (i = 0; i < tab->nids; i++) {
+        for (slot = (int)(tab->ids[i].hash & (nslots - 1)); slots[slot] != 0; slot = (slot + 1) & (nslots - 1)) {
+        }
+        slots[slot] = i + 1;
+    }
+    free(tab->slots);
+    tab->slots = slots;
+    tab->nslots = nslots;
+    return 0;
+}
+
+/*!
+ * @brief Copy a name to the arena of a table
+ * @param[in] tab Table
+ * @param[in] np Name
+ * @param[in] len Length of the name
+ * @return char* Returns the null-terminated copy, or NULL on failure.
+ */
+static char *idtab_alloc_name(struct ID_TABLE *tab, const char *np, int len) {
+    struct NAME_BLOCK *block = tab->names;
+    size_t size;
+    char *cp;
+
+    if (block == NULL || block->size - block->used < (size_t)len + 1) {
+        size = ((size_t)len + 1 > NAME_BLOCK_SIZE) ? (size_t)len + 1 : NAME_BLOCK_SIZE;
+        if ((block = (struct NAME_BLOCK *)malloc(sizeof(struct NAME_BLOCK) + size)) == NULL) {
+            return NULL;
+        }
+        block->next = tab->names;
+        block->used = 0;
+        block->size = size;
+        tab->names = block;
+    }
+    cp = (char *)(block + 1) + block->used;
+    memcpy(cp, np, len);
+    cp[len] = '\0';
+    block->used += (size_t)len + 1;
+    return cp;
+}
+
+/*!
+ * @brief Compare two names for qsort()
+ * @param[in] a Pointer to a name
+ * @param[in] b Pointer to a name
+ * @return int Returns the order of their names by strcmp()
+ */
+static int compare_ids(const void *a, const void *b) {
+    return strcmp((*(struct ID *const *)a)->name, (*(struct ID *const *)b)->name);
 }
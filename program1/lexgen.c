@@ -0,0 +1,376 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! maximum number of the states of the DFA */
+#define MAX_STATES 256
+/*! maximum number of the keywords and symbols */
+#define MAX_SPELLINGS 128
+/*! maximum length of a line in the header */
+#define MAX_LINE 256
+
+/*! @name accept codes other than token codes */
+/* @{ */
+/*! not accepting */
+#define ACCEPT_NONE 0
+/*! accepting separators and comments, which are skipped */
+#define ACCEPT_SKIP -1
+/*! accepting an end of line */
+#define ACCEPT_NEWLINE -2
+/*! accepting a number */
+#define ACCEPT_NUMBER -3
+/*! accepting a string */
+#define ACCEPT_STRING -4
+/* @} */
+
+/*!
+ * @brief A keyword or a symbol with its token code
+ */
+struct SPELLING {
+    char text[MAX_LINE]; /*! spelling of the token */
+    int is_keyword;      /*! 1 if keyword, 0 if symbol */
+    int code;            /*! token code */
+};
+
+static struct SPELLING spellings[MAX_SPELLINGS];
+static int num_spellings = 0;
+/*! token code of Name */
+static int name_code = 0;
+
+/*! transitions for each byte, 0 is the dead state */
+static int trans[MAX_STATES][256];
+/*! accept code for each state */
+static int accept[MAX_STATES];
+/*! 1 if the state is a node of the keyword trie */
+static int is_keyword_node[MAX_STATES];
+static int num_states = 1;
+
+/*! class of each byte */
+static int char_class[256];
+/*! a representative byte of each class */
+static int class_repr[256];
+static int num_classes = 0;
+
+static int read_spellings(char *filename);
+static int new_state(int accept_code);
+static int add_keyword(struct SPELLING *sp, int start, int name);
+static int add_symbol(struct SPELLING *sp, int start);
+static void build_classes(void);
+static void print_tables(char *filename);
+
+/*! @name states referred to by the driver */
+/* @{ */
+static int state_start, state_string_quote;
+/* @} */
+
+/*!
+ * @brief Generate the tables of the DFA lexer (dfa-scan.c) from the token definitions
+ * @details The keywords and symbols are taken from the comment before each token code in
+ * the header, e.g. "program : Keyword" before "#define TPROGRAM 2".
+ * The tables are written to stdout.
+ * @param[in] nc The number of arguments
+ * @param[in] np Header file with the token definitions
+ * @return int Returns 0 on success and 1 on failure.
+ */
+int main(int nc, char *np[]) {
+    int i, c;
+    int name, number, blank, cr, lf, crlf;
+    int brace, brace_end, slash, block, block_star, block_end;
+    int string;
+
+    if (nc < 2) {
+        fprintf(stderr, "Usage: %s header\n", np[0]);
+        return EXIT_FAILURE;
+    }
+    if (read_spellings(np[1]) == -1) {
+        return EXIT_FAILURE;
+    }
+
+    /* state 0 is the dead state */
+    state_start = new_state(ACCEPT_NONE);
+
+    /* Name : Alphabet { Alphabet | Digit } */
+    name = new_state(name_code);
+    number = new_state(ACCEPT_NUMBER);
+    for (c = 0; c < 256; c++) {
+        if (isalnum(c)) {
+            trans[name][c] = name;
+        }
+        if (isalpha(c)) {
+            trans[state_start][c] = name;
+        }
+        if (isdigit(c)) {
+            trans[state_start][c] = number;
+            trans[number][c] = number;
+        }
+    }
+
+    /* Keywords and symbols */
+    for (i = 0; i < num_spellings; i++) {
+        if (spellings[i].is_keyword) {
+            if (add_keyword(&spellings[i], state_start, name) == -1) {
+                return EXIT_FAILURE;
+            }
+        } else if (add_symbol(&spellings[i], state_start) == -1) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* Separator */
+    blank = new_state(ACCEPT_SKIP);
+    trans[state_start][' '] = trans[state_start]['\t'] = blank;
+    trans[blank][' '] = trans[blank]['\t'] = blank;
+
+    /* End of Line : \r, \n, \r\n or \n\r */
+    cr = new_state(ACCEPT_NEWLINE);
+    lf = new_state(ACCEPT_NEWLINE);
+    crlf = new_state(ACCEPT_NEWLINE);
+    trans[state_start]['\r'] = cr;
+    trans[state_start]['\n'] = lf;
+    trans[cr]['\n'] = crlf;
+    trans[lf]['\r'] = crlf;
+
+    /* Comment : { ... } */
+    brace = new_state(ACCEPT_NONE);
+    brace_end = new_state(ACCEPT_SKIP);
+    trans[state_start]['{'] = brace;
+    for (c = 0; c < 256; c++) {
+        trans[brace][c] = (c == '}') ? brace_end : brace;
+    }
+
+    /* Comment : / * ... * / */
+    if (trans[state_start]['/'] != 0) {
+        fprintf(stderr, "'/' must not be a symbol.\n");
+        return EXIT_FAILURE;
+    }
+    slash = new_state(ACCEPT_NONE);
+    block = new_state(ACCEPT_NONE);
+    block_star = new_state(ACCEPT_NONE);
+    block_end = new_state(ACCEPT_SKIP);
+    trans[state_start]['/'] = slash;
+    trans[slash]['*'] = block;
+    for (c = 0; c < 256; c++) {
+        trans[block][c] = (c == '*') ? block_star : block;
+        trans[block_star][c] = (c == '*') ? block_star : (c == '/') ? block_end : block;
+    }
+
+    /* String : ' { graphic character other than ' | '' } ' */
+    string = new_state(ACCEPT_NONE);
+    state_string_quote = new_state(ACCEPT_STRING);
+    trans[state_start]['\''] = string;
+    for (c = 0; c < 256; c++) {
+        if (isprint(c)) {
+            trans[string][c] = (c == '\'') ? state_string_quote : string;
+        }
+    }
+    trans[state_string_quote]['\''] = string;
+
+    build_classes();
+    print_tables(np[1]);
+    return 0;
+}
+
+/*!
+ * @brief Read the keywords and symbols from the token definitions
+ * @param[in] filename Header file
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int read_spellings(char *filename) {
+    FILE *in;
+    char line[MAX_LINE];
+    char *head, *tail, *sep;
+    struct SPELLING *sp = NULL;
+
+    if ((in = fopen(filename, "r")) == NULL) {
+        fprintf(stderr, "File %s can not open.\n", filename);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+        sscanf(line, "#define TNAME %d", &name_code);
+        if (sp != NULL) {
+            /* the token code follows its comment */
+            if (sscanf(line, "#define %*s %d", &sp->code) == 1) {
+                num_spellings++;
+            }
+            sp = NULL;
+            continue;
+        }
+        if ((head = strstr(line, "/*! ")) == NULL || (tail = strstr(line, " */")) == NULL) {
+            continue;
+        }
+        head += strlen("/*! ");
+        *tail = '\0';
+        /* the spelling may contain " : " itself, e.g. ": : symbol" */
+        for (sep = tail - 1; sep > head && strncmp(sep, " : ", 3) != 0; sep--) {
+        }
+        if (sep <= head || (strcmp(sep, " : Keyword") != 0 && strcmp(sep, " : symbol") != 0)) {
+            continue;
+        }
+        if (num_spellings == MAX_SPELLINGS) {
+            fprintf(stderr, "Too many tokens.\n");
+            fclose(in);
+            return -1;
+        }
+        sp = &spellings[num_spellings];
+        sp->is_keyword = (strcmp(sep, " : Keyword") == 0);
+        *sep = '\0';
+        strcpy(sp->text, head);
+    }
+    fclose(in);
+    if (num_spellings == 0 || name_code == 0) {
+        fprintf(stderr, "No token definitions in %s.\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief Create a new state
+ * @details Exit if there are too many states to fit in the tables.
+ * @param[in] accept_code Token code or ACCEPT_* of the state
+ * @return int Returns the new state
+ */
+static int new_state(int accept_code) {
+    if (num_states == MAX_STATES) {
+        fprintf(stderr, "Too many states.\n");
+        exit(EXIT_FAILURE);
+    }
+    accept[num_states] = accept_code;
+    return num_states++;
+}
+
+/*!
+ * @brief Add a keyword to the trie which branches off from the Name state
+ * @param[in] sp Keyword
+ * @param[in] start Start state
+ * @param[in] name Name state
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int add_keyword(struct SPELLING *sp, int start, int name) {
+    int cur = start, next, i;
+    unsigned char c;
+
+    for (i = 0; sp->text[i] != '\0'; i++) {
+        c = (unsigned char)sp->text[i];
+        if (!isalpha(c) && !(i > 0 && isdigit(c))) {
+            fprintf(stderr, "'%s' is not a name.\n", sp->text);
+            return -1;
+        }
+        next = trans[cur][c];
+        if (!is_keyword_node[next]) {
+            /* a prefix of keywords is a Name unless it is followed by the rest */
+            next = new_state(name_code);
+            memcpy(trans[next], trans[name], sizeof(trans[name]));
+            is_keyword_node[next] = 1;
+            trans[cur][c] = next;
+        }
+        cur = next;
+    }
+    accept[cur] = sp->code;
+    return 0;
+}
+
+/*!
+ * @brief Add a symbol to the trie of symbols
+ * @param[in] sp Symbol
+ * @param[in] start Start state
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int add_symbol(struct SPELLING *sp, int start) {
+    int cur = start, next, i;
+    unsigned char c;
+
+    for (i = 0; sp->text[i] != '\0'; i++) {
+        c = (unsigned char)sp->text[i];
+        if (isalnum(c) || isspace(c) || c == '\'' || c == '{') {
+            fprintf(stderr, "'%s' can not be a symbol.\n", sp->text);
+            return -1;
+        }
+        if ((next = trans[cur][c]) == 0) {
+            next = new_state(ACCEPT_NONE);
+            trans[cur][c] = next;
+        }
+        cur = next;
+    }
+    accept[cur] = sp->code;
+    return 0;
+}
+
+/*!
+ * @brief Divide the bytes into classes which have the same transitions in every state
+ */
+static void build_classes(void) {
+    int c, k, s;
+
+    for (c = 0; c < 256; c++) {
+        for (k = 0; k < num_classes; k++) {
+            for (s = 0; s < num_states; s++) {
+                if (trans[s][c] != trans[s][class_repr[k]]) {
+                    break;
+                }
+            }
+            if (s == num_states) {
+                break;
+            }
+        }
+        if (k == num_classes) {
+            class_repr[num_classes++] = c;
+        }
+        char_class[c] = k;
+    }
+}
+
+/*!
+ * @brief Output the tables as C source
+ * @param[in] filename Header file the tables are generated from
+ */
+static void print_tables(char *filename) {
+    int c, s, k;
+
+    printf("/* Generated by lexgen from %s. Do not edit. */\n", filename);
+    printf("#ifndef _LEX_TABLES_H_\n");
+    printf("#define _LEX_TABLES_H_\n\n");
+    printf("/*! number of the states, 0 is the dead state */\n");
+    printf("#define DFA_NUM_STATES %d\n", num_states);
+    printf("/*! number of the character classes */\n");
+    printf("#define DFA_NUM_CLASSES %d\n", num_classes);
+    printf("/*! start state */\n");
+    printf("#define DFA_START %d\n", state_start);
+    printf("/*! accept code of states which are not accepting */\n");
+    printf("#define DFA_ACCEPT_NONE %d\n", ACCEPT_NONE);
+    printf("/*! accept code of separators and comments */\n");
+    printf("#define DFA_ACCEPT_SKIP %d\n", ACCEPT_SKIP);
+    printf("/*! accept code of an end of line */\n");
+    printf("#define DFA_ACCEPT_NEWLINE %d\n", ACCEPT_NEWLINE);
+    printf("/*! accept code of a number, whose value is checked by the driver */\n");
+    printf("#define DFA_ACCEPT_NUMBER %d\n", ACCEPT_NUMBER);
+    printf("/*! accept code of a string, whose enclosing quotes are removed by the driver */\n");
+    printf("#define DFA_ACCEPT_STRING %d\n\n", ACCEPT_STRING);
+
+    printf("/*! character class of each byte */\n");
+    printf("static const unsigned char dfa_char_class[256] = {");
+    for (c = 0; c < 256; c++) {
+        printf("%s%d", (c == 0) ? "\n    " : (c % 16 == 0) ? ",\n    " : ", ", char_class[c]);
+    }
+    printf("};\n\n");
+
+    printf("/*! next state for each state and character class */\n");
+    printf("static const unsigned char dfa_transition[DFA_NUM_STATES][DFA_NUM_CLASSES] = {\n");
+    for (s = 0; s < num_states; s++) {
+        printf("    {");
+        for (k = 0; k < num_classes; k++) {
+            printf("%d%s", trans[s][class_repr[k]], (k == num_classes - 1) ? "" : ", ");
+        }
+        printf("}%s\n", (s == num_states - 1) ? "" : ",");
+    }
+    printf("};\n\n");
+
+    printf("/*! token code or DFA_ACCEPT_* of each state */\n");
+    printf("static const signed char dfa_accept[DFA_NUM_STATES] = {");
+    for (s = 0; s < num_states; s++) {
+        printf("%s%d", (s == 0) ? "\n    " : (s % 16 == 0) ? ",\n    " : ", ", accept[s]);
+    }
+    printf("};\n\n");
+    printf("#endif\n");
+}
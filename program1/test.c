@@ -4,14 +4,58 @@
 #include <CUnit/TestDB.h>
 #include <CUnit/TestRun.h>
 #include <stdio.h>
+#include <sys/wait.h>
 
 /* Source Files */
+#include "approx-list.c"
+#include "dfa-scan.c"
 #include "id-list.c"
 #include "scan.c"
 #include "token-list.c"
 #include "token-list.h"
 
 void scan_func_test_isblank(void);
+void scan_func_test_load_source(void);
+void scan_func_test_keyword(void);
+void scan_func_test_token_span(void);
+void scan_func_test_no_copy(void);
+void scan_func_test_scanner_context(void);
+void scan_func_test_find_special(void);
+void scan_func_test_skip_lines(void);
+
+void dfa_test_samples(void);
+void dfa_test_select(void);
+void dfa_test_quiet(void);
+void dfa_compare(char *filename);
+long dfa_scan_stderr(char *filename, int quiet);
+
+void parallel_test_samples(void);
+void parallel_compare(char *filename);
+
+void cache_test_samples(void);
+void cache_test_dir(void);
+void cache_compare(char *filename);
+void dump_scan(char *dump, int size);
+
+void stream_test_samples(void);
+void stream_test_long_tokens(void);
+void stream_compare(char *filename);
+
+void relex_test_samples(void);
+void relex_test_comment(void);
+void relex_compare(char *filename);
+int relex_full_scan(const char *src, long size, struct TOKEN_ARRAY *ta);
+void relex_assert_same(struct TOKEN_ARRAY *ta, struct TOKEN_ARRAY *expected);
+
+void idtab_test_many_names(void);
+
+void approx_test_exact(void);
+void approx_test_zipf(void);
+void approx_test_merge(void);
+void approx_assert_bounds(struct APPROX_TABLE *tab, struct ID_TABLE *exact);
+
+void count_test_files(void);
+void count_test_directory(void);
 
 void integration_test_sample11pp(void);
 void integration_test_sample12(void);
@@ -27,6 +71,29 @@ void set_correct_ans_sample12(int *correct_ans);
 void set_correct_ans_sample15(int *correct_ans);
 void set_correct_ans_sample011(int *correct_ans);
 
+/* Every file in samples/ */
+char *all_samples[] = {
+    "samples/comment1.mpl",
+    "samples/comment2.mpl",
+    "samples/number1.mpl",
+    "samples/sample011.mpl",
+    "samples/sample014.mpl",
+    "samples/sample11.mpl",
+    "samples/sample11p.mpl",
+    "samples/sample11pp.mpl",
+    "samples/sample12.mpl",
+    "samples/sample13.mpl",
+    "samples/sample14.mpl",
+    "samples/sample14p.mpl",
+    "samples/sample15.mpl",
+    "samples/sample15a.mpl",
+    "samples/sample16.mpl",
+    "samples/sample17.mpl",
+    "samples/sample18.mpl",
+    "samples/sample19p.mpl",
+    "samples/string1.mpl"
+};
+
 #undef main
 int main() {
     CU_pSuite suite;
@@ -35,6 +102,45 @@ int main() {
 
     suite = CU_add_suite("Scan functions Test", NULL, NULL);
     CU_add_test(suite, "scan_func_test_isblank", scan_func_test_isblank);
+    CU_add_test(suite, "scan_func_test_load_source", scan_func_test_load_source);
+    CU_add_test(suite, "scan_func_test_keyword", scan_func_test_keyword);
+    CU_add_test(suite, "scan_func_test_token_span", scan_func_test_token_span);
+    CU_add_test(suite, "scan_func_test_no_copy", scan_func_test_no_copy);
+    CU_add_test(suite, "scan_func_test_scanner_context", scan_func_test_scanner_context);
+    CU_add_test(suite, "scan_func_test_find_special", scan_func_test_find_special);
+    CU_add_test(suite, "scan_func_test_skip_lines", scan_func_test_skip_lines);
+
+    suite = CU_add_suite("DFA Lexer Test", NULL, NULL);
+    CU_add_test(suite, "dfa_test_samples", dfa_test_samples);
+    CU_add_test(suite, "dfa_test_select", dfa_test_select);
+    CU_add_test(suite, "dfa_test_quiet", dfa_test_quiet);
+
+    suite = CU_add_suite("Parallel Tokenization Test", NULL, NULL);
+    CU_add_test(suite, "parallel_test_samples", parallel_test_samples);
+
+    suite = CU_add_suite("Token Cache Test", NULL, NULL);
+    CU_add_test(suite, "cache_test_samples", cache_test_samples);
+    CU_add_test(suite, "cache_test_dir", cache_test_dir);
+
+    suite = CU_add_suite("Streaming Test", NULL, NULL);
+    CU_add_test(suite, "stream_test_samples", stream_test_samples);
+    CU_add_test(suite, "stream_test_long_tokens", stream_test_long_tokens);
+
+    suite = CU_add_suite("Incremental Re-lexing Test", NULL, NULL);
+    CU_add_test(suite, "relex_test_samples", relex_test_samples);
+    CU_add_test(suite, "relex_test_comment", relex_test_comment);
+
+    suite = CU_add_suite("Identifier Table Test", NULL, NULL);
+    CU_add_test(suite, "idtab_test_many_names", idtab_test_many_names);
+
+    suite = CU_add_suite("Approximate Count Test", NULL, NULL);
+    CU_add_test(suite, "approx_test_exact", approx_test_exact);
+    CU_add_test(suite, "approx_test_zipf", approx_test_zipf);
+    CU_add_test(suite, "approx_test_merge", approx_test_merge);
+
+    suite = CU_add_suite("Multi-file Count Test", NULL, NULL);
+    CU_add_test(suite, "count_test_files", count_test_files);
+    CU_add_test(suite, "count_test_directory", count_test_directory);
 
     suite = CU_add_suite("Integration Test", NULL, NULL);
     CU_add_test(suite, "integration_test_sample11pp", integration_test_sample11pp);
@@ -68,6 +174,1077 @@ void scan_func_test_isblank(void) {
     CU_ASSERT(_isblank('a') == 0);
 }
 
+void scan_func_test_load_source(void) {
+    int ret;
+    char *filename = "samples/sample12.mpl";
+
+    ret = init_scan(filename);
+    CU_ASSERT_EQUAL(ret, 0);
+    /* regular file is loaded into one buffer */
+    CU_ASSERT_PTR_NOT_NULL(default_scanner.src_head);
+    CU_ASSERT(default_scanner.src_end > default_scanner.src_head);
+
+    CU_ASSERT_EQUAL(scan(), TPROGRAM);
+    CU_ASSERT_EQUAL(scan(), TNAME);
+    CU_ASSERT_STRING_EQUAL(get_string_attr(), "S");
+
+    ret = end_scan();
+    CU_ASSERT_EQUAL(ret, 0);
+    CU_ASSERT_PTR_NULL(default_scanner.src_head);
+}
+
+void scan_func_test_keyword(void) {
+    int index;
+
+    CU_ASSERT_EQUAL(init_keyword_table(), 0);
+    for (index = 0; index < KEYWORDSIZE; index++) {
+        CU_ASSERT_EQUAL(get_keyword_token_code(key[index].keyword, (int)strlen(key[index].keyword)), key[index].keytoken);
+    }
+    CU_ASSERT_EQUAL(get_keyword_token_code("a", 1), TNAME);
+    CU_ASSERT_EQUAL(get_keyword_token_code("ends", 4), TNAME);
+    CU_ASSERT_EQUAL(get_keyword_token_code("writel", 6), TNAME);
+    CU_ASSERT_EQUAL(get_keyword_token_code("procedures", 10), TNAME);
+    CU_ASSERT_EQUAL(get_keyword_token_code("Program", 7), TNAME);
+    /* a prefix of a longer text is looked up by its length */
+    CU_ASSERT_EQUAL(get_keyword_token_code("endx", 3), TEND);
+    CU_ASSERT_EQUAL(get_keyword_token_code("en", 2), TNAME);
+}
+
+void scan_func_test_token_span(void) {
+    int ret, token, len;
+    const char *value;
+    char *filename = "samples/sample011.mpl";
+
+    ret = init_scan(filename);
+    CU_ASSERT_EQUAL(ret, 0);
+
+    CU_ASSERT_EQUAL(scan(), TNAME);
+    CU_ASSERT_EQUAL(token_span.offset, 0);
+    CU_ASSERT_EQUAL(token_span.len, 4);
+    CU_ASSERT(strncmp(token_span.ptr, "NAME", 4) == 0);
+
+    while ((token = scan()) >= 0 && token != TSTRING) {
+    }
+    CU_ASSERT_EQUAL(token, TSTRING);
+    CU_ASSERT_EQUAL(token_span.escaped, 0);
+    value = get_string_value(&len);
+    CU_ASSERT_EQUAL(len, 6);
+    CU_ASSERT(strncmp(value, "string", len) == 0);
+
+    /* '' is kept in the text and unescaped only by get_string_value() */
+    CU_ASSERT_EQUAL(scan(), TSTRING);
+    CU_ASSERT_EQUAL(token_span.escaped, 1);
+    CU_ASSERT_EQUAL(token_span.len, 27);
+    CU_ASSERT_STRING_EQUAL(get_string_attr(), "''s''t''r''i''n''g''''''s''");
+    value = get_string_value(&len);
+    CU_ASSERT_EQUAL(len, 17);
+    CU_ASSERT(strncmp(value, "'s't'r'i'n'g'''s'", len) == 0);
+
+    ret = end_scan();
+    CU_ASSERT_EQUAL(ret, 0);
+}
+
+void scan_func_test_no_copy(void) {
+    struct SCANNER *sc;
+    char *text;
+    int token, i;
+
+    for (i = 0; i < 2; i++) {
+        /* scanning and replaying the tokenized source */
+        sc = (i == 0) ? scanner_open("samples/sample11pp.mpl") : scanner_open_tokens("samples/sample11pp.mpl", 4, NULL);
+        CU_ASSERT_PTR_NOT_NULL(sc);
+        if (sc == NULL) {
+            return;
+        }
+        /* no name is copied while nobody asks for its text */
+        while ((token = scanner_next(sc)) >= 0) {
+            if (token == TNAME) {
+                CU_ASSERT_EQUAL(sc->string_attr_valid, 0);
+                CU_ASSERT_STRING_EQUAL(sc->string_attr, "");
+            }
+        }
+        CU_ASSERT_EQUAL(scanner_close(sc), 0);
+    }
+
+    sc = scanner_open("samples/sample11pp.mpl");
+    CU_ASSERT_PTR_NOT_NULL(sc);
+    if (sc == NULL) {
+        return;
+    }
+    CU_ASSERT_EQUAL(scanner_next(sc), TPROGRAM);
+    CU_ASSERT_EQUAL(scanner_next(sc), TNAME);
+    CU_ASSERT_EQUAL(sc->string_attr_valid, 0);
+    /* the text is copied on the first use only */
+    text = scanner_string_attr(sc);
+    CU_ASSERT_EQUAL(sc->string_attr_valid, 1);
+    CU_ASSERT_EQUAL((int)strlen(text), sc->span.len);
+    CU_ASSERT(strncmp(text, sc->span.ptr, sc->span.len) == 0);
+    text[0] = '\0';
+    CU_ASSERT(scanner_string_attr(sc) == text);
+    CU_ASSERT_STRING_EQUAL(scanner_string_attr(sc), "");
+    CU_ASSERT_EQUAL(scanner_close(sc), 0);
+}
+
+void scan_func_test_scanner_context(void) {
+    int correct_ans1[NUMOFTOKEN + 1], correct_ans2[NUMOFTOKEN + 1];
+    int count1[NUMOFTOKEN + 1], count2[NUMOFTOKEN + 1];
+    struct SCANNER *sc1, *sc2;
+    int token1 = 0, token2 = 0, index;
+
+    memset(correct_ans1, 0, sizeof(correct_ans1));
+    memset(correct_ans2, 0, sizeof(correct_ans2));
+    memset(count1, 0, sizeof(count1));
+    memset(count2, 0, sizeof(count2));
+    set_correct_ans_sample11pp(correct_ans1);
+    set_correct_ans_sample15(correct_ans2);
+
+    sc1 = scanner_open("samples/sample11pp.mpl");
+    sc2 = scanner_open("samples/sample15.mpl");
+    CU_ASSERT_PTR_NOT_NULL(sc1);
+    CU_ASSERT_PTR_NOT_NULL(sc2);
+    if (sc1 == NULL || sc2 == NULL) {
+        return;
+    }
+
+    /* scan two files alternately */
+    while (token1 >= 0 || token2 >= 0) {
+        if (token1 >= 0 && (token1 = scanner_next(sc1)) >= 0) {
+            count1[token1]++;
+        }
+        if (token2 >= 0 && (token2 = scanner_next(sc2)) >= 0) {
+            count2[token2]++;
+        }
+    }
+    CU_ASSERT_EQUAL(scanner_line(sc1), 28);
+    CU_ASSERT_EQUAL(scanner_close(sc1), 0);
+    CU_ASSERT_EQUAL(scanner_close(sc2), 0);
+
+    for (index = 0; index < NUMOFTOKEN + 1; index++) {
+        CU_ASSERT_EQUAL(count1[index], correct_ans1[index]);
+        CU_ASSERT_EQUAL(count2[index], correct_ans2[index]);
+    }
+}
+
+void scan_func_test_find_special(void) {
+    char buf[80];
+    char specials[] = {'}', '*', '\'', '\r', '\n', '\t', ' ', 'a', 0x7f, (char)0x80, (char)0xff};
+    int kinds[] = {FIND_NEWLINE, FIND_NONGRAPHIC, FIND_NONBLANK};
+    int stops[] = {'}', '\'', 0};
+    int k, s, pos, len;
+    const char *expected;
+
+    pthread_once(&find_special_once, init_find_special_once);
+    /* one special byte at every position, with every length across the vector widths */
+    for (k = 0; k < 3; k++) {
+        for (s = 0; s < (int)sizeof(specials); s++) {
+            for (len = 0; len <= (int)sizeof(buf); len++) {
+                for (pos = 0; pos < len; pos++) {
+                    memset(buf, (kinds[k] == FIND_NONBLANK) ? ' ' : 'x', sizeof(buf));
+                    buf[pos] = specials[s];
+                    expected = find_special_scalar(buf, buf + len, kinds[k], stops[k]);
+                    CU_ASSERT(find_special(buf, buf + len, kinds[k], stops[k]) == expected);
+#ifdef SCAN_USE_SSE2
+                    CU_ASSERT(find_special_sse2(buf, buf + len, kinds[k], stops[k]) == expected);
+#endif
+                }
+            }
+        }
+    }
+}
+
+void scan_func_test_skip_lines(void) {
+    int token, value_len;
+    const char *value;
+    char *filename = "samples/comment2.mpl";
+
+    CU_ASSERT_EQUAL(init_scan(filename), 0);
+
+    /* the ends of line in comments are counted */
+    CU_ASSERT_EQUAL(scan(), TPROGRAM);
+    CU_ASSERT_EQUAL(get_linenum(), 3);
+    while ((token = scan()) >= 0 && token != TVAR) {
+    }
+    CU_ASSERT_EQUAL(get_linenum(), 6);
+
+    /* long indentation */
+    while ((token = scan()) >= 0 && token != TNUMBER) {
+    }
+    CU_ASSERT_EQUAL(num_attr, 1);
+    CU_ASSERT_EQUAL(get_linenum(), 8);
+    while ((token = scan()) >= 0 && token != TNUMBER) {
+    }
+    CU_ASSERT_EQUAL(num_attr, 2);
+    CU_ASSERT_EQUAL(get_linenum(), 9);
+
+    /* long string */
+    while ((token = scan()) >= 0 && token != TSTRING) {
+    }
+    CU_ASSERT_EQUAL(get_linenum(), 10);
+    CU_ASSERT_EQUAL(token_span.len, 85);
+    value = get_string_value(&value_len);
+    CU_ASSERT_EQUAL(value_len, 84);
+    CU_ASSERT_EQUAL(value[value_len - 5], '\'');
+
+    while ((token = scan()) >= 0 && token != TSTRING) {
+    }
+    CU_ASSERT_EQUAL(get_linenum(), 12);
+    CU_ASSERT_EQUAL(scan(), TRPAREN);
+    CU_ASSERT_EQUAL(scan(), TEND);
+    CU_ASSERT_EQUAL(get_linenum(), 13);
+
+    CU_ASSERT_EQUAL(end_scan(), 0);
+}
+
+void dfa_test_samples(void) {
+    int index;
+
+    for (index = 0; index < (int)(sizeof(all_samples) / sizeof(all_samples[0])); index++) {
+        dfa_compare(all_samples[index]);
+    }
+}
+
+/* scan_use_dfa makes scan() give the same tokens by the DFA, also when they are tokenized first */
+void dfa_test_select(void) {
+    static char expected[1 << 16], dump[1 << 16];
+    int index;
+
+    for (index = 0; index < (int)(sizeof(all_samples) / sizeof(all_samples[0])); index++) {
+        init_scan(all_samples[index]);
+        CU_ASSERT_EQUAL(default_scanner.dfa, 0);
+        dump_scan(expected, sizeof(expected));
+        end_scan();
+
+        scan_use_dfa = 1;
+        CU_ASSERT_EQUAL(init_scan(all_samples[index]), 0);
+        CU_ASSERT_EQUAL(default_scanner.dfa, 1);
+        dump_scan(dump, sizeof(dump));
+        CU_ASSERT_STRING_EQUAL(dump, expected);
+        CU_ASSERT_EQUAL(end_scan(), 0);
+
+        CU_ASSERT_EQUAL(init_scan_tokens(all_samples[index], 4, NULL), 0);
+        dump_scan(dump, sizeof(dump));
+        CU_ASSERT_STRING_EQUAL(dump, expected);
+        CU_ASSERT_EQUAL(end_scan(), 0);
+        scan_use_dfa = 0;
+    }
+}
+
+/* The DFA reports the scan errors unless the scanner is quiet, as scanner_next() does */
+void dfa_test_quiet(void) {
+    CU_ASSERT(dfa_scan_stderr("samples/number1.mpl", 0) > 0);
+    CU_ASSERT_EQUAL(dfa_scan_stderr("samples/number1.mpl", 1), 0);
+    CU_ASSERT(dfa_scan_stderr("samples/sample014.mpl", 0) > 0);
+    CU_ASSERT_EQUAL(dfa_scan_stderr("samples/sample014.mpl", 1), 0);
+}
+
+/* Scan a file with dfa_scanner_next() until -1, and return the number of bytes written to stderr */
+long dfa_scan_stderr(char *filename, int quiet) {
+    struct SCANNER *sc;
+    FILE *out;
+    long written;
+    int saved;
+
+    if ((sc = scanner_open(filename)) == NULL || (out = tmpfile()) == NULL) {
+        CU_FAIL("can not open");
+        return -1;
+    }
+    sc->quiet = quiet;
+    fflush(stderr);
+    saved = dup(fileno(stderr));
+    dup2(fileno(out), fileno(stderr));
+    while (dfa_scanner_next(sc) >= 0) {
+    }
+    fflush(stderr);
+    dup2(saved, fileno(stderr));
+    close(saved);
+    written = (long)lseek(fileno(out), 0, SEEK_END);
+    fclose(out);
+    CU_ASSERT_EQUAL(scanner_close(sc), 0);
+    return written;
+}
+
+/* Scan a file with scanner_next() and dfa_scanner_next(), and compare the token streams */
+void dfa_compare(char *filename) {
+    struct SCANNER *sc1, *sc2;
+    int token1, token2;
+
+    sc1 = scanner_open(filename);
+    sc2 = scanner_open(filename);
+    CU_ASSERT_PTR_NOT_NULL(sc1);
+    CU_ASSERT_PTR_NOT_NULL(sc2);
+    if (sc1 == NULL || sc2 == NULL) {
+        return;
+    }
+
+    do {
+        token1 = scanner_next(sc1);
+        token2 = dfa_scanner_next(sc2);
+        CU_ASSERT_EQUAL(token1, token2);
+        CU_ASSERT_EQUAL(scanner_line(sc1), scanner_line(sc2));
+        if (token1 == TNUMBER && token2 == TNUMBER) {
+            CU_ASSERT_EQUAL(sc1->num_attr, sc2->num_attr);
+        }
+        if ((token1 == TNAME || token1 == TSTRING) && token1 == token2) {
+            CU_ASSERT_STRING_EQUAL(scanner_string_attr(sc1), scanner_string_attr(sc2));
+            CU_ASSERT_EQUAL(sc1->span.offset, sc2->span.offset);
+            CU_ASSERT_EQUAL(sc1->span.len, sc2->span.len);
+            CU_ASSERT_EQUAL(sc1->span.escaped, sc2->span.escaped);
+        }
+    } while (token1 >= 0 && token1 == token2);
+
+    CU_ASSERT_EQUAL(scanner_close(sc1), 0);
+    CU_ASSERT_EQUAL(scanner_close(sc2), 0);
+}
+
+void parallel_test_samples(void) {
+    int index;
+
+    for (index = 0; index < (int)(sizeof(all_samples) / sizeof(all_samples[0])); index++) {
+        parallel_compare(all_samples[index]);
+    }
+}
+
+/* Tokenize a file by several numbers of threads, and compare the tokens with scanning */
+void parallel_compare(char *filename) {
+    int nthreads[] = {1, 2, 3, 5, 8, 16, 64};
+    struct SCANNER *sc;
+    struct TOKEN_ARRAY expected, ta;
+    long end_offset = 0;
+    int end_linenum = 0, code, index, i, token, linenum;
+
+    /* tokens by scanning */
+    sc = scanner_open(filename);
+    CU_ASSERT_PTR_NOT_NULL(sc);
+    if (sc == NULL) {
+        return;
+    }
+    memset(&expected, 0, sizeof(expected));
+    sc->quiet = 1;
+    do {
+        end_offset = sc->current_offset;
+        end_linenum = sc->linenum;
+    } while ((code = scanner_next(sc)) != -1 && token_array_push(&expected, sc, code) == 0);
+    CU_ASSERT_EQUAL(scanner_close(sc), 0);
+
+    for (index = 0; index < (int)(sizeof(nthreads) / sizeof(nthreads[0])); index++) {
+        sc = scanner_open(filename);
+        CU_ASSERT_EQUAL(scanner_tokenize(sc, nthreads[index], &ta), 0);
+        CU_ASSERT_EQUAL(ta.ntokens, expected.ntokens);
+        for (i = 0; i < ta.ntokens && i < expected.ntokens; i++) {
+            CU_ASSERT_EQUAL(ta.tokens[i].code, expected.tokens[i].code);
+            CU_ASSERT_EQUAL(ta.tokens[i].linenum, expected.tokens[i].linenum);
+            CU_ASSERT_EQUAL(ta.tokens[i].offset, expected.tokens[i].offset);
+            CU_ASSERT_EQUAL(ta.tokens[i].len, expected.tokens[i].len);
+            if (expected.tokens[i].code == TNUMBER) {
+                CU_ASSERT_EQUAL(ta.tokens[i].num_attr, expected.tokens[i].num_attr);
+            }
+            if (expected.tokens[i].code == TSTRING) {
+                CU_ASSERT_EQUAL(ta.tokens[i].escaped, expected.tokens[i].escaped);
+            }
+        }
+        CU_ASSERT_EQUAL(ta.end_offset, end_offset);
+        CU_ASSERT_EQUAL(ta.end_linenum, end_linenum);
+        token_array_release(&ta);
+        scanner_close(sc);
+    }
+
+    /* scan() replays the tokens */
+    CU_ASSERT_EQUAL(init_scan_tokens(filename, 4, NULL), 0);
+    i = 0;
+    while ((token = scan()) >= 0) {
+        CU_ASSERT(i < expected.ntokens && token == expected.tokens[i].code);
+        CU_ASSERT(i < expected.ntokens && get_linenum() == expected.tokens[i].linenum);
+        i++;
+    }
+    linenum = get_linenum();
+    CU_ASSERT_EQUAL(i, expected.ntokens);
+    CU_ASSERT_EQUAL(end_scan(), 0);
+    init_scan(filename);
+    while (scan() >= 0) {
+    }
+    CU_ASSERT_EQUAL(get_linenum(), linenum);
+    CU_ASSERT_EQUAL(end_scan(), 0);
+
+    token_array_release(&expected);
+}
+
+/* Directory of the token cache used by the test */
+#define TEST_CACHE_DIR "test-token-cache"
+
+void cache_test_samples(void) {
+    int index;
+
+    for (index = 0; index < (int)(sizeof(all_samples) / sizeof(all_samples[0])); index++) {
+        cache_compare(all_samples[index]);
+    }
+    rmdir(TEST_CACHE_DIR);
+}
+
+/* Scan a file without and with the token cache, and compare what scan() returns */
+void cache_compare(char *filename) {
+    static char expected[1 << 16], dump[1 << 16];
+    char path[FILENAME_MAX];
+    unsigned long hash[2];
+    struct TOKEN_CACHE_HEADER header;
+    FILE *cache;
+
+    init_scan(filename);
+    dump_scan(expected, sizeof(expected));
+    source_hash(&default_scanner, hash);
+    token_cache_path(path, TEST_CACHE_DIR, hash);
+    end_scan();
+    remove(path);
+
+    /* the first time writes the cache */
+    CU_ASSERT_EQUAL(init_scan_tokens(filename, 1, TEST_CACHE_DIR), 0);
+    CU_ASSERT_PTR_NULL(default_scanner.cache_map);
+    dump_scan(dump, sizeof(dump));
+    CU_ASSERT_STRING_EQUAL(dump, expected);
+    CU_ASSERT_EQUAL(end_scan(), 0);
+
+    /* the next time replays it */
+    CU_ASSERT_EQUAL(init_scan_tokens(filename, 1, TEST_CACHE_DIR), 0);
+    CU_ASSERT_PTR_NOT_NULL(default_scanner.cache_map);
+    dump_scan(dump, sizeof(dump));
+    CU_ASSERT_STRING_EQUAL(dump, expected);
+    CU_ASSERT_EQUAL(end_scan(), 0);
+
+    /* a broken cache is stale, and written again */
+    if ((cache = fopen(path, "r+b")) != NULL) {
+        fputs("BROKEN", cache);
+        fclose(cache);
+    }
+    CU_ASSERT_EQUAL(init_scan_tokens(filename, 1, TEST_CACHE_DIR), 0);
+    CU_ASSERT_PTR_NULL(default_scanner.cache_map);
+    dump_scan(dump, sizeof(dump));
+    CU_ASSERT_STRING_EQUAL(dump, expected);
+    CU_ASSERT_EQUAL(end_scan(), 0);
+    CU_ASSERT_EQUAL(init_scan_tokens(filename, 1, TEST_CACHE_DIR), 0);
+    CU_ASSERT_PTR_NOT_NULL(default_scanner.cache_map);
+    CU_ASSERT_EQUAL(end_scan(), 0);
+
+    /* a cache written by another version of the scanner is stale, and written again */
+    if ((cache = fopen(path, "r+b")) != NULL) {
+        if (fread(&header, sizeof(header), 1, cache) == 1) {
+            header.version = TOKEN_CACHE_VERSION + 1;
+            rewind(cache);
+            fwrite(&header, sizeof(header), 1, cache);
+        }
+        fclose(cache);
+    }
+    CU_ASSERT_EQUAL(init_scan_tokens(filename, 1, TEST_CACHE_DIR), 0);
+    CU_ASSERT_PTR_NULL(default_scanner.cache_map);
+    dump_scan(dump, sizeof(dump));
+    CU_ASSERT_STRING_EQUAL(dump, expected);
+    CU_ASSERT_EQUAL(end_scan(), 0);
+    CU_ASSERT_EQUAL(init_scan_tokens(filename, 1, TEST_CACHE_DIR), 0);
+    CU_ASSERT_PTR_NOT_NULL(default_scanner.cache_map);
+    CU_ASSERT_EQUAL(end_scan(), 0);
+
+    remove(path);
+}
+
+/* The directory of the token cache, and a directory which can not be written */
+void cache_test_dir(void) {
+    static char expected[1 << 16], dump[1 << 16];
+    static char saved_dir[FILENAME_MAX], saved_xdg[FILENAME_MAX];
+    char *env, *dir;
+
+    /* the environment is restored at the end */
+    saved_dir[0] = saved_xdg[0] = '\0';
+    if ((env = getenv("MPPL_TOKEN_CACHE_DIR")) != NULL) {
+        strncat(saved_dir, env, sizeof(saved_dir) - 1);
+    }
+    if ((env = getenv("XDG_CACHE_HOME")) != NULL) {
+        strncat(saved_xdg, env, sizeof(saved_xdg) - 1);
+    }
+
+    setenv("MPPL_TOKEN_CACHE_DIR", "/tmp/mppl-dir", 1);
+    setenv("XDG_CACHE_HOME", "/tmp/xdg", 1);
+    CU_ASSERT_STRING_EQUAL(token_cache_dir(), "/tmp/mppl-dir");
+    unsetenv("MPPL_TOKEN_CACHE_DIR");
+    CU_ASSERT_STRING_EQUAL(token_cache_dir(), "/tmp/xdg/mppl-tokens");
+    /* a relative $XDG_CACHE_HOME is ignored */
+    setenv("XDG_CACHE_HOME", "xdg", 1);
+    dir = token_cache_dir();
+    CU_ASSERT(dir == NULL || strstr(dir, "/.cache/mppl-tokens") != NULL);
+
+    if (saved_dir[0] != '\0') {
+        setenv("MPPL_TOKEN_CACHE_DIR", saved_dir, 1);
+    }
+    if (saved_xdg[0] != '\0') {
+        setenv("XDG_CACHE_HOME", saved_xdg, 1);
+    } else {
+        unsetenv("XDG_CACHE_HOME");
+    }
+
+    /* scanning goes on without the cache, and quietly, if it can not be written */
+    init_scan("samples/sample11pp.mpl");
+    dump_scan(expected, sizeof(expected));
+    end_scan();
+    CU_ASSERT_EQUAL(init_scan_tokens("samples/sample11pp.mpl", 1, "/proc/mppl-tokens/unwritable"), 0);
+    CU_ASSERT_PTR_NULL(default_scanner.cache_map);
+    dump_scan(dump, sizeof(dump));
+    CU_ASSERT_STRING_EQUAL(dump, expected);
+    CU_ASSERT_EQUAL(end_scan(), 0);
+}
+
+/* Scan until -1 and write the tokens and their attributes as text */
+void dump_scan(char *dump, int size) {
+    int token, len = 0;
+
+    dump[0] = '\0';
+    while ((token = scan()) >= 0 && len < size - MAXSTRSIZE - 64) {
+        len += sprintf(dump + len, "%d %d", token, get_linenum());
+        if (token == TNUMBER) {
+            len += sprintf(dump + len, " %d", num_attr);
+        } else if (token == TNAME || token == TSTRING) {
+            len += sprintf(dump + len, " %s %d", get_string_attr(), token_span.escaped);
+        }
+        len += sprintf(dump + len, "\n");
+    }
+    sprintf(dump + len, "end %d\n", get_linenum());
+}
+
+#define TEST_FIFO "test-stream.fifo"
+#define TEST_LONG_SOURCE "test-long.mpl"
+#define TEST_LONG_LEN 200000
+
+void stream_test_samples(void) {
+    int index;
+
+    for (index = 0; index < (int)(sizeof(all_samples) / sizeof(all_samples[0])); index++) {
+        stream_compare(all_samples[index]);
+    }
+}
+
+void stream_test_long_tokens(void) {
+    struct SCANNER *sc;
+    FILE *out;
+    const char *value;
+    int i, len;
+
+    /* a string and a name far longer than MAXSTRSIZE and than a block of the stream */
+    out = fopen(TEST_LONG_SOURCE, "w");
+    CU_ASSERT_PTR_NOT_NULL(out);
+    if (out == NULL) {
+        return;
+    }
+    fputs("program '", out);
+    for (i = 0; i < TEST_LONG_LEN; i++) {
+        fputs((i % 1000 == 999) ? "''" : "s", out);
+    }
+    fputs("' ", out);
+    for (i = 0; i < TEST_LONG_LEN; i++) {
+        fputc('n', out);
+    }
+    fputs(" .\n", out);
+    fclose(out);
+
+    sc = scanner_open(TEST_LONG_SOURCE);
+    CU_ASSERT_PTR_NOT_NULL(sc);
+    if (sc == NULL) {
+        return;
+    }
+    CU_ASSERT_EQUAL(scanner_next(sc), TPROGRAM);
+    CU_ASSERT_EQUAL(scanner_next(sc), TSTRING);
+    CU_ASSERT_EQUAL(sc->span.len, TEST_LONG_LEN + TEST_LONG_LEN / 1000);
+    CU_ASSERT_EQUAL((int)strlen(scanner_string_attr(sc)), sc->span.len);
+    value = scanner_string_value(sc, &len);
+    CU_ASSERT_EQUAL(len, TEST_LONG_LEN);
+    CU_ASSERT(value[998] == 's' && value[999] == '\'' && value[1000] == 's');
+    CU_ASSERT_EQUAL(scanner_next(sc), TNAME);
+    CU_ASSERT_EQUAL((int)strlen(scanner_string_attr(sc)), TEST_LONG_LEN);
+    CU_ASSERT_EQUAL(scanner_next(sc), TDOT);
+    CU_ASSERT_EQUAL(scanner_next(sc), -1);
+    CU_ASSERT_EQUAL(scanner_close(sc), 0);
+
+    stream_compare(TEST_LONG_SOURCE);
+    remove(TEST_LONG_SOURCE);
+}
+
+/* Scan a file through a pipe, which is streamed, and compare the tokens with the file loaded into memory */
+void stream_compare(char *filename) {
+    struct SCANNER *sc1, *sc2;
+    const char *value1, *value2;
+    char buf[4096];
+    FILE *in, *out;
+    pid_t pid;
+    size_t n;
+    int token1, token2, len1, len2;
+
+    remove(TEST_FIFO);
+    if (mkfifo(TEST_FIFO, 0600) == -1) {
+        CU_FAIL("mkfifo() failed.");
+        return;
+    }
+    if ((pid = fork()) == 0) {
+        /* the writer of the pipe */
+        in = fopen(filename, "rb");
+        out = fopen(TEST_FIFO, "wb");
+        while (in != NULL && out != NULL && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+            fwrite(buf, 1, n, out);
+        }
+        if (out != NULL) {
+            fclose(out);
+        }
+        _exit(0);
+    }
+    if (pid == -1) {
+        CU_FAIL("fork() failed.");
+        remove(TEST_FIFO);
+        return;
+    }
+
+    sc1 = scanner_open(filename);
+    sc2 = scanner_open(TEST_FIFO);
+    CU_ASSERT_PTR_NOT_NULL(sc1);
+    CU_ASSERT_PTR_NOT_NULL(sc2);
+    if (sc1 != NULL && sc2 != NULL) {
+        CU_ASSERT_PTR_NOT_NULL(sc1->src_head);
+        CU_ASSERT_PTR_NULL(sc2->src_head);
+        sc2->quiet = 1;
+        do {
+            token1 = scanner_next(sc1);
+            token2 = scanner_next(sc2);
+            CU_ASSERT_EQUAL(token1, token2);
+            CU_ASSERT_EQUAL(scanner_line(sc1), scanner_line(sc2));
+            if (token1 == TNUMBER && token2 == TNUMBER) {
+                CU_ASSERT_EQUAL(sc1->num_attr, sc2->num_attr);
+            }
+            if ((token1 == TNAME || token1 == TSTRING) && token1 == token2) {
+                CU_ASSERT_STRING_EQUAL(scanner_string_attr(sc1), scanner_string_attr(sc2));
+                CU_ASSERT_EQUAL(sc1->span.offset, sc2->span.offset);
+                CU_ASSERT_EQUAL(sc1->span.len, sc2->span.len);
+                value1 = scanner_string_value(sc1, &len1);
+                value2 = scanner_string_value(sc2, &len2);
+                CU_ASSERT(len1 == len2 && memcmp(value1, value2, len1) == 0);
+            }
+        } while (token1 >= 0 && token1 == token2);
+    }
+    if (sc1 != NULL) {
+        CU_ASSERT_EQUAL(scanner_close(sc1), 0);
+    }
+    if (sc2 != NULL) {
+        /* let the writer finish if the scan stopped early */
+        while (fread(buf, 1, sizeof(buf), sc2->fp) > 0) {
+        }
+        CU_ASSERT_EQUAL(scanner_close(sc2), 0);
+    }
+    waitpid(pid, NULL, 0);
+    remove(TEST_FIFO);
+}
+
+#define TEST_RELEX_SOURCE "test-relex.mpl"
+#define TEST_RELEX_EDITS 200
+
+void relex_test_samples(void) {
+    int index;
+
+    srand(1);
+    for (index = 0; index < (int)(sizeof(all_samples) / sizeof(all_samples[0])); index++) {
+        relex_compare(all_samples[index]);
+    }
+}
+
+void relex_test_comment(void) {
+    static char src[] = "program p;\nbegin\n  a := 1;\n  b := 2\nend.\n";
+    char edited[sizeof(src) + 1];
+    long size = (long)strlen(src);
+    struct TOKEN_ARRAY ta, expected;
+    struct TEXT_EDIT edit;
+    struct TOKEN_RANGE changed;
+
+    /* lex the whole source */
+    memset(&ta, 0, sizeof(ta));
+    edit.offset = 0;
+    edit.removed_len = 0;
+    edit.inserted_len = size;
+    CU_ASSERT_EQUAL(token_array_relex(&ta, src, size, &edit, &changed), 0);
+    CU_ASSERT(changed.begin == 0 && changed.old_end == 0 && changed.new_end == 13);
+
+    /* "a := 1" is commented out, and then the comment is closed at ';' */
+    memcpy(edited, src, 19);
+    edited[19] = '{';
+    memcpy(edited + 20, src + 19, size - 19 + 1);
+    edit.offset = 19;
+    edit.removed_len = 0;
+    edit.inserted_len = 1;
+    CU_ASSERT_EQUAL(token_array_relex(&ta, edited, size + 1, &edit, &changed), 0);
+    CU_ASSERT(changed.begin == 4 && changed.new_end == 4);
+    CU_ASSERT_EQUAL(ta.ntokens, 4);
+    if (relex_full_scan(edited, size + 1, &expected) == 0) {
+        relex_assert_same(&ta, &expected);
+        token_array_release(&expected);
+    }
+
+    edited[26] = '}';
+    edit.offset = 26;
+    edit.removed_len = 1;
+    edit.inserted_len = 1;
+    CU_ASSERT_EQUAL(token_array_relex(&ta, edited, size + 1, &edit, &changed), 0);
+    CU_ASSERT(changed.begin == 4 && changed.old_end == 4 && changed.new_end == 9);
+    if (relex_full_scan(edited, size + 1, &expected) == 0) {
+        relex_assert_same(&ta, &expected);
+        CU_ASSERT_EQUAL(ta.tokens[4].code, TNAME);
+        CU_ASSERT_EQUAL(ta.tokens[4].linenum, 4);
+        token_array_release(&expected);
+    }
+    token_array_release(&ta);
+}
+
+/* Edit a file at random, re-lex it after every edit, and compare the tokens with scanning the whole */
+void relex_compare(char *filename) {
+    static char src[1 << 16], edited[1 << 16];
+    const char *letters = "ab1 \n:=<>.;\r9xyz()+";
+    struct TOKEN_ARRAY ta, expected;
+    struct TEXT_EDIT edit;
+    struct TOKEN_RANGE changed;
+    FILE *in;
+    long size;
+    int i, k;
+
+    in = fopen(filename, "rb");
+    CU_ASSERT_PTR_NOT_NULL(in);
+    if (in == NULL) {
+        return;
+    }
+    size = (long)fread(src, 1, sizeof(src) / 2, in);
+    fclose(in);
+
+    memset(&ta, 0, sizeof(ta));
+    edit.offset = 0;
+    edit.removed_len = 0;
+    edit.inserted_len = size;
+    CU_ASSERT_EQUAL(token_array_relex(&ta, src, size, &edit, &changed), 0);
+    for (i = 0; i < TEST_RELEX_EDITS; i++) {
+        if (relex_full_scan(src, size, &expected) == 0) {
+            relex_assert_same(&ta, &expected);
+            token_array_release(&expected);
+        }
+        edit.offset = rand() % (size + 1);
+        edit.removed_len = rand() % 4;
+        edit.inserted_len = rand() % 4;
+        if (edit.offset + edit.removed_len > size) {
+            edit.removed_len = size - edit.offset;
+        }
+        if (size - edit.removed_len + edit.inserted_len > (long)sizeof(src)) {
+            edit.inserted_len = 0;
+        }
+        memcpy(edited, src, edit.offset);
+        for (k = 0; k < edit.inserted_len; k++) {
+            /* quotes and comments now and then */
+            edited[edit.offset + k] = (rand() % 100 == 0) ? "'{}/*"[rand() % 5] : letters[rand() % strlen(letters)];
+        }
+        memcpy(edited + edit.offset + edit.inserted_len, src + edit.offset + edit.removed_len,
+               size - edit.offset - edit.removed_len);
+        size += edit.inserted_len - edit.removed_len;
+        memcpy(src, edited, size);
+        CU_ASSERT_EQUAL(token_array_relex(&ta, src, size, &edit, &changed), 0);
+        CU_ASSERT(changed.begin <= changed.old_end && changed.begin <= changed.new_end && changed.new_end <= ta.ntokens);
+    }
+    token_array_release(&ta);
+}
+
+/* Tokenize a source by scanning the whole of it */
+int relex_full_scan(const char *src, long size, struct TOKEN_ARRAY *ta) {
+    struct SCANNER *sc;
+    FILE *out;
+    int ret;
+
+    out = fopen(TEST_RELEX_SOURCE, "wb");
+    CU_ASSERT_PTR_NOT_NULL(out);
+    if (out == NULL) {
+        return -1;
+    }
+    fwrite(src, 1, size, out);
+    fclose(out);
+    sc = scanner_open(TEST_RELEX_SOURCE);
+    CU_ASSERT_PTR_NOT_NULL(sc);
+    if (sc == NULL) {
+        return -1;
+    }
+    sc->quiet = 1;
+    ret = scanner_tokenize(sc, 1, ta);
+    CU_ASSERT_EQUAL(ret, 0);
+    scanner_close(sc);
+    remove(TEST_RELEX_SOURCE);
+    return ret;
+}
+
+void relex_assert_same(struct TOKEN_ARRAY *ta, struct TOKEN_ARRAY *expected) {
+    struct TOKEN *token, *answer;
+    int i;
+
+    CU_ASSERT_EQUAL(ta->ntokens, expected->ntokens);
+    CU_ASSERT_EQUAL(ta->end_offset, expected->end_offset);
+    CU_ASSERT_EQUAL(ta->end_linenum, expected->end_linenum);
+    for (i = 0; i < ta->ntokens && i < expected->ntokens; i++) {
+        token = &ta->tokens[i];
+        answer = &expected->tokens[i];
+        CU_ASSERT(token->code == answer->code && token->linenum == answer->linenum);
+        CU_ASSERT(token->offset == answer->offset && token->len == answer->len);
+        if (token->code == TNUMBER) {
+            CU_ASSERT_EQUAL(token->num_attr, answer->num_attr);
+        } else if (token->code == TSTRING) {
+            CU_ASSERT_EQUAL(token->escaped, answer->escaped);
+        }
+    }
+}
+
+void idtab_test_many_names(void) {
+    struct ID_TABLE tab;
+    struct ID *p;
+    char name[32];
+    int i, ok = 1;
+
+    idtab_init(&tab);
+    CU_ASSERT_PTR_NULL(idtab_search(&tab, "a", 1));
+    /* enough names to grow the slots and the arena several times */
+    for (i = 0; i < 50000; i++) {
+        sprintf(name, "x%d", i);
+        CU_ASSERT_EQUAL(idtab_countup(&tab, name, (int)strlen(name)), 0);
+        /* and its prefix, so that x1 to x4999 are counted 11 times */
+        CU_ASSERT_EQUAL(idtab_countup(&tab, name, (int)strlen(name) - 1), 0);
+    }
+    CU_ASSERT_EQUAL(tab.nids, 50001);
+    for (i = 0; i < 50000; i++) {
+        sprintf(name, "x%d", i);
+        p = idtab_search(&tab, name, (int)strlen(name));
+        if (p == NULL || strcmp(p->name, name) != 0 || p->count != ((i >= 1 && i < 5000) ? 11 : 1)) {
+            ok = 0;
+        }
+    }
+    CU_ASSERT(ok);
+    CU_ASSERT_EQUAL(idtab_search(&tab, "x", 1)->count, 10);
+    /* the names are kept in the order of registration */
+    CU_ASSERT_STRING_EQUAL(tab.ids[0].name, "x0");
+    CU_ASSERT_STRING_EQUAL(tab.ids[1].name, "x");
+    CU_ASSERT_STRING_EQUAL(tab.ids[tab.nids - 1].name, "x49999");
+    idtab_release(&tab);
+    CU_ASSERT_EQUAL(tab.nids, 0);
+    CU_ASSERT_PTR_NULL(idtab_search(&tab, "x0", 2));
+}
+
+void approx_test_exact(void) {
+    struct APPROX_TABLE tab;
+    char *names[] = {"b", "a", "c", "a", "b", "a", "d"};
+    struct TOP_ID *p;
+    unsigned long h1, h2;
+    long lower, upper;
+    int i;
+
+    CU_ASSERT_EQUAL(approx_init(&tab, 4), 0);
+    for (i = 0; i < 7; i++) {
+        CU_ASSERT_EQUAL(approx_countup(&tab, names[i], 1), 0);
+    }
+    /* as many names as k are counted exactly */
+    CU_ASSERT_EQUAL(tab.nheap, 4);
+    CU_ASSERT_EQUAL(tab.total, 7);
+    for (i = 0; i < tab.nheap; i++) {
+        approx_bounds(&tab, &tab.heap[i], &lower, &upper);
+        CU_ASSERT_EQUAL(lower, tab.heap[i].count);
+        CU_ASSERT_EQUAL(upper, tab.heap[i].count);
+    }
+    CU_ASSERT_EQUAL(approx_estimate(&tab, "a", 1), 3);
+    CU_ASSERT_EQUAL(approx_estimate(&tab, "d", 1), 1);
+    /* the least frequent of them gives way to a new name */
+    CU_ASSERT_EQUAL(approx_countup(&tab, "e", 1), 0);
+    CU_ASSERT_EQUAL(tab.nheap, 4);
+    approx_hash("e", 1, &h1, &h2);
+    if ((p = approx_search(&tab, "e", 1, h1)) == NULL) {
+        CU_FAIL("e is not kept");
+    } else {
+        CU_ASSERT_EQUAL(p->count, 2);
+        CU_ASSERT_EQUAL(p->error, 1);
+        /* the sketch tells that it is new */
+        approx_bounds(&tab, p, &lower, &upper);
+        CU_ASSERT_EQUAL(lower, 1);
+        CU_ASSERT_EQUAL(upper, 1);
+    }
+    approx_release(&tab);
+    CU_ASSERT_PTR_NULL(tab.heap);
+}
+
+void approx_test_zipf(void) {
+    struct APPROX_TABLE tab;
+    struct ID_TABLE exact;
+    unsigned long h1, h2;
+    char name[32];
+    int i, r, n;
+
+    CU_ASSERT_EQUAL(approx_init(&tab, 20), 0);
+    idtab_init(&exact);
+    srand(1);
+    /* a name of rank r appears about 1/r as often as the first */
+    for (i = 0; i < 200000; i++) {
+        for (r = 1; r < 10000 && rand() % (r + 1) != 0; r++) {
+        }
+        sprintf(name, "z%d", r);
+        n = (int)strlen(name);
+        CU_ASSERT_EQUAL(approx_countup(&tab, name, n), 0);
+        idtab_countup(&exact, name, n);
+    }
+    CU_ASSERT_EQUAL(tab.nheap, 20);
+    approx_assert_bounds(&tab, &exact);
+    /* the most frequent names are kept */
+    for (r = 1; r <= 5; r++) {
+        sprintf(name, "z%d", r);
+        n = (int)strlen(name);
+        approx_hash(name, n, &h1, &h2);
+        CU_ASSERT_PTR_NOT_NULL(approx_search(&tab, name, n, h1));
+    }
+    approx_release(&tab);
+    idtab_release(&exact);
+}
+
+void approx_test_merge(void) {
+    struct APPROX_TABLE tab[2];
+    struct ID_TABLE exact;
+    char name[32];
+    int i, n;
+
+    CU_ASSERT_EQUAL(approx_init(&tab[0], 8), 0);
+    CU_ASSERT_EQUAL(approx_init(&tab[1], 8), 0);
+    idtab_init(&exact);
+    srand(2);
+    for (i = 0; i < 20000; i++) {
+        /* the halves have different names in their tails */
+        sprintf(name, "m%d", (i % 2) * 1000 + rand() % ((i % 4 == 0) ? 4 : 200));
+        n = (int)strlen(name);
+        CU_ASSERT_EQUAL(approx_countup(&tab[i % 2], name, n), 0);
+        idtab_countup(&exact, name, n);
+    }
+    CU_ASSERT_EQUAL(approx_merge(&tab[0], &tab[1]), 0);
+    CU_ASSERT_EQUAL(tab[0].total, 20000);
+    CU_ASSERT_EQUAL(tab[0].nheap, 8);
+    approx_assert_bounds(&tab[0], &exact);
+    approx_release(&tab[0]);
+    approx_release(&tab[1]);
+    idtab_release(&exact);
+}
+
+/*!
+ * @brief Assert that the bounds of every name kept by a table hold the exact count, and that
+ * the heap and the slots agree
+ */
+void approx_assert_bounds(struct APPROX_TABLE *tab, struct ID_TABLE *exact) {
+    struct ID *p;
+    long lower, upper;
+    int i, ok = 1;
+
+    for (i = 0; i < tab->nheap; i++) {
+        p = idtab_search(exact, tab->heap[i].name, tab->heap[i].len);
+        approx_bounds(tab, &tab->heap[i], &lower, &upper);
+        if (p == NULL || lower > p->count || upper < p->count ||
+            approx_search(tab, tab->heap[i].name, tab->heap[i].len, tab->heap[i].hash) != &tab->heap[i] ||
+            (i > 0 && tab->heap[(i - 1) / 2].count > tab->heap[i].count)) {
+            ok = 0;
+        }
+    }
+    CU_ASSERT(ok);
+}
+
+void count_test_files(void) {
+    int nfiles = (int)(sizeof(all_samples) / sizeof(all_samples[0]));
+    int nthreads[] = {1, 2, 4, 32};
+    struct FILE_COUNT *files = NULL;
+    struct ID_TABLE expected_ids, idtab;
+    struct APPROX_TABLE approx_tab;
+    struct SCANNER *sc;
+    struct ID *p;
+    int expected[NUMOFTOKEN + 1], total[NUMOFTOKEN + 1];
+    int capacity = 0, n = 0, i, k, token, ok;
+
+    /* the counts by scanning each file in turn */
+    memset(expected, 0, sizeof(expected));
+    idtab_init(&expected_ids);
+    for (i = 0; i < nfiles; i++) {
+        CU_ASSERT_EQUAL(add_file(all_samples[i], &files, &n, &capacity), 0);
+        if ((sc = scanner_open(all_samples[i])) != NULL) {
+            sc->quiet = 1;
+            while ((token = scanner_next(sc)) >= 0) {
+                expected[token]++;
+                if (token == TNAME) {
+                    idtab_countup(&expected_ids, sc->span.ptr, sc->span.len);
+                }
+            }
+            scanner_close(sc);
+        }
+    }
+    CU_ASSERT_EQUAL(n, nfiles);
+
+    for (k = 0; k < (int)(sizeof(nthreads) / sizeof(nthreads[0])); k++) {
+        CU_ASSERT(count_files(files, n, nthreads[k], NULL, 1, 0, total, &idtab, NULL) >= 0);
+        CU_ASSERT(memcmp(total, expected, sizeof(total)) == 0);
+        CU_ASSERT_EQUAL(idtab.nids, expected_ids.nids);
+        ok = 1;
+        for (i = 0; i < expected_ids.nids; i++) {
+            p = idtab_search(&idtab, expected_ids.ids[i].name, expected_ids.ids[i].len);
+            if (p == NULL || p->count != expected_ids.ids[i].count) {
+                ok = 0;
+            }
+        }
+        CU_ASSERT(ok);
+        idtab_release(&idtab);
+        /* the approximate counts reduced from the threads bound the exact ones */
+        CU_ASSERT(count_files(files, n, nthreads[k], NULL, 1, 5, total, &idtab, &approx_tab) >= 0);
+        CU_ASSERT(memcmp(total, expected, sizeof(total)) == 0);
+        CU_ASSERT_EQUAL(approx_tab.total, expected[TNAME]);
+        approx_assert_bounds(&approx_tab, &expected_ids);
+        release_counts(&idtab, &approx_tab);
+        /* the counts of each file add up to the total */
+        memset(total, 0, sizeof(total));
+        for (i = 0; i < n; i++) {
+            CU_ASSERT_EQUAL(files[i].result, 0);
+            for (token = 0; token < NUMOFTOKEN + 1; token++) {
+                total[token] += files[i].numtoken[token];
+            }
+        }
+        CU_ASSERT(memcmp(total, expected, sizeof(total)) == 0);
+    }
+    /* samples/sample11pp.mpl */
+    CU_ASSERT_EQUAL(files[7].numtoken[TNAME], 27);
+
+    idtab_release(&expected_ids);
+    for (i = 0; i < n; i++) {
+        free(files[i].path);
+    }
+    free(files);
+}
+
+void count_test_directory(void) {
+    struct FILE_COUNT *files = NULL;
+    struct ID_TABLE idtab;
+    int total[NUMOFTOKEN + 1];
+    int capacity = 0, n = 0, i;
+
+    CU_ASSERT_EQUAL(collect_files("samples", &files, &n, &capacity), 0);
+    CU_ASSERT_EQUAL(n, (int)(sizeof(all_samples) / sizeof(all_samples[0])));
+    for (i = 0; i < n; i++) {
+        /* in the order of the names, as all_samples is */
+        CU_ASSERT_STRING_EQUAL(files[i].path, all_samples[i]);
+        free(files[i].path);
+    }
+    free(files);
+
+    /* a file which does not exist is added, and fails to be counted */
+    files = NULL;
+    capacity = n = 0;
+    CU_ASSERT_EQUAL(collect_files("samples/none.mpl", &files, &n, &capacity), 0);
+    CU_ASSERT_EQUAL(collect_files("samples/sample12.mpl", &files, &n, &capacity), 0);
+    CU_ASSERT_EQUAL(n, 2);
+    CU_ASSERT(count_files(files, n, 2, NULL, 1, 0, total, &idtab, NULL) < 0);
+    CU_ASSERT_EQUAL(files[0].result, -1);
+    CU_ASSERT_EQUAL(files[1].result, 0);
+    CU_ASSERT_EQUAL(total[TPROGRAM], 1);
+    idtab_release(&idtab);
+    for (i = 0; i < n; i++) {
+        free(files[i].path);
+    }
+    free(files);
+}
+
 void integration_test_sample11pp(void) {
     int correct_ans[NUMOFTOKEN + 1];
     memset(correct_ans, 0, sizeof(correct_ans));
@@ -219,8 +1396,11 @@ void exceptional_string1(void) {
 
     memset(numtoken, 0, sizeof(numtoken));
 
+    /* a name longer than MAXSTRSIZE is scanned whole */
     ret = scan();
-    CU_ASSERT_EQUAL(ret, -1);
+    CU_ASSERT_EQUAL(ret, TNAME);
+    CU_ASSERT_EQUAL((int)strlen(get_string_attr()), 1029);
+    CU_ASSERT_EQUAL(scan(), -1);
 
     ret = end_scan();
     CU_ASSERT_EQUAL(ret, 0);
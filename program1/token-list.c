@@ -1,7 +1,55 @@
 ﻿#include "token-list.h"
 
+#include <dirent.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/*!
+ * @brief Counts of a file counted with others
+ */
+struct FILE_COUNT {
+    char *path;                    /*! path of the file */
+    int numtoken[NUMOFTOKEN + 1];  /*! counts of the tokens */
+    int result;                    /*! 0 on success and -1 on failure */
+};
+
+/*!
+ * @brief Files shared by the threads counting them
+ */
+struct COUNT_WORK {
+    struct FILE_COUNT *files; /*! files to count */
+    int nfiles;               /*! number of the files */
+    int next;                 /*! index of the file to be counted next */
+    pthread_mutex_t lock;     /*! lock of next */
+    char *cache_dir;          /*! directory of the token cache, or NULL */
+    int quiet;                /*! 1 if the scan errors are not reported */
+    int approx;               /*! number of the names kept by approximate counting, or 0 to count exactly */
+};
+
+/*!
+ * @brief A thread counting files, with counts of its own to be reduced at the end
+ */
+struct COUNT_WORKER {
+    struct COUNT_WORK *work;      /*! files shared */
+    int numtoken[NUMOFTOKEN + 1]; /*! counts of the tokens in the files counted by the thread */
+    struct ID_TABLE idtab;        /*! counts of the names in the files counted by the thread */
+    struct APPROX_TABLE approx;   /*! approximate counts of the names, if work->approx is not 0 */
+    int result;                   /*! 0 on success and -1 on failure */
+};
+
+static int count_paths(char **paths, int npaths, int nthreads, char *cache_dir, int speedup, int approx);
+static int collect_files(char *path, struct FILE_COUNT **files, int *nfiles, int *capacity);
+static int add_file(char *path, struct FILE_COUNT **files, int *nfiles, int *capacity);
+static int compare_names(const void *a, const void *b);
+static double count_files(struct FILE_COUNT *files, int nfiles, int nthreads, char *cache_dir, int quiet,
+                          int approx, int numtoken[], struct ID_TABLE *idtab, struct APPROX_TABLE *approx_tab);
+static void *count_worker(void *arg);
+static int count_file(struct FILE_COUNT *file, struct COUNT_WORKER *worker);
+static void print_counts(int numtoken[], struct ID_TABLE *idtab, struct APPROX_TABLE *approx_tab);
+static void release_counts(struct ID_TABLE *idtab, struct APPROX_TABLE *approx_tab);
 
 /*! list of keywords */
 struct KEY key[KEYWORDSIZE] = {
@@ -50,38 +98,84 @@ char *tokenstr[NUMOFTOKEN + 1] = {
 
 /*!
  * @brief main function
+ * @details Usage: token-list [-j threads] [--token-cache | --no-token-cache] [--dfa] [--speedup] [--approx[=K]] file...
+ * The file "-" is the standard input, which is scanned as it is read.
+ * --token-cache keeps the tokens of the file in the token cache in token_cache_dir(), which
+ * --no-token-cache turns off again.
+ * --dfa scans with the DFA generated by lexgen instead of the hand-written scanner.
+ * --approx counts the names in fixed memory, and outputs the K (APPROX_TOPK by default) most
+ * frequent names with the bounds of their counts instead of the count of every name.
+ * Given several files or a directory, whose .mpl files are counted, the files are counted by
+ * the threads, and the counts of each file and their total are output. --speedup measures the
+ * time of counting them by a thread and by the threads.
  * @param[in] nc The number of arguments
- * @param[in] np File name to read
+ * @param[in] np Options and file names to read
  * @return int Returns 0 on success and 1 on failure.
  */
 int main(int nc, char *np[]) {
-    int token, index;
+    int token, index, argi, nthreads = 1, speedup = 0, approx = 0;
+    char *cache_dir = NULL;
+    struct APPROX_TABLE approx_tab;
+    struct stat st;
 
-    if (nc < 2) {
+    for (argi = 1; argi < nc - 1 && np[argi][0] == '-' && np[argi][1] != '\0'; argi++) {
+        if (strcmp(np[argi], "-j") == 0 && argi + 1 < nc - 1) {
+            /* tokenize the file, or count the files, by threads */
+            nthreads = atoi(np[++argi]);
+        } else if (strcmp(np[argi], "--token-cache") == 0) {
+            cache_dir = token_cache_dir();
+        } else if (strcmp(np[argi], "--no-token-cache") == 0) {
+            cache_dir = NULL;
+        } else if (strcmp(np[argi], "--dfa") == 0) {
+            scan_use_dfa = 1;
+        } else if (strcmp(np[argi], "--speedup") == 0) {
+            speedup = 1;
+        } else if (strcmp(np[argi], "--approx") == 0) {
+            approx = APPROX_TOPK;
+        } else if (strncmp(np[argi], "--approx=", 9) == 0 && atoi(np[argi] + 9) > 0) {
+            approx = atoi(np[argi] + 9);
+        } else {
+            error("function main()");
+            fprintf(stderr, "Unknown option %s.\n", np[argi]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argi >= nc) {
         error("function main()");
         fprintf(stderr, "File name id not given.\n");
         return EXIT_FAILURE;
     }
-    if (init_scan(np[1]) < 0) {
-        fprintf(stderr, "File %s can not open.\n", np[1]);
+    if (nc - argi > 1 || (stat(np[argi], &st) == 0 && S_ISDIR(st.st_mode))) {
+        return (count_paths(np + argi, nc - argi, nthreads, cache_dir, speedup, approx) == 0) ? 0 : EXIT_FAILURE;
+    }
+    if (init_scan_tokens(np[argi], nthreads, cache_dir) < 0) {
+        fprintf(stderr, "File %s can not open.\n", np[argi]);
         return EXIT_FAILURE;
     }
 
     memset(numtoken, 0, sizeof(numtoken));
     init_idtab();
+    if (approx > 0 && approx_init(&approx_tab, approx) == -1) {
+        end_scan();
+        return EXIT_FAILURE;
+    }
 
     while ((token = scan()) >= 0) {
         /* Count the tokens */
         numtoken[token]++;
         /* Count by name */
         if (token == TNAME) {
-            id_countup(string_attr);
+            if (approx > 0) {
+                approx_countup(&approx_tab, token_span.ptr, token_span.len);
+            } else {
+                id_countup(token_span.ptr, token_span.len);
+            }
         }
     }
 
     if (end_scan() < 0) {
         error("function main()");
-        fprintf(stderr, "File %s can not close.\n", np[1]);
+        fprintf(stderr, "File %s can not close.\n", np[argi]);
         return EXIT_FAILURE;
     }
     /* Output the results of the count. */
@@ -90,14 +184,379 @@ int main(int nc, char *np[]) {
             fprintf(stdout, "%10s: %5d\n", tokenstr[index], numtoken[index]);
         }
         if (index == TNAME) {
-            print_idtab();
+            if (approx > 0) {
+                approx_print(&approx_tab);
+            } else {
+                print_idtab();
+            }
         }
     }
     release_idtab();
+    if (approx > 0) {
+        approx_release(&approx_tab);
+    }
+
+    return 0;
+}
+
+/*!
+ * @brief Count the tokens of files by threads, and output the counts of each file and the total
+ * @param[in] paths Files, or directories whose .mpl files are counted
+ * @param[in] npaths The number of paths
+ * @param[in] nthreads The number of threads
+ * @param[in] cache_dir Directory of the token cache, or NULL not to use the cache
+ * @param[in] speedup 1 to measure the time of counting by a thread and by the threads
+ * @param[in] approx The number of the names kept by approximate counting, or 0 to count exactly
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int count_paths(char **paths, int npaths, int nthreads, char *cache_dir, int speedup, int approx) {
+    struct FILE_COUNT *files = NULL;
+    struct ID_TABLE idtab;
+    struct APPROX_TABLE approx_tab;
+    int total[NUMOFTOKEN + 1];
+    int nfiles = 0, capacity = 0, i, ret = 0;
+    double serial, parallel;
+
+    for (i = 0; i < npaths; i++) {
+        if (collect_files(paths[i], &files, &nfiles, &capacity) == -1) {
+            ret = -1;
+        }
+    }
+    if (count_files(files, nfiles, nthreads, cache_dir, 0, approx, total, &idtab, &approx_tab) < 0) {
+        ret = -1;
+    }
+    for (i = 0; i < nfiles; i++) {
+        if (files[i].result == 0) {
+            fprintf(stdout, "%s:\n", files[i].path);
+            print_counts(files[i].numtoken, NULL, NULL);
+        } else {
+            ret = -1;
+        }
+    }
+    fprintf(stdout, "total (%d files):\n", nfiles);
+    print_counts(total, &idtab, (approx > 0) ? &approx_tab : NULL);
+    release_counts(&idtab, (approx > 0) ? &approx_tab : NULL);
+
+    if (speedup) {
+        /* both are measured after the run above, which has warmed up the caches */
+        serial = count_files(files, nfiles, 1, cache_dir, 1, approx, total, &idtab, &approx_tab);
+        release_counts(&idtab, (approx > 0) ? &approx_tab : NULL);
+        parallel = count_files(files, nfiles, nthreads, cache_dir, 1, approx, total, &idtab, &approx_tab);
+        release_counts(&idtab, (approx > 0) ? &approx_tab : NULL);
+        if (serial >= 0 && parallel > 0) {
+            fprintf(stderr, "speedup: %.2fx (1 thread %.3f s, %d threads %.3f s)\n", serial / parallel, serial,
+                    nthreads, parallel);
+        }
+    }
+
+    for (i = 0; i < nfiles; i++) {
+        free(files[i].path);
+    }
+    free(files);
+    return ret;
+}
+
+/*!
+ * @brief Add a file, or the .mpl files in a directory and its subdirectories in the order of their names
+ * @param[in] path File or directory
+ * @param[in,out] files Files
+ * @param[in,out] nfiles The number of the files
+ * @param[in,out] capacity Allocated length of files
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int collect_files(char *path, struct FILE_COUNT **files, int *nfiles, int *capacity) {
+    struct stat st;
+    struct dirent *entry;
+    DIR *dir;
+    char **names = NULL, **p, *name;
+    int nnames = 0, size = 0, i, len, ret = 0;
+
+    if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode)) {
+        /* a file named explicitly is counted whatever its name is */
+        return add_file(path, files, nfiles, capacity);
+    }
+    if ((dir = opendir(path)) == NULL) {
+        error("function collect_files()");
+        fprintf(stderr, "Directory %s can not open.\n", path);
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL && ret == 0) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (nnames == size) {
+            size = (size > 0) ? size * 2 : 64;
+            if ((p = (char **)realloc(names, sizeof(char *) * size)) == NULL) {
+                error("can not malloc in collect_files");
+                ret = -1;
+                break;
+            }
+            names = p;
+        }
+        if ((name = (char *)malloc(strlen(path) + strlen(entry->d_name) + 2)) == NULL) {
+            error("can not malloc in collect_files");
+            ret = -1;
+            break;
+        }
+        sprintf(name, "%s/%s", path, entry->d_name);
+        names[nnames++] = name;
+    }
+    closedir(dir);
 
+    qsort(names, nnames, sizeof(char *), compare_names);
+    for (i = 0; i < nnames; i++) {
+        len = (int)strlen(names[i]);
+        if (ret == 0 && stat(names[i], &st) == 0 &&
+            (S_ISDIR(st.st_mode) || (len > 4 && strcmp(names[i] + len - 4, ".mpl") == 0))) {
+            ret = collect_files(names[i], files, nfiles, capacity);
+        }
+        free(names[i]);
+    }
+    free(names);
+    return ret;
+}
+
+/*!
+ * @brief Add a file to be counted
+ * @param[in] path File
+ * @param[in,out] files Files
+ * @param[in,out] nfiles The number of the files
+ * @param[in,out] capacity Allocated length of files
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int add_file(char *path, struct FILE_COUNT **files, int *nfiles, int *capacity) {
+    struct FILE_COUNT *p;
+    int size;
+
+    if (*nfiles == *capacity) {
+        size = (*capacity > 0) ? *capacity * 2 : 64;
+        if ((p = (struct FILE_COUNT *)realloc(*files, sizeof(struct FILE_COUNT) * size)) == NULL) {
+            error("can not malloc in add_file");
+            return -1;
+        }
+        *files = p;
+        *capacity = size;
+    }
+    p = &(*files)[*nfiles];
+    if ((p->path = (char *)malloc(strlen(path) + 1)) == NULL) {
+        error("can not malloc in add_file");
+        return -1;
+    }
+    strcpy(p->path, path);
+    memset(p->numtoken, 0, sizeof(p->numtoken));
+    p->result = 0;
+    (*nfiles)++;
     return 0;
 }
 
+/*!
+ * @brief Compare two names for qsort()
+ * @param[in] a Pointer to a name
+ * @param[in] b Pointer to a name
+ * @return int Returns the order of them by strcmp()
+ */
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*!
+ * @brief Count the tokens of files by a pool of threads, each with counts of its own, and sum them up
+ * @param[in,out] files Files, whose counts are set
+ * @param[in] nfiles The number of the files
+ * @param[in] nthreads The number of threads
+ * @param[in] cache_dir Directory of the token cache, or NULL not to use the cache
+ * @param[in] quiet 1 not to report the scan errors
+ * @param[in] approx The number of the names kept by approximate counting, or 0 to count exactly
+ * @param[out] numtoken Total counts of the tokens
+ * @param[out] idtab Total counts of the names, to be released by release_counts()
+ * @param[out] approx_tab Total approximate counts of the names if approx is not 0, to be released by release_counts()
+ * @return double Returns the seconds taken on success and -1 on failure.
+ */
+static double count_files(struct FILE_COUNT *files, int nfiles, int nthreads, char *cache_dir, int quiet,
+                          int approx, int numtoken[], struct ID_TABLE *idtab, struct APPROX_TABLE *approx_tab) {
+    struct COUNT_WORK work;
+    struct COUNT_WORKER *workers;
+    struct timespec begin, end;
+    pthread_t *threads, self = pthread_self();
+    int i, index, ret = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    memset(numtoken, 0, sizeof(int) * (NUMOFTOKEN + 1));
+    idtab_init(idtab);
+    if (approx > 0 && approx_init(approx_tab, approx) == -1) {
+        return -1;
+    }
+    if (nthreads > nfiles) {
+        nthreads = nfiles;
+    }
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    workers = (struct COUNT_WORKER *)malloc(sizeof(struct COUNT_WORKER) * nthreads);
+    threads = (pthread_t *)malloc(sizeof(pthread_t) * nthreads);
+    if (workers == NULL || threads == NULL) {
+        error("can not malloc in count_files");
+        free(workers);
+        free(threads);
+        release_counts(idtab, (approx > 0) ? approx_tab : NULL);
+        return -1;
+    }
+    work.files = files;
+    work.nfiles = nfiles;
+    work.next = 0;
+    work.cache_dir = cache_dir;
+    work.quiet = quiet;
+    work.approx = approx;
+    pthread_mutex_init(&work.lock, NULL);
+
+    for (i = 0; i < nthreads; i++) {
+        workers[i].work = &work;
+        memset(workers[i].numtoken, 0, sizeof(workers[i].numtoken));
+        idtab_init(&workers[i].idtab);
+        workers[i].result = 0;
+        if (approx > 0 && approx_init(&workers[i].approx, approx) == -1) {
+            workers[i].result = -1;
+        }
+    }
+    for (i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[i], NULL, count_worker, &workers[i]) != 0) {
+            /* the other threads take its share */
+            threads[i] = self;
+        }
+    }
+    count_worker(&workers[0]);
+    for (i = 1; i < nthreads; i++) {
+        if (!pthread_equal(threads[i], self)) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    /* reduction */
+    for (i = 0; i < nthreads; i++) {
+        for (index = 0; index < NUMOFTOKEN + 1; index++) {
+            numtoken[index] += workers[i].numtoken[index];
+        }
+        if (workers[i].result == -1 || idtab_merge(idtab, &workers[i].idtab) == -1 ||
+            (approx > 0 && approx_merge(approx_tab, &workers[i].approx) == -1)) {
+            ret = -1;
+        }
+        release_counts(&workers[i].idtab, (approx > 0) ? &workers[i].approx : NULL);
+    }
+    pthread_mutex_destroy(&work.lock);
+    free(workers);
+    free(threads);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (ret == -1) {
+        return -1;
+    }
+    return (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1e9;
+}
+
+/*!
+ * @brief Count the files not yet taken by the other threads, the start routine of a thread
+ * @param[in] arg Thread
+ * @return void* Returns NULL
+ */
+static void *count_worker(void *arg) {
+    struct COUNT_WORKER *worker = (struct COUNT_WORKER *)arg;
+    struct COUNT_WORK *work = worker->work;
+    int index;
+
+    if (work->approx > 0 && worker->approx.sketch == NULL) {
+        /* the other threads take its share, and the count fails */
+        return NULL;
+    }
+    while (1) {
+        pthread_mutex_lock(&work->lock);
+        index = work->next;
+        if (index < work->nfiles) {
+            work->next++;
+        }
+        pthread_mutex_unlock(&work->lock);
+        if (index >= work->nfiles) {
+            break;
+        }
+        if (count_file(&work->files[index], worker) == -1) {
+            worker->result = -1;
+        }
+    }
+    return NULL;
+}
+
+/*!
+ * @brief Count the tokens of a file with a scanner of its own
+ * @param[in,out] file File, whose counts are set
+ * @param[in,out] worker Thread, to whose counts the file is added
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int count_file(struct FILE_COUNT *file, struct COUNT_WORKER *worker) {
+    struct COUNT_WORK *work = worker->work;
+    struct SCANNER *sc;
+    int token, ret;
+
+    memset(file->numtoken, 0, sizeof(file->numtoken));
+    file->result = 0;
+    if ((sc = scanner_open_tokens(file->path, 1, work->cache_dir)) == NULL) {
+        fprintf(stderr, "File %s can not open.\n", file->path);
+        file->result = -1;
+        return -1;
+    }
+    sc->quiet = work->quiet;
+    while ((token = scanner_next(sc)) >= 0) {
+        file->numtoken[token]++;
+        worker->numtoken[token]++;
+        if (token == TNAME) {
+            if (work->approx > 0) {
+                ret = approx_countup(&worker->approx, sc->span.ptr, sc->span.len);
+            } else {
+                ret = idtab_countup(&worker->idtab, sc->span.ptr, sc->span.len);
+            }
+            if (ret == -1) {
+                file->result = -1;
+            }
+        }
+    }
+    if (scanner_close(sc) == -1) {
+        fprintf(stderr, "File %s can not close.\n", file->path);
+        file->result = -1;
+    }
+    return file->result;
+}
+
+/*!
+ * @brief Output counts of the tokens, with the names after NAME
+ * @param[in] numtoken Counts of the tokens
+ * @param[in] idtab Counts of the names, which are output in the order of the names, or NULL
+ * @param[in] approx_tab Approximate counts of the names, which are output instead of idtab, or NULL
+ */
+static void print_counts(int numtoken[], struct ID_TABLE *idtab, struct APPROX_TABLE *approx_tab) {
+    int index;
+
+    for (index = 0; index < NUMOFTOKEN + 1; index++) {
+        if (numtoken[index] > 0) {
+            fprintf(stdout, "%10s: %5d\n", tokenstr[index], numtoken[index]);
+        }
+        if (index == TNAME && approx_tab != NULL) {
+            approx_print(approx_tab);
+        } else if (index == TNAME && idtab != NULL) {
+            idtab_print_sorted(idtab);
+        }
+    }
+}
+
+/*!
+ * @brief Release counts of the names
+ * @param[in] idtab Counts of the names
+ * @param[in] approx_tab Approximate counts of the names, or NULL
+ */
+static void release_counts(struct ID_TABLE *idtab, struct APPROX_TABLE *approx_tab) {
+    idtab_release(idtab);
+    if (approx_tab != NULL) {
+        approx_release(approx_tab);
+    }
+}
+
 /*!
  * @brief display an error message
  * @param[in] mes Error message
@@ -6,7 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-/*! maximum length of a string */
+/*! initial size of the buffer of a scanned string, which grows as needed */
 #define MAXSTRSIZE 1024
 
 /*! @name definition of token code */
@@ -134,15 +134,201 @@ extern void error(char *mes);
 /* scan.c */
 extern FILE *fp;
 extern int num_attr;
-extern char string_attr[MAXSTRSIZE];
+/*!
+ * @brief View of the last scanned name, number or string in the source
+ */
+extern struct TOKEN_SPAN {
+    const char *ptr; /*! head of the token (a string excludes the enclosing quotes) */
+    int len;         /*! length of the token */
+    long offset;     /*! offset of the token from the head of the source */
+    int escaped;     /*! 1 if the string contains '' */
+} token_span;
+extern int scan_use_dfa;
+extern char *get_string_attr(void);
+extern const char *get_string_value(int *len);
+
+/*!
+ * @brief A scanned token, whose name, number or string is taken from the source
+ */
+struct TOKEN {
+    int code;     /*! token code */
+    int linenum;  /*! line number of the token */
+    int num_attr; /*! value of a number */
+    int escaped;  /*! 1 if the string contains '' */
+    long offset;  /*! offset of the head of the token (a string includes the enclosing quotes) */
+    int len;      /*! length of the token in the source */
+};
+
+/*!
+ * @brief Tokens of a source, in the order scan() returns them
+ */
+struct TOKEN_ARRAY {
+    struct TOKEN *tokens; /*! array of the tokens, NULL if empty */
+    int ntokens;          /*! number of the tokens */
+    int capacity;         /*! allocated length of tokens, 0 if they are mapped from the token cache */
+    long end_offset;      /*! offset just after the last token, from which scanning gives -1 */
+    int end_linenum;      /*! line number at end_offset */
+    const char *text;     /*! texts of the names, numbers and strings in order, NULL to take them from the source */
+};
+
+/*!
+ * @brief An edit of a source, which replaces removed_len bytes at offset with inserted_len bytes
+ */
+struct TEXT_EDIT {
+    long offset;       /*! offset of the edit */
+    long removed_len;  /*! length of the text removed */
+    long inserted_len; /*! length of the text inserted, which is at offset in the edited source */
+};
+
+/*!
+ * @brief Tokens replaced by re-lexing: [begin, old_end) of the old tokens became [begin, new_end)
+ */
+struct TOKEN_RANGE {
+    int begin;   /*! index of the first token replaced */
+    int old_end; /*! index just after the last old token replaced */
+    int new_end; /*! index just after the last new token */
+};
+
+/*!
+ * @brief Context of a scanner, so that several files can be scanned at the same time
+ */
+struct SCANNER {
+    FILE *fp;                         /*! file pointer of the loaded file */
+    const char *src_head;             /*! head of the source loaded into memory, NULL when streaming */
+    const char *src_pos;              /*! position of the character to be loaded next */
+    const char *src_end;              /*! end of the source loaded into memory */
+    int src_is_mapped;                /*! 1 if src_head is mapped by mmap(), 0 if it is allocated by malloc() */
+    int current_char;                 /*! the letter just loaded */
+    int next_char;                    /*! look-ahead character */
+    long current_offset;              /*! offset of current_char from the head of the source */
+    int linenum;                      /*! line number of the character just loaded */
+    int token_linenum;                /*! line number of the last token scanned */
+    int num_attr;                     /*! scanned unsigned integer */
+    char *string_attr;                /*! text of span copied by scanner_string_attr(), grown as needed */
+    int string_attr_len;              /*! length of string_attr */
+    int string_attr_size;             /*! allocated size of string_attr, 0 if not allocated */
+    int string_attr_valid;            /*! 1 if string_attr holds the text of span, 0 until it is copied */
+    struct TOKEN_SPAN span;           /*! view of the last scanned name, number or string */
+    char *string_value;               /*! unescaped value of the last scanned string, grown as needed */
+    int string_value_len;             /*! length of string_value, -1 if it is not built yet */
+    int string_value_size;            /*! allocated size of string_value, 0 if not allocated */
+    long token_offset;                /*! offset of the head of the last token scanned */
+    int quiet;                        /*! 1 if the scan errors are not reported */
+    int dfa;                          /*! 1 if scanner_next() scans with dfa_scanner_next() */
+    struct TOKEN_ARRAY replay;        /*! tokens returned instead of scanning, set by init_scan_tokens() */
+    int replay_pos;                   /*! index of the token in replay to be returned next */
+    long replay_text;                 /*! offset in replay.text of the text of the next token */
+    void *cache_map;                  /*! token cache mapped by mmap(), NULL if not mapped */
+    long cache_map_size;              /*! size of cache_map */
+    unsigned char *stream_buf;        /*! block of the input read by fread() when streaming */
+    int stream_pos;                   /*! position in stream_buf of the character to be loaded next */
+    int stream_len;                   /*! number of the bytes in stream_buf */
+};
+extern struct SCANNER *scanner_open(char *filename);
+extern struct SCANNER *scanner_open_tokens(char *filename, int nthreads, char *cache_dir);
+extern int scanner_next(struct SCANNER *sc);
+extern int scanner_line(struct SCANNER *sc);
+extern void scanner_error(struct SCANNER *sc, char *mes, const char *format, ...);
+extern const char *scanner_string_value(struct SCANNER *sc, int *len);
+extern char *scanner_string_attr(struct SCANNER *sc);
+extern int scanner_close(struct SCANNER *sc);
+extern int scanner_tokenize(struct SCANNER *sc, int nthreads, struct TOKEN_ARRAY *ta);
+extern void token_array_release(struct TOKEN_ARRAY *ta);
+extern int token_array_relex(struct TOKEN_ARRAY *ta, const char *src, long size, const struct TEXT_EDIT *edit,
+                             struct TOKEN_RANGE *changed);
 extern int init_scan(char *filename);
+extern int init_scan_tokens(char *filename, int nthreads, char *cache_dir);
+extern char *token_cache_dir(void);
 extern int scan(void);
 extern int get_linenum(void);
 extern int end_scan(void);
 
+/* dfa-scan.c */
+extern int dfa_scanner_next(struct SCANNER *sc);
+
 /* id-list.c */
+/*!
+ * @brief A registered name and its count
+ */
+struct ID {
+    char *name;         /*! name, allocated in the arena of the table */
+    int len;            /*! length of the name */
+    unsigned long hash; /*! hash of the name */
+    int count;          /*! number of the appearances */
+};
+
+/*!
+ * @brief Block of the arena of the names, followed by the names
+ */
+struct NAME_BLOCK {
+    struct NAME_BLOCK *next; /*! block allocated before */
+    size_t used;             /*! bytes used by the names */
+    size_t size;             /*! bytes for the names */
+};
+
+/*!
+ * @brief Table of the names and their counts, by open addressing with linear probing
+ */
+struct ID_TABLE {
+    struct ID *ids;           /*! names in the order of registration */
+    int nids;                 /*! number of the names */
+    int capacity;             /*! allocated length of ids */
+    int *slots;               /*! index in ids plus 1 for each slot, 0 if the slot is empty */
+    int nslots;               /*! number of the slots, a power of 2 */
+    struct NAME_BLOCK *names; /*! arena of the names, the latest block first */
+};
+
 extern void init_idtab();
-extern void id_countup(char *np);
+extern struct ID *search_idtab(const char *np, int len);
+extern void id_countup(const char *np, int len);
 extern void print_idtab();
 extern void release_idtab();
+extern void idtab_init(struct ID_TABLE *tab);
+extern struct ID *idtab_search(struct ID_TABLE *tab, const char *np, int len);
+extern int idtab_countup(struct ID_TABLE *tab, const char *np, int len);
+extern int idtab_add(struct ID_TABLE *tab, const char *np, int len, int count);
+extern int idtab_merge(struct ID_TABLE *tab, struct ID_TABLE *from);
+extern void idtab_print(struct ID_TABLE *tab);
+extern void idtab_print_sorted(struct ID_TABLE *tab);
+extern void idtab_release(struct ID_TABLE *tab);
+
+/* approx-list.c */
+#define SKETCH_DEPTH 4    /* rows of the Count-Min sketch */
+#define SKETCH_WIDTH 4096 /* counters in a row of the Count-Min sketch, a power of 2 */
+#define APPROX_TOPK 10    /* number of the most frequent names reported by default */
+
+/*!
+ * @brief A name kept by the Space-Saving summary
+ */
+struct TOP_ID {
+    char *name;         /*! name */
+    int len;            /*! length of the name */
+    int size;           /*! allocated size of name */
+    unsigned long hash; /*! hash of the name */
+    long count;         /*! count, never less than the real count */
+    long error;         /*! how much count may exceed the real count */
+    int slot;           /*! slot pointing to it */
+};
+
+/*!
+ * @brief Approximate counts of the names in fixed memory,
+ * by a Count-Min sketch and a Space-Saving summary of the most frequent names
+ */
+struct APPROX_TABLE {
+    long *sketch;        /*! SKETCH_DEPTH rows of SKETCH_WIDTH counters */
+    long total;          /*! number of the names counted */
+    int k;               /*! number of the names kept */
+    struct TOP_ID *heap; /*! names kept, the least frequent first as a min-heap */
+    int nheap;           /*! number of the names kept so far */
+    int *slots;          /*! index in heap plus 1 for each slot, 0 if the slot is empty */
+    int nslots;          /*! number of the slots, a power of 2 */
+};
+
+extern int approx_init(struct APPROX_TABLE *tab, int k);
+extern int approx_countup(struct APPROX_TABLE *tab, const char *np, int len);
+extern int approx_merge(struct APPROX_TABLE *tab, struct APPROX_TABLE *from);
+extern long approx_estimate(struct APPROX_TABLE *tab, const char *np, int len);
+extern void approx_bounds(struct APPROX_TABLE *tab, struct TOP_ID *p, long *lower, long *upper);
+extern void approx_print(struct APPROX_TABLE *tab);
+extern void approx_release(struct APPROX_TABLE *tab);
 #endif
@@ -9,7 +9,7 @@
 #define ERROR -1
 #define NORMAL 0
 
-/*! maximum length of a string */
+/*! initial size of the buffer of a scanned string, which grows as needed */
 #define MAXSTRSIZE 1024
 
 /*! @name definition of token code */
@@ -137,8 +137,108 @@ extern int error(char *mes);
 /* scan.c */
 extern FILE *fp;
 extern int num_attr;
-extern char string_attr[MAXSTRSIZE];
+/*!
+ * @brief View of the last scanned name, number or string in the source
+ */
+extern struct TOKEN_SPAN {
+    const char *ptr; /*! head of the token (a string excludes the enclosing quotes) */
+    int len;         /*! length of the token */
+    long offset;     /*! offset of the token from the head of the source */
+    int escaped;     /*! 1 if the string contains '' */
+} token_span;
+extern char *get_string_attr(void);
+extern const char *get_string_value(int *len);
+
+/*!
+ * @brief A scanned token, whose name, number or string is taken from the source
+ */
+struct TOKEN {
+    int code;     /*! token code */
+    int linenum;  /*! line number of the token */
+    int num_attr; /*! value of a number */
+    int escaped;  /*! 1 if the string contains '' */
+    long offset;  /*! offset of the head of the token (a string includes the enclosing quotes) */
+    int len;      /*! length of the token in the source */
+};
+
+/*!
+ * @brief Tokens of a source, in the order scan() returns them
+ */
+struct TOKEN_ARRAY {
+    struct TOKEN *tokens; /*! array of the tokens, NULL if empty */
+    int ntokens;          /*! number of the tokens */
+    int capacity;         /*! allocated length of tokens, 0 if they are mapped from the token cache */
+    long end_offset;      /*! offset just after the last token, from which scanning gives -1 */
+    int end_linenum;      /*! line number at end_offset */
+    const char *text;     /*! texts of the names, numbers and strings in order, NULL to take them from the source */
+};
+
+/*!
+ * @brief An edit of a source, which replaces removed_len bytes at offset with inserted_len bytes
+ */
+struct TEXT_EDIT {
+    long offset;       /*! offset of the edit */
+    long removed_len;  /*! length of the text removed */
+    long inserted_len; /*! length of the text inserted, which is at offset in the edited source */
+};
+
+/*!
+ * @brief Tokens replaced by re-lexing: [begin, old_end) of the old tokens became [begin, new_end)
+ */
+struct TOKEN_RANGE {
+    int begin;   /*! index of the first token replaced */
+    int old_end; /*! index just after the last old token replaced */
+    int new_end; /*! index just after the last new token */
+};
+
+/*!
+ * @brief Context of a scanner, so that several files can be scanned at the same time
+ */
+struct SCANNER {
+    FILE *fp;                         /*! file pointer of the loaded file */
+    const char *src_head;             /*! head of the source loaded into memory, NULL when streaming */
+    const char *src_pos;              /*! position of the character to be loaded next */
+    const char *src_end;              /*! end of the source loaded into memory */
+    int src_is_mapped;                /*! 1 if src_head is mapped by mmap(), 0 if it is allocated by malloc() */
+    int current_char;                 /*! the letter just loaded */
+    int next_char;                    /*! look-ahead character */
+    long current_offset;              /*! offset of current_char from the head of the source */
+    int linenum;                      /*! line number of the character just loaded */
+    int token_linenum;                /*! line number of the last token scanned */
+    int num_attr;                     /*! scanned unsigned integer */
+    char *string_attr;                /*! text of span copied by scanner_string_attr(), grown as needed */
+    int string_attr_len;              /*! length of string_attr */
+    int string_attr_size;             /*! allocated size of string_attr, 0 if not allocated */
+    int string_attr_valid;            /*! 1 if string_attr holds the text of span, 0 until it is copied */
+    struct TOKEN_SPAN span;           /*! view of the last scanned name, number or string */
+    char *string_value;               /*! unescaped value of the last scanned string, grown as needed */
+    int string_value_len;             /*! length of string_value, -1 if it is not built yet */
+    int string_value_size;            /*! allocated size of string_value, 0 if not allocated */
+    long token_offset;                /*! offset of the head of the last token scanned */
+    int quiet;                        /*! 1 if the scan errors are not reported */
+    struct TOKEN_ARRAY replay;        /*! tokens returned instead of scanning, set by init_scan_tokens() */
+    int replay_pos;                   /*! index of the token in replay to be returned next */
+    long replay_text;                 /*! offset in replay.text of the text of the next token */
+    void *cache_map;                  /*! token cache mapped by mmap(), NULL if not mapped */
+    long cache_map_size;              /*! size of cache_map */
+    unsigned char *stream_buf;        /*! block of the input read by fread() when streaming */
+    int stream_pos;                   /*! position in stream_buf of the character to be loaded next */
+    int stream_len;                   /*! number of the bytes in stream_buf */
+};
+extern struct SCANNER *scanner_open(char *filename);
+extern struct SCANNER *scanner_open_tokens(char *filename, int nthreads, char *cache_dir);
+extern int scanner_next(struct SCANNER *sc);
+extern int scanner_line(struct SCANNER *sc);
+extern const char *scanner_string_value(struct SCANNER *sc, int *len);
+extern char *scanner_string_attr(struct SCANNER *sc);
+extern int scanner_close(struct SCANNER *sc);
+extern int scanner_tokenize(struct SCANNER *sc, int nthreads, struct TOKEN_ARRAY *ta);
+extern void token_array_release(struct TOKEN_ARRAY *ta);
+extern int token_array_relex(struct TOKEN_ARRAY *ta, const char *src, long size, const struct TEXT_EDIT *edit,
+                             struct TOKEN_RANGE *changed);
 extern int init_scan(char *filename);
+extern int init_scan_tokens(char *filename, int nthreads, char *cache_dir);
+extern char *token_cache_dir(void);
 extern int scan(void);
 extern int get_linenum(void);
 extern int end_scan(void);
@@ -67,7 +67,7 @@ int parse_program(void) {
     if (token != TNAME) {
         return error("Program name is not found.");
     }
-    fprintf(stdout, "%s", string_attr);
+    fprintf(stdout, "%s", get_string_attr());
     token = scan();
 
     if (token != TSEMI) {
@@ -174,7 +174,7 @@ static int parse_variable_names(void) {
     if (token != TNAME) {
         return error("Name is not found.");
     }
-    fprintf(stdout, "%s", string_attr);
+    fprintf(stdout, "%s", get_string_attr());
     token = scan();
 
     while (token == TCOMMA) {
@@ -184,7 +184,7 @@ static int parse_variable_names(void) {
         if (token != TNAME) {
             return error("Name is not found.");
         }
-        fprintf(stdout, "%s", string_attr);
+        fprintf(stdout, "%s", get_string_attr());
         token = scan();
     }
     return NORMAL;
@@ -243,7 +243,7 @@ static int parse_array_type(void) {
     if (token != TNUMBER) {
         return error("Number is not found.");
     }
-    fprintf(stdout, "%s", string_attr);
+    fprintf(stdout, "%s", get_string_attr());
     token = scan();
 
     if (token != TRSQPAREN) {
@@ -323,7 +323,7 @@ static int parse_procedure_name(void) {
     if (token != TNAME) {
         return error("Procedure name is not found.");
     }
-    fprintf(stdout, "%s", string_attr);
+    fprintf(stdout, "%s", get_string_attr());
     token = scan();
 
     return NORMAL;
@@ -696,7 +696,7 @@ static int parse_variable(void) {
         return error("Name is not found.");
     }
 
-    fprintf(stdout, "%s", string_attr);
+    fprintf(stdout, "%s", get_string_attr());
     token = scan();
 
     if (token == TLSQPAREN) {
@@ -797,8 +797,8 @@ static int parse_output_statement(void) {
  * @return int Returns 0 on success and 1 on failure.
  */
 static int parse_output_format(void) {
-    if (token == TSTRING && strlen(string_attr) > 1) {
-        fprintf(stdout, "'%s'", string_attr);
+    if (token == TSTRING && strlen(get_string_attr()) > 1) {
+        fprintf(stdout, "'%s'", get_string_attr());
         token = scan();
         return NORMAL;
     }
@@ -838,7 +838,7 @@ static int parse_output_format(void) {
                 if (token != TNUMBER) {
                     return error("Number is not found.");
                 }
-                fprintf(stdout, "%s", string_attr);
+                fprintf(stdout, "%s", get_string_attr());
                 token = scan();
             }
             break;
@@ -1020,7 +1020,7 @@ static int parse_factor(void) {
 static int parse_constant(void) {
     switch (token) {
         case TNUMBER:
-            fprintf(stdout, "%s", string_attr);
+            fprintf(stdout, "%s", get_string_attr());
             break;
         case TFALSE:
             /* FALLTHROUGH */
@@ -1028,10 +1028,10 @@ static int parse_constant(void) {
             fprintf(stdout, "%s", tokenstr[token]);
             break;
         case TSTRING:
-            if (strlen(string_attr) != 1) {
+            if (strlen(get_string_attr()) != 1) {
                 return error("Constant string length != 1");
             }
-            fprintf(stdout, "'%s'", string_attr);
+            fprintf(stdout, "'%s'", get_string_attr());
             break;
         default:
             return error("Constant is not found.");
@@ -1,7 +1,21 @@
 #include <ctype.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_USE_SSE2
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SCAN_USE_AVX2
+#endif
 
 #include "mppl_compiler.h"
 
@@ -9,131 +23,1144 @@
 FILE *fp;
 /*! Scanned unsigned integer */
 int num_attr = 0;
-/*! Scanned string  */
-char string_attr[MAXSTRSIZE];
+/*! View of the last scanned name, number or string in the source */
+struct TOKEN_SPAN token_span;
+
+/*! Scanner used by init_scan(), scan(), get_linenum() and end_scan() */
+static struct SCANNER default_scanner;
+
+/*! size of a block read by fread() when the source is streamed */
+#define STREAM_BUFSIZE (64 * 1024)
+
+/*! @name parallel tokenization */
+/* @{ */
+/*! init_scan_tokens() gives each thread at least this many bytes */
+#define PARALLEL_MIN_CHUNK (1L << 20)
+/*!
+ * @brief A part of the source tokenized by a thread, assuming that no token or comment crosses its head
+ */
+struct CHUNK {
+    struct SCANNER sc;     /*! scanner of the thread, sharing the source */
+    long begin;            /*! offset of the head of the chunk */
+    long end;              /*! offset of the end of the chunk, tokens beginning here or later are left */
+    struct TOKEN_ARRAY ta; /*! tokens beginning in the chunk, with line numbers counted from 1 at begin */
+    int ended;             /*! 1 if scanning returned -1 in the chunk */
+    int result;            /*! 0 on success and -1 on failure of memory allocation */
+};
+/* @} */
+
+/*! @name token cache */
+/* @{ */
+/*! magic number of a token cache file, changed whenever the format changes */
+#define TOKEN_CACHE_MAGIC "MPPLTOK2"
+/*! version of the scanner, increased whenever it changes the tokens, so that the caches written before are stale */
+#define TOKEN_CACHE_VERSION 1
+/*!
+ * @brief Header of a token cache file, followed by the tokens and then their texts
+ */
+struct TOKEN_CACHE_HEADER {
+    char magic[8];         /*! TOKEN_CACHE_MAGIC */
+    long version;          /*! TOKEN_CACHE_VERSION of the scanner which wrote it */
+    unsigned long hash[2]; /*! hashes of the source */
+    long source_size;      /*! size of the source */
+    long numoftoken;       /*! NUMOFTOKEN of the scanner which wrote it */
+    long token_size;       /*! sizeof(struct TOKEN) of the scanner which wrote it */
+    long ntokens;          /*! number of the tokens */
+    long end_offset;       /*! end_offset of the tokens */
+    long end_linenum;      /*! end_linenum of the tokens */
+    long text_size;        /*! total length of the texts */
+};
+/* @} */
+
+/*! @name perfect hash of keywords */
+/* @{ */
+/*! number of bits of the keyword hash */
+#define KEYWORD_HASH_BITS 6
+/*! number of slots of the keyword hash table */
+#define KEYWORD_HASH_SIZE (1 << KEYWORD_HASH_BITS)
+/*! length of the longest keyword */
+#define KEYWORD_MAXLEN 9
+/*! Seed of the keyword hash. It gives no collision for the keywords in key[]. */
+static unsigned long keyword_hash_seed = 736;
+/*! Index of key[] for each hash value, -1 if empty */
+static int keyword_table[KEYWORD_HASH_SIZE];
+/*! 1 if keyword_table is built */
+static int keyword_table_ready = 0;
+/*! Build keyword_table only once even if scanners are opened by several threads */
+static pthread_once_t keyword_table_once = PTHREAD_ONCE_INIT;
+/* @} */
+
+/*! @name search of the next interesting byte in the source */
+/* @{ */
+/*! find the given byte or an end of line (in comments) */
+#define FIND_NEWLINE 0
+/*! find the given byte or a non-graphic character (in strings) */
+#define FIND_NONGRAPHIC 1
+/*! find a byte other than space and tab (in separators) */
+#define FIND_NONBLANK 2
+/*! find_special_scalar() or a vectorized one chosen for the CPU */
+static const char *(*find_special)(const char *p, const char *end, int kind, int stop);
+/*! Choose find_special only once */
+static pthread_once_t find_special_once = PTHREAD_ONCE_INIT;
+/* @} */
+
+static int scanner_init(struct SCANNER *sc, char *filename);
+static int scanner_release(struct SCANNER *sc);
+static int scanner_prepare_tokens(struct SCANNER *sc, int nthreads, char *cache_dir);
+static int load_source(struct SCANNER *sc);
+static void unload_source(struct SCANNER *sc);
+static int refill_stream(struct SCANNER *sc);
+static void look_ahead(struct SCANNER *sc);
+static void seek_source(struct SCANNER *sc, const char *p);
+static void skip_newline(struct SCANNER *sc);
+static const char *find_special_scalar(const char *p, const char *end, int kind, int stop);
+#ifdef SCAN_USE_SSE2
+static const char *find_special_sse2(const char *p, const char *end, int kind, int stop);
+#endif
+#ifdef SCAN_USE_AVX2
+static const char *find_special_avx2(const char *p, const char *end, int kind, int stop);
+#endif
+static void init_find_special_once(void);
+static int _isblank(int c);
+int get_linenum(void);
+static int scan_alnum(struct SCANNER *sc);
+static int scan_digit(struct SCANNER *sc);
+static int scan_string(struct SCANNER *sc);
+static int scan_comment(struct SCANNER *sc);
+static int scan_symbol(struct SCANNER *sc);
+static int get_keyword_token_code(const char *token, int len);
+static unsigned long keyword_hash(const char *token, int len, unsigned long seed);
+static int init_keyword_table(void);
+static void init_keyword_table_once(void);
+static int string_attr_push_back(struct SCANNER *sc, const char c);
+static int string_attr_reserve(struct SCANNER *sc, int len);
+static void span_begin(struct SCANNER *sc);
+static int span_end(struct SCANNER *sc);
+static void sync_default_scanner(void);
+static void scanner_detach(struct SCANNER *copy, struct SCANNER *sc);
+static void scanner_free_buffers(struct SCANNER *sc);
+static void scanner_error(struct SCANNER *sc, char *mes, const char *format, ...);
+static int token_array_reserve(struct TOKEN_ARRAY *ta, int n);
+static int token_array_push(struct TOKEN_ARRAY *ta, struct SCANNER *sc, int code);
+static int token_array_search(struct TOKEN_ARRAY *ta, long offset, int by_end);
+static void *tokenize_chunk(void *arg);
+static int merge_chunk(struct SCANNER *sc, struct CHUNK *chunk, struct TOKEN_ARRAY *ta);
+static int replay_token(struct SCANNER *sc);
+static int token_text(struct TOKEN *token, long *offset);
+static void source_hash(struct SCANNER *sc, unsigned long hash[2]);
+static int token_cache_path(char *path, char *cache_dir, unsigned long hash[2]);
+static int make_dirs(char *path);
+static int token_cache_load(struct SCANNER *sc, char *cache_dir);
+static int token_cache_store(struct SCANNER *sc, char *cache_dir, struct TOKEN_ARRAY *ta);
+
+/*!
+ * @brief Initialization to begin scanning
+ * @param[in] filename File name to scan, or "-" for the standard input
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int init_scan(char *filename) {
+    if (scanner_init(&default_scanner, filename) == -1) {
+        error("function init_scan()");
+        return -1;
+    }
+    fp = default_scanner.fp;
+    sync_default_scanner();
+    return 0;
+}
+
+/*!
+ * @brief Initialization to begin scanning, taking the tokens from the token cache or tokenizing first
+ * @details The token cache is a file named after the hashes of the source in cache_dir.
+ * If it is missing or stale, the file is tokenized by several threads and the cache is written.
+ * If the cache can not be written, e.g. cache_dir is not writable, scanning goes on without it.
+ * Then scan() returns the tokens, which are the same as init_scan() gives.
+ * Without the cache and threads, or for a file which is not loaded into memory, it is the same
+ * as init_scan().
+ * @param[in] filename File name to scan
+ * @param[in] nthreads The maximum number of threads
+ * @param[in] cache_dir Directory of the token cache, or NULL not to use the cache
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int init_scan_tokens(char *filename, int nthreads, char *cache_dir) {
+    if (init_scan(filename) == -1) {
+        return -1;
+    }
+    if (scanner_prepare_tokens(&default_scanner, nthreads, cache_dir) == -1) {
+        error("function init_scan_tokens()");
+        end_scan();
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief Return the default directory of the token cache
+ * @details It is $MPPL_TOKEN_CACHE_DIR if set, $XDG_CACHE_HOME/mppl-tokens if $XDG_CACHE_HOME is
+ * an absolute path, or ~/.cache/mppl-tokens. The cache is used only when it is asked for, so this
+ * is not called otherwise.
+ * @return char* Returns the directory, or NULL if there is none.
+ */
+char *token_cache_dir(void) {
+    static char dir[FILENAME_MAX];
+    char *env;
+
+    if ((env = getenv("MPPL_TOKEN_CACHE_DIR")) != NULL && env[0] != '\0') {
+        return env;
+    }
+    if ((env = getenv("XDG_CACHE_HOME")) != NULL && env[0] == '/') {
+        if (strlen(env) + strlen("/mppl-tokens") >= sizeof(dir)) {
+            return NULL;
+        }
+        sprintf(dir, "%s/mppl-tokens", env);
+        return dir;
+    }
+    if ((env = getenv("HOME")) == NULL || strlen(env) + strlen("/.cache/mppl-tokens") >= sizeof(dir)) {
+        return NULL;
+    }
+    sprintf(dir, "%s/.cache/mppl-tokens", env);
+    return dir;
+}
+
+/*!
+ * @brief Scan the file and return the token code
+ * @return int Returns token code on success and -1 on failure.
+ */
+int scan(void) {
+    int token_code = scanner_next(&default_scanner);
+    sync_default_scanner();
+    return token_code;
+}
+
+/*!
+ * @brief Return the line number of the last token scanned
+ * @return int Return line number
+ */
+int get_linenum(void) {
+    return default_scanner.token_linenum;
+}
+
+/*!
+ * @brief The process of finishing the scan
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int end_scan(void) {
+    int ret = scanner_release(&default_scanner);
+
+    if (ret == -1) {
+        error("function end_scan");
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief Open a scanner of its own, independent of init_scan()
+ * @param[in] filename File name to scan, or "-" for the standard input
+ * @return struct SCANNER* Returns the scanner on success and NULL on failure.
+ */
+struct SCANNER *scanner_open(char *filename) {
+    struct SCANNER *sc;
+
+    if ((sc = (struct SCANNER *)malloc(sizeof(struct SCANNER))) == NULL) {
+        error("can not malloc in scanner_open");
+        return NULL;
+    }
+    if (scanner_init(sc, filename) == -1) {
+        error("function scanner_open()");
+        free(sc);
+        return NULL;
+    }
+    return sc;
+}
+
+/*!
+ * @brief Open a scanner of its own, taking the tokens from the token cache or tokenizing first
+ * @details It is to scanner_open() what init_scan_tokens() is to init_scan().
+ * @param[in] filename File name to scan, or "-" for the standard input
+ * @param[in] nthreads The maximum number of threads
+ * @param[in] cache_dir Directory of the token cache, or NULL not to use the cache
+ * @return struct SCANNER* Returns the scanner on success and NULL on failure.
+ */
+struct SCANNER *scanner_open_tokens(char *filename, int nthreads, char *cache_dir) {
+    struct SCANNER *sc;
+
+    if ((sc = scanner_open(filename)) == NULL) {
+        return NULL;
+    }
+    if (scanner_prepare_tokens(sc, nthreads, cache_dir) == -1) {
+        error("function scanner_open_tokens()");
+        scanner_close(sc);
+        return NULL;
+    }
+    return sc;
+}
+
+/*!
+ * @brief Scan the next token with a scanner
+ * @details The attributes of the token are left in sc->num_attr and sc->span. Its text is copied
+ * into sc->string_attr only when scanner_string_attr() asks for it.
+ * @param[in] sc Scanner
+ * @return int Returns token code on success and -1 on failure.
+ */
+int scanner_next(struct SCANNER *sc) {
+    int token_code = -1;
+
+    if (sc->replay.tokens != NULL) {
+        if (sc->replay_pos < sc->replay.ntokens) {
+            return replay_token(sc);
+        }
+        /* scanning after the last token gives -1, with the error reported if any */
+        seek_source(sc, sc->src_head + sc->replay.end_offset);
+        sc->linenum = sc->replay.end_linenum;
+        token_array_release(&sc->replay);
+    }
+    while (1) {
+        sc->token_offset = sc->current_offset;
+        if (sc->current_char == EOF) { /* End Of File*/
+            return -1;
+        } else if (sc->current_char == '\r' || sc->current_char == '\n') { /* End of Line */
+            skip_newline(sc);
+        } else if (_isblank(sc->current_char)) { /* Separator (Space or Tab) */
+            if (sc->src_head != NULL) {
+                seek_source(sc, find_special(sc->src_head + sc->current_offset, sc->src_end, FIND_NONBLANK, 0));
+            } else {
+                look_ahead(sc);
+            }
+        } else if (!isprint(sc->current_char)) { /* Not Graphic Character(0x20~0x7e) */
+            scanner_error(sc, "function scan()", "[%c]0x%x is not graphic character.\n", sc->current_char,
+                          sc->current_char);
+            return -1;
+        } else if (isalpha(sc->current_char)) { /* Name or Keyword */
+            token_code = scan_alnum(sc);
+            break;
+        } else if (isdigit(sc->current_char)) { /* Digit */
+            token_code = scan_digit(sc);
+            break;
+        } else if (sc->current_char == '\'') { /* String */
+            token_code = scan_string(sc);
+            break;
+        } else if ((sc->current_char == '/' && sc->next_char == '*') || sc->current_char == '{') { /* Comment */
+            if (scan_comment(sc) == -1) {
+                break;
+            }
+        } else { /* Symbol */
+            token_code = scan_symbol(sc);
+            break;
+        }
+    }
+    sc->token_linenum = sc->linenum;
+    return token_code;
+}
+
+/*!
+ * @brief Return the line number of the last token scanned with a scanner
+ * @param[in] sc Scanner
+ * @return int Return line number
+ */
+int scanner_line(struct SCANNER *sc) {
+    return sc->token_linenum;
+}
+
+/*!
+ * @brief Close a scanner opened by scanner_open()
+ * @param[in] sc Scanner
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int scanner_close(struct SCANNER *sc) {
+    int ret = scanner_release(sc);
+    free(sc);
+    return ret;
+}
+
+/*!
+ * @brief Tokenize the rest of the source with several threads
+ * @details The source is split into chunks, which are tokenized in parallel on the assumption
+ * that no token or comment crosses their heads. Then the chunks are merged in order: the
+ * tokens before the chunk are scanned on from the end of the previous chunk until one of them
+ * coincides with a token of the chunk, from which the chunk is right. The line numbers of the
+ * chunk are shifted by the difference there. The tokens are the same as scanner_next() returns
+ * until -1, and the scanner itself is not moved.
+ * @param[in] sc Scanner, whose source must be loaded into memory and which must not be replaying
+ * @param[in] nthreads The number of threads
+ * @param[out] ta Tokens, to be released by token_array_release()
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int scanner_tokenize(struct SCANNER *sc, int nthreads, struct TOKEN_ARRAY *ta) {
+    struct CHUNK *chunks;
+    pthread_t *threads, self = pthread_self();
+    const char *p;
+    long begin, size;
+    int i, ret = 0;
+
+    memset(ta, 0, sizeof(*ta));
+    ta->end_offset = sc->current_offset;
+    ta->end_linenum = sc->linenum;
+    if (sc->src_head == NULL) {
+        error("function scanner_tokenize");
+        fprintf(stderr, "The source is not loaded into memory.\n");
+        return -1;
+    }
+    begin = sc->current_offset;
+    size = (long)(sc->src_end - sc->src_head);
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    if (nthreads > size - begin) {
+        nthreads = (size - begin > 0) ? (int)(size - begin) : 1;
+    }
+    chunks = (struct CHUNK *)malloc(sizeof(struct CHUNK) * nthreads);
+    threads = (pthread_t *)malloc(sizeof(pthread_t) * nthreads);
+    if (chunks == NULL || threads == NULL) {
+        error("can not malloc in scanner_tokenize");
+        free(chunks);
+        free(threads);
+        return -1;
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        scanner_detach(&chunks[i].sc, sc);
+        if (i == 0) {
+            chunks[i].begin = begin;
+        } else {
+            /* begin at the head of a line, since only comments cross lines */
+            p = sc->src_head + begin + (size - begin) / nthreads * i;
+            if (p <= sc->src_head + chunks[i - 1].begin) {
+                p = sc->src_head + chunks[i - 1].begin + 1;
+            }
+            p = (p <= sc->src_end) ? memchr(p - 1, '\n', sc->src_end - p + 1) : NULL;
+            chunks[i].begin = (p != NULL) ? (long)(p + 1 - sc->src_head) : size;
+            chunks[i - 1].end = chunks[i].begin;
+            chunks[i].sc.linenum = 1;
+        }
+        chunks[i].end = size;
+    }
+    for (i = 0; i < nthreads; i++) {
+        if (i > 0 && pthread_create(&threads[i], NULL, tokenize_chunk, &chunks[i]) != 0) {
+            /* tokenize it in this thread */
+            tokenize_chunk(&chunks[i]);
+            threads[i] = self;
+        }
+    }
+    tokenize_chunk(&chunks[0]);
+    for (i = 1; i < nthreads; i++) {
+        if (!pthread_equal(threads[i], self)) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        if (chunks[i].result == -1) {
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        /* the first chunk begins at the real state of the scanner */
+        *ta = chunks[0].ta;
+        memset(&chunks[0].ta, 0, sizeof(chunks[0].ta));
+        for (i = 1; i < nthreads && !chunks[i - 1].ended && ret == 0; i++) {
+            ret = merge_chunk(sc, &chunks[i], ta);
+        }
+    }
+    for (i = 0; i < nthreads; i++) {
+        token_array_release(&chunks[i].ta);
+        scanner_free_buffers(&chunks[i].sc);
+    }
+    free(chunks);
+    free(threads);
+    if (ret == -1) {
+        error("function scanner_tokenize");
+        token_array_release(ta);
+    }
+    return ret;
+}
+
+/*!
+ * @brief Release the tokens
+ * @param[in] ta Tokens
+ */
+void token_array_release(struct TOKEN_ARRAY *ta) {
+    if (ta->capacity > 0) {
+        free(ta->tokens);
+    }
+    ta->tokens = NULL;
+    ta->ntokens = ta->capacity = 0;
+}
+
+/*!
+ * @brief Re-lex the tokens of a source after an edit, only around the edit
+ * @details The scanner looks at most one character beyond a token, so scanning restarts at the
+ * end of the last token ending before the edit. It stops at the first token which an old token
+ * after the removed text also gives at the same place with the same code, since the rest of the
+ * source and the state of the scanner are the same there. The old tokens from there are kept
+ * with their offsets and line numbers shifted. The tokens and the line numbers are the same as
+ * scanning the whole source gives. An empty token array with an edit inserting the whole source
+ * lexes all of it. Scan errors end the tokens as in scanning, but they are not reported.
+ * @param[in,out] ta Tokens of the source before the edit, from scanner_tokenize() or this function
+ * @param[in] src Source after the edit
+ * @param[in] size Size of src
+ * @param[in] edit Edit made to the source
+ * @param[out] changed Tokens replaced
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int token_array_relex(struct TOKEN_ARRAY *ta, const char *src, long size, const struct TEXT_EDIT *edit,
+                      struct TOKEN_RANGE *changed) {
+    struct SCANNER sc;
+    struct TOKEN_ARRAY fresh;
+    struct TOKEN *token;
+    long delta = edit->inserted_len - edit->removed_len, prev_offset;
+    int restart, old, tail, code, prev_linenum, linedelta = 0, synced = 0, i, ret = 0;
+
+    if (edit->offset < 0 || edit->removed_len < 0 || edit->inserted_len < 0 ||
+        edit->offset + edit->inserted_len > size || ta->text != NULL || (ta->ntokens > 0 && ta->capacity == 0)) {
+        error("function token_array_relex");
+        fprintf(stderr, "The edit or the tokens can not be re-lexed.\n");
+        return -1;
+    }
+    pthread_once(&keyword_table_once, init_keyword_table_once);
+    pthread_once(&find_special_once, init_find_special_once);
+    if (!keyword_table_ready) {
+        return -1;
+    }
+    restart = token_array_search(ta, edit->offset, 1);
+    old = token_array_search(ta, edit->offset + edit->removed_len, 0);
+
+    memset(&sc, 0, sizeof(sc));
+    memset(&fresh, 0, sizeof(fresh));
+    if (string_attr_reserve(&sc, 0) == -1) {
+        return -1;
+    }
+    sc.src_head = src;
+    sc.src_end = src + size;
+    sc.quiet = 1;
+    if (restart > 0) {
+        /* no token crosses a line */
+        token = &ta->tokens[restart - 1];
+        seek_source(&sc, src + token->offset + token->len);
+        sc.linenum = token->linenum;
+    } else {
+        seek_source(&sc, src);
+        sc.linenum = 1;
+    }
+
+    while (1) {
+        prev_offset = sc.current_offset;
+        prev_linenum = sc.linenum;
+        if ((code = scanner_next(&sc)) == -1) {
+            fresh.end_offset = prev_offset;
+            fresh.end_linenum = prev_linenum;
+            break;
+        }
+        while (old < ta->ntokens && ta->tokens[old].offset + delta < sc.token_offset) {
+            old++;
+        }
+        if (old < ta->ntokens && ta->tokens[old].offset + delta == sc.token_offset && ta->tokens[old].code == code) {
+            /* the old tokens are right from this token */
+            synced = 1;
+            linedelta = sc.token_linenum - ta->tokens[old].linenum;
+            break;
+        }
+        if (token_array_push(&fresh, &sc, code) == -1) {
+            ret = -1;
+            break;
+        }
+    }
+
+    if (ret == 0) {
+        tail = synced ? ta->ntokens - old : 0;
+        ret = token_array_reserve(ta, restart + fresh.ntokens + tail - ta->ntokens);
+    }
+    if (ret == 0) {
+        changed->begin = restart;
+        changed->old_end = synced ? old : ta->ntokens;
+        changed->new_end = restart + fresh.ntokens;
+        if (tail > 0) {
+            memmove(&ta->tokens[changed->new_end], &ta->tokens[old], sizeof(struct TOKEN) * tail);
+            for (i = changed->new_end; i < changed->new_end + tail; i++) {
+                ta->tokens[i].offset += delta;
+                ta->tokens[i].linenum += linedelta;
+            }
+        }
+        if (fresh.ntokens > 0) {
+            memcpy(&ta->tokens[restart], fresh.tokens, sizeof(struct TOKEN) * fresh.ntokens);
+        }
+        ta->ntokens = changed->new_end + tail;
+        if (synced) {
+            ta->end_offset += delta;
+            ta->end_linenum += linedelta;
+        } else {
+            ta->end_offset = fresh.end_offset;
+            ta->end_linenum = fresh.end_linenum;
+        }
+    } else {
+        error("function token_array_relex");
+    }
+    token_array_release(&fresh);
+    scanner_free_buffers(&sc);
+    return ret;
+}
+
+/*!
+ * @brief Make a scanner just set up replay the tokens from the token cache or tokenized by threads
+ * @details The token cache is written if it is missing or stale. Nothing is done without the
+ * cache and threads, or for a source which is not loaded into memory.
+ * @param[in] sc Scanner
+ * @param[in] nthreads The maximum number of threads
+ * @param[in] cache_dir Directory of the token cache, or NULL not to use the cache
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int scanner_prepare_tokens(struct SCANNER *sc, int nthreads, char *cache_dir) {
+    struct TOKEN_ARRAY ta;
+    long size;
+
+    if (sc->src_head == NULL || (cache_dir == NULL && nthreads <= 1)) {
+        return 0;
+    }
+    if (cache_dir != NULL && token_cache_load(sc, cache_dir) == 0) {
+        return 0;
+    }
+    size = (long)(sc->src_end - sc->src_head);
+    if (nthreads > size / PARALLEL_MIN_CHUNK) {
+        nthreads = (int)(size / PARALLEL_MIN_CHUNK);
+    }
+    if (scanner_tokenize(sc, nthreads, &ta) == -1) {
+        return -1;
+    }
+    if (cache_dir != NULL) {
+        /* scanning goes on without the cache if it can not be written */
+        token_cache_store(sc, cache_dir, &ta);
+    }
+    sc->replay = ta;
+    sc->replay_pos = 0;
+    sc->replay_text = 0;
+    return 0;
+}
+
+/*!
+ * @brief Open a file and set up a scanner to scan it from the beginning
+ * @param[out] sc Scanner to be set up
+ * @param[in] filename File name to scan
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int scanner_init(struct SCANNER *sc, char *filename) {
+    if (strcmp(filename, "-") == 0) {
+        sc->fp = stdin;
+    } else if ((sc->fp = fopen(filename, "r")) == NULL) {
+        error("fopen() returns NULL");
+        return -1;
+    }
+    pthread_once(&keyword_table_once, init_keyword_table_once);
+    pthread_once(&find_special_once, init_find_special_once);
+    sc->string_attr = sc->string_value = NULL;
+    sc->string_attr_size = sc->string_value_size = 0;
+    sc->quiet = 0;
+    if (!keyword_table_ready || load_source(sc) == -1) {
+        if (sc->fp != stdin) {
+            fclose(sc->fp);
+        }
+        return -1;
+    }
+    if (string_attr_reserve(sc, 0) == -1) {
+        unload_source(sc);
+        if (sc->fp != stdin) {
+            fclose(sc->fp);
+        }
+        return -1;
+    }
+
+    sc->string_attr[0] = '\0';
+    sc->string_attr_len = 0;
+    sc->string_attr_valid = 1;
+    sc->string_value_len = -1;
+    sc->num_attr = 0;
+    memset(&sc->span, 0, sizeof(sc->span));
+    sc->linenum = 1;
+    sc->token_linenum = 0;
+    sc->token_offset = 0;
+    memset(&sc->replay, 0, sizeof(sc->replay));
+    sc->replay_pos = 0;
+    sc->replay_text = 0;
+    sc->cache_map = NULL;
+    sc->cache_map_size = 0;
+
+    sc->next_char = '\0';
+    sc->current_offset = -2;
+    look_ahead(sc);
+    look_ahead(sc);
+
+    return 0;
+}
+
+/*!
+ * @brief Release the source and close the file of a scanner
+ * @param[in] sc Scanner
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int scanner_release(struct SCANNER *sc) {
+    token_array_release(&sc->replay);
+    if (sc->cache_map != NULL) {
+        munmap(sc->cache_map, (size_t)sc->cache_map_size);
+        sc->cache_map = NULL;
+    }
+    unload_source(sc);
+    scanner_free_buffers(sc);
+    if (sc->fp == stdin) {
+        return 0;
+    }
+    if (fclose(sc->fp) == EOF) {
+        fprintf(stderr, "fclose() returns EOF.");
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief Copy the attributes of the token scanned by the default scanner to the globals
+ */
+static void sync_default_scanner(void) {
+    num_attr = default_scanner.num_attr;
+    token_span = default_scanner.span;
+}
+
+/*!
+ * @brief Make a quiet copy of a scanner sharing the source, with buffers of its own
+ * @param[out] copy Copy, to be released by scanner_free_buffers()
+ * @param[in] sc Scanner whose source is loaded into memory
+ */
+static void scanner_detach(struct SCANNER *copy, struct SCANNER *sc) {
+    *copy = *sc;
+    copy->string_attr = copy->string_value = NULL;
+    copy->string_attr_size = copy->string_value_size = 0;
+    copy->string_attr_valid = 0;
+    copy->quiet = 1;
+    memset(&copy->replay, 0, sizeof(copy->replay));
+    copy->cache_map = NULL;
+    copy->stream_buf = NULL;
+}
+
+/*!
+ * @brief Release string_attr and string_value of a scanner
+ * @param[in] sc Scanner
+ */
+static void scanner_free_buffers(struct SCANNER *sc) {
+    free(sc->string_attr);
+    free(sc->string_value);
+    sc->string_attr = sc->string_value = NULL;
+    sc->string_attr_size = sc->string_value_size = 0;
+}
+
+/*!
+ * @brief Make room for more tokens
+ * @param[in] ta Tokens
+ * @param[in] n The number of tokens to be added
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int token_array_reserve(struct TOKEN_ARRAY *ta, int n) {
+    struct TOKEN *tokens;
+    int capacity = (ta->capacity > 0) ? ta->capacity : 1024;
+
+    while (capacity - ta->ntokens < n) {
+        capacity *= 2;
+    }
+    if (capacity != ta->capacity) {
+        if ((tokens = (struct TOKEN *)realloc(ta->tokens, sizeof(struct TOKEN) * capacity)) == NULL) {
+            error("can not realloc in token_array_reserve");
+            return -1;
+        }
+        ta->tokens = tokens;
+        ta->capacity = capacity;
+    }
+    return 0;
+}
+
+/*!
+ * @brief Add the token just scanned to the end of the tokens
+ * @param[in] ta Tokens
+ * @param[in] sc Scanner which has scanned the token
+ * @param[in] code Token code
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int token_array_push(struct TOKEN_ARRAY *ta, struct SCANNER *sc, int code) {
+    struct TOKEN *token;
+
+    if (token_array_reserve(ta, 1) == -1) {
+        return -1;
+    }
+    token = &ta->tokens[ta->ntokens++];
+    /* the padding is written to the token cache too */
+    memset(token, 0, sizeof(struct TOKEN));
+    token->code = code;
+    token->linenum = sc->token_linenum;
+    token->num_attr = sc->num_attr;
+    token->escaped = (code == TSTRING) ? sc->span.escaped : 0;
+    token->offset = sc->token_offset;
+    token->len = (int)(sc->current_offset - sc->token_offset);
+    return 0;
+}
+
+/*!
+ * @brief Count the tokens before an offset by binary search
+ * @param[in] ta Tokens
+ * @param[in] offset Offset
+ * @param[in] by_end 1 to count the tokens ending before offset, 0 to count those beginning before it
+ * @return int Returns the number of the tokens
+ */
+static int token_array_search(struct TOKEN_ARRAY *ta, long offset, int by_end) {
+    int low = 0, high = ta->ntokens, mid;
+    struct TOKEN *token;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        token = &ta->tokens[mid];
+        if (token->offset + (by_end ? token->len : 0) < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/*!
+ * @brief Tokenize a chunk, the start routine of a thread
+ * @param[in] arg Chunk
+ * @return void* Returns NULL
+ */
+static void *tokenize_chunk(void *arg) {
+    struct CHUNK *chunk = (struct CHUNK *)arg;
+    struct SCANNER *sc = &chunk->sc;
+    long prev_offset;
+    int prev_linenum, code;
+
+    memset(&chunk->ta, 0, sizeof(chunk->ta));
+    chunk->ended = 0;
+    chunk->result = 0;
+    seek_source(sc, sc->src_head + chunk->begin);
+    while (1) {
+        prev_offset = sc->current_offset;
+        prev_linenum = sc->linenum;
+        if ((code = scanner_next(sc)) == -1) {
+            chunk->ended = 1;
+            break;
+        }
+        if (sc->token_offset >= chunk->end) {
+            break;
+        }
+        if (token_array_push(&chunk->ta, sc, code) == -1) {
+            chunk->result = -1;
+            break;
+        }
+    }
+    chunk->ta.end_offset = prev_offset;
+    chunk->ta.end_linenum = prev_linenum;
+    return NULL;
+}
+
+/*!
+ * @brief Append the tokens of a chunk to the tokens before it
+ * @param[in] sc Scanner, whose source is tokenized
+ * @param[in] chunk Chunk tokenized by tokenize_chunk()
+ * @param[in,out] ta Tokens before the chunk, whose end is the real state at the chunk
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int merge_chunk(struct SCANNER *sc, struct CHUNK *chunk, struct TOKEN_ARRAY *ta) {
+    struct SCANNER *rescan;
+    struct TOKEN *token;
+    int code, index = 0, delta, ret = 0;
+
+    if ((rescan = (struct SCANNER *)malloc(sizeof(struct SCANNER))) == NULL) {
+        error("can not malloc in merge_chunk");
+        return -1;
+    }
+    scanner_detach(rescan, sc);
+    seek_source(rescan, sc->src_head + ta->end_offset);
+    rescan->linenum = ta->end_linenum;
+
+    while (1) {
+        if ((code = scanner_next(rescan)) == -1) {
+            /* the tokens end before the chunk is reached */
+            chunk->ended = 1;
+            break;
+        }
+        if (rescan->token_offset >= chunk->end) {
+            /* no token of the chunk is right, e.g. it begins in a comment */
+            chunk->ended = 0;
+            break;
+        }
+        while (index < chunk->ta.ntokens && chunk->ta.tokens[index].offset < rescan->token_offset) {
+            index++;
+        }
+        if (index < chunk->ta.ntokens && chunk->ta.tokens[index].offset == rescan->token_offset &&
+            chunk->ta.tokens[index].code == code) {
+            /* the chunk is right from this token */
+            delta = rescan->token_linenum - chunk->ta.tokens[index].linenum;
+            if (token_array_reserve(ta, chunk->ta.ntokens - index) == -1) {
+                ret = -1;
+                break;
+            }
+            for (; index < chunk->ta.ntokens; index++) {
+                token = &ta->tokens[ta->ntokens++];
+                *token = chunk->ta.tokens[index];
+                token->linenum += delta;
+            }
+            ta->end_offset = chunk->ta.end_offset;
+            ta->end_linenum = chunk->ta.end_linenum + delta;
+            break;
+        }
+        if (token_array_push(ta, rescan, code) == -1) {
+            ret = -1;
+            break;
+        }
+        ta->end_offset = rescan->current_offset;
+        ta->end_linenum = rescan->linenum;
+    }
+    scanner_free_buffers(rescan);
+    free(rescan);
+    return ret;
+}
 
-/*! @name looka ahead */
-/* @{ */
-/*! The letters you just loaded. */
-static int current_char;
-/*! look-ahead character */
-static int next_char = '\0';
-static void look_ahead();
-/* @} */
-/*! Line number of the character you just loaded */
-static int linenum = 1;
-/*! The line number of the last token scanned */
-static int token_linenum = 0;
+/*!
+ * @brief Return the next token of the tokens tokenized in advance, as scanning does
+ * @param[in] sc Scanner replaying the tokens
+ * @return int Returns token code on success and -1 on failure.
+ */
+static int replay_token(struct SCANNER *sc) {
+    struct TOKEN *token = &sc->replay.tokens[sc->replay_pos++];
+    long offset;
+    int len;
 
-static int _isblank(int c);
-int get_linenum(void);
-void set_token_linenum(void);
-static int scan_alnum();
-static int scan_digit();
-static int scan_string();
-static int scan_comment();
-static int scan_symbol();
-static int get_keyword_token_code(char *token);
-static int string_attr_push_back(const char c);
+    seek_source(sc, sc->src_head + token->offset + token->len);
+    sc->token_offset = token->offset;
+    sc->token_linenum = token->linenum;
+    if ((len = token_text(token, &offset)) >= 0) {
+        /* names, keywords, numbers and strings leave their text, but symbols do not */
+        sc->span.offset = offset;
+        sc->span.len = len;
+        sc->span.escaped = token->escaped;
+        if (sc->replay.text != NULL) {
+            sc->span.ptr = sc->replay.text + sc->replay_text;
+            sc->replay_text += sc->span.len;
+        } else {
+            sc->span.ptr = sc->src_head + sc->span.offset;
+        }
+        sc->string_attr_valid = 0;
+        sc->string_value_len = -1;
+    }
+    if (token->code == TNUMBER) {
+        sc->num_attr = token->num_attr;
+    }
+    return token->code;
+}
 
 /*!
- * @brief Initialization to begin scanning
- * @param[in] filename File name to scan
- * @return int Returns 0 on success and -1 on failure.
+ * @brief Get the text of a token, which is left in span by scanning
+ * @param[in] token Token
+ * @param[out] offset Offset of the text in the source
+ * @return int Returns the length of the text, or -1 for a symbol which has no text.
  */
-int init_scan(char *filename) {
-    if ((fp = fopen(filename, "r")) == NULL) {
-        error("fopen() returns NULL");
-        error("function init_scan()");
+static int token_text(struct TOKEN *token, long *offset) {
+    if (token->code >= TPLUS && token->code <= TSEMI) {
         return -1;
     }
+    if (token->code == TSTRING) {
+        /* exclude the enclosing quotes */
+        *offset = token->offset + 1;
+        return token->len - 2;
+    }
+    *offset = token->offset;
+    return token->len;
+}
 
-    look_ahead();
-    look_ahead();
+/*!
+ * @brief Hash the source for the name of the token cache
+ * @details Two 32-bit hashes, FNV-1a and djb2, are taken in one pass.
+ * @param[in] sc Scanner, whose source is loaded into memory
+ * @param[out] hash Hashes
+ */
+static void source_hash(struct SCANNER *sc, unsigned long hash[2]) {
+    const unsigned char *p;
+    unsigned long fnv = 2166136261UL, djb = 5381;
 
-    return 0;
+    for (p = (const unsigned char *)sc->src_head; p < (const unsigned char *)sc->src_end; p++) {
+        fnv = ((fnv ^ *p) * 16777619UL) & 0xffffffffUL;
+        djb = (djb * 33 + *p) & 0xffffffffUL;
+    }
+    hash[0] = fnv;
+    hash[1] = djb;
 }
 
 /*!
- * @brief Scan the file and return the token code
- * @return int Returns token code on success and -1 on failure.
+ * @brief Make the file name of the token cache
+ * @param[out] path File name, FILENAME_MAX bytes
+ * @param[in] cache_dir Directory of the token cache
+ * @param[in] hash Hashes of the source
+ * @return int Returns 0 on success and -1 on failure.
  */
-int scan(void) {
-    int token_code = -1;
-    while (1) {
-        if (current_char == EOF) { /* End Of File*/
-            return -1;
-        } else if (current_char == '\r' || current_char == '\n') { /* End of Line */
-            if (current_char == '\r') {
-                if (next_char == '\n') {
-                    look_ahead();
-                }
-                look_ahead();
-                linenum++;
-            } else {
-                if (next_char == '\r') {
-                    look_ahead();
-                }
-                look_ahead();
-                linenum++;
-            }
-        } else if (_isblank(current_char)) { /* Separator (Space or Tab) */
-            look_ahead();
-        } else if (!isprint(current_char)) { /* Not Graphic Character(0x20~0x7e) */
-            error("function scan()");
-            fprintf(stderr, "[%c]0x%x is not graphic character.\n", current_char, current_char);
-            return -1;
-        } else if (isalpha(current_char)) { /* Name or Keyword */
-            token_code = scan_alnum();
-            break;
-        } else if (isdigit(current_char)) { /* Digit */
-            token_code = scan_digit();
-            break;
-        } else if (current_char == '\'') { /* String */
-            token_code = scan_string();
-            break;
-        } else if ((current_char == '/' && next_char == '*') || current_char == '{') { /* Comment */
-            if (scan_comment() == -1) {
-                break;
-            }
-        } else { /* Symbol */
-            token_code = scan_symbol();
-            break;
-        }
+static int token_cache_path(char *path, char *cache_dir, unsigned long hash[2]) {
+    if (strlen(cache_dir) + 32 >= FILENAME_MAX) {
+        return -1;
     }
-    set_token_linenum();
-    return token_code;
+    sprintf(path, "%s/%08lx%08lx.tok", cache_dir, hash[0], hash[1]);
+    return 0;
 }
 
 /*!
- * @brief Return the line number of the last token scanned
- * @return int Return line number
+ * @brief Make a directory and its parents if they do not exist
+ * @param[in] path Directory
+ * @return int Returns 0 on success and -1 on failure.
  */
-int get_linenum(void) {
-    return token_linenum;
+static int make_dirs(char *path) {
+    char dir[FILENAME_MAX];
+    struct stat st;
+    char *p;
+
+    if (strlen(path) >= sizeof(dir)) {
+        return -1;
+    }
+    strcpy(dir, path);
+    for (p = dir + 1; *p != '\0'; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(dir, 0777);
+            *p = '/';
+        }
+    }
+    mkdir(dir, 0777);
+    return (stat(dir, &st) == 0 && S_ISDIR(st.st_mode)) ? 0 : -1;
 }
 
 /*!
- * @brief Set the line number of the last token scanned
+ * @brief Map the token cache of the source to replay its tokens
+ * @details The cache is stale if it was written from another source with the same name,
+ * by a scanner of another version or format, or is broken.
+ * @param[in] sc Scanner, whose source is loaded into memory
+ * @param[in] cache_dir Directory of the token cache
+ * @return int Returns 0 if the cache is used and -1 if it is missing or stale.
  */
-void set_token_linenum(void) {
-    token_linenum = linenum;
+static int token_cache_load(struct SCANNER *sc, char *cache_dir) {
+    struct TOKEN_CACHE_HEADER *header;
+    char path[FILENAME_MAX];
+    unsigned long hash[2];
+    struct stat st;
+    FILE *in;
+    void *map;
+
+    source_hash(sc, hash);
+    if (token_cache_path(path, cache_dir, hash) == -1 || (in = fopen(path, "rb")) == NULL) {
+        return -1;
+    }
+    if (fstat(fileno(in), &st) == -1 || (size_t)st.st_size < sizeof(struct TOKEN_CACHE_HEADER)) {
+        fclose(in);
+        return -1;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+    fclose(in);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    header = (struct TOKEN_CACHE_HEADER *)map;
+    if (memcmp(header->magic, TOKEN_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != TOKEN_CACHE_VERSION || header->hash[0] != hash[0] ||
+        header->hash[1] != hash[1] || header->source_size != (long)(sc->src_end - sc->src_head) ||
+        header->numoftoken != NUMOFTOKEN || header->token_size != (long)sizeof(struct TOKEN) ||
+        header->ntokens < 0 || header->text_size < 0 || header->end_offset < 0 ||
+        header->end_offset > header->source_size ||
+        (long)sizeof(struct TOKEN_CACHE_HEADER) + header->ntokens * header->token_size + header->text_size !=
+            (long)st.st_size) {
+        /* stale */
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+
+    sc->cache_map = map;
+    sc->cache_map_size = (long)st.st_size;
+    sc->replay.tokens = (struct TOKEN *)(header + 1);
+    sc->replay.ntokens = (int)header->ntokens;
+    sc->replay.capacity = 0;
+    sc->replay.end_offset = header->end_offset;
+    sc->replay.end_linenum = (int)header->end_linenum;
+    sc->replay.text = (const char *)(sc->replay.tokens + header->ntokens);
+    sc->replay_pos = 0;
+    sc->replay_text = 0;
+    return 0;
 }
 
 /*!
- * @brief The process of finishing the scan
+ * @brief Write the tokens of the source to the token cache
+ * @details The cache is written to a temporary file and renamed, so that no one maps a half-written cache.
+ * @param[in] sc Scanner, whose source is loaded into memory
+ * @param[in] cache_dir Directory of the token cache
+ * @param[in] ta Tokens of the whole source
  * @return int Returns 0 on success and -1 on failure.
  */
-int end_scan(void) {
-    if (fclose(fp) == EOF) {
-        error("function end_scan");
-        fprintf(stderr, "fclose() returns EOF.");
-        ;
+static int token_cache_store(struct SCANNER *sc, char *cache_dir, struct TOKEN_ARRAY *ta) {
+    struct TOKEN_CACHE_HEADER header;
+    char path[FILENAME_MAX], tmp[FILENAME_MAX + 32];
+    FILE *out;
+    long offset;
+    int i, len, ret = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TOKEN_CACHE_MAGIC, sizeof(header.magic));
+    header.version = TOKEN_CACHE_VERSION;
+    source_hash(sc, header.hash);
+    header.source_size = (long)(sc->src_end - sc->src_head);
+    header.numoftoken = NUMOFTOKEN;
+    header.token_size = (long)sizeof(struct TOKEN);
+    header.ntokens = ta->ntokens;
+    header.end_offset = ta->end_offset;
+    header.end_linenum = ta->end_linenum;
+    for (i = 0; i < ta->ntokens; i++) {
+        if ((len = token_text(&ta->tokens[i], &offset)) > 0) {
+            header.text_size += len;
+        }
+    }
+
+    if (make_dirs(cache_dir) == -1 || token_cache_path(path, cache_dir, header.hash) == -1) {
+        return -1;
+    }
+    /* the scanner tells the threads of the process apart */
+    sprintf(tmp, "%s.%ld.%lx", path, (long)getpid(), (unsigned long)sc);
+    if ((out = fopen(tmp, "wb")) == NULL) {
+        return -1;
+    }
+    if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+        (ta->ntokens > 0 && fwrite(ta->tokens, sizeof(struct TOKEN), ta->ntokens, out) != (size_t)ta->ntokens)) {
+        ret = -1;
+    }
+    for (i = 0; i < ta->ntokens && ret == 0; i++) {
+        if ((len = token_text(&ta->tokens[i], &offset)) > 0 &&
+            fwrite(sc->src_head + offset, 1, len, out) != (size_t)len) {
+            ret = -1;
+        }
+    }
+    if (fclose(out) == EOF || ret == -1 || rename(tmp, path) == -1) {
+        remove(tmp);
         return -1;
     }
     return 0;
 }
 
+/*!
+ * @brief Report a scan error unless the scanner is quiet
+ * @param[in] sc Scanner
+ * @param[in] mes Error message passed to error()
+ * @param[in] format Format of the detail printed after mes, or NULL
+ */
+static void scanner_error(struct SCANNER *sc, char *mes, const char *format, ...) {
+    va_list args;
+
+    if (sc->quiet) {
+        return;
+    }
+    error(mes);
+    if (format != NULL) {
+        va_start(args, format);
+        vfprintf(stderr, format, args);
+        va_end(args);
+    }
+}
+
 /*!
  * @brief Determine if a character is a space character or not.
  * @param[in] c Character to be determined
@@ -149,50 +1176,56 @@ static int _isblank(int c) {
 
 /*!
  * @brief Scan one string of letters and numbers
+ * @param[in] sc Scanner
  * @return int Returns token code on success and -1 on failure.
  */
-static int scan_alnum() {
-    memset(string_attr, '\0', sizeof(string_attr));
-    string_attr[0] = current_char;
-
-    look_ahead();
-    while (isalnum(current_char)) {
-        if (string_attr_push_back(current_char) == -1) {
-            error("function scan_alnum()");
+static int scan_alnum(struct SCANNER *sc) {
+    span_begin(sc);
+    while (isalnum(sc->current_char)) {
+        if (string_attr_push_back(sc, sc->current_char) == -1) {
+            scanner_error(sc, "function scan_alnum()", NULL);
             return -1;
         }
-        look_ahead();
+        look_ahead(sc);
     }
-    return get_keyword_token_code(string_attr);
+    if (span_end(sc) == -1) {
+        scanner_error(sc, "function scan_alnum()", NULL);
+        return -1;
+    }
+    return get_keyword_token_code(sc->span.ptr, sc->span.len);
 }
 
 /*!
  * @brief Scan one number sequence.
+ * @param[in] sc Scanner
  * @return int Returns token code of number on success and -1 on failure.
  */
-static int scan_digit() {
-    int num = current_char - '0';
+static int scan_digit(struct SCANNER *sc) {
+    int num = 0;
 
-    memset(string_attr, '\0', sizeof(string_attr));
-    string_attr[0] = current_char;
-
-    look_ahead();
-    while (isdigit(current_char)) {
-        if (string_attr_push_back(current_char) == -1) {
-            error("function scan_digit()");
+    span_begin(sc);
+    while (isdigit(sc->current_char)) {
+        if (string_attr_push_back(sc, sc->current_char) == -1) {
+            scanner_error(sc, "function scan_digit()", NULL);
             return -1;
         }
-        num *= 10;
-        num += current_char - '0';
-        look_ahead();
+        /* stop accumulating once it overflows, to avoid overflow of int */
+        if (num <= MAX_NUM_ATTR) {
+            num *= 10;
+            num += sc->current_char - '0';
+        }
+        look_ahead(sc);
+    }
+    if (span_end(sc) == -1) {
+        scanner_error(sc, "function scan_digit()", NULL);
+        return -1;
     }
     if (num <= MAX_NUM_ATTR) {
-        num_attr = num;
+        sc->num_attr = num;
         return TNUMBER;
     } else {
         /* Buffer Overflow */
-        error("function scan_digit");
-        fprintf(stderr, "num_attr: Buffer Overflow.");
+        scanner_error(sc, "function scan_digit", "num_attr: Buffer Overflow.");
     }
 
     return -1;
@@ -200,83 +1233,99 @@ static int scan_digit() {
 
 /*!
  * @brief Scan one string.
+ * @param[in] sc Scanner
  * @return int Returns token code of string on success and -1 on failure.
  */
-static int scan_string() {
-    memset(string_attr, '\0', sizeof(string_attr));
-    look_ahead();
+static int scan_string(struct SCANNER *sc) {
+    look_ahead(sc);
+    span_begin(sc);
 
     while (1) {
-        if (!isprint(current_char)) {
-            error("function scan_string()");
-            fprintf(stderr, "[%c]0x%x is not graphic character.\n", current_char, current_char);
+        if (sc->src_head != NULL) {
+            /* jump over the graphic characters other than ' */
+            seek_source(sc, find_special(sc->src_head + sc->current_offset, sc->src_end, FIND_NONGRAPHIC, '\''));
+        }
+        if (!isprint(sc->current_char)) {
+            scanner_error(sc, "function scan_string()", "[%c]0x%x is not graphic character.\n", sc->current_char,
+                          sc->current_char);
             return -1;
         }
 
-        if (current_char == '\'' && next_char != '\'') {
+        if (sc->current_char == '\'' && sc->next_char != '\'') {
             break;
         }
 
-        if (current_char == '\'' && next_char == '\'') {
-            if (string_attr_push_back(current_char) == -1) {
-                error("function scan_string()");
+        if (sc->current_char == '\'' && sc->next_char == '\'') {
+            sc->span.escaped = 1;
+            if (string_attr_push_back(sc, sc->current_char) == -1) {
+                scanner_error(sc, "function scan_string()", NULL);
                 return -1;
             }
-            look_ahead();
+            look_ahead(sc);
         }
 
-        if (string_attr_push_back(current_char) == -1) {
-            error("function scan_string()");
+        if (string_attr_push_back(sc, sc->current_char) == -1) {
+            scanner_error(sc, "function scan_string()", NULL);
             return -1;
         }
-        look_ahead();
+        look_ahead(sc);
+    }
+    if (span_end(sc) == -1) {
+        scanner_error(sc, "function scan_string()", NULL);
+        return -1;
     }
-    look_ahead(); /* read '\'' */
+    look_ahead(sc); /* read '\'' */
 
     return TSTRING;
 }
 
 /*!
  * @brief Scan the annotation
+ * @details The ends of line in the annotation are counted in the line number.
+ * @param[in] sc Scanner
  * @return int Returns 0 on success and -1 on failure.
  */
-static int scan_comment() {
-    if (current_char == '/' && next_char == '*') {
-        look_ahead();
-        look_ahead();
-        while (current_char != EOF) {
-            if (current_char == '*' && next_char == '/') {
-                look_ahead();
-                look_ahead();
-                return 0;
-            }
-            look_ahead();
-        }
-    } else if (current_char == '{') {
-        look_ahead();
-        while (current_char != EOF) {
-            if (current_char == '}') {
-                look_ahead();
-                return 0;
+static int scan_comment(struct SCANNER *sc) {
+    int is_block = (sc->current_char == '/');
+
+    look_ahead(sc);
+    if (is_block) {
+        look_ahead(sc);
+    }
+    while (sc->current_char != EOF) {
+        if (sc->src_head != NULL) {
+            /* jump to the next closing character or end of line */
+            seek_source(sc, find_special(sc->src_head + sc->current_offset, sc->src_end, FIND_NEWLINE,
+                                         is_block ? '*' : '}'));
+            if (sc->current_char == EOF) {
+                break;
             }
-            look_ahead();
+        }
+        if (sc->current_char == '\r' || sc->current_char == '\n') {
+            skip_newline(sc);
+        } else if (is_block && sc->current_char == '*' && sc->next_char == '/') {
+            look_ahead(sc);
+            look_ahead(sc);
+            return 0;
+        } else if (!is_block && sc->current_char == '}') {
+            look_ahead(sc);
+            return 0;
+        } else {
+            look_ahead(sc);
         }
     }
     /* EOF */
-    if (current_char != EOF) {
-        error("function scan_comment");
-        fprintf(stderr, "Failed to scan the comment.");
-    }
     return -1;
 }
 
 /*!
  * @brief Scan one symbol
+ * @param[in] sc Scanner
  * @return int Returns token code of symbol on success and -1 on failure.
  */
-static int scan_symbol() {
-    char symbol = current_char;
-    look_ahead();
+static int scan_symbol(struct SCANNER *sc) {
+    char symbol = sc->current_char;
+    look_ahead(sc);
     switch (symbol) {
         case '+':
             return TPLUS;
@@ -287,18 +1336,18 @@ static int scan_symbol() {
         case '=':
             return TEQUAL;
         case '<':
-            if (current_char == '>') {
-                look_ahead();
+            if (sc->current_char == '>') {
+                look_ahead(sc);
                 return TNOTEQ;
-            } else if (current_char == '=') {
-                look_ahead();
+            } else if (sc->current_char == '=') {
+                look_ahead(sc);
                 return TLEEQ;
             } else {
                 return TLE;
             }
         case '>':
-            if (current_char == '=') {
-                look_ahead();
+            if (sc->current_char == '=') {
+                look_ahead(sc);
                 return TGREQ;
             } else {
                 return TGR;
@@ -312,8 +1361,8 @@ static int scan_symbol() {
         case ']':
             return TRSQPAREN;
         case ':':
-            if (current_char == '=') {
-                look_ahead();
+            if (sc->current_char == '=') {
+                look_ahead(sc);
                 return TASSIGN;
             } else {
                 return TCOLON;
@@ -325,21 +1374,22 @@ static int scan_symbol() {
         case ';':
             return TSEMI;
         default:
-            error("function scan_symbol()");
-            fprintf(stderr, "[%c]0x%x is undefined symbol.\n", current_char, current_char);
+            scanner_error(sc, "function scan_symbol()", "[%c]0x%x is undefined symbol.\n", symbol, symbol);
             return -1;
     }
 }
 /*!
  * @brief Get the token code for a token
- * @param[in] token token to be determined
+ * @param[in] token token to be determined, which need not be null-terminated
+ * @param[in] len Length of the token
  * @return int If it is a keyword, it returns its token code, otherwise it returns the Name token code
  */
-static int get_keyword_token_code(char *token) {
+static int get_keyword_token_code(const char *token, int len) {
     int index;
-    /* TODO: binary search */
-    for (index = 0; index < KEYWORDSIZE; index++) {
-        if (strcmp(token, key[index].keyword) == 0) {
+
+    if (len <= KEYWORD_MAXLEN) {
+        index = keyword_table[keyword_hash(token, len, keyword_hash_seed)];
+        if (index >= 0 && strncmp(token, key[index].keyword, len) == 0 && key[index].keyword[len] == '\0') {
             /* This token is Keyword */
             return key[index].keytoken;
         }
@@ -348,29 +1398,442 @@ static int get_keyword_token_code(char *token) {
     return TNAME;
 }
 
+/*!
+ * @brief Hash a token for the keyword table
+ * @details FNV-1a with a seed instead of the offset basis.
+ * @param[in] token Token to hash
+ * @param[in] len Length of the token
+ * @param[in] seed Seed of the hash
+ * @return unsigned long Returns the hash value in [0, KEYWORD_HASH_SIZE)
+ */
+static unsigned long keyword_hash(const char *token, int len, unsigned long seed) {
+    unsigned long hash = seed;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        hash = ((hash ^ (unsigned char)token[i]) * 16777619UL) & 0xffffffffUL;
+    }
+    return hash >> (32 - KEYWORD_HASH_BITS);
+}
+
+/*!
+ * @brief Build the perfect hash table of keywords from key[]
+ * @details If the seed gives a collision (e.g. key[] has been changed), the next seed is tried
+ * until the hash becomes perfect.
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int init_keyword_table(void) {
+    int index, len, tries;
+    unsigned long hash;
+
+    for (tries = 0; tries < 1000000; tries++, keyword_hash_seed++) {
+        for (index = 0; index < KEYWORD_HASH_SIZE; index++) {
+            keyword_table[index] = -1;
+        }
+        for (index = 0; index < KEYWORDSIZE; index++) {
+            len = (int)strlen(key[index].keyword);
+            hash = keyword_hash(key[index].keyword, len, keyword_hash_seed);
+            if (len > KEYWORD_MAXLEN || keyword_table[hash] != -1) {
+                break;
+            }
+            keyword_table[hash] = index;
+        }
+        if (index == KEYWORDSIZE) {
+            keyword_table_ready = 1;
+            return 0;
+        }
+        if (len > KEYWORD_MAXLEN) {
+            break;
+        }
+    }
+    error("function init_keyword_table()");
+    fprintf(stderr, "Failed to build the perfect hash of keywords.\n");
+    return -1;
+}
+
+/*!
+ * @brief Build keyword_table, called through pthread_once()
+ */
+static void init_keyword_table_once(void) {
+    init_keyword_table();
+}
+
 /*!
  * @brief Adding characters to the end of a scanned string
+ * @details When the source is loaded into memory, nothing is added and the span points into
+ * the source instead.
+ * @param[in] sc Scanner
  * @param[in] c Characters to add
  * @return int Returns 0 on success and -1 on failure.
  */
-static int string_attr_push_back(const char c) {
-    int len = strlen(string_attr);
-    if (len < MAXSTRSIZE - 1) {
-        string_attr[len] = c;
+static int string_attr_push_back(struct SCANNER *sc, const char c) {
+    if (sc->src_head != NULL) {
         return 0;
-    } else {
-        /* Buffer Overflow */
-        error("function string_attr_push_back");
-        fprintf(stderr, "string_attr: Buffer Overflow.");
+    }
+    if (string_attr_reserve(sc, sc->string_attr_len + 1) == -1) {
         return -1;
     }
+    sc->string_attr[sc->string_attr_len++] = c;
+    return 0;
+}
+
+/*!
+ * @brief Grow string_attr of a scanner to hold a string and its terminating null
+ * @param[in] sc Scanner
+ * @param[in] len Length of the string
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int string_attr_reserve(struct SCANNER *sc, int len) {
+    char *buf;
+    int size = (sc->string_attr_size > 0) ? sc->string_attr_size : MAXSTRSIZE;
+
+    while (size <= len) {
+        size *= 2;
+    }
+    if (size != sc->string_attr_size) {
+        if ((buf = (char *)realloc(sc->string_attr, size)) == NULL) {
+            scanner_error(sc, "can not realloc in string_attr_reserve", "string_attr: %d bytes.\n", size);
+            return -1;
+        }
+        sc->string_attr = buf;
+        sc->string_attr_size = size;
+    }
+    return 0;
+}
+
+/*!
+ * @brief Get the text of the last scanned name, number or string as a null-terminated string
+ * @return char* Returns the text, which is kept until the next scan(), or "" on failure.
+ */
+char *get_string_attr(void) {
+    return scanner_string_attr(&default_scanner);
+}
+
+/*!
+ * @brief Get the text of the last name, number or string scanned with a scanner as a null-terminated string
+ * @details Scanning leaves only the span of the token. Its text is copied into string_attr
+ * the first time it is asked for, and not again for the same token.
+ * @param[in] sc Scanner
+ * @return char* Returns the text, which is kept until the next token is scanned, or "" on failure.
+ */
+char *scanner_string_attr(struct SCANNER *sc) {
+    if (sc->string_attr_valid) {
+        return (sc->string_attr != NULL) ? sc->string_attr : "";
+    }
+    if (string_attr_reserve(sc, sc->span.len) == -1) {
+        return "";
+    }
+    memcpy(sc->string_attr, sc->span.ptr, sc->span.len);
+    sc->string_attr[sc->span.len] = '\0';
+    sc->string_attr_len = sc->span.len;
+    sc->string_attr_valid = 1;
+    return sc->string_attr;
+}
+
+/*!
+ * @brief Begin the span of a token at current_char
+ * @param[in] sc Scanner
+ */
+static void span_begin(struct SCANNER *sc) {
+    sc->span.offset = sc->current_offset;
+    sc->span.escaped = 0;
+    sc->string_attr_len = 0;
+    sc->string_attr_valid = 0;
+    sc->string_value_len = -1;
+}
+
+/*!
+ * @brief End the span of a token just before current_char
+ * @details When the source is loaded into memory, the span points into it and nothing is copied.
+ * @param[in] sc Scanner
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int span_end(struct SCANNER *sc) {
+    sc->span.len = (int)(sc->current_offset - sc->span.offset);
+    if (sc->src_head != NULL) {
+        sc->span.ptr = sc->src_head + sc->span.offset;
+        return 0;
+    }
+    /* string_attr_push_back() has left room for the null */
+    sc->string_attr[sc->span.len] = '\0';
+    sc->string_attr_valid = 1;
+    sc->span.ptr = sc->string_attr;
+    return 0;
+}
+
+/*!
+ * @brief Get the value of the last scanned string, in which '' is unescaped to '
+ * @details The unescaped value is built only when the string contains ''.
+ * @param[out] len Length of the value
+ * @return const char* Returns the value, which is not null-terminated.
+ */
+const char *get_string_value(int *len) {
+    return scanner_string_value(&default_scanner, len);
+}
+
+/*!
+ * @brief Get the value of the last string scanned with a scanner, in which '' is unescaped to '
+ * @param[in] sc Scanner
+ * @param[out] len Length of the value
+ * @return const char* Returns the value, which is not null-terminated, or "" on failure.
+ */
+const char *scanner_string_value(struct SCANNER *sc, int *len) {
+    char *buf;
+    int i;
+
+    if (!sc->span.escaped) {
+        *len = sc->span.len;
+        return sc->span.ptr;
+    }
+    if (sc->string_value_len < 0) {
+        if (sc->string_value_size < sc->span.len) {
+            /* the value is never longer than the span */
+            if ((buf = (char *)realloc(sc->string_value, sc->span.len)) == NULL) {
+                error("can not realloc in scanner_string_value");
+                *len = 0;
+                return "";
+            }
+            sc->string_value = buf;
+            sc->string_value_size = sc->span.len;
+        }
+        sc->string_value_len = 0;
+        for (i = 0; i < sc->span.len; i++) {
+            sc->string_value[sc->string_value_len++] = sc->span.ptr[i];
+            if (sc->span.ptr[i] == '\'') {
+                /* skip the second ' of '' */
+                i++;
+            }
+        }
+    }
+    *len = sc->string_value_len;
+    return sc->string_value;
+}
+
+/*!
+ * @brief Load the whole source file into one contiguous buffer
+ * @details A regular file is mapped by mmap(), or read by fread() if mapping fails.
+ * Other files such as pipes are streamed through a block refilled by fread(), so that the
+ * memory used does not grow with the input.
+ * @param[in] sc Scanner
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int load_source(struct SCANNER *sc) {
+    struct stat st;
+    char *buf;
+    size_t size;
+
+    sc->src_head = sc->src_pos = sc->src_end = NULL;
+    sc->src_is_mapped = 0;
+    sc->stream_buf = NULL;
+    sc->stream_pos = sc->stream_len = 0;
+    if (fstat(fileno(sc->fp), &st) == -1 || !S_ISREG(st.st_mode)) {
+        /* stream it */
+        if ((sc->stream_buf = (unsigned char *)malloc(STREAM_BUFSIZE)) == NULL) {
+            error("can not malloc in load_source");
+            return -1;
+        }
+        return 0;
+    }
+    size = (size_t)st.st_size;
+    if (size == 0) {
+        sc->src_head = sc->src_pos = sc->src_end = "";
+        return 0;
+    }
+
+    buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(sc->fp), 0);
+    if (buf != MAP_FAILED) {
+        posix_madvise(buf, size, POSIX_MADV_SEQUENTIAL);
+        sc->src_is_mapped = 1;
+    } else {
+        if ((buf = (char *)malloc(size)) == NULL) {
+            error("can not malloc in load_source");
+            return -1;
+        }
+        if (fread(buf, 1, size, sc->fp) != size) {
+            error("fread() failed in load_source");
+            free(buf);
+            return -1;
+        }
+    }
+    sc->src_head = sc->src_pos = buf;
+    sc->src_end = buf + size;
+    return 0;
+}
+
+/*!
+ * @brief Release the buffer loaded by load_source()
+ * @param[in] sc Scanner
+ */
+static void unload_source(struct SCANNER *sc) {
+    if (sc->src_is_mapped) {
+        munmap((void *)sc->src_head, sc->src_end - sc->src_head);
+    } else if (sc->src_head != NULL && sc->src_head != sc->src_end) {
+        free((void *)sc->src_head);
+    }
+    sc->src_head = sc->src_pos = sc->src_end = NULL;
+    sc->src_is_mapped = 0;
+    free(sc->stream_buf);
+    sc->stream_buf = NULL;
+}
+
+/*!
+ * @brief Read the next block of the streamed source
+ * @param[in] sc Scanner
+ * @return int Returns the number of the bytes read, 0 at the end of the file
+ */
+static int refill_stream(struct SCANNER *sc) {
+    sc->stream_pos = 0;
+    sc->stream_len = (int)fread(sc->stream_buf, 1, STREAM_BUFSIZE, sc->fp);
+    return sc->stream_len;
 }
 
 /*!
  * @brief Pre-reading file
+ * @param[in] sc Scanner
  */
-static void look_ahead() {
-    current_char = next_char;
-    next_char = fgetc(fp);
+static void look_ahead(struct SCANNER *sc) {
+    sc->current_char = sc->next_char;
+    sc->current_offset++;
+    if (sc->src_head != NULL) {
+        sc->next_char = (sc->src_pos < sc->src_end) ? (unsigned char)*sc->src_pos++ : EOF;
+    } else if (sc->stream_pos < sc->stream_len || refill_stream(sc) > 0) {
+        sc->next_char = sc->stream_buf[sc->stream_pos++];
+    } else {
+        sc->next_char = EOF;
+    }
     return;
 }
+
+/*!
+ * @brief Move current_char to a position in the source loaded into memory
+ * @param[in] sc Scanner
+ * @param[in] p Position of the new current_char, at most src_end
+ */
+static void seek_source(struct SCANNER *sc, const char *p) {
+    sc->current_offset = (long)(p - sc->src_head);
+    sc->current_char = (p < sc->src_end) ? (unsigned char)*p++ : EOF;
+    sc->next_char = (p < sc->src_end) ? (unsigned char)*p++ : EOF;
+    sc->src_pos = p;
+}
+
+/*!
+ * @brief Read an end of line (\r, \n, \r\n or \n\r) and count up the line number
+ * @param[in] sc Scanner
+ */
+static void skip_newline(struct SCANNER *sc) {
+    if ((sc->current_char == '\r' && sc->next_char == '\n') || (sc->current_char == '\n' && sc->next_char == '\r')) {
+        look_ahead(sc);
+    }
+    look_ahead(sc);
+    sc->linenum++;
+}
+
+/*!
+ * @brief Find the next interesting byte, one byte at a time
+ * @param[in] p Position to begin the search
+ * @param[in] end End of the source
+ * @param[in] kind FIND_NEWLINE, FIND_NONGRAPHIC or FIND_NONBLANK
+ * @param[in] stop Byte to find, ignored for FIND_NONBLANK
+ * @return const char* Returns the position of the byte found, or end if not found.
+ */
+static const char *find_special_scalar(const char *p, const char *end, int kind, int stop) {
+    int c;
+
+    for (; p < end; p++) {
+        c = (unsigned char)*p;
+        if (kind == FIND_NONBLANK) {
+            if (!_isblank(c)) {
+                break;
+            }
+        } else if (c == stop || (kind == FIND_NEWLINE ? (c == '\r' || c == '\n') : !isprint(c))) {
+            break;
+        }
+    }
+    return p;
+}
+
+#ifdef SCAN_USE_SSE2
+/*!
+ * @brief Find the next interesting byte, 16 bytes at a time with SSE2
+ * @details The parameters and the return value are the same as find_special_scalar().
+ */
+static const char *find_special_sse2(const char *p, const char *end, int kind, int stop) {
+    __m128i x, hit;
+    int mask;
+
+    for (; end - p >= 16; p += 16) {
+        x = _mm_loadu_si128((const __m128i *)p);
+        if (kind == FIND_NONBLANK) {
+            hit = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\t')));
+            mask = ~_mm_movemask_epi8(hit) & 0xffff;
+        } else {
+            hit = _mm_cmpeq_epi8(x, _mm_set1_epi8((char)stop));
+            if (kind == FIND_NEWLINE) {
+                hit = _mm_or_si128(hit, _mm_cmpeq_epi8(x, _mm_set1_epi8('\r')));
+                hit = _mm_or_si128(hit, _mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+            } else {
+                /* 0x80-0xff are negative, so they are less than 0x20 as well as the controls */
+                hit = _mm_or_si128(hit, _mm_cmplt_epi8(x, _mm_set1_epi8(0x20)));
+                hit = _mm_or_si128(hit, _mm_cmpeq_epi8(x, _mm_set1_epi8(0x7f)));
+            }
+            mask = _mm_movemask_epi8(hit);
+        }
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return find_special_scalar(p, end, kind, stop);
+}
+#endif
+
+#ifdef SCAN_USE_AVX2
+/*!
+ * @brief Find the next interesting byte, 32 bytes at a time with AVX2
+ * @details The parameters and the return value are the same as find_special_scalar().
+ * It is called only if the CPU supports AVX2.
+ */
+__attribute__((target("avx2"))) static const char *find_special_avx2(const char *p, const char *end, int kind,
+                                                                    int stop) {
+    __m256i x, hit;
+    unsigned int mask;
+
+    for (; end - p >= 32; p += 32) {
+        x = _mm256_loadu_si256((const __m256i *)p);
+        if (kind == FIND_NONBLANK) {
+            hit = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+                                  _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t')));
+            mask = ~(unsigned int)_mm256_movemask_epi8(hit);
+        } else {
+            hit = _mm256_cmpeq_epi8(x, _mm256_set1_epi8((char)stop));
+            if (kind == FIND_NEWLINE) {
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\r')));
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+            } else {
+                /* 0x80-0xff are negative, so they are less than 0x20 as well as the controls */
+                hit = _mm256_or_si256(hit, _mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), x));
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(0x7f)));
+            }
+            mask = (unsigned int)_mm256_movemask_epi8(hit);
+        }
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return find_special_scalar(p, end, kind, stop);
+}
+#endif
+
+/*!
+ * @brief Choose the fastest find_special for the CPU, called through pthread_once()
+ */
+static void init_find_special_once(void) {
+    find_special = find_special_scalar;
+#ifdef SCAN_USE_SSE2
+    find_special = find_special_sse2;
+#endif
+#ifdef SCAN_USE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        find_special = find_special_avx2;
+    }
+#endif
+}
@@ -0,0 +1,106 @@
+#include "mppl_compiler.h"
+
+/*! size of a block of an arena, unless an allocation needs a larger one */
+#define ARENA_BLOCKSIZE (64 * 1024)
+
+/*!
+ * @brief Alignment of the allocations, which is enough for any struct of the compiler
+ */
+union ARENA_ALIGN {
+    long l;
+    double d;
+    void *p;
+};
+
+/*! round n up to the alignment of the allocations */
+#define ARENA_ROUNDUP(n) (((n) + sizeof(union ARENA_ALIGN) - 1) / sizeof(union ARENA_ALIGN) * sizeof(union ARENA_ALIGN))
+
+/*! Arena of a compilation, which backs the names, types, references and literals */
+struct ARENA compile_arena;
+
+/*!
+ * @brief Allocate memory from an arena, which is released only with the arena
+ * @param[in] arena The arena
+ * @param[in] size Size of the memory
+ * @return void * Return a pointer to the memory, or NULL on failure.
+ */
+void *arena_alloc(struct ARENA *arena, size_t size) {
+    struct ARENA_BLOCK *block = arena->blocks;
+    size_t header = ARENA_ROUNDUP(sizeof(struct ARENA_BLOCK));
+    size_t blocksize;
+    void *p;
+
+    size = ARENA_ROUNDUP((size > 0) ? size : 1);
+    if (block == NULL || block->size - block->used < size) {
+        blocksize = (size > ARENA_BLOCKSIZE) ? size : ARENA_BLOCKSIZE;
+        if ((block = (struct ARENA_BLOCK *)malloc(header + blocksize)) == NULL) {
+            error("can not malloc in arena_alloc\n");
+            return NULL;
+        }
+        block->used = 0;
+        block->size = blocksize;
+        if (arena->blocks != NULL && size > ARENA_BLOCKSIZE) {
+            /* a large block goes behind the current one, which still has room */
+            block->next = arena->blocks->next;
+            arena->blocks->next = block;
+        } else {
+            block->next = arena->blocks;
+            arena->blocks = block;
+        }
+        arena->nblocks++;
+    }
+    p = (char *)block + header + block->used;
+    block->used += size;
+
+    arena->nallocs++;
+    arena->bytes += size;
+    if (arena->bytes > arena->peak_bytes) {
+        arena->peak_bytes = arena->bytes;
+    }
+    return p;
+}
+
+/*!
+ * @brief Copy a string of length len to an arena
+ * @param[in] arena The arena
+ * @param[in] s String, which need not be null-terminated
+ * @param[in] len Length of the string
+ * @return char * Return a pointer to the null-terminated copy, or NULL on failure.
+ */
+char *arena_strndup(struct ARENA *arena, const char *s, size_t len) {
+    char *p;
+
+    if ((p = (char *)arena_alloc(arena, len + 1)) == NULL) {
+        return NULL;
+    }
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p;
+}
+
+/*!
+ * @brief Release all the memory of an arena at once, keeping the peak for the statistics
+ * @param[in] arena The arena
+ */
+void arena_release(struct ARENA *arena) {
+    struct ARENA_BLOCK *p, *q;
+
+    for (p = arena->blocks; p != NULL; p = q) {
+        q = p->next;
+        free(p);
+    }
+    arena->blocks = NULL;
+    arena->nblocks = 0;
+    arena->nallocs = 0;
+    arena->bytes = 0;
+}
+
+/*!
+ * @brief Output the statistics of an arena
+ * @param[in] arena The arena
+ * @param[in] fp Output stream
+ */
+void arena_print_stats(struct ARENA *arena, FILE *fp) {
+    fprintf(fp, "arena: %ld allocations, %lu bytes in %d blocks, peak %lu bytes\n", arena->nallocs,
+            (unsigned long)arena->bytes, arena->nblocks, (unsigned long)arena->peak_bytes);
+}
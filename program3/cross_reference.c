@@ -169,12 +169,12 @@ static int parse_variable_names(void) {
 
     /* declaration */
     if (in_variable_declaration || is_formal_parameter) {
-        if (id_register_without_type(string_attr) == ERROR) {
+        if (id_register_without_type(token_span.ptr, token_span.len) == ERROR) {
             return ERROR;
         }
     }
     /* reference */
-    else if (register_linenum(string_attr) == ERROR) {
+    else if (register_linenum(get_string_attr()) == ERROR) {
         return ERROR;
     }
 
@@ -189,12 +189,12 @@ static int parse_variable_names(void) {
 
         /* definition */
         if (in_variable_declaration || is_formal_parameter) {
-            if (id_register_without_type(string_attr) == ERROR) {
+            if (id_register_without_type(token_span.ptr, token_span.len) == ERROR) {
                 return ERROR;
             }
         }
         /* reference */
-        else if (register_linenum(string_attr) == ERROR) {
+        else if (register_linenum(get_string_attr()) == ERROR) {
             return ERROR;
         }
 
@@ -396,7 +396,7 @@ static int parse_procedure_name(void) {
     if (definition_procedure_name) {
         struct TYPE *type;
         /* regist procedure name */
-        id_register_without_type(string_attr);
+        id_register_without_type(token_span.ptr, token_span.len);
         /* procedure name's type is TPPROC */
         type = std_type(TPPROC);
         /* error multiple definition or can not malloc */
@@ -404,14 +404,14 @@ static int parse_procedure_name(void) {
             return ERROR;
         }
 
-        set_procedure_name(string_attr);
+        set_procedure_name(get_string_attr());
     }
     /* reference */
     else {
-        if (register_linenum(string_attr) == ERROR) {
+        if (register_linenum(get_string_attr()) == ERROR) {
             return ERROR;
         }
-        id_procedure = search_procedure(string_attr);
+        id_procedure = search_procedure(get_string_attr());
     }
     token = scan();
 
@@ -769,7 +769,7 @@ static int parse_variable(void) {
         return error("Name is not found.");
     }
 
-    if ((id_type = register_linenum(string_attr)) == ERROR) {
+    if ((id_type = register_linenum(get_string_attr())) == ERROR) {
         return ERROR;
     }
 
@@ -778,7 +778,7 @@ static int parse_variable(void) {
     if (token == TLSQPAREN) {
         int exp_type = TPNONE;
         if (!(id_type & TPARRAY)) {
-            fprintf(stderr, "%s is not Array type.", string_attr);
+            fprintf(stderr, "%s is not Array type.", get_string_attr());
             return error("id is not Array type.");
         }
 
@@ -894,7 +894,7 @@ static int parse_output_statement(void) {
  */
 static int parse_output_format(void) {
     int exp_type = TPNONE;
-    if (token == TSTRING && strlen(string_attr) > 1) {
+    if (token == TSTRING && strlen(get_string_attr()) > 1) {
         token = scan();
         return NORMAL;
     }
@@ -1164,6 +1164,7 @@ static int parse_factor(void) {
  */
 static int parse_constant(void) {
     int constant_type = NORMAL;
+    int string_len;
 
     switch (token) {
         case TNUMBER:
@@ -1175,7 +1176,8 @@ static int parse_constant(void) {
             constant_type = TPBOOL;
             break;
         case TSTRING:
-            if (strlen(string_attr) != 1) {
+            get_string_value(&string_len);
+            if (string_len != 1) {
                 return error("Constant string length != 1");
             }
             constant_type = TPCHAR;
@@ -10,200 +10,273 @@
 #define INDENT_SIZE_DEF 4
 /* @} */
 
+/*! minimum number of the buckets of a table */
+#define ID_TAB_MINBUCKETS 64
+/*! initial length of the line numbers of the references to a name */
+#define LINE_MINREFS 8
+/*! number of the buckets of the type table, a power of 2 */
+#define TYPE_BUCKETS 256
+/*! initial size of the buffer of the cross reference table */
+#define REPORT_MINSIZE (16 * 1024)
+
+/*!
+ * @brief Buffer, into which the cross reference table is formatted
+ */
+struct REPORT {
+    char *buf;   /*! formatted characters, or NULL if the allocation failed */
+    size_t len;  /*! number of the formatted characters */
+    size_t size; /*! allocated size of buf */
+    int failed;  /*! 1 if an allocation failed, after which nothing is appended */
+};
+
 /*! search the name pointed by name */
-static struct ID *search_tab(struct ID **root, char *name, char *procname);
+static struct ID *search_tab(struct ID_TAB *tab, char *name, char *procname);
+/*! search the name of length namelen pointed by name */
+static struct ID *search_tab_n(struct ID_TAB *tab, const char *name, int namelen, char *procname);
+/*! search the name in the scope of the procedure, and then in the global scope */
+static struct ID *search_scope(char *name, char *procname);
 /*! Register the name pointed by name root */
-static int id_register_to_tab(struct ID **root, char *name, char *procname, struct TYPE **type, int ispara, int deflinenum);
+static int id_register_to_tab(struct ID_TAB *tab, const char *name, int namelen, char *procname, int ispara, int deflinenum);
+/*! Create a struct ID without type */
+static struct ID *new_id(const char *name, int namelen, char *procname, int ispara, int deflinenum);
+/*! Add a struct ID to the end of a table */
+static int add_id_to_tab(struct ID_TAB *tab, struct ID *p_id);
 /*! Add a type to the parameter list of a procedure name */
-static int add_type_to_parameter_list(struct ID **root, char *procname, struct TYPE **type);
+static int add_type_to_parameter_list(struct ID_TAB *tab, char *procname, struct TYPE **type);
+/*! Append a type to a parameter list */
+static struct TYPE *append_parameter(struct TYPE *paratp, struct TYPE *type);
 /*! Add id to crtab */
-static int add_id_to_crtab(struct ID *root);
-/*! Release the struct ID */
-static void free_strcut_ID(struct ID **root);
-/*! Release the struct TYPE */
-static void free_struct_TYPE(struct TYPE *root);
-
-/*! Pointers to root of global only & local only */
-struct ID *globalidroot, *localidroot;
-/*! Pointers to root of global + local symbol tables */
-struct ID *crtabroot;
-/*! Pointers to root of id symbol tables without type */
-struct ID *id_without_type_root;
+static void add_id_to_crtab(struct ID *p_id);
+/*! Hash the name of length namelen pointed by name */
+static unsigned long hash_name(const char *name, int namelen);
+/*! Double the buckets of a table */
+static int grow_buckets(struct ID_TAB *tab);
+/*! Release a table */
+static void release_tab(struct ID_TAB *tab);
+/*! Compare the names of two struct IDs */
+static int compare_ids(const void *a, const void *b);
+/*! Format and output the rows of the cross reference table */
+static void write_tab(struct ID **ids, int nids);
+/*! Reserve the space in the buffer of a report */
+static int report_reserve(struct REPORT *report, size_t n);
+/*! Append a string to a report */
+static int report_puts(struct REPORT *report, const char *s);
+/*! Append spaces to a report */
+static void report_pad(struct REPORT *report, int used, int width);
+/*! Append an integer to a report */
+static int report_int(struct REPORT *report, int value, int width);
+/*! Append a type to a report */
+static int report_type(struct REPORT *report, struct TYPE *type);
+
+/*! Symbol tables of the global scope and of the scope of the procedure being parsed */
+struct ID_TAB globalidtab, localidtab;
+/*! Cross reference table, the names of all the scopes linked by crnextp */
+struct ID_TAB crtab;
+/*! Symbol table of the names whose type is not yet parsed */
+struct ID_TAB id_without_type_tab;
+/*! Canonical types, chained by nextp for each hash */
+static struct TYPE *type_buckets[TYPE_BUCKETS];
 /*! the procedure name currenty being parsed */
-static char current_procedure_name[MAXSTRSIZE];
+static char *current_procedure_name = "";
+/*! allocated size of current_procedure_name, 0 while it is not allocated */
+static size_t current_procedure_name_size = 0;
 
 /*! To set the procedure name */
 void set_procedure_name(char *name) {
-    strncpy(current_procedure_name, name, MAXSTRSIZE);
-}
-
-/*!
- * @brief Add global id to crtab
- * @return int Return 0 on success and -1 on failure.
- */
-int add_globalid_to_crtab(void) {
-    return add_id_to_crtab(globalidroot);
+    size_t len = strlen(name);
+    char *buf;
+
+    if (len + 1 > current_procedure_name_size) {
+        buf = (current_procedure_name_size > 0) ? realloc(current_procedure_name, len + 1) : malloc(len + 1);
+        if (buf == NULL) {
+            error("can not malloc in set_procedure_name");
+            return;
+        }
+        current_procedure_name = buf;
+        current_procedure_name_size = len + 1;
+    }
+    memcpy(current_procedure_name, name, len + 1);
 }
 
 /*!
  * @brief Initialise the table
  */
 void init_crtab() {
-    globalidroot = NULL;
-    localidroot = NULL;
-    crtabroot = NULL;
-    id_without_type_root = NULL;
+    memset(&globalidtab, 0, sizeof(globalidtab));
+    memset(&localidtab, 0, sizeof(localidtab));
+    memset(&crtab, 0, sizeof(crtab));
+    memset(&id_without_type_tab, 0, sizeof(id_without_type_tab));
+    memset(type_buckets, 0, sizeof(type_buckets));
     return;
 }
 
 /*!
- * @brief Release tha data structure
+ * @brief Release tha data structure, and the arena of the compilation all at once
  */
 void release_crtab(void) {
-    free_strcut_ID(&globalidroot);
-    free_strcut_ID(&localidroot);
-    free_strcut_ID(&crtabroot);
-    free_strcut_ID(&id_without_type_root);
+    release_tab(&globalidtab);
+    release_tab(&localidtab);
+    release_tab(&crtab);
+    release_tab(&id_without_type_tab);
+    if (current_procedure_name_size > 0) {
+        free(current_procedure_name);
+        current_procedure_name = "";
+        current_procedure_name_size = 0;
+    }
+    arena_release(&compile_arena);
 
     init_crtab();
     return;
 }
 
 /*!
- * @brief Release tha localidroot and add local id to crtab
+ * @brief Pop the scope of the procedure, whose names stay in crtab
  * @return int Return 0 on success and -1 on failure.
  */
 int release_localidroot(void) {
-    free_strcut_ID(&localidroot);
+    release_tab(&localidtab);
     return 0;
 }
 
 /*!
  * @brief Register the name pointed by name global or local without type
- * @param[in] name Name to be registered
+ * @param[in] name Name to be registered, which need not be null-terminated
+ * @param[in] len Length of the name
  * @return int Return 0 on success and -1 on failure.
  */
-int id_register_without_type(char *name) {
+int id_register_without_type(const char *name, int len) {
     int ispara = is_formal_parameter;
     int deflinenum = get_linenum();
     if (in_subprogram_declaration) {
-        return id_register_to_tab(&id_without_type_root, name, current_procedure_name, NULL, ispara, deflinenum);
+        return id_register_to_tab(&id_without_type_tab, name, len, current_procedure_name, ispara, deflinenum);
     } else {
-        return id_register_to_tab(&id_without_type_root, name, NULL, NULL, ispara, deflinenum);
+        return id_register_to_tab(&id_without_type_tab, name, len, NULL, ispara, deflinenum);
     }
 }
 
 /*!
- * @brief Register the name pointed by name global or local
+ * @brief Register the names without type global or local, as the type
+ * @details The names are moved to the scope and to crtab, so that each name has a single struct ID.
  * @param[in] type type for a name to be registered
  * @return int Return 0 on success and -1 on failure.
  */
 int id_register_as_type(struct TYPE **type) {
-    int ret, ret1;
+    struct ID_TAB *tab;
     struct ID *p;
 
     if (type == NULL) {
         return error("struct TYPE is NULL\n");
     }
 
-    for (p = id_without_type_root; p != NULL; p = p->nextp) {
-        char *name = p->name;
-        char *current_procedure_name = p->procname;
-        int ispara = p->ispara;
-        int deflinenum = p->deflinenum;
-        if (definition_procedure_name) {
-            /* regist procedure name */
-            ret = id_register_to_tab(&globalidroot, name, NULL, type, ispara, deflinenum);
-            ret1 = id_register_to_tab(&crtabroot, name, NULL, type, ispara, deflinenum);
-        } else if (in_subprogram_declaration) {
-            /* regist local name and formal parameter */
-            ret = id_register_to_tab(&localidroot, name, current_procedure_name, type, ispara, deflinenum);
-            ret1 = id_register_to_tab(&crtabroot, name, current_procedure_name, type, ispara, deflinenum);
+    while ((p = id_without_type_tab.root) != NULL) {
+        id_without_type_tab.root = p->nextp;
+        p->nextp = NULL;
+        if (definition_procedure_name || !in_subprogram_declaration) {
+            /* regist procedure name or global name */
+            p->procname = NULL;
+            tab = &globalidtab;
         } else {
-            /* regist global name */
-            ret = id_register_to_tab(&globalidroot, name, NULL, type, ispara, deflinenum);
-            ret1 = id_register_to_tab(&crtabroot, name, NULL, type, ispara, deflinenum);
+            /* regist local name and formal parameter */
+            tab = &localidtab;
         }
-        if (ret == ERROR || ret1 == ERROR)
+        /* the names share the canonical type */
+        p->itp = *type;
+        if (add_id_to_tab(tab, p) == ERROR) {
+            release_tab(&id_without_type_tab);
             return ERROR;
+        }
+        add_id_to_crtab(p);
 
         /* Add a type to the parameter list of a procedure name */
         if (is_formal_parameter) {
-            add_type_to_parameter_list(&globalidroot, current_procedure_name, type);
-            add_type_to_parameter_list(&crtabroot, current_procedure_name, type);
+            add_type_to_parameter_list(&globalidtab, p->procname, type);
         }
     }
-    free_strcut_ID(&id_without_type_root);
-    free(*type);
+    release_tab(&id_without_type_tab);
     type = NULL;
     return 0;
 }
 
 /*!
- * @brief Create a structure of the standard type
- * @param[in] type Code representing the type
- * @return struct TYPE * Return a pointer to the created structure. 
+ * @brief Return the canonical type, which is created only once for each distinct type
+ * @details The types are immutable and shared, so that two types are the same if and only if
+ * their pointers are equal. They are released with the arena of the compilation.
+ * @param[in] ttype Code representing the type
+ * @param[in] arraysize size of array, if TPARRAY
+ * @param[in] etp canonical element type if TPARRAY, otherwise NULL
+ * @param[in] paratp canonical parameter list if TPPROC, or the rest of a parameter list
+ * @return struct TYPE * Return a pointer to the canonical type, or NULL on failure.
  */
-struct TYPE *std_type(int type) {
+struct TYPE *intern_type(int ttype, int arraysize, struct TYPE *etp, struct TYPE *paratp) {
+    unsigned long hash;
     struct TYPE *p_type;
+    struct TYPE **p_bucket;
+
+    /* the element type and the parameter list are canonical, whose pointers are hashed */
+    hash = (unsigned long)ttype * 31 + (unsigned long)arraysize;
+    hash = hash * 31 + (unsigned long)(size_t)etp / sizeof(struct TYPE);
+    hash = hash * 31 + (unsigned long)(size_t)paratp / sizeof(struct TYPE);
+    p_bucket = &type_buckets[hash & (TYPE_BUCKETS - 1)];
+    for (p_type = *p_bucket; p_type != NULL; p_type = p_type->nextp) {
+        if (p_type->ttype == ttype && p_type->arraysize == arraysize && p_type->etp == etp &&
+            p_type->paratp == paratp) {
+            return p_type;
+        }
+    }
+
     /* struct TYPE */
-    if ((p_type = (struct TYPE *)malloc(sizeof(struct TYPE))) == NULL) {
-        error("can not malloc for struct TYPE in std_type\n");
+    if ((p_type = (struct TYPE *)arena_alloc(&compile_arena, sizeof(struct TYPE))) == NULL) {
+        error("can not malloc for struct TYPE in intern_type\n");
         return (NULL);
     }
-    /* set type only */
-    p_type->ttype = type;
-    p_type->arraysize = 0;
-    p_type->etp = NULL;
-    p_type->paratp = NULL;
+    p_type->ttype = ttype;
+    p_type->arraysize = arraysize;
+    p_type->etp = etp;
+    p_type->paratp = paratp;
+    p_type->nextp = *p_bucket;
+    *p_bucket = p_type;
     return p_type;
 }
 
 /*!
- * @brief Create a structure of the array type
+ * @brief Return the structure of the standard type
+ * @param[in] type Code representing the type
+ * @return struct TYPE * Return a pointer to the canonical type. 
+ */
+struct TYPE *std_type(int type) {
+    /* set type only */
+    return intern_type(type, 0, NULL, NULL);
+}
+
+/*!
+ * @brief Return the structure of the array type, whose size is num_attr
  * @param[in] type Code representing the type
- * @return struct TYPE * Return a pointer to the created structure. 
+ * @return struct TYPE * Return a pointer to the canonical type. 
  */
 struct TYPE *array_type(int type) {
-    struct TYPE *p_type;
     struct TYPE *p_etp;
-    /* struct TYPE */
-    if ((p_type = (struct TYPE *)malloc(sizeof(struct TYPE))) == NULL) {
-        error("can not malloc1 for struct TYPE in array_type\n");
-        return (NULL);
-    }
-    /* set array type */
-    p_type->ttype = type;
-    p_type->arraysize = num_attr;
 
-    /* struct TYPE ->etp */
-    if ((p_etp = (struct TYPE *)malloc(sizeof(struct TYPE))) == NULL) {
-        error("can not malloc2 for struct TYPE in array_type\n");
-        return (NULL);
-    }
     /* set element type */
     switch (type) {
         case TPARRAYINT:
-            p_etp->ttype = TPINT;
+            p_etp = std_type(TPINT);
             break;
         case TPARRAYCHAR:
-            p_etp->ttype = TPCHAR;
+            p_etp = std_type(TPCHAR);
             break;
         case TPARRAYBOOL:
-            p_etp->ttype = TPBOOL;
+            p_etp = std_type(TPBOOL);
             break;
         default:
             fprintf(stderr, "[%d] is not array type code.\n", type);
             error("type is not array type code.\n");
             return (NULL);
     }
-    p_etp->arraysize = 0;
-    p_etp->etp = NULL;
-    p_etp->paratp = NULL;
-
-    p_type->etp = p_etp;
-    p_type->paratp = NULL;
-    return p_type;
+    if (p_etp == NULL) {
+        return (NULL);
+    }
+    /* set array type */
+    return intern_type(type, num_attr, p_etp, NULL);
 }
 
 /*!
@@ -213,28 +286,16 @@ struct TYPE *array_type(int type) {
  */
 int register_linenum(char *name) {
     struct ID *p_id;
-    struct ID *p_crtab_id;
-    struct LINE *p_line;
-    struct LINE *p_crtab_line;
-    struct LINE *p_line_tail;
-    struct LINE *p_crtab_line_tail;
+    int *p_reflinenums;
+    int size;
     int id_type;
 
     if (in_subprogram_declaration) {
         char *procname = current_procedure_name;
-        /* search local */
-        if ((p_id = search_tab(&localidroot, name, procname)) == NULL) {
-            /* search global */
-            if ((p_id = search_tab(&globalidroot, name, NULL)) == NULL) {
-                fprintf(stderr, "%s was not declared in this scope.", name);
-                return error("An undefined name was detected.");
-            } else {
-                /* id found in global */
-                p_crtab_id = search_tab(&crtabroot, name, NULL);
-            }
-        } else {
-            /* id found in local */
-            p_crtab_id = search_tab(&crtabroot, name, procname);
+        /* search local, and then global */
+        if ((p_id = search_scope(name, procname)) == NULL) {
+            fprintf(stderr, "%s was not declared in this scope.", name);
+            return error("An undefined name was detected.");
         }
 
         /* recursively called error */
@@ -244,51 +305,29 @@ int register_linenum(char *name) {
         }
     } else {
         /* search global */
-        if ((p_id = search_tab(&globalidroot, name, NULL)) == NULL) {
+        if ((p_id = search_scope(name, NULL)) == NULL) {
             fprintf(stderr, "%s was not declared in this scope.", name);
             return error("An undefined name was detected.");
-        } else {
-            p_crtab_id = search_tab(&crtabroot, name, NULL);
         }
     }
 
     /* the type of the variable. */
     id_type = p_id->itp->ttype;
 
-    if ((p_line = (struct LINE *)malloc(sizeof(struct LINE))) == NULL) {
-        return error("can not malloc1 for struct LINE in register_linenum\n");
-    }
-    p_line->reflinenum = get_linenum();
-    p_line->nextlinep = NULL;
-
-    /* Move to the end of the list */
-    /* and register linenum */
-    p_line_tail = p_id->irefp;
-    if (p_line_tail == NULL) {
-        p_id->irefp = p_line;
-    } else {
-        while (p_line_tail->nextlinep != NULL) {
-            p_line_tail = p_line_tail->nextlinep;
+    /* register linenum at the end of the references, doubling them as needed */
+    if (p_id->irefs.nrefs == p_id->irefs.size) {
+        size = (p_id->irefs.size > 0) ? p_id->irefs.size * 2 : LINE_MINREFS;
+        /* the old ones are left in the arena, which are at most as many as the new ones */
+        if ((p_reflinenums = (int *)arena_alloc(&compile_arena, sizeof(int) * size)) == NULL) {
+            return error("can not malloc for struct LINE in register_linenum\n");
         }
-        p_line_tail->nextlinep = p_line;
-    }
-
-    /* for crtab */
-    if ((p_crtab_line = (struct LINE *)malloc(sizeof(struct LINE))) == NULL) {
-        return error("can not malloc2 for struct LINE in register_linenum\n");
-    }
-    p_crtab_line->reflinenum = get_linenum();
-    p_crtab_line->nextlinep = NULL;
-
-    p_crtab_line_tail = p_crtab_id->irefp;
-    if (p_crtab_line_tail == NULL) {
-        p_crtab_id->irefp = p_crtab_line;
-    } else {
-        while (p_crtab_line_tail->nextlinep != NULL) {
-            p_crtab_line_tail = p_crtab_line_tail->nextlinep;
+        if (p_id->irefs.nrefs > 0) {
+            memcpy(p_reflinenums, p_id->irefs.reflinenums, sizeof(int) * p_id->irefs.nrefs);
         }
-        p_crtab_line_tail->nextlinep = p_crtab_line;
+        p_id->irefs.reflinenums = p_reflinenums;
+        p_id->irefs.size = size;
     }
+    p_id->irefs.reflinenums[p_id->irefs.nrefs++] = get_linenum();
 
     return id_type;
 }
@@ -300,90 +339,349 @@ int register_linenum(char *name) {
  */
 struct ID *search_procedure(char *procname) {
     struct ID *p;
-    p = search_tab(&globalidroot, procname, NULL);
+    p = search_tab(&globalidtab, procname, NULL);
     return p;
 }
 
 /*!
- * @brief Output the cross reference table
- * @param[in] root pointer cross reference table
+ * @brief Output the cross reference table in the order of the declarations
+ * @param[in] root pointer cross reference table, linked by crnextp
  */
 void print_tab(struct ID *root) {
     struct ID *p;
-    struct LINE *q;
+    struct ID **ids;
+    int nids = 0;
 
-    fprintf(stdout, "-----------------------------------------------------------------------------------------\n");
-    fprintf(stdout, "%-*s", INDENT_SIZE_NAME, "Name");
-    fprintf(stdout, "%-*s", INDENT_SIZE_TYPE, "Type");
-    fprintf(stdout, "Def. | Ref.\n");
-    for (p = root; p != NULL; p = p->nextp) {
+    for (p = root; p != NULL; p = p->crnextp) {
+        nids++;
+    }
+    if ((ids = (struct ID **)malloc(sizeof(struct ID *) * (nids > 0 ? nids : 1))) == NULL) {
+        error("can not malloc in print_tab\n");
+        return;
+    }
+    nids = 0;
+    for (p = root; p != NULL; p = p->crnextp) {
+        ids[nids++] = p;
+    }
+    write_tab(ids, nids);
+    free(ids);
+    return;
+}
+
+/*!
+ * @brief Output the cross reference table sorted by the name, and then by the procedure name
+ * @details The global name comes before the local names of the same name.
+ * @param[in] root pointer cross reference table, linked by crnextp
+ */
+void print_sorted_tab(struct ID *root) {
+    struct ID *p;
+    struct ID **ids;
+    int nids = 0;
+
+    for (p = root; p != NULL; p = p->crnextp) {
+        nids++;
+    }
+    if ((ids = (struct ID **)malloc(sizeof(struct ID *) * (nids > 0 ? nids : 1))) == NULL) {
+        error("can not malloc in print_sorted_tab\n");
+        return;
+    }
+    nids = 0;
+    for (p = root; p != NULL; p = p->crnextp) {
+        ids[nids++] = p;
+    }
+    qsort(ids, nids, sizeof(struct ID *), compare_ids);
+    write_tab(ids, nids);
+    free(ids);
+    return;
+}
+
+/*!
+ * @brief Compare the names, and then the procedure names of two struct IDs for qsort
+ * @param[in] a pointer to a pointer to struct ID
+ * @param[in] b pointer to a pointer to struct ID
+ * @return int Return negative if a comes first, positive if b comes first.
+ */
+static int compare_ids(const void *a, const void *b) {
+    const struct ID *p = *(struct ID *const *)a;
+    const struct ID *q = *(struct ID *const *)b;
+    int cmp;
+
+    if ((cmp = strcmp(p->name, q->name)) != 0) {
+        return cmp;
+    }
+    if (p->procname == NULL || q->procname == NULL) {
+        /* global name first */
+        if (p->procname != q->procname) {
+            return (p->procname == NULL) ? -1 : 1;
+        }
+    } else if ((cmp = strcmp(p->procname, q->procname)) != 0) {
+        return cmp;
+    }
+    return p->deflinenum - q->deflinenum;
+}
+
+/*!
+ * @brief Format the cross reference table into a buffer, and write it at once to the standard output
+ * @param[in] ids struct IDs in the order of the rows
+ * @param[in] nids number of the struct IDs
+ */
+static void write_tab(struct ID **ids, int nids) {
+    static const char rule[] = "-----------------------------------------------------------------------------------------\n";
+    struct REPORT report;
+    struct ID *p;
+    int i, j, width;
+
+    report.len = 0;
+    report.size = 0;
+    report.buf = NULL;
+    report.failed = 0;
+    report_puts(&report, rule);
+    report_pad(&report, report_puts(&report, "Name"), INDENT_SIZE_NAME);
+    report_pad(&report, report_puts(&report, "Type"), INDENT_SIZE_TYPE);
+    report_puts(&report, "Def. | Ref.\n");
+    for (i = 0; i < nids; i++) {
+        p = ids[i];
         /* Name */
+        width = report_puts(&report, p->name);
         if (p->procname != NULL) {
-            char name_procname[INDENT_SIZE_NAME];
-            sprintf(name_procname, "%s:%s", p->name, p->procname);
-            fprintf(stdout, "%-*s", INDENT_SIZE_NAME, name_procname);
-        } else {
-            fprintf(stdout, "%-*s", INDENT_SIZE_NAME, p->name);
+            width += report_puts(&report, ":");
+            width += report_puts(&report, p->procname);
         }
+        report_pad(&report, width, INDENT_SIZE_NAME);
 
         /* Type */
+        width = report_type(&report, p->itp);
         if (p->itp->ttype == TPPROC) {
-            struct TYPE *paratp;
-            int remaining_space = INDENT_SIZE_TYPE;
-
-            /* +1 is space of '(' */
-            remaining_space -= strlen(typestr[p->itp->ttype]) + 1;
-            fprintf(stdout, "%s(", typestr[p->itp->ttype]);
-
-            for (paratp = p->itp->paratp; paratp != NULL; paratp = paratp->paratp) {
-                remaining_space -= strlen(typestr[paratp->ttype]);
-                fprintf(stdout, "%s", typestr[paratp->ttype]);
-                if (paratp->paratp != NULL) {
-                    remaining_space -= 1;
-                    fprintf(stdout, ",");
-                }
-            }
-            remaining_space -= 1;
-            fprintf(stdout, ")");
-            fprintf(stdout, "%*s", 0 < remaining_space ? remaining_space : 0, " ");
-        } else if (p->itp->ttype & TPARRAY) {
-            /* id is array type */
-            struct TYPE *p_type = p->itp;
-            char str_array_of_type[INDENT_SIZE_TYPE];
-            sprintf(str_array_of_type, "array[%d] of %s", p_type->arraysize, typestr[p_type->ttype]);
-            fprintf(stdout, "%-*s", INDENT_SIZE_TYPE, str_array_of_type);
+            /* at least one space after the parameters */
+            report_pad(&report, (width < INDENT_SIZE_TYPE) ? width : INDENT_SIZE_TYPE - 1, INDENT_SIZE_TYPE);
         } else {
-            /* id is standard type */
-            fprintf(stdout, "%-*s", INDENT_SIZE_TYPE, typestr[p->itp->ttype]);
+            report_pad(&report, width, INDENT_SIZE_TYPE);
         }
 
         /* Def. */
-        fprintf(stdout, "%*d", INDENT_SIZE_DEF, p->deflinenum);
+        report_int(&report, p->deflinenum, INDENT_SIZE_DEF);
         /* separator */
-        fprintf(stdout, " | ");
+        report_puts(&report, " | ");
         /* Ref. */
-        for (q = p->irefp; q != NULL; q = q->nextlinep) {
-            fprintf(stdout, "%d", q->reflinenum);
-            fprintf(stdout, "%s", q->nextlinep == NULL ? "" : ",");
+        for (j = 0; j < p->irefs.nrefs; j++) {
+            if (j > 0) {
+                report_puts(&report, ",");
+            }
+            report_int(&report, p->irefs.reflinenums[j], 0);
         }
-        fprintf(stdout, "\n");
+        report_puts(&report, "\n");
+    }
+    report_puts(&report, rule);
+
+    if (report.failed || report.buf == NULL) {
+        free(report.buf);
+        error("can not malloc in print_tab\n");
+        return;
     }
-    fprintf(stdout, "-----------------------------------------------------------------------------------------\n");
+    fwrite(report.buf, 1, report.len, stdout);
+    free(report.buf);
     return;
 }
 
+/*!
+ * @brief Append a type to a report, as it is printed in the cross reference table
+ * @param[in] report The report
+ * @param[in] type The type
+ * @return int Return the number of the characters written.
+ */
+static int report_type(struct REPORT *report, struct TYPE *type) {
+    struct TYPE *paratp;
+    int width;
+
+    if (type->ttype == TPPROC) {
+        width = report_puts(report, typestr[type->ttype]);
+        width += report_puts(report, "(");
+        for (paratp = type->paratp; paratp != NULL; paratp = paratp->paratp) {
+            width += report_puts(report, typestr[paratp->ttype]);
+            if (paratp->paratp != NULL) {
+                width += report_puts(report, ",");
+            }
+        }
+        width += report_puts(report, ")");
+    } else if (type->ttype & TPARRAY) {
+        /* id is array type */
+        width = report_puts(report, "array[");
+        width += report_int(report, type->arraysize, 0);
+        width += report_puts(report, "] of ");
+        width += report_puts(report, typestr[type->ttype]);
+    } else {
+        /* id is standard type */
+        width = report_puts(report, typestr[type->ttype]);
+    }
+    return width;
+}
+
+/*!
+ * @brief Write the cross reference table to a cross reference index
+ * @param[in] root pointer cross reference table, linked by crnextp
+ * @param[in] source Name of the source file
+ * @param[in] path Path of the index
+ * @return int Return 0 on success, -1 on failure.
+ */
+int write_xref_index(struct ID *root, char *source, char *path) {
+    struct XREF_BUILDER builder;
+    struct REPORT type;
+    struct ID *p;
+    int file, ret = 0;
+
+    xref_builder_init(&builder);
+    type.len = 0;
+    type.size = 0;
+    type.buf = NULL;
+    type.failed = 0;
+    if ((file = xref_builder_add_file(&builder, source)) == -1) {
+        ret = -1;
+    }
+    for (p = root; p != NULL && ret == 0; p = p->crnextp) {
+        /* the type string is terminated by the null character */
+        type.len = 0;
+        report_type(&type, p->itp);
+        if (report_reserve(&type, 1) == -1 || type.failed) {
+            ret = -1;
+            break;
+        }
+        type.buf[type.len] = '\0';
+        if (xref_builder_add(&builder, file, p->name, p->procname, type.buf, p->deflinenum, p->irefs.reflinenums,
+                             p->irefs.nrefs) == -1) {
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        ret = xref_builder_write(&builder, path);
+    }
+    if (ret == -1) {
+        fprintf(stderr, "Index %s can not be written.\n", path);
+        error("can not write the cross reference index\n");
+    }
+    free(type.buf);
+    xref_builder_release(&builder);
+    return ret;
+}
+
+/*!
+ * @brief Reserve the space of n more characters in the buffer of a report
+ * @param[in] report The report
+ * @param[in] n number of the characters
+ * @return int Return 0 on success, -1 on failure, after which the report is empty.
+ */
+static int report_reserve(struct REPORT *report, size_t n) {
+    size_t size;
+    char *buf;
+
+    if (report->failed) {
+        return -1;
+    }
+    if (report->len + n <= report->size) {
+        return 0;
+    }
+    for (size = (report->size > 0) ? report->size : REPORT_MINSIZE; size < report->len + n; size *= 2) {
+    }
+    if ((buf = (char *)realloc(report->buf, size)) == NULL) {
+        free(report->buf);
+        report->buf = NULL;
+        report->len = 0;
+        report->size = 0;
+        report->failed = 1;
+        return -1;
+    }
+    report->buf = buf;
+    report->size = size;
+    return 0;
+}
+
+/*!
+ * @brief Append a string to a report
+ * @param[in] report The report
+ * @param[in] s The string
+ * @return int Return the length of the string.
+ */
+static int report_puts(struct REPORT *report, const char *s) {
+    size_t len = strlen(s);
+
+    if (report_reserve(report, len) == 0) {
+        memcpy(report->buf + report->len, s, len);
+        report->len += len;
+    }
+    return (int)len;
+}
+
+/*!
+ * @brief Append spaces to a report, so that a column of the width is filled
+ * @param[in] report The report
+ * @param[in] used number of the characters already written to the column
+ * @param[in] width width of the column
+ */
+static void report_pad(struct REPORT *report, int used, int width) {
+    if (used < width && report_reserve(report, width - used) == 0) {
+        memset(report->buf + report->len, ' ', width - used);
+        report->len += width - used;
+    }
+}
+
+/*!
+ * @brief Append a decimal integer to a report, right-justified in the width
+ * @param[in] report The report
+ * @param[in] value The integer
+ * @param[in] width minimum width, or 0
+ * @return int Return the number of the characters written.
+ */
+static int report_int(struct REPORT *report, int value, int width) {
+    char digits[sizeof(int) * 3 + 2];
+    char *p = digits + sizeof(digits);
+    unsigned int u = (value < 0) ? 0U - (unsigned int)value : (unsigned int)value;
+    int len;
+
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (value < 0) {
+        *--p = '-';
+    }
+    len = (int)(digits + sizeof(digits) - p);
+    report_pad(report, len, width);
+    if (report_reserve(report, len) == 0) {
+        memcpy(report->buf + report->len, p, len);
+        report->len += len;
+    }
+    return (len < width) ? width : len;
+}
+
 /*!
  * @brief search the name pointed by name and procname
- * @param[in] root The root of the id-list
+ * @param[in] tab The table
  * @param[in] name Name you want to find
  * @param[in] procname procedure name you want to find
  * @return struct TYPE * Return a pointer to the structure with matching name. 
  */
-static struct ID *search_tab(struct ID **root, char *name, char *procname) {
+static struct ID *search_tab(struct ID_TAB *tab, char *name, char *procname) {
+    return search_tab_n(tab, name, strlen(name), procname);
+}
+
+/*!
+ * @brief search the name of length namelen pointed by name and procname
+ * @param[in] tab The table
+ * @param[in] name Name you want to find, which need not be null-terminated
+ * @param[in] namelen Length of the name
+ * @param[in] procname procedure name you want to find
+ * @return struct TYPE * Return a pointer to the structure with matching name.
+ */
+static struct ID *search_tab_n(struct ID_TAB *tab, const char *name, int namelen, char *procname) {
     struct ID *p;
+    unsigned long hash;
 
-    for (p = *root; p != NULL; p = p->nextp) {
-        if (strcmp(name, p->name) == 0) {
+    if (tab->nbuckets == 0) {
+        return (NULL);
+    }
+    hash = hash_name(name, namelen);
+    /* only the names of the same hash are compared */
+    for (p = tab->buckets[hash & (tab->nbuckets - 1)]; p != NULL; p = p->hashnextp) {
+        if (p->hash == hash && strncmp(name, p->name, namelen) == 0 && p->name[namelen] == '\0') {
             /* when name and p->name are globalid(= procname and p->procname are NULL) */
             if (procname == NULL && p->procname == NULL) {
                 return (p);
@@ -397,217 +695,222 @@ static struct ID *search_tab(struct ID **root, char *name, char *procname) {
     return (NULL);
 }
 
+/*!
+ * @brief search the name in the scope of the procedure, and then in the global scope
+ * @param[in] name Name you want to find
+ * @param[in] procname procedure name being parsed, NULL if it is not in a procedure
+ * @return struct ID * Return a pointer to the innermost structure with matching name, or NULL.
+ */
+static struct ID *search_scope(char *name, char *procname) {
+    struct ID *p;
+
+    if (procname != NULL && (p = search_tab(&localidtab, name, procname)) != NULL) {
+        return p;
+    }
+    return search_tab(&globalidtab, name, NULL);
+}
+
 /*!
  * @brief Add a type to the parameter list of a procedure name
+ * @param[in] tab The table
  * @param[in] procname procedure name to add parameter to
  * @param[in] type parameter's type
  * @return int Return 0 on success and -1 on failure.
  */
-static int add_type_to_parameter_list(struct ID **root, char *procname, struct TYPE **type) {
+static int add_type_to_parameter_list(struct ID_TAB *tab, char *procname, struct TYPE **type) {
     struct ID *p_id;
     struct TYPE *p_paratp;
     /* search procedure name */
     /* procedure name is global id */
-    if ((p_id = search_tab(root, procname, NULL)) == NULL) {
+    if ((p_id = search_tab(tab, procname, NULL)) == NULL) {
         fprintf(stderr, "'%s' is not found.", procname);
         return error("procedure name is not found.");
     }
-    /* Move to the end of the list */
-    p_paratp = p_id->itp;
-    while (p_paratp->paratp != NULL) {
-        p_paratp = p_paratp->paratp;
-    }
-    /* add type */
-    if ((p_paratp->paratp = (struct TYPE *)malloc(sizeof(struct TYPE))) == NULL) {
-        error("can not malloc1 for struct TYPE in add_type_to_parameter_list\n");
+    /* the type of the procedure is replaced, since the types are immutable */
+    if ((p_paratp = append_parameter(p_id->itp->paratp, *type)) == NULL ||
+        (p_paratp = intern_type(p_id->itp->ttype, 0, NULL, p_paratp)) == NULL) {
         return ERROR;
     }
-    p_paratp->paratp->ttype = (*type)->ttype;
-    p_paratp->paratp->arraysize = (*type)->arraysize;
+    p_id->itp = p_paratp;
+    return 0;
+}
 
-    /* if parameter's type is TPARRAY, parameter's type has element type */
-    if ((*type)->ttype & TPARRAY) {
-        struct TYPE *p_etype;
-        if ((p_etype = (struct TYPE *)malloc(sizeof(struct TYPE))) == NULL) {
-            return error("can not malloc2 for struct TYPE in add_type_to_parameter_list\n");
-        }
-        p_etype->ttype = (*type)->ttype;
-        p_etype->arraysize = (*type)->arraysize;
-        /* element type must be standard type(etp == NULL) */
-        p_etype->etp = NULL;
-        /* element type doesn't have parameter list */
-        p_etype->paratp = NULL;
-        /* register element type */
-        p_paratp->paratp->etp = p_etype;
-    } else {
-        /* parameter type is standard type */
-        /* standard type doesn't have element type */
-        p_paratp->paratp->etp = NULL;
-    }
-    /* another parameter */
-    /* next pointer of parameter list is NULL */
-    p_paratp->paratp->paratp = NULL;
+/*!
+ * @brief Append a type to a parameter list
+ * @param[in] paratp canonical parameter list, whose cells are the types chained by paratp
+ * @param[in] type parameter's type
+ * @return struct TYPE * Return a pointer to the canonical parameter list, or NULL on failure.
+ */
+static struct TYPE *append_parameter(struct TYPE *paratp, struct TYPE *type) {
+    struct TYPE *rest;
 
-    return 0;
+    if (paratp == NULL) {
+        return intern_type(type->ttype, type->arraysize, type->etp, NULL);
+    }
+    if ((rest = append_parameter(paratp->paratp, type)) == NULL) {
+        return NULL;
+    }
+    return intern_type(paratp->ttype, paratp->arraysize, paratp->etp, rest);
 }
 
 /*!
- * @brief Register the name pointed by name root
- * @param[in] root The root of the list struct
- * @param[in] name Name to be registered
+ * @brief Register the name pointed by name at the end of a table
+ * @param[in] tab The table
+ * @param[in] name Name to be registered, which need not be null-terminated
+ * @param[in] namelen Length of the name
  * @param[in] procname procedure name
- * @param[in] type type for a name
  * @param[in] ispara If it is a formal parameter, then 1, otherwise 0
  * @param[in] deflinenum The line number where the name is defined.
  * @return int Return 0 on success and -1 on failure.
  */
-static int id_register_to_tab(struct ID **root, char *name, char *procname, struct TYPE **type, int ispara, int deflinenum) {
+static int id_register_to_tab(struct ID_TAB *tab, const char *name, int namelen, char *procname, int ispara, int deflinenum) {
     struct ID *p_id;
-    struct ID *p_id_tail;
-    struct TYPE *p_type;
-    char *p_name;
-    char *p_procname;
 
-    if ((p_id = search_tab(root, name, procname)) != NULL) {
-        fprintf(stderr, "multiple definition of '%s'.\n", name);
+    if (search_tab_n(tab, name, namelen, procname) != NULL) {
+        fprintf(stderr, "multiple definition of '%.*s'.\n", namelen, name);
         return error("multiple definition");
     }
+    if ((p_id = new_id(name, namelen, procname, ispara, deflinenum)) == NULL) {
+        return ERROR;
+    }
+    if (add_id_to_tab(tab, p_id) == ERROR) {
+        return ERROR;
+    }
+    return 0;
+}
+
+/*!
+ * @brief Create a struct ID without type
+ * @param[in] name Name, which need not be null-terminated
+ * @param[in] namelen Length of the name
+ * @param[in] procname procedure name, NULL if it is a global name
+ * @param[in] ispara If it is a formal parameter, then 1, otherwise 0
+ * @param[in] deflinenum The line number where the name is defined.
+ * @return struct ID * Return a pointer to the created structure, or NULL on failure.
+ */
+static struct ID *new_id(const char *name, int namelen, char *procname, int ispara, int deflinenum) {
+    struct ID *p_id;
 
     /* struct ID */
-    if ((p_id = (struct ID *)malloc(sizeof(struct ID))) == NULL) {
-        return error("can not malloc1 for struct ID in id_register_to_tab\n");
+    if ((p_id = (struct ID *)arena_alloc(&compile_arena, sizeof(struct ID))) == NULL) {
+        error("can not malloc1 for struct ID in new_id\n");
+        return NULL;
     }
+    memset(p_id, 0, sizeof(struct ID));
 
     /* struct ID ->name */
-    if ((p_name = (char *)malloc(strlen(name) + 1)) == NULL) {
-        return error("can not malloc2 for name in id_register_to_tab\n");
+    if ((p_id->name = arena_strndup(&compile_arena, name, namelen)) == NULL) {
+        error("can not malloc2 for name in new_id\n");
+        return NULL;
     }
-    strcpy(p_name, name);
-    p_id->name = p_name;
 
-    /* struct ID ->procname */
-    if (procname == NULL) {
-        /* id is global name */
-        p_id->procname = NULL;
-    } else {
-        /* procedure name is registered because id is local name */
-        if ((p_procname = (char *)malloc(strlen(procname) + 1)) == NULL) {
-            return error("can not malloc3 for procname in id_register_to_tab\n");
-        }
-        strcpy(p_procname, procname);
-        p_id->procname = p_procname;
+    /* struct ID ->procname, which is registered if id is local name */
+    if (procname != NULL && (p_id->procname = arena_strndup(&compile_arena, procname, strlen(procname))) == NULL) {
+        error("can not malloc3 for procname in new_id\n");
+        return NULL;
     }
 
-    /* struct TYPE ->itp */
-    if (type == NULL) {
-        /* register id without type */
-        p_id->itp = NULL;
-    } else {
-        /* register id with type */
-        if ((p_type = (struct TYPE *)malloc(sizeof(struct TYPE))) == NULL) {
-            return error("can not malloc4 for struct TYPE in id_register_to_tab\n");
-        }
-        p_type->ttype = (*type)->ttype;
-        p_type->arraysize = (*type)->arraysize;
-        /* if id's type is TPARRAY, id's type has element type */
-        if ((*type)->ttype & TPARRAY) {
-            struct TYPE *p_etype;
-            if ((p_etype = (struct TYPE *)malloc(sizeof(struct TYPE))) == NULL) {
-                return error("can not malloc5 for struct TYPE in id_register_to_tab\n");
-            }
-            p_etype->ttype = (*type)->ttype;
-            p_etype->arraysize = (*type)->arraysize;
-            /* element type must be standard type */
-            p_etype->etp = NULL;
-            p_etype->paratp = NULL;
-            /* register element type */
-            p_type->etp = p_etype;
-        } else {
-            /* id is standard type or procedure */
-            p_type->etp = NULL;
-        }
-        p_type->paratp = NULL;
-        p_id->itp = p_type;
-    }
     p_id->ispara = ispara;
     p_id->deflinenum = deflinenum;
-    p_id->irefp = NULL;
-    p_id->nextp = NULL;
+    p_id->hash = hash_name(name, namelen);
+    return p_id;
+}
 
-    /* Move to the end of the list */
-    /* and register a variable */
-    p_id_tail = *root;
-    if (p_id_tail == NULL) {
-        *root = p_id;
-    } else {
-        while (p_id_tail->nextp != NULL) {
-            p_id_tail = p_id_tail->nextp;
-        }
-        p_id_tail->nextp = p_id;
+/*!
+ * @brief Add a struct ID to the end of a table
+ * @param[in] tab The table
+ * @param[in] p_id The struct ID, whose name must not be registered in the table
+ * @return int Return 0 on success and -1 on failure.
+ */
+static int add_id_to_tab(struct ID_TAB *tab, struct ID *p_id) {
+    struct ID **p_bucket;
+
+    if (search_tab(tab, p_id->name, p_id->procname) != NULL) {
+        fprintf(stderr, "multiple definition of '%s'.\n", p_id->name);
+        return error("multiple definition");
+    }
+
+    /* keep the load factor at most 1 */
+    if (tab->nids >= tab->nbuckets && grow_buckets(tab) == ERROR) {
+        return ERROR;
     }
+    p_bucket = &tab->buckets[p_id->hash & (tab->nbuckets - 1)];
+    p_id->hashnextp = *p_bucket;
+    *p_bucket = p_id;
 
+    /* register a variable at the end of the list */
+    p_id->nextp = NULL;
+    if (tab->tail == NULL) {
+        tab->root = p_id;
+    } else {
+        tab->tail->nextp = p_id;
+    }
+    tab->tail = p_id;
+    tab->nids++;
     return 0;
 }
 
 /*!
- * @brief Add id to crtab
- * @param[in] root The root of the list struct
- * @return int Return 0 on success and -1 on failure.
+ * @brief Add id to the end of crtab
+ * @param[in] p_id The struct ID
  */
-static int add_id_to_crtab(struct ID *root) {
-    struct ID *p;
-    int ret;
-
-    for (p = root; p != NULL; p = p->nextp) {
-        char *name = p->name;
-        char *current_procedure_name = p->procname;
-        int ispara = p->ispara;
-        int deflinenum = p->deflinenum;
-        struct TYPE *type = p->itp;
-        ret = id_register_to_tab(&crtabroot, name, current_procedure_name, &type, ispara, deflinenum);
-        if (ret == ERROR)
-            return ERROR;
+static void add_id_to_crtab(struct ID *p_id) {
+    p_id->crnextp = NULL;
+    if (crtab.tail == NULL) {
+        crtab.root = p_id;
+    } else {
+        crtab.tail->crnextp = p_id;
     }
-    return 0;
+    crtab.tail = p_id;
+    crtab.nids++;
 }
 
 /*!
- * @brief Release the struct ID
- * @param[in] root The root of the list struct
+ * @brief Hash the name of length namelen pointed by name by FNV-1a
+ * @param[in] name Name, which need not be null-terminated
+ * @param[in] namelen Length of the name
+ * @return unsigned long Return the hash.
  */
-static void free_strcut_ID(struct ID **root) {
-    struct ID *p, *q;
+static unsigned long hash_name(const char *name, int namelen) {
+    unsigned long hash = 2166136261UL;
+    int i;
 
-    for (p = *root; p != NULL; p = q) {
-        free(p->name);
-        free(p->procname);
-        free_struct_TYPE(p->itp);
-        free(p->irefp);
-        q = p->nextp;
-        free(p);
+    for (i = 0; i < namelen; i++) {
+        hash = ((hash ^ (unsigned char)name[i]) * 16777619UL) & 0xffffffffUL;
     }
-    *root = NULL;
-    return;
+    return hash;
 }
 
 /*!
- * @brief Release the struct TYPE
- * @param[in] root The root of the list struct
+ * @brief Double the buckets of a table, and chain the names again
+ * @param[in] tab The table
+ * @return int Return 0 on success and -1 on failure.
  */
-static void free_struct_TYPE(struct TYPE *root) {
-    struct TYPE *p, *q;
+static int grow_buckets(struct ID_TAB *tab) {
+    int nbuckets = (tab->nbuckets > 0) ? tab->nbuckets * 2 : ID_TAB_MINBUCKETS;
+    struct ID **buckets;
+    struct ID *p;
 
-    if (root == NULL) {
-        return;
+    if ((buckets = (struct ID **)calloc(nbuckets, sizeof(struct ID *))) == NULL) {
+        return error("can not malloc for buckets in grow_buckets\n");
     }
-
-    p = root;
-
-    free(p->etp);
-    for (p = root->paratp; p != NULL; p = q) {
-        q = p->paratp;
-        free(p);
+    for (p = tab->root; p != NULL; p = p->nextp) {
+        p->hashnextp = buckets[p->hash & (nbuckets - 1)];
+        buckets[p->hash & (nbuckets - 1)] = p;
     }
-    root = NULL;
+    free(tab->buckets);
+    tab->buckets = buckets;
+    tab->nbuckets = nbuckets;
+    return 0;
+}
+
+/*!
+ * @brief Release a table, and make it empty
+ * @details The struct IDs are not released, which are in the arena of the compilation.
+ * @param[in] tab The table
+ */
+static void release_tab(struct ID_TAB *tab) {
+    free(tab->buckets);
+    memset(tab, 0, sizeof(*tab));
     return;
 }
@@ -53,21 +53,51 @@ static char *file_name;
 
 /*!
  * @brief main function
+ * @details Usage: main [-j threads] [--token-cache | --no-token-cache] [--arena-stats] [--sort] [--index index] file
+ * The file "-" is the standard input, which is scanned as it is read.
+ * --token-cache keeps the tokens of the file in the token cache in token_cache_dir(), which
+ * --no-token-cache turns off again.
+ * --arena-stats outputs the statistics of the arena of the compilation to the standard error.
+ * --sort outputs the cross reference table sorted by the name, and then by the procedure name.
+ * --index writes the cross reference table to the index, which is queried by xref-query, instead of outputting it.
  * @param[in] nc The number of arguments
- * @param[in] np File name to read
+ * @param[in] np Options and file name to read
  * @return int Returns 0 on success and 1 on failure.
  */
 int main(int nc, char *np[]) {
-    int ret;
-    if (nc < 2) {
+    int ret, argi, nthreads = 1, arena_stats = 0, sorted = 0;
+    char *cache_dir = NULL;
+    char *index_path = NULL;
+
+    for (argi = 1; argi < nc - 1 && np[argi][0] == '-'; argi++) {
+        if (strcmp(np[argi], "-j") == 0 && argi + 1 < nc - 1) {
+            /* tokenize the file by threads in advance */
+            nthreads = atoi(np[++argi]);
+        } else if (strcmp(np[argi], "--token-cache") == 0) {
+            cache_dir = token_cache_dir();
+        } else if (strcmp(np[argi], "--no-token-cache") == 0) {
+            cache_dir = NULL;
+        } else if (strcmp(np[argi], "--arena-stats") == 0) {
+            arena_stats = 1;
+        } else if (strcmp(np[argi], "--sort") == 0) {
+            sorted = 1;
+        } else if (strcmp(np[argi], "--index") == 0 && argi + 1 < nc - 1) {
+            index_path = np[++argi];
+        } else {
+            error("function main()");
+            fprintf(stderr, "Unknown option %s.\n", np[argi]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argi >= nc) {
         error("function main()");
         fprintf(stderr, "File name id not given.\n");
         return EXIT_FAILURE;
     }
 
-    file_name = np[1];
+    file_name = np[argi];
 
-    if (init_scan(file_name) < 0) {
+    if (init_scan_tokens(file_name, nthreads, cache_dir) < 0) {
         fprintf(stderr, "File %s can not open.\n", file_name);
         return EXIT_FAILURE;
     }
@@ -82,8 +112,19 @@ int main(int nc, char *np[]) {
         return EXIT_FAILURE;
     }
 
-    print_tab(crtabroot);
+    if (index_path != NULL) {
+        if (ret == NORMAL && write_xref_index(crtab.root, file_name, index_path) == -1) {
+            ret = EXIT_FAILURE;
+        }
+    } else if (sorted) {
+        print_sorted_tab(crtab.root);
+    } else {
+        print_tab(crtab.root);
+    }
     fflush(stdout);
+    if (arena_stats) {
+        arena_print_stats(&compile_arena, stderr);
+    }
     release_crtab();
     return ret;
 }
@@ -9,7 +9,7 @@
 #define ERROR -1
 #define NORMAL 0
 
-/*! maximum length of a string */
+/*! initial size of the buffer of a scanned string, which grows as needed */
 #define MAXSTRSIZE 1024
 
 /*! @name definition of token code */
@@ -163,27 +163,137 @@ struct TYPE {
     int arraysize;       /*! size of array, if TPARRAY */
     struct TYPE *etp;    /*! pointer to element type if TPARRAY */
     struct TYPE *paratp; /*! pointer to parameter's type list if ttype is TPPROC */
+    struct TYPE *nextp;  /*! pointer next struct in the same bucket of the canonical types */
 };
 
 /*!
- * @brief List to store the line number
+ * @brief Vector to store the line numbers, in the order of registration
  */
 struct LINE {
-    int reflinenum;         /*! the line number */
-    struct LINE *nextlinep; /*! pointer to next struct */
+    int *reflinenums; /*! the line numbers */
+    int nrefs;        /*! number of the line numbers */
+    int size;         /*! allocated length of reflinenums */
 };
 
 struct ID {
-    char *name;         /*! name */
-    char *procname;     /* procedure name within which this name is defined, NULL if global name */
-    struct TYPE *itp;   /*! Type for the name */
-    int ispara;         /*! 1:formal parameter, 0:else(variable) */
-    int deflinenum;     /*! Name defined line number */
-    struct LINE *irefp; /*! List of line numbers where the name was referenced */
-    struct ID *nextp;   /*! pointer next struct */
+    char *name;           /*! name */
+    char *procname;       /* procedure name within which this name is defined, NULL if global name */
+    struct TYPE *itp;     /*! Type for the name */
+    int ispara;           /*! 1:formal parameter, 0:else(variable) */
+    int deflinenum;       /*! Name defined line number */
+    struct LINE irefs;    /*! Line numbers where the name was referenced */
+    struct ID *nextp;     /*! pointer next struct */
+    unsigned long hash;   /*! hash of the name */
+    struct ID *hashnextp; /*! pointer next struct in the same bucket */
+    struct ID *crnextp;   /*! pointer next struct in the cross reference table */
 };
 
-extern struct ID *crtabroot;
+/*!
+ * @brief Symbol table of a scope, a list in the order of registration indexed by a hash table
+ */
+struct ID_TAB {
+    struct ID *root;     /*! names in the order of registration */
+    struct ID *tail;     /*! the last name of the list */
+    struct ID **buckets; /*! chains of the names by hashnextp, for each hash of the name */
+    int nbuckets;        /*! number of the buckets, a power of 2 */
+    int nids;            /*! number of the names */
+};
+
+/*!
+ * @brief Block of an arena, followed by the memory allocated from it
+ */
+struct ARENA_BLOCK {
+    struct ARENA_BLOCK *next; /*! block allocated before */
+    size_t used;              /*! bytes allocated from the block */
+    size_t size;              /*! bytes of the block */
+};
+
+/*!
+ * @brief Arena, whose memory is released all at once
+ */
+struct ARENA {
+    struct ARENA_BLOCK *blocks; /*! blocks, the current one first */
+    int nblocks;                /*! number of the blocks */
+    long nallocs;               /*! number of the allocations since the release */
+    size_t bytes;               /*! bytes allocated since the release */
+    size_t peak_bytes;          /*! the most bytes allocated at a time */
+};
+
+/*
+ * A cross reference index is the same on any host. Every field is an unsigned 32-bit integer
+ * in little-endian byte order, and XREF_NONE stands for -1.
+ * The header is the magic number followed by XREF_RECORD_SIZE, the number of the source files,
+ * the symbols and the line numbers of the references, and the size of the strings.
+ * It is followed by the offsets of the names of the source files, the symbols sorted by the name,
+ * the procedure name and the source file, the line numbers of the references, and the strings.
+ * A symbol is a record of the fields of struct XREF_SYMBOL in the order of their declaration.
+ */
+/*! @name cross reference index */
+/* @{ */
+/*! magic number of a cross reference index, changed whenever the format changes */
+#define XREF_INDEX_MAGIC "MPPLXRF2"
+/*! size of a field */
+#define XREF_FIELD_SIZE 4
+/*! size of the header */
+#define XREF_HEADER_SIZE (8 + 5 * XREF_FIELD_SIZE)
+/*! size of the record of a symbol */
+#define XREF_RECORD_SIZE (7 * XREF_FIELD_SIZE)
+/*! the largest value of a field, which also stands for -1 */
+#define XREF_NONE 0xffffffffUL
+/* @} */
+
+/*!
+ * @brief Symbol of a cross reference index, decoded from its record
+ */
+struct XREF_SYMBOL {
+    long name;      /*! offset of the name in the strings */
+    long procname;  /*! offset of the procedure name, or -1 for a global name */
+    long type;      /*! offset of the type, as printed in the cross reference table */
+    long firstref;  /*! index of the first line number of the references */
+    int file;       /*! index of the source file */
+    int deflinenum; /*! line number of the definition */
+    int nrefs;      /*! number of the line numbers of the references */
+};
+
+/*!
+ * @brief Cross reference index mapped by mmap()
+ */
+struct XREF_INDEX {
+    void *map;                     /*! mapped file */
+    long map_size;                 /*! size of the mapped file */
+    long nfiles;                   /*! number of the source files */
+    long nsymbols;                 /*! number of the symbols */
+    long nrefs;                    /*! number of the line numbers of the references */
+    long strings_size;             /*! total size of the null-terminated strings */
+    const unsigned char *files;    /*! offsets of the names of the source files */
+    const unsigned char *symbols;  /*! records of the sorted symbols */
+    const unsigned char *refs;     /*! line numbers of the references */
+    const char *strings;           /*! null-terminated strings */
+};
+
+/*!
+ * @brief Cross reference index being built in memory
+ */
+struct XREF_BUILDER {
+    struct XREF_SYMBOL *symbols; /*! symbols in the order of the addition */
+    long nsymbols;               /*! number of the symbols */
+    long symbols_size;           /*! allocated length of symbols */
+    int *refs;                   /*! line numbers of the references */
+    long nrefs;                  /*! number of the line numbers */
+    long refs_size;              /*! allocated length of refs */
+    char *strings;               /*! null-terminated strings, each only once */
+    long strings_len;            /*! length of strings */
+    long strings_size;           /*! allocated size of strings */
+    long *slots;                 /*! open addressing hash of the offsets of the strings, -1 if empty */
+    int *slot_files;             /*! index of the source file of each slot, -1 if not a file name */
+    long nslots;                 /*! number of the slots, a power of 2 */
+    long nstrings;               /*! number of the strings */
+    long *files;                 /*! offsets of the names of the source files */
+    int nfiles;                  /*! number of the source files */
+    int files_size;              /*! allocated length of files */
+};
+
+extern struct ID_TAB crtab;
 
 extern int error(char *mes);
 
@@ -191,8 +301,108 @@ extern int error(char *mes);
 /* @{ */
 extern FILE *fp;
 extern int num_attr;
-extern char string_attr[MAXSTRSIZE];
+/*!
+ * @brief View of the last scanned name, number or string in the source
+ */
+extern struct TOKEN_SPAN {
+    const char *ptr; /*! head of the token (a string excludes the enclosing quotes) */
+    int len;         /*! length of the token */
+    long offset;     /*! offset of the token from the head of the source */
+    int escaped;     /*! 1 if the string contains '' */
+} token_span;
+extern char *get_string_attr(void);
+extern const char *get_string_value(int *len);
+
+/*!
+ * @brief A scanned token, whose name, number or string is taken from the source
+ */
+struct TOKEN {
+    int code;     /*! token code */
+    int linenum;  /*! line number of the token */
+    int num_attr; /*! value of a number */
+    int escaped;  /*! 1 if the string contains '' */
+    long offset;  /*! offset of the head of the token (a string includes the enclosing quotes) */
+    int len;      /*! length of the token in the source */
+};
+
+/*!
+ * @brief Tokens of a source, in the order scan() returns them
+ */
+struct TOKEN_ARRAY {
+    struct TOKEN *tokens; /*! array of the tokens, NULL if empty */
+    int ntokens;          /*! number of the tokens */
+    int capacity;         /*! allocated length of tokens, 0 if they are mapped from the token cache */
+    long end_offset;      /*! offset just after the last token, from which scanning gives -1 */
+    int end_linenum;      /*! line number at end_offset */
+    const char *text;     /*! texts of the names, numbers and strings in order, NULL to take them from the source */
+};
+
+/*!
+ * @brief An edit of a source, which replaces removed_len bytes at offset with inserted_len bytes
+ */
+struct TEXT_EDIT {
+    long offset;       /*! offset of the edit */
+    long removed_len;  /*! length of the text removed */
+    long inserted_len; /*! length of the text inserted, which is at offset in the edited source */
+};
+
+/*!
+ * @brief Tokens replaced by re-lexing: [begin, old_end) of the old tokens became [begin, new_end)
+ */
+struct TOKEN_RANGE {
+    int begin;   /*! index of the first token replaced */
+    int old_end; /*! index just after the last old token replaced */
+    int new_end; /*! index just after the last new token */
+};
+
+/*!
+ * @brief Context of a scanner, so that several files can be scanned at the same time
+ */
+struct SCANNER {
+    FILE *fp;                         /*! file pointer of the loaded file */
+    const char *src_head;             /*! head of the source loaded into memory, NULL when streaming */
+    const char *src_pos;              /*! position of the character to be loaded next */
+    const char *src_end;              /*! end of the source loaded into memory */
+    int src_is_mapped;                /*! 1 if src_head is mapped by mmap(), 0 if it is allocated by malloc() */
+    int current_char;                 /*! the letter just loaded */
+    int next_char;                    /*! look-ahead character */
+    long current_offset;              /*! offset of current_char from the head of the source */
+    int linenum;                      /*! line number of the character just loaded */
+    int token_linenum;                /*! line number of the last token scanned */
+    int num_attr;                     /*! scanned unsigned integer */
+    char *string_attr;                /*! text of span copied by scanner_string_attr(), grown as needed */
+    int string_attr_len;              /*! length of string_attr */
+    int string_attr_size;             /*! allocated size of string_attr, 0 if not allocated */
+    int string_attr_valid;            /*! 1 if string_attr holds the text of span, 0 until it is copied */
+    struct TOKEN_SPAN span;           /*! view of the last scanned name, number or string */
+    char *string_value;               /*! unescaped value of the last scanned string, grown as needed */
+    int string_value_len;             /*! length of string_value, -1 if it is not built yet */
+    int string_value_size;            /*! allocated size of string_value, 0 if not allocated */
+    long token_offset;                /*! offset of the head of the last token scanned */
+    int quiet;                        /*! 1 if the scan errors are not reported */
+    struct TOKEN_ARRAY replay;        /*! tokens returned instead of scanning, set by init_scan_tokens() */
+    int replay_pos;                   /*! index of the token in replay to be returned next */
+    long replay_text;                 /*! offset in replay.text of the text of the next token */
+    void *cache_map;                  /*! token cache mapped by mmap(), NULL if not mapped */
+    long cache_map_size;              /*! size of cache_map */
+    unsigned char *stream_buf;        /*! block of the input read by fread() when streaming */
+    int stream_pos;                   /*! position in stream_buf of the character to be loaded next */
+    int stream_len;                   /*! number of the bytes in stream_buf */
+};
+extern struct SCANNER *scanner_open(char *filename);
+extern struct SCANNER *scanner_open_tokens(char *filename, int nthreads, char *cache_dir);
+extern int scanner_next(struct SCANNER *sc);
+extern int scanner_line(struct SCANNER *sc);
+extern const char *scanner_string_value(struct SCANNER *sc, int *len);
+extern char *scanner_string_attr(struct SCANNER *sc);
+extern int scanner_close(struct SCANNER *sc);
+extern int scanner_tokenize(struct SCANNER *sc, int nthreads, struct TOKEN_ARRAY *ta);
+extern void token_array_release(struct TOKEN_ARRAY *ta);
+extern int token_array_relex(struct TOKEN_ARRAY *ta, const char *src, long size, const struct TEXT_EDIT *edit,
+                             struct TOKEN_RANGE *changed);
 extern int init_scan(char *filename);
+extern int init_scan_tokens(char *filename, int nthreads, char *cache_dir);
+extern char *token_cache_dir(void);
 extern int scan(void);
 extern int get_linenum(void);
 extern int end_scan(void);
@@ -206,20 +416,49 @@ extern int definition_procedure_name;
 extern int is_formal_parameter;
 /* @} */
 
+/*! @name arena.c */
+/* @{ */
+extern struct ARENA compile_arena;
+extern void *arena_alloc(struct ARENA *arena, size_t size);
+extern char *arena_strndup(struct ARENA *arena, const char *s, size_t len);
+extern void arena_release(struct ARENA *arena);
+extern void arena_print_stats(struct ARENA *arena, FILE *fp);
+/* @} */
+
+/*! @name xref-index.c */
+/* @{ */
+extern void xref_builder_init(struct XREF_BUILDER *builder);
+extern void xref_builder_release(struct XREF_BUILDER *builder);
+extern int xref_builder_add_file(struct XREF_BUILDER *builder, const char *file);
+extern int xref_builder_add(struct XREF_BUILDER *builder, int file, const char *name, const char *procname,
+                            const char *type, int deflinenum, const int *refs, int nrefs);
+extern int xref_builder_write(struct XREF_BUILDER *builder, const char *path);
+extern int xref_index_open(struct XREF_INDEX *index, const char *path);
+extern void xref_index_close(struct XREF_INDEX *index);
+extern const char *xref_index_string(const struct XREF_INDEX *index, long offset);
+extern const char *xref_index_file(const struct XREF_INDEX *index, long file);
+extern int xref_index_symbol(const struct XREF_INDEX *index, long i, struct XREF_SYMBOL *symbol);
+extern int xref_index_ref(const struct XREF_INDEX *index, long i);
+extern long xref_index_lookup(const struct XREF_INDEX *index, const char *name, long *nsymbols);
+extern int xref_index_merge(const char *path, struct XREF_INDEX *indexes, int nindexes);
+/* @} */
+
 /*! @name id-list.c */
 /* @{ */
 extern void set_procedure_name(char *name);
-extern int add_globalid_to_crtab(void);
 extern void init_crtab(void);
 extern void release_crtab(void);
 extern int release_localidroot(void);
-extern int id_register_without_type(char *name);
+extern int id_register_without_type(const char *name, int len);
 extern int id_register_as_type(struct TYPE **type);
+extern struct TYPE *intern_type(int ttype, int arraysize, struct TYPE *etp, struct TYPE *paratp);
 extern struct TYPE *std_type(int type);
 extern struct TYPE *array_type(int type);
 extern int register_linenum(char *name);
 extern struct ID *search_procedure(char *procname);
 extern void print_tab(struct ID *root);
+extern void print_sorted_tab(struct ID *root);
+extern int write_xref_index(struct ID *root, char *source, char *path);
 /* @} */
 
 /*! @name main.c */
@@ -6,6 +6,8 @@
 
 // clang-format off
 #include "mppl_compiler.h"
+#include "arena.c"
+#include "xref-index.c"
 #include "cross_reference.c"
 #include "id-list.c"
 #include "main.c"
@@ -20,6 +22,13 @@ void id_register_as_type_array_test1(void);
 void id_register_as_type_array_test2(void);
 void id_register_parameter_list(void);
 void register_linenum_test(void);
+void scope_test(void);
+void arena_test(void);
+void intern_type_test(void);
+void sorted_tab_test(void);
+void xref_index_test(void);
+void xref_index_format_test(char *path, char *broken);
+void xref_index_patch(char *path, char *broken, long offset, unsigned long value, long size);
 void ref_array_index_test(void);
 void cast_test(void);
 
@@ -49,6 +58,11 @@ int main() {
     CU_add_test(suite, "id_register_as_type_array_test2", id_register_as_type_array_test2);
     CU_add_test(suite, "id_register_parameter_list", id_register_parameter_list);
     CU_add_test(suite, "register_linenum_test", register_linenum_test);
+    CU_add_test(suite, "scope_test", scope_test);
+    CU_add_test(suite, "arena_test", arena_test);
+    CU_add_test(suite, "intern_type_test", intern_type_test);
+    CU_add_test(suite, "sorted_tab_test", sorted_tab_test);
+    CU_add_test(suite, "xref_index_test", xref_index_test);
     CU_add_test(suite, "ref_array_index_test", ref_array_index_test);
     CU_add_test(suite, "cast_test", cast_test);
 
@@ -83,13 +97,13 @@ void id_register_without_type_test(void) {
     test_init();
 
     /* global */
-    id_register_without_type("GLOBAL NAME1");
-    id_register_without_type("GLOBAL NAME2");
+    id_register_without_type("GLOBAL NAME1", strlen("GLOBAL NAME1"));
+    id_register_without_type("GLOBAL NAME2", strlen("GLOBAL NAME2"));
 
-    CU_ASSERT_PTR_NOT_NULL(search_tab(&id_without_type_root, "GLOBAL NAME1", NULL));
-    CU_ASSERT_PTR_NOT_NULL(search_tab(&id_without_type_root, "GLOBAL NAME2", NULL));
+    CU_ASSERT_PTR_NOT_NULL(search_tab(&id_without_type_tab, "GLOBAL NAME1", NULL));
+    CU_ASSERT_PTR_NOT_NULL(search_tab(&id_without_type_tab, "GLOBAL NAME2", NULL));
 
-    root = id_without_type_root;
+    root = id_without_type_tab.root;
     CU_ASSERT_STRING_EQUAL(root->name, "GLOBAL NAME1");
     CU_ASSERT_PTR_NULL(root->procname);
     CU_ASSERT_PTR_NOT_NULL(root->nextp);
@@ -103,13 +117,13 @@ void id_register_without_type_test(void) {
     /* local */
     in_subprogram_declaration = true;
     set_procedure_name("procedure_name");
-    id_register_without_type("LOCAL NAME1");
-    id_register_without_type("LOCAL NAME2");
+    id_register_without_type("LOCAL NAME1", strlen("LOCAL NAME1"));
+    id_register_without_type("LOCAL NAME2", strlen("LOCAL NAME2"));
 
-    CU_ASSERT_PTR_NOT_NULL(search_tab(&id_without_type_root, "LOCAL NAME1", "procedure_name"));
-    CU_ASSERT_PTR_NOT_NULL(search_tab(&id_without_type_root, "LOCAL NAME2", "procedure_name"));
+    CU_ASSERT_PTR_NOT_NULL(search_tab(&id_without_type_tab, "LOCAL NAME1", "procedure_name"));
+    CU_ASSERT_PTR_NOT_NULL(search_tab(&id_without_type_tab, "LOCAL NAME2", "procedure_name"));
 
-    root = id_without_type_root;
+    root = id_without_type_tab.root;
     CU_ASSERT_STRING_EQUAL(root->name, "LOCAL NAME1");
     CU_ASSERT_STRING_EQUAL(root->procname, "procedure_name");
     CU_ASSERT_PTR_NOT_NULL(root->nextp);
@@ -137,7 +151,7 @@ void std_type_test(void) {
     CU_ASSERT_PTR_NULL(type->etp);
     CU_ASSERT_PTR_NULL(type->paratp);
 
-    free(type);
+    /* the type is released with the arena */
     test_end();
 }
 
@@ -152,20 +166,20 @@ void id_register_as_type_test(void) {
     test_init();
 
     /* global */
-    id_register_without_type("GLOBAL NAME1");
-    id_register_without_type("GLOBAL NAME2");
+    id_register_without_type("GLOBAL NAME1", strlen("GLOBAL NAME1"));
+    id_register_without_type("GLOBAL NAME2", strlen("GLOBAL NAME2"));
     // INT型として記号表に登録
     type = std_type(TPINT);
     id_register_as_type(&type);
 
-    CU_ASSERT_PTR_NOT_NULL(search_tab(&globalidroot, "GLOBAL NAME1", NULL));
-    CU_ASSERT_PTR_NOT_NULL(search_tab(&globalidroot, "GLOBAL NAME2", NULL));
-    root = globalidroot;
+    CU_ASSERT_PTR_NOT_NULL(search_tab(&globalidtab, "GLOBAL NAME1", NULL));
+    CU_ASSERT_PTR_NOT_NULL(search_tab(&globalidtab, "GLOBAL NAME2", NULL));
+    root = globalidtab.root;
     CU_ASSERT_STRING_EQUAL(root->name, "GLOBAL NAME1");
     CU_ASSERT_PTR_NULL(root->procname);
     CU_ASSERT_EQUAL(root->ispara, 0);
     CU_ASSERT_EQUAL(root->deflinenum, 0);
-    CU_ASSERT_PTR_NULL(root->irefp);
+    CU_ASSERT_EQUAL(root->irefs.nrefs, 0);
     CU_ASSERT_PTR_NOT_NULL(root->nextp);
 
     root = root->nextp;
@@ -173,10 +187,10 @@ void id_register_as_type_test(void) {
     CU_ASSERT_PTR_NULL(root->procname);
     CU_ASSERT_EQUAL(root->ispara, 0);
     CU_ASSERT_EQUAL(root->deflinenum, 0);
-    CU_ASSERT_PTR_NULL(root->irefp);
+    CU_ASSERT_EQUAL(root->irefs.nrefs, 0);
     CU_ASSERT_PTR_NULL(root->nextp);
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
 
     test_end();
 }
@@ -192,34 +206,34 @@ void id_register_as_type_std_test(void) {
     test_init();
 
     /* global */
-    id_register_without_type("INT NAME1");
+    id_register_without_type("INT NAME1", strlen("INT NAME1"));
     // INT型として記号表に登録
     type = std_type(TPINT);
     id_register_as_type(&type);
 
-    CU_ASSERT_PTR_NOT_NULL(search_tab(&globalidroot, "INT NAME1", NULL));
-    root = globalidroot;
+    CU_ASSERT_PTR_NOT_NULL(search_tab(&globalidtab, "INT NAME1", NULL));
+    root = globalidtab.root;
     CU_ASSERT_STRING_EQUAL(root->name, "INT NAME1");
     CU_ASSERT_PTR_NULL(root->procname);
     CU_ASSERT_EQUAL(root->ispara, 0);
     CU_ASSERT_EQUAL(root->deflinenum, 0);
-    CU_ASSERT_PTR_NULL(root->irefp);
+    CU_ASSERT_EQUAL(root->irefs.nrefs, 0);
 
-    id_register_without_type("CHAR NAME2");
+    id_register_without_type("CHAR NAME2", strlen("CHAR NAME2"));
     // CHAR型として記号表に登録
     type = std_type(TPCHAR);
     id_register_as_type(&type);
-    root = globalidroot;
+    root = globalidtab.root;
     root = root->nextp;
 
-    CU_ASSERT_PTR_NOT_NULL(search_tab(&globalidroot, "CHAR NAME2", NULL));
+    CU_ASSERT_PTR_NOT_NULL(search_tab(&globalidtab, "CHAR NAME2", NULL));
     CU_ASSERT_STRING_EQUAL(root->name, "CHAR NAME2");
     CU_ASSERT_PTR_NULL(root->procname);
     CU_ASSERT_EQUAL(root->ispara, 0);
     CU_ASSERT_EQUAL(root->deflinenum, 0);
-    CU_ASSERT_PTR_NULL(root->irefp);
+    CU_ASSERT_EQUAL(root->irefs.nrefs, 0);
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
 
     test_end();
 }
@@ -235,35 +249,35 @@ void id_register_as_type_array_test1(void) {
     test_init();
 
     /* global */
-    id_register_without_type("INT NAME1");
+    id_register_without_type("INT NAME1", strlen("INT NAME1"));
     // INT型として記号表に登録
     num_attr = 10;  // 配列の要素数
     type = array_type(TPARRAYINT);
     id_register_as_type(&type);
 
-    CU_ASSERT_PTR_NOT_NULL(search_tab(&globalidroot, "INT NAME1", NULL));
-    root = globalidroot;
+    CU_ASSERT_PTR_NOT_NULL(search_tab(&globalidtab, "INT NAME1", NULL));
+    root = globalidtab.root;
     CU_ASSERT_STRING_EQUAL(root->name, "INT NAME1");
     CU_ASSERT_PTR_NULL(root->procname);
     CU_ASSERT_EQUAL(root->ispara, 0);
     CU_ASSERT_EQUAL(root->deflinenum, 0);
-    CU_ASSERT_PTR_NULL(root->irefp);
+    CU_ASSERT_EQUAL(root->irefs.nrefs, 0);
 
-    id_register_without_type("CHAR NAME2");
+    id_register_without_type("CHAR NAME2", strlen("CHAR NAME2"));
     // CHAR型として記号表に登録
     type = array_type(TPARRAYCHAR);
     id_register_as_type(&type);
-    root = globalidroot;
+    root = globalidtab.root;
     root = root->nextp;
 
-    CU_ASSERT_PTR_NOT_NULL(search_tab(&globalidroot, "CHAR NAME2", NULL));
+    CU_ASSERT_PTR_NOT_NULL(search_tab(&globalidtab, "CHAR NAME2", NULL));
     CU_ASSERT_STRING_EQUAL(root->name, "CHAR NAME2");
     CU_ASSERT_PTR_NULL(root->procname);
     CU_ASSERT_EQUAL(root->ispara, 0);
     CU_ASSERT_EQUAL(root->deflinenum, 0);
-    CU_ASSERT_PTR_NULL(root->irefp);
+    CU_ASSERT_EQUAL(root->irefs.nrefs, 0);
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
 
     test_end();
 }
@@ -278,8 +292,6 @@ void id_register_as_type_array_test2(void) {
     file_name = "./samples/id_register_as_type_array_test2.mpl";
 
     init_scan(file_name);
-    linenum = 1;
-    token_linenum = 0;
 
     token = scan();
     CU_ASSERT_EQUAL(parse_program(), ERROR);
@@ -287,7 +299,7 @@ void id_register_as_type_array_test2(void) {
     fprintf(stdout, "\n");
     fflush(stdout);
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
 
     test_end();
 }
@@ -303,7 +315,7 @@ void id_register_parameter_list(void) {
 
     // 手続き名を登録する
     definition_procedure_name = true;
-    id_register_without_type("procedure name");
+    id_register_without_type("procedure name", strlen("procedure name"));
     type = std_type(TPPROC);
     id_register_as_type(&type);
     definition_procedure_name = false;
@@ -312,17 +324,17 @@ void id_register_parameter_list(void) {
     in_subprogram_declaration = true;
     set_procedure_name("procedure name");
     is_formal_parameter = true;
-    id_register_without_type("INT1");
+    id_register_without_type("INT1", strlen("INT1"));
     type = std_type(TPINT);
     id_register_as_type(&type);
 
-    id_register_without_type("CHAR1");
+    id_register_without_type("CHAR1", strlen("CHAR1"));
     type = std_type(TPCHAR);
     id_register_as_type(&type);
 
-    CU_ASSERT_PTR_NOT_NULL(globalidroot->itp->paratp);
+    CU_ASSERT_PTR_NOT_NULL(globalidtab.root->itp->paratp);
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
 
     test_end();
 }
@@ -338,7 +350,7 @@ void register_linenum_test(void) {
 
     // 手続き名を登録する
     definition_procedure_name = true;
-    id_register_without_type("procedure name");
+    id_register_without_type("procedure name", strlen("procedure name"));
     type = std_type(TPPROC);
     id_register_as_type(&type);
     definition_procedure_name = false;
@@ -347,28 +359,196 @@ void register_linenum_test(void) {
     in_subprogram_declaration = true;
     set_procedure_name("procedure name");
     is_formal_parameter = true;
-    id_register_without_type("INT1");
+    id_register_without_type("INT1", strlen("INT1"));
     type = std_type(TPINT);
     id_register_as_type(&type);
 
-    id_register_without_type("CHAR1");
+    id_register_without_type("CHAR1", strlen("CHAR1"));
     type = std_type(TPCHAR);
     id_register_as_type(&type);
 
-    token_linenum = 1;
+    default_scanner.token_linenum = 1;
     register_linenum("INT1");
-    token_linenum = 2;
+    default_scanner.token_linenum = 2;
     register_linenum("CHAR1");
     register_linenum("INT1");
-    token_linenum = 3;
+    default_scanner.token_linenum = 3;
     register_linenum("CHAR1");
     register_linenum("INT1");
 
     in_subprogram_declaration = false;
-    token_linenum = 4;
+    default_scanner.token_linenum = 4;
     register_linenum("procedure name");
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
+
+    test_end();
+}
+
+/*!
+ * @brief 多数の大域変数を登録順に保持し，手続き内では局所変数が大域変数を隠すかテスト
+ */
+void scope_test(void) {
+    struct TYPE *type;
+    struct ID *p;
+    char name[32];
+    int i, ok = 1;
+
+    test_init();
+
+    // 大域変数をたくさん登録する
+    for (i = 0; i < 5000; i++) {
+        sprintf(name, "G%d", i);
+        id_register_without_type(name, strlen(name));
+    }
+    type = std_type(TPINT);
+    id_register_as_type(&type);
+    CU_ASSERT_EQUAL(globalidtab.nids, 5000);
+    for (i = 0, p = globalidtab.root; p != NULL; i++, p = p->nextp) {
+        sprintf(name, "G%d", i);
+        if (strcmp(p->name, name) != 0 || search_tab(&globalidtab, name, NULL) != p) {
+            ok = 0;
+        }
+    }
+    CU_ASSERT(ok);
+    CU_ASSERT_EQUAL(i, 5000);
+    CU_ASSERT_PTR_NULL(search_tab(&globalidtab, "G5000", NULL));
+
+    // 手続きと同名の局所変数
+    definition_procedure_name = true;
+    id_register_without_type("proc", strlen("proc"));
+    type = std_type(TPPROC);
+    id_register_as_type(&type);
+    definition_procedure_name = false;
+    in_subprogram_declaration = true;
+    set_procedure_name("proc");
+    id_register_without_type("G1", strlen("G1"));
+    type = std_type(TPCHAR);
+    id_register_as_type(&type);
+
+    default_scanner.token_linenum = 7;
+    CU_ASSERT_EQUAL(register_linenum("G1"), TPCHAR);
+    CU_ASSERT_EQUAL(register_linenum("G2"), TPINT);
+    // 何度も参照される変数の行番号は参照順に並ぶ
+    for (i = 0; i < 1000; i++) {
+        default_scanner.token_linenum = 100 + i;
+        register_linenum("G3");
+    }
+    p = search_tab(&globalidtab, "G3", NULL);
+    CU_ASSERT_EQUAL(p->irefs.nrefs, 1000);
+    CU_ASSERT_EQUAL(p->irefs.reflinenums[0], 100);
+    CU_ASSERT_EQUAL(p->irefs.reflinenums[999], 1099);
+    default_scanner.token_linenum = 7;
+    CU_ASSERT_EQUAL(search_tab(&localidtab, "G1", "proc")->irefs.reflinenums[0], 7);
+    CU_ASSERT_EQUAL(search_tab(&globalidtab, "G1", NULL)->irefs.nrefs, 0);
+
+    // 手続きを抜けると局所変数は見えない
+    release_localidroot();
+    in_subprogram_declaration = false;
+    CU_ASSERT_EQUAL(localidtab.nids, 0);
+    CU_ASSERT_EQUAL(register_linenum("G1"), TPINT);
+    CU_ASSERT_EQUAL(search_tab(&globalidtab, "G1", NULL)->irefs.nrefs, 1);
+    // 局所変数は相互参照表に残る
+    CU_ASSERT_EQUAL(crtab.nids, 5002);
+    CU_ASSERT_STRING_EQUAL(crtab.tail->name, "G1");
+    CU_ASSERT_EQUAL(crtab.tail->irefs.reflinenums[0], 7);
+
+    test_end();
+}
+
+/*!
+ * @brief アリーナから確保した領域が整列され，まとめて解放されるかテスト
+ */
+void arena_test(void) {
+    struct ARENA arena;
+    char *p, *large;
+    int i, ok = 1;
+
+    memset(&arena, 0, sizeof(arena));
+    for (i = 0; i < 10000; i++) {
+        if ((p = (char *)arena_alloc(&arena, i % 37 + 1)) == NULL || (size_t)p % sizeof(union ARENA_ALIGN) != 0) {
+            ok = 0;
+        } else {
+            memset(p, 'x', i % 37 + 1);
+        }
+    }
+    CU_ASSERT(ok);
+    CU_ASSERT_EQUAL(arena.nallocs, 10000);
+    CU_ASSERT(arena.nblocks > 1);
+
+    // ブロックより大きい領域
+    large = (char *)arena_alloc(&arena, 200 * 1024);
+    CU_ASSERT_PTR_NOT_NULL(large);
+    memset(large, 'y', 200 * 1024);
+    CU_ASSERT_STRING_EQUAL(arena_strndup(&arena, "NAME1 rest", 5), "NAME1");
+    CU_ASSERT(arena.peak_bytes >= 200 * 1024 + 10000);
+
+    arena_release(&arena);
+    CU_ASSERT_PTR_NULL(arena.blocks);
+    CU_ASSERT_EQUAL(arena.nallocs, 0);
+    CU_ASSERT_EQUAL(arena.bytes, 0);
+    CU_ASSERT(arena.peak_bytes >= 200 * 1024 + 10000);
+
+    // コンパイルのアリーナは表とともに解放される
+    test_init();
+    id_register_without_type("NAME", strlen("NAME"));
+    CU_ASSERT(compile_arena.nallocs > 0);
+    test_end();
+    CU_ASSERT_EQUAL(compile_arena.nallocs, 0);
+    CU_ASSERT_PTR_NULL(compile_arena.blocks);
+}
+
+/*!
+ * @brief 同じ型は1つの構造体を共有するかテスト
+ */
+void intern_type_test(void) {
+    struct TYPE *type;
+    struct ID *p_id1, *p_id2;
+    char *procnames[2] = {"proc1", "proc2"};
+    int i;
+
+    test_init();
+
+    CU_ASSERT(std_type(TPINT) == std_type(TPINT));
+    CU_ASSERT(std_type(TPINT) != std_type(TPCHAR));
+    num_attr = 10;
+    type = array_type(TPARRAYINT);
+    CU_ASSERT(type == array_type(TPARRAYINT));
+    CU_ASSERT(type->etp == std_type(TPINT));
+    num_attr = 20;
+    CU_ASSERT(type != array_type(TPARRAYINT));
+
+    // 仮引数が同じ手続きは型を共有する
+    for (i = 0; i < 2; i++) {
+        set_procedure_name(procnames[i]);
+        definition_procedure_name = true;
+        id_register_without_type(procnames[i], strlen(procnames[i]));
+        type = std_type(TPPROC);
+        id_register_as_type(&type);
+        definition_procedure_name = false;
+
+        in_subprogram_declaration = true;
+        is_formal_parameter = true;
+        id_register_without_type("INT1", strlen("INT1"));
+        type = std_type(TPINT);
+        id_register_as_type(&type);
+        id_register_without_type("CHAR1", strlen("CHAR1"));
+        type = std_type(TPCHAR);
+        id_register_as_type(&type);
+        is_formal_parameter = false;
+        in_subprogram_declaration = false;
+        release_localidroot();
+    }
+    p_id1 = search_tab(&globalidtab, "proc1", NULL);
+    p_id2 = search_tab(&globalidtab, "proc2", NULL);
+    CU_ASSERT_PTR_NOT_NULL(p_id1);
+    CU_ASSERT_PTR_NOT_NULL(p_id2);
+    if (p_id1 != NULL && p_id2 != NULL) {
+        CU_ASSERT(p_id1->itp == p_id2->itp);
+        CU_ASSERT_EQUAL(p_id1->itp->paratp->ttype, TPINT);
+        CU_ASSERT_EQUAL(p_id1->itp->paratp->paratp->ttype, TPCHAR);
+        CU_ASSERT_PTR_NULL(p_id1->itp->paratp->paratp->paratp);
+    }
 
     test_end();
 }
@@ -382,19 +562,19 @@ void ref_array_index_test(void) {
 
     test_init();
 
-    id_register_without_type("ARRAY INT");
+    id_register_without_type("ARRAY INT", strlen("ARRAY INT"));
     // INT型として記号表に登録
     num_attr = 10;  // 配列の要素数
     type = array_type(TPARRAYINT);
     id_register_as_type(&type);
 
-    token_linenum = 4;
+    default_scanner.token_linenum = 4;
     num_attr = 0;
     // CU_ASSERT_EQUAL(register_linenum("ARRAY INT"), TPARRAYINT);
     // num_attr = 10;
     // CU_ASSERT_EQUAL(register_linenum("ARRAY INT"), -1);
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
 
     test_end();
 }
@@ -405,18 +585,234 @@ void cast_test(void) {
     file_name = "../samples/program3/cast_test.mpl";
     parse();
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
 
     test_end();
 }
 
+/*!
+ * @brief クロスリファレンス表を名前順に並べ，バッファに出力するテスト
+ */
+void sorted_tab_test(void) {
+    struct REPORT report;
+    struct ID *ids[16];
+    struct ID *p;
+    int nids = 0, i, ok = 1;
+
+    // 整数の書式
+    memset(&report, 0, sizeof(report));
+    CU_ASSERT_EQUAL(report_int(&report, 0, 0), 1);
+    CU_ASSERT_EQUAL(report_int(&report, -123, 6), 6);
+    CU_ASSERT_EQUAL(report_int(&report, 2147483647, 4), 10);
+    CU_ASSERT_EQUAL(report.len, 17);
+    if (report.buf != NULL) {
+        CU_ASSERT_EQUAL(memcmp(report.buf, "0  -1232147483647", 17), 0);
+    }
+    free(report.buf);
+
+    // 確保に失敗した後は小さな確保も失敗する
+    memset(&report, 0, sizeof(report));
+    report.failed = 1;
+    CU_ASSERT_EQUAL(report_reserve(&report, 1), -1);
+    report_puts(&report, "a");
+    CU_ASSERT_PTR_NULL(report.buf);
+    CU_ASSERT_EQUAL(report.len, 0);
+
+    test_init();
+    file_name = "./samples/sample31p.mpl";
+    parse();
+
+    for (p = crtab.root; p != NULL && nids < 16; p = p->crnextp) {
+        ids[nids++] = p;
+    }
+    CU_ASSERT_EQUAL(nids, 9);
+    qsort(ids, nids, sizeof(struct ID *), compare_ids);
+    for (i = 1; i < nids; i++) {
+        if (compare_ids(&ids[i - 1], &ids[i]) >= 0) {
+            ok = 0;
+        }
+    }
+    CU_ASSERT(ok);
+    // 大域的な名前が先
+    CU_ASSERT_STRING_EQUAL(ids[0]->name, "a");
+    CU_ASSERT_PTR_NULL(ids[0]->procname);
+    CU_ASSERT_STRING_EQUAL(ids[1]->name, "a");
+    CU_ASSERT_STRING_EQUAL(ids[1]->procname, "p");
+    CU_ASSERT_STRING_EQUAL(ids[nids - 1]->name, "q");
+    CU_ASSERT_STRING_EQUAL(ids[nids - 1]->procname, "q");
+
+    print_sorted_tab(crtab.root);
+
+    test_end();
+}
+
+/*!
+ * @brief クロスリファレンス表を索引に書き出し，検索・併合するテスト
+ */
+void xref_index_test(void) {
+    struct XREF_INDEX indexes[3];
+    struct XREF_SYMBOL symbol;
+    char path1[] = "/tmp/mppl_xref_test1.idx";
+    char path2[] = "/tmp/mppl_xref_test2.idx";
+    char merged[] = "/tmp/mppl_xref_test3.idx";
+    long first, nsymbols;
+
+    test_init();
+    file_name = "./samples/sample31p.mpl";
+    parse();
+    CU_ASSERT_EQUAL(write_xref_index(crtab.root, "sample31p.mpl", path1), 0);
+    CU_ASSERT_EQUAL(write_xref_index(crtab.root, "copy.mpl", path2), 0);
+    test_end();
+
+    CU_ASSERT_EQUAL(xref_index_open(&indexes[0], path1), 0);
+    CU_ASSERT_EQUAL(indexes[0].nsymbols, 9);
+    // 大域的な名前，手続き名の順
+    first = xref_index_lookup(&indexes[0], "a", &nsymbols);
+    CU_ASSERT_EQUAL(first, 0);
+    CU_ASSERT_EQUAL(nsymbols, 3);
+    CU_ASSERT_EQUAL(xref_index_symbol(&indexes[0], 1, &symbol), 0);
+    CU_ASSERT_STRING_EQUAL(xref_index_string(&indexes[0], symbol.procname), "p");
+    CU_ASSERT_EQUAL(xref_index_symbol(&indexes[0], 0, &symbol), 0);
+    CU_ASSERT_EQUAL(symbol.procname, -1);
+    CU_ASSERT_PTR_NULL(xref_index_string(&indexes[0], symbol.procname));
+    CU_ASSERT_STRING_EQUAL(xref_index_string(&indexes[0], symbol.type), "integer");
+    CU_ASSERT_STRING_EQUAL(xref_index_file(&indexes[0], symbol.file), "sample31p.mpl");
+    CU_ASSERT_EQUAL(symbol.deflinenum, 2);
+    CU_ASSERT_EQUAL(symbol.nrefs, 3);
+    CU_ASSERT_EQUAL(xref_index_ref(&indexes[0], symbol.firstref + 2), 22);
+    CU_ASSERT_EQUAL(xref_index_symbol(&indexes[0], 9, &symbol), -1);
+    first = xref_index_lookup(&indexes[0], "p", &nsymbols);
+    CU_ASSERT_EQUAL(nsymbols, 1);
+    CU_ASSERT_EQUAL(xref_index_symbol(&indexes[0], first, &symbol), 0);
+    CU_ASSERT_STRING_EQUAL(xref_index_string(&indexes[0], symbol.type), "procedure(char)");
+    xref_index_lookup(&indexes[0], "zz", &nsymbols);
+    CU_ASSERT_EQUAL(nsymbols, 0);
+
+    // 同じソースファイルは後の索引で置き換える
+    CU_ASSERT_EQUAL(xref_index_open(&indexes[1], path2), 0);
+    CU_ASSERT_EQUAL(xref_index_open(&indexes[2], path1), 0);
+    CU_ASSERT_EQUAL(xref_index_merge(merged, indexes, 3), 0);
+    xref_index_close(&indexes[0]);
+    xref_index_close(&indexes[1]);
+    xref_index_close(&indexes[2]);
+
+    CU_ASSERT_EQUAL(xref_index_open(&indexes[0], merged), 0);
+    CU_ASSERT_EQUAL(indexes[0].nfiles, 2);
+    CU_ASSERT_EQUAL(indexes[0].nsymbols, 18);
+    first = xref_index_lookup(&indexes[0], "c", &nsymbols);
+    CU_ASSERT_EQUAL(nsymbols, 2);
+    CU_ASSERT_EQUAL(xref_index_symbol(&indexes[0], first, &symbol), 0);
+    CU_ASSERT_STRING_EQUAL(xref_index_file(&indexes[0], symbol.file), "copy.mpl");
+    CU_ASSERT_EQUAL(xref_index_symbol(&indexes[0], first + 1, &symbol), 0);
+    CU_ASSERT_STRING_EQUAL(xref_index_file(&indexes[0], symbol.file), "sample31p.mpl");
+    CU_ASSERT_EQUAL(symbol.deflinenum, 18);
+    xref_index_close(&indexes[0]);
+
+    xref_index_format_test(path1, path2);
+
+    // 形式の異なるファイルは開かない
+    CU_ASSERT_EQUAL(xref_index_open(&indexes[0], "./samples/sample31p.mpl"), -1);
+
+    remove(path1);
+    remove(path2);
+    remove(merged);
+}
+
+/*!
+ * @brief 索引の形式が固定長のリトルエンディアンであり，壊れた索引を読まないことのテスト
+ * @param[in] path 正しい索引
+ * @param[in] broken 壊した索引を書き出すファイル
+ */
+void xref_index_format_test(char *path, char *broken) {
+    struct XREF_INDEX index;
+    struct XREF_SYMBOL symbol;
+    unsigned char buf[XREF_HEADER_SIZE + XREF_FIELD_SIZE];
+    FILE *in;
+    long size, symbols;
+
+    if ((in = fopen(path, "rb")) == NULL) {
+        CU_FAIL("can not open the index");
+        return;
+    }
+    CU_ASSERT_EQUAL(fread(buf, 1, sizeof(buf), in), sizeof(buf));
+    fseek(in, 0, SEEK_END);
+    size = ftell(in);
+    fclose(in);
+    // ヘッダとファイル名のオフセットはホストによらず同じバイト列
+    CU_ASSERT(memcmp(buf, "MPPLXRF2", 8) == 0);
+    CU_ASSERT(memcmp(buf + 8, "\x1c\0\0\0\x01\0\0\0\x09\0\0\0", 12) == 0);
+    CU_ASSERT(memcmp(buf + XREF_HEADER_SIZE, "\0\0\0\0", 4) == 0);
+    symbols = XREF_HEADER_SIZE + XREF_FIELD_SIZE;
+    CU_ASSERT(size > symbols + 9 * XREF_RECORD_SIZE);
+
+    // 記録の大きさが違う，短い，長い索引は開かない
+    xref_index_patch(path, broken, 8, 32, size);
+    CU_ASSERT_EQUAL(xref_index_open(&index, broken), -1);
+    xref_index_patch(path, broken, 0, 0, size - 1);
+    CU_ASSERT_EQUAL(xref_index_open(&index, broken), -1);
+    xref_index_patch(path, broken, size, 0, size + XREF_FIELD_SIZE);
+    CU_ASSERT_EQUAL(xref_index_open(&index, broken), -1);
+    // 数が大きすぎる索引は開かない
+    xref_index_patch(path, broken, 8 + 2 * XREF_FIELD_SIZE, XREF_NONE - 1, size);
+    CU_ASSERT_EQUAL(xref_index_open(&index, broken), -1);
+
+    // 範囲外のソースファイルを指す記号は読まず，併合もしない
+    xref_index_patch(path, broken, symbols + 4 * XREF_FIELD_SIZE, 1, size);
+    CU_ASSERT_EQUAL(xref_index_open(&index, broken), 0);
+    CU_ASSERT_EQUAL(xref_index_symbol(&index, 0, &symbol), -1);
+    CU_ASSERT_EQUAL(xref_index_symbol(&index, 1, &symbol), 0);
+    CU_ASSERT_EQUAL(xref_index_merge(broken, &index, 1), -1);
+    xref_index_close(&index);
+    // 参照行が範囲外の記号も読まない
+    xref_index_patch(path, broken, symbols + 6 * XREF_FIELD_SIZE, 1000, size);
+    CU_ASSERT_EQUAL(xref_index_open(&index, broken), 0);
+    CU_ASSERT_EQUAL(xref_index_symbol(&index, 0, &symbol), -1);
+    xref_index_close(&index);
+    // 文字列の範囲外の名前も読まない
+    xref_index_patch(path, broken, symbols, XREF_NONE - 1, size);
+    CU_ASSERT_EQUAL(xref_index_open(&index, broken), 0);
+    CU_ASSERT_EQUAL(xref_index_symbol(&index, 0, &symbol), -1);
+    xref_index_close(&index);
+}
+
+/*!
+ * @brief 索引の1つのフィールドを書き換え，大きさを変えて別のファイルに書き出す
+ * @param[in] path 元の索引
+ * @param[in] broken 書き出すファイル
+ * @param[in] offset 書き換えるフィールドの位置，書き換えない場合は size 以上
+ * @param[in] value フィールドの値
+ * @param[in] size 書き出す大きさ，元より大きい場合は0で埋める
+ */
+void xref_index_patch(char *path, char *broken, long offset, unsigned long value, long size) {
+    FILE *in, *out;
+    long i;
+    int c, k;
+
+    in = fopen(path, "rb");
+    out = fopen(broken, "wb");
+    if (in == NULL || out == NULL) {
+        CU_FAIL("can not open the index");
+        return;
+    }
+    for (i = 0; i < size; i++) {
+        c = fgetc(in);
+        if (i >= offset && i < offset + XREF_FIELD_SIZE) {
+            k = (int)(i - offset);
+            c = (int)((value >> (8 * k)) & 0xff);
+        }
+        fputc(c == EOF ? 0 : c, out);
+    }
+    fclose(in);
+    fclose(out);
+}
+
 void integration_test_sample31p(void) {
     test_init();
 
     file_name = "./samples/sample31p.mpl";
     parse();
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
 
     test_end();
 }
@@ -427,7 +823,7 @@ void integration_test_sample032p(void) {
     file_name = "./samples/sample032p.mpl";
     parse();
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
 
     test_end();
 }
@@ -438,7 +834,7 @@ void integration_test_sample33p(void) {
     file_name = "./samples/sample33p.mpl";
     parse();
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
 
     test_end();
 }
@@ -449,7 +845,7 @@ void integration_test_sample34(void) {
     file_name = "./samples/sample34.mpl";
     parse();
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
 
     test_end();
 }
@@ -460,7 +856,7 @@ void integration_test_sample35(void) {
     file_name = "./samples/sample35.mpl";
     parse();
 
-    print_tab(crtabroot);
+    print_tab(crtab.root);
 
     test_end();
 }
@@ -516,7 +912,7 @@ void integration_test(void) {
 
         parse();
 
-        print_tab(crtabroot);
+        print_tab(crtab.root);
 
         test_end();
     }
@@ -536,8 +932,6 @@ void test_end(void) {
 
 void parse(void) {
     init_scan(file_name);
-    linenum = 1;
-    token_linenum = 0;
 
     token = scan();
     parse_program();
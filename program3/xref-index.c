@@ -0,0 +1,638 @@
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mppl_compiler.h"
+
+/*! initial number of the slots of the hash of the strings, a power of 2 */
+#define XREF_MINSLOTS 1024
+/*! initial length of the arrays of a builder */
+#define XREF_MINSIZE 256
+
+/*! Intern a string in the strings of a builder */
+static long intern_string(struct XREF_BUILDER *builder, const char *s, long *slot);
+/*! Double the slots of the hash of the strings */
+static int grow_slots(struct XREF_BUILDER *builder);
+/*! Hash a string */
+static unsigned long hash_string(const char *s);
+/*! Make room for n more elements in an array */
+static int reserve(void **array, long *size, long len, long n, size_t elem_size);
+/*! Compare two symbols of the builder being sorted */
+static int compare_symbols(const void *a, const void *b);
+/*! Write a field of an index */
+static int write_field(FILE *out, long value);
+/*! Read a field of an index */
+static long read_field(const unsigned char *p);
+/*! Take an array from the rest of an index */
+static int take_array(long *rest, long n, long elem_size);
+
+/*! builder whose symbols are being sorted by compare_symbols() */
+static struct XREF_BUILDER *sorting_builder;
+
+/*!
+ * @brief Initialize an empty builder
+ * @param[in] builder The builder
+ */
+void xref_builder_init(struct XREF_BUILDER *builder) {
+    memset(builder, 0, sizeof(*builder));
+}
+
+/*!
+ * @brief Release the memory of a builder
+ * @param[in] builder The builder
+ */
+void xref_builder_release(struct XREF_BUILDER *builder) {
+    free(builder->symbols);
+    free(builder->refs);
+    free(builder->strings);
+    free(builder->slots);
+    free(builder->slot_files);
+    free(builder->files);
+    xref_builder_init(builder);
+}
+
+/*!
+ * @brief Add a source file to a builder, unless it is already added
+ * @param[in] builder The builder
+ * @param[in] file Name of the source file
+ * @return int Return the index of the source file, or -1 on failure.
+ */
+int xref_builder_add_file(struct XREF_BUILDER *builder, const char *file) {
+    long offset, slot, size = builder->files_size;
+
+    if ((offset = intern_string(builder, file, &slot)) < 0) {
+        return -1;
+    }
+    if (builder->slot_files[slot] >= 0) {
+        return builder->slot_files[slot];
+    }
+    if (reserve((void **)&builder->files, &size, builder->nfiles, 1, sizeof(long)) == -1) {
+        return -1;
+    }
+    builder->files_size = (int)size;
+    builder->files[builder->nfiles] = offset;
+    builder->slot_files[slot] = builder->nfiles;
+    return builder->nfiles++;
+}
+
+/*!
+ * @brief Add a symbol to a builder
+ * @param[in] builder The builder
+ * @param[in] file index of the source file returned by xref_builder_add_file()
+ * @param[in] name Name
+ * @param[in] procname procedure name, or NULL for a global name
+ * @param[in] type Type, as printed in the cross reference table
+ * @param[in] deflinenum line number of the definition
+ * @param[in] refs line numbers of the references
+ * @param[in] nrefs number of the line numbers
+ * @return int Return 0 on success, -1 on failure.
+ */
+int xref_builder_add(struct XREF_BUILDER *builder, int file, const char *name, const char *procname,
+                     const char *type, int deflinenum, const int *refs, int nrefs) {
+    struct XREF_SYMBOL symbol;
+    long slot;
+
+    symbol.procname = -1;
+    if ((symbol.name = intern_string(builder, name, &slot)) < 0 ||
+        (symbol.type = intern_string(builder, type, &slot)) < 0 ||
+        (procname != NULL && (symbol.procname = intern_string(builder, procname, &slot)) < 0)) {
+        return -1;
+    }
+    symbol.firstref = builder->nrefs;
+    symbol.file = file;
+    symbol.deflinenum = deflinenum;
+    symbol.nrefs = nrefs;
+
+    if (reserve((void **)&builder->symbols, &builder->symbols_size, builder->nsymbols, 1,
+                sizeof(struct XREF_SYMBOL)) == -1 ||
+        reserve((void **)&builder->refs, &builder->refs_size, builder->nrefs, nrefs, sizeof(int)) == -1) {
+        return -1;
+    }
+    builder->symbols[builder->nsymbols++] = symbol;
+    if (nrefs > 0) {
+        memcpy(builder->refs + builder->nrefs, refs, sizeof(int) * nrefs);
+        builder->nrefs += nrefs;
+    }
+    return 0;
+}
+
+/*!
+ * @brief Sort the symbols of a builder and write them to a cross reference index
+ * @details The index is written to a temporary file and renamed, so that no one maps a half-written index.
+ * @param[in] builder The builder
+ * @param[in] path Path of the index
+ * @return int Return 0 on success, -1 on failure or if the index is too large for its fields.
+ */
+int xref_builder_write(struct XREF_BUILDER *builder, const char *path) {
+    const struct XREF_SYMBOL *symbol;
+    char tmp[FILENAME_MAX + 32];
+    FILE *out;
+    long i;
+    int ret = 0;
+
+    if (builder->nsymbols > 1) {
+        sorting_builder = builder;
+        qsort(builder->symbols, builder->nsymbols, sizeof(struct XREF_SYMBOL), compare_symbols);
+        sorting_builder = NULL;
+    }
+
+    /* every offset and index is less than these */
+    if (strlen(path) >= FILENAME_MAX || (unsigned long)builder->nsymbols >= XREF_NONE ||
+        (unsigned long)builder->nrefs >= XREF_NONE || (unsigned long)builder->strings_len >= XREF_NONE) {
+        return -1;
+    }
+    sprintf(tmp, "%s.%ld", path, (long)getpid());
+    if ((out = fopen(tmp, "wb")) == NULL) {
+        return -1;
+    }
+    if (fwrite(XREF_INDEX_MAGIC, 1, 8, out) != 8 || write_field(out, XREF_RECORD_SIZE) == -1 ||
+        write_field(out, builder->nfiles) == -1 || write_field(out, builder->nsymbols) == -1 ||
+        write_field(out, builder->nrefs) == -1 || write_field(out, builder->strings_len) == -1) {
+        ret = -1;
+    }
+    for (i = 0; i < builder->nfiles && ret == 0; i++) {
+        ret = write_field(out, builder->files[i]);
+    }
+    for (i = 0; i < builder->nsymbols && ret == 0; i++) {
+        symbol = &builder->symbols[i];
+        if (write_field(out, symbol->name) == -1 || write_field(out, symbol->procname) == -1 ||
+            write_field(out, symbol->type) == -1 || write_field(out, symbol->firstref) == -1 ||
+            write_field(out, symbol->file) == -1 || write_field(out, symbol->deflinenum) == -1 ||
+            write_field(out, symbol->nrefs) == -1) {
+            ret = -1;
+        }
+    }
+    for (i = 0; i < builder->nrefs && ret == 0; i++) {
+        ret = write_field(out, builder->refs[i]);
+    }
+    if (ret == 0 && builder->strings_len > 0 &&
+        fwrite(builder->strings, 1, builder->strings_len, out) != (size_t)builder->strings_len) {
+        ret = -1;
+    }
+    if (fclose(out) == EOF || ret == -1 || rename(tmp, path) == -1) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief Map a cross reference index
+ * @details The header is checked here, and each symbol when it is read by xref_index_symbol().
+ * @param[out] index The index
+ * @param[in] path Path of the index
+ * @return int Return 0 on success, -1 if the index is missing, of another format, or broken.
+ */
+int xref_index_open(struct XREF_INDEX *index, const char *path) {
+    const unsigned char *p;
+    struct stat st;
+    FILE *in;
+    void *map;
+    long rest;
+
+    memset(index, 0, sizeof(*index));
+    if ((in = fopen(path, "rb")) == NULL) {
+        return -1;
+    }
+    if (fstat(fileno(in), &st) == -1 || st.st_size < XREF_HEADER_SIZE || st.st_size > LONG_MAX) {
+        fclose(in);
+        return -1;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+    fclose(in);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    p = (const unsigned char *)map;
+    index->nfiles = read_field(p + 8 + XREF_FIELD_SIZE);
+    index->nsymbols = read_field(p + 8 + 2 * XREF_FIELD_SIZE);
+    index->nrefs = read_field(p + 8 + 3 * XREF_FIELD_SIZE);
+    index->strings_size = read_field(p + 8 + 4 * XREF_FIELD_SIZE);
+    rest = (long)st.st_size - XREF_HEADER_SIZE;
+    if (memcmp(p, XREF_INDEX_MAGIC, 8) != 0 || read_field(p + 8) != XREF_RECORD_SIZE ||
+        take_array(&rest, index->nfiles, XREF_FIELD_SIZE) == -1 ||
+        take_array(&rest, index->nsymbols, XREF_RECORD_SIZE) == -1 ||
+        take_array(&rest, index->nrefs, XREF_FIELD_SIZE) == -1 || take_array(&rest, index->strings_size, 1) == -1 ||
+        rest != 0) {
+        munmap(map, (size_t)st.st_size);
+        memset(index, 0, sizeof(*index));
+        return -1;
+    }
+
+    index->map = map;
+    index->map_size = (long)st.st_size;
+    index->files = p + XREF_HEADER_SIZE;
+    index->symbols = index->files + index->nfiles * XREF_FIELD_SIZE;
+    index->refs = index->symbols + index->nsymbols * XREF_RECORD_SIZE;
+    index->strings = (const char *)(index->refs + index->nrefs * XREF_FIELD_SIZE);
+    if (index->strings_size > 0 && index->strings[index->strings_size - 1] != '\0') {
+        /* a string would run off the end */
+        xref_index_close(index);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief Unmap a cross reference index
+ * @param[in] index The index
+ */
+void xref_index_close(struct XREF_INDEX *index) {
+    if (index->map != NULL) {
+        munmap(index->map, (size_t)index->map_size);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+/*!
+ * @brief Return a string of a cross reference index
+ * @param[in] index The index
+ * @param[in] offset offset of the string
+ * @return const char * Return the string, or NULL if the offset is out of the strings.
+ */
+const char *xref_index_string(const struct XREF_INDEX *index, long offset) {
+    if (offset < 0 || offset >= index->strings_size) {
+        return NULL;
+    }
+    return index->strings + offset;
+}
+
+/*!
+ * @brief Return the name of a source file of a cross reference index
+ * @param[in] index The index
+ * @param[in] file index of the source file
+ * @return const char * Return the name, or NULL if the source file is out of the index or broken.
+ */
+const char *xref_index_file(const struct XREF_INDEX *index, long file) {
+    if (file < 0 || file >= index->nfiles) {
+        return NULL;
+    }
+    return xref_index_string(index, read_field(index->files + file * XREF_FIELD_SIZE));
+}
+
+/*!
+ * @brief Read a symbol of a cross reference index
+ * @details The strings, the source file and the line numbers of the references of the symbol are
+ * checked to be in the index, so that they can be used without checking again.
+ * @param[in] index The index
+ * @param[in] i index of the symbol
+ * @param[out] symbol The symbol
+ * @return int Return 0 on success, -1 if the symbol is out of the index or broken.
+ */
+int xref_index_symbol(const struct XREF_INDEX *index, long i, struct XREF_SYMBOL *symbol) {
+    long field[XREF_RECORD_SIZE / XREF_FIELD_SIZE];
+    int k;
+
+    if (i < 0 || i >= index->nsymbols) {
+        return -1;
+    }
+    for (k = 0; k < XREF_RECORD_SIZE / XREF_FIELD_SIZE; k++) {
+        field[k] = read_field(index->symbols + i * XREF_RECORD_SIZE + k * XREF_FIELD_SIZE);
+    }
+    symbol->name = field[0];
+    symbol->procname = field[1];
+    symbol->type = field[2];
+    symbol->firstref = field[3];
+    if (xref_index_string(index, symbol->name) == NULL || xref_index_string(index, symbol->type) == NULL ||
+        (symbol->procname != -1 && xref_index_string(index, symbol->procname) == NULL) || field[4] < 0 ||
+        field[4] >= index->nfiles || field[4] > INT_MAX || field[5] < 0 || field[5] > INT_MAX || field[6] < 0 ||
+        field[6] > INT_MAX || symbol->firstref < 0 || symbol->firstref > index->nrefs - field[6]) {
+        return -1;
+    }
+    symbol->file = (int)field[4];
+    symbol->deflinenum = (int)field[5];
+    symbol->nrefs = (int)field[6];
+    return 0;
+}
+
+/*!
+ * @brief Return a line number of the references of a cross reference index
+ * @param[in] index The index
+ * @param[in] i index of the line number, from a symbol read by xref_index_symbol()
+ * @return int Return the line number.
+ */
+int xref_index_ref(const struct XREF_INDEX *index, long i) {
+    return (int)read_field(index->refs + i * XREF_FIELD_SIZE);
+}
+
+/*!
+ * @brief Find the symbols of a name by binary search
+ * @param[in] index The index
+ * @param[in] name Name you want to find
+ * @param[out] nsymbols number of the symbols of the name
+ * @return long Return the index of the first symbol of the name.
+ */
+long xref_index_lookup(const struct XREF_INDEX *index, const char *name, long *nsymbols) {
+    long low = 0, high = index->nsymbols, mid, first;
+    const char *s;
+
+    /* first symbol whose name is not less than name */
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        s = xref_index_string(index, read_field(index->symbols + mid * XREF_RECORD_SIZE));
+        if (s != NULL && strcmp(s, name) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    first = low;
+    /* first symbol whose name is greater than name */
+    high = index->nsymbols;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        s = xref_index_string(index, read_field(index->symbols + mid * XREF_RECORD_SIZE));
+        if (s != NULL && strcmp(s, name) <= 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *nsymbols = low - first;
+    return first;
+}
+
+/*!
+ * @brief Merge cross reference indexes into one
+ * @details A source file in more than one index is taken from the last of them,
+ * so that the index of a file compiled again replaces the old one.
+ * @param[in] path Path of the merged index, which may be one of the indexes
+ * @param[in] indexes The indexes
+ * @param[in] nindexes number of the indexes
+ * @return int Return 0 on success, -1 on failure.
+ */
+int xref_index_merge(const char *path, struct XREF_INDEX *indexes, int nindexes) {
+    struct XREF_BUILDER builder;
+    const struct XREF_INDEX *index;
+    struct XREF_SYMBOL symbol;
+    const char *name;
+    int **files;
+    int *owners = NULL, *refs = NULL;
+    int i, k, ret = 0;
+    long j, refs_size = 0;
+
+    xref_builder_init(&builder);
+    if ((files = (int **)calloc(nindexes > 0 ? nindexes : 1, sizeof(int *))) == NULL) {
+        return -1;
+    }
+    /* the source files of each index, in the merged index */
+    for (i = 0; i < nindexes && ret == 0; i++) {
+        index = &indexes[i];
+        if ((files[i] = (int *)malloc(sizeof(int) * (index->nfiles + 1))) == NULL) {
+            ret = -1;
+            break;
+        }
+        for (j = 0; j < index->nfiles; j++) {
+            if ((name = xref_index_file(index, j)) == NULL ||
+                (files[i][j] = xref_builder_add_file(&builder, name)) == -1) {
+                ret = -1;
+                break;
+            }
+        }
+    }
+    /* the last index of each source file */
+    if (ret == 0 && (owners = (int *)malloc(sizeof(int) * (builder.nfiles + 1))) == NULL) {
+        ret = -1;
+    }
+    for (i = 0; i < nindexes && ret == 0; i++) {
+        for (j = 0; j < indexes[i].nfiles; j++) {
+            owners[files[i][j]] = i;
+        }
+    }
+
+    for (i = 0; i < nindexes && ret == 0; i++) {
+        index = &indexes[i];
+        for (j = 0; j < index->nsymbols; j++) {
+            if (xref_index_symbol(index, j, &symbol) == -1) {
+                /* broken */
+                ret = -1;
+                break;
+            }
+            if (owners[files[i][symbol.file]] != i) {
+                /* replaced by a later index */
+                continue;
+            }
+            if (reserve((void **)&refs, &refs_size, 0, symbol.nrefs, sizeof(int)) == -1) {
+                ret = -1;
+                break;
+            }
+            for (k = 0; k < symbol.nrefs; k++) {
+                refs[k] = xref_index_ref(index, symbol.firstref + k);
+            }
+            if (xref_builder_add(&builder, files[i][symbol.file], xref_index_string(index, symbol.name),
+                                 xref_index_string(index, symbol.procname), xref_index_string(index, symbol.type),
+                                 symbol.deflinenum, refs, symbol.nrefs) == -1) {
+                ret = -1;
+                break;
+            }
+        }
+    }
+    if (ret == 0) {
+        ret = xref_builder_write(&builder, path);
+    }
+
+    for (i = 0; i < nindexes; i++) {
+        free(files[i]);
+    }
+    free(files);
+    free(owners);
+    free(refs);
+    xref_builder_release(&builder);
+    return ret;
+}
+
+/*!
+ * @brief Intern a string in the strings of a builder, which hold each string only once
+ * @param[in] builder The builder
+ * @param[in] s The string
+ * @param[out] slot slot of the string in the hash
+ * @return long Return the offset of the string, or -1 on failure.
+ */
+static long intern_string(struct XREF_BUILDER *builder, const char *s, long *slot) {
+    long i, len = (long)strlen(s) + 1, offset;
+
+    if ((builder->nstrings + 1) * 2 > builder->nslots && grow_slots(builder) == -1) {
+        return -1;
+    }
+    for (i = (long)(hash_string(s) & (builder->nslots - 1)); builder->slots[i] != -1;
+         i = (i + 1) & (builder->nslots - 1)) {
+        if (strcmp(builder->strings + builder->slots[i], s) == 0) {
+            *slot = i;
+            return builder->slots[i];
+        }
+    }
+
+    if (reserve((void **)&builder->strings, &builder->strings_size, builder->strings_len, len, 1) == -1) {
+        return -1;
+    }
+    offset = builder->strings_len;
+    memcpy(builder->strings + offset, s, len);
+    builder->strings_len += len;
+    builder->slots[i] = offset;
+    builder->slot_files[i] = -1;
+    builder->nstrings++;
+    *slot = i;
+    return offset;
+}
+
+/*!
+ * @brief Double the slots of the hash of the strings of a builder
+ * @param[in] builder The builder
+ * @return int Return 0 on success, -1 on failure.
+ */
+static int grow_slots(struct XREF_BUILDER *builder) {
+    long nslots = (builder->nslots > 0) ? builder->nslots * 2 : XREF_MINSLOTS;
+    long *slots;
+    int *slot_files;
+    long i, j;
+
+    if ((slots = (long *)malloc(sizeof(long) * nslots)) == NULL) {
+        return -1;
+    }
+    if ((slot_files = (int *)malloc(sizeof(int) * nslots)) == NULL) {
+        free(slots);
+        return -1;
+    }
+    for (i = 0; i < nslots; i++) {
+        slots[i] = -1;
+        slot_files[i] = -1;
+    }
+    /* rehash */
+    for (i = 0; i < builder->nslots; i++) {
+        if (builder->slots[i] == -1) {
+            continue;
+        }
+        for (j = (long)(hash_string(builder->strings + builder->slots[i]) & (nslots - 1)); slots[j] != -1;
+             j = (j + 1) & (nslots - 1)) {
+        }
+        slots[j] = builder->slots[i];
+        slot_files[j] = builder->slot_files[i];
+    }
+    free(builder->slots);
+    free(builder->slot_files);
+    builder->slots = slots;
+    builder->slot_files = slot_files;
+    builder->nslots = nslots;
+    return 0;
+}
+
+/*!
+ * @brief FNV-1a hash of a string
+ * @param[in] s The string
+ * @return unsigned long Return the hash.
+ */
+static unsigned long hash_string(const char *s) {
+    unsigned long hash = 2166136261UL;
+
+    for (; *s != '\0'; s++) {
+        hash ^= (unsigned char)*s;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/*!
+ * @brief Make room for n more elements in an array, doubling it
+ * @param[in,out] array The array
+ * @param[in,out] size allocated length of the array
+ * @param[in] len number of the elements in use
+ * @param[in] n number of the elements to add
+ * @param[in] elem_size size of an element
+ * @return int Return 0 on success, -1 on failure.
+ */
+static int reserve(void **array, long *size, long len, long n, size_t elem_size) {
+    long new_size;
+    void *p;
+
+    if (len + n <= *size) {
+        return 0;
+    }
+    for (new_size = (*size > 0) ? *size * 2 : XREF_MINSIZE; new_size < len + n; new_size *= 2) {
+    }
+    if ((p = realloc(*array, elem_size * new_size)) == NULL) {
+        return -1;
+    }
+    *array = p;
+    *size = new_size;
+    return 0;
+}
+
+/*!
+ * @brief Compare the names, the procedure names and the source files of two symbols for qsort
+ * @details The global name comes before the local names of the same name.
+ * @param[in] a pointer to struct XREF_SYMBOL
+ * @param[in] b pointer to struct XREF_SYMBOL
+ * @return int Return negative if a comes first, positive if b comes first.
+ */
+static int compare_symbols(const void *a, const void *b) {
+    const struct XREF_SYMBOL *p = (const struct XREF_SYMBOL *)a;
+    const struct XREF_SYMBOL *q = (const struct XREF_SYMBOL *)b;
+    const char *strings = sorting_builder->strings;
+    int cmp;
+
+    if ((cmp = strcmp(strings + p->name, strings + q->name)) != 0) {
+        return cmp;
+    }
+    if (p->procname != q->procname) {
+        /* global name first */
+        if (p->procname == -1 || q->procname == -1) {
+            return (p->procname == -1) ? -1 : 1;
+        }
+        if ((cmp = strcmp(strings + p->procname, strings + q->procname)) != 0) {
+            return cmp;
+        }
+    }
+    if (p->file != q->file) {
+        return strcmp(strings + sorting_builder->files[p->file], strings + sorting_builder->files[q->file]);
+    }
+    return p->deflinenum - q->deflinenum;
+}
+
+/*!
+ * @brief Write a field of a cross reference index in little-endian byte order
+ * @param[in] out The index being written
+ * @param[in] value The value, which is -1 or less than XREF_NONE
+ * @return int Return 0 on success, -1 on failure.
+ */
+static int write_field(FILE *out, long value) {
+    unsigned long v = (value == -1) ? XREF_NONE : (unsigned long)value;
+    unsigned char field[XREF_FIELD_SIZE];
+    int k;
+
+    for (k = 0; k < XREF_FIELD_SIZE; k++) {
+        field[k] = (unsigned char)((v >> (8 * k)) & 0xff);
+    }
+    return (fwrite(field, XREF_FIELD_SIZE, 1, out) == 1) ? 0 : -1;
+}
+
+/*!
+ * @brief Read a field of a cross reference index in little-endian byte order
+ * @param[in] p The field
+ * @return long Return the value, or -1 for XREF_NONE.
+ */
+static long read_field(const unsigned char *p) {
+    unsigned long v = 0;
+    int k;
+
+    for (k = XREF_FIELD_SIZE - 1; k >= 0; k--) {
+        v = (v << 8) | p[k];
+    }
+    return (v == XREF_NONE) ? -1 : (long)v;
+}
+
+/*!
+ * @brief Take an array from the bytes of a cross reference index which are not taken yet
+ * @param[in,out] rest number of the bytes not taken yet
+ * @param[in] n number of the elements of the array
+ * @param[in] elem_size size of an element
+ * @return int Return 0 on success, -1 if n is negative or the array does not fit in the rest.
+ */
+static int take_array(long *rest, long n, long elem_size) {
+    if (n < 0 || n > *rest / elem_size) {
+        return -1;
+    }
+    *rest -= n * elem_size;
+    return 0;
+}
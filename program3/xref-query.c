@@ -0,0 +1,85 @@
+#include "mppl_compiler.h"
+
+/*!
+ * @brief Output the symbols of a name in a cross reference index
+ * @param[in] index The index
+ * @param[in] name Name you want to find
+ * @return int Return 0 if the name is found, 1 if it is not, and 2 if the index is broken.
+ */
+static int query(const struct XREF_INDEX *index, const char *name) {
+    struct XREF_SYMBOL symbol;
+    const char *file, *procname;
+    long first, nsymbols, i;
+    int j;
+
+    first = xref_index_lookup(index, name, &nsymbols);
+    for (i = first; i < first + nsymbols; i++) {
+        if (xref_index_symbol(index, i, &symbol) == -1 || (file = xref_index_file(index, symbol.file)) == NULL) {
+            fprintf(stderr, "Index is broken.\n");
+            return 2;
+        }
+        procname = xref_index_string(index, symbol.procname);
+        fprintf(stdout, "%s:%d: %s%s%s %s |", file, symbol.deflinenum, name, procname != NULL ? ":" : "",
+                procname != NULL ? procname : "", xref_index_string(index, symbol.type));
+        for (j = 0; j < symbol.nrefs; j++) {
+            fprintf(stdout, "%s%d", j == 0 ? " " : ",", xref_index_ref(index, symbol.firstref + j));
+        }
+        fprintf(stdout, "\n");
+    }
+    return (nsymbols > 0) ? 0 : 1;
+}
+
+/*!
+ * @brief main function
+ * @details Usage: xref-query index name...
+ * Output the definitions and the references of the names in the index written by main --index.
+ * Usage: xref-query --merge merged index...
+ * Merge the indexes into one. A source file in more than one index is taken from the last of them.
+ * @param[in] nc The number of arguments
+ * @param[in] np Options, index and names
+ * @return int Returns 0 if all the names are found, 1 if not, and 2 on failure.
+ */
+int main(int nc, char *np[]) {
+    struct XREF_INDEX index, *indexes;
+    int i, nindexes, found, ret = 0;
+
+    if (nc >= 3 && strcmp(np[1], "--merge") == 0) {
+        nindexes = nc - 3;
+        if ((indexes = (struct XREF_INDEX *)calloc(nindexes > 0 ? nindexes : 1, sizeof(struct XREF_INDEX))) ==
+            NULL) {
+            fprintf(stderr, "can not malloc in main\n");
+            return 2;
+        }
+        for (i = 0; i < nindexes && ret == 0; i++) {
+            if (xref_index_open(&indexes[i], np[i + 3]) == -1) {
+                fprintf(stderr, "Index %s can not open.\n", np[i + 3]);
+                ret = 2;
+            }
+        }
+        if (ret == 0 && xref_index_merge(np[2], indexes, nindexes) == -1) {
+            fprintf(stderr, "Index %s can not be written.\n", np[2]);
+            ret = 2;
+        }
+        for (i = 0; i < nindexes; i++) {
+            xref_index_close(&indexes[i]);
+        }
+        free(indexes);
+        return ret;
+    }
+    if (nc < 3) {
+        fprintf(stderr, "Usage: %s index name...\n       %s --merge merged index...\n", np[0], np[0]);
+        return 2;
+    }
+
+    if (xref_index_open(&index, np[1]) == -1) {
+        fprintf(stderr, "Index %s can not open.\n", np[1]);
+        return 2;
+    }
+    for (i = 2; i < nc && ret != 2; i++) {
+        if ((found = query(&index, np[i])) != 0) {
+            ret = found;
+        }
+    }
+    xref_index_close(&index);
+    return ret;
+}
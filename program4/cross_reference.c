@@ -76,7 +76,7 @@ int parse_program(void) {
         return error("Program name is not found.");
     }
 
-    if (assemble_start(string_attr) == ERROR) {
+    if (assemble_start(get_string_attr()) == ERROR) {
         return ERROR;
     }
 
@@ -126,7 +126,7 @@ static int parse_block(void) {
         }
     }
 
-    fprintf(out_fp, "%s\n", L0001);
+    assemble_label(L0001);
     if (parse_compound_statement() == ERROR) {
         return ERROR;
     }
@@ -190,12 +190,12 @@ static int parse_variable_names(void) {
 
     /* declaration */
     if (in_variable_declaration || is_formal_parameter) {
-        if (id_register_without_type(string_attr) == ERROR) {
+        if (id_register_without_type(token_span.ptr, token_span.len) == ERROR) {
             return ERROR;
         }
     }
     /* reference */
-    else if (register_linenum(string_attr) == ERROR) {
+    else if (register_linenum(get_string_attr()) == ERROR) {
         return ERROR;
     }
 
@@ -209,12 +209,12 @@ static int parse_variable_names(void) {
         }
         /* definition */
         if (in_variable_declaration || is_formal_parameter) {
-            if (id_register_without_type(string_attr) == ERROR) {
+            if (id_register_without_type(token_span.ptr, token_span.len) == ERROR) {
                 return ERROR;
             }
         }
         /* reference */
-        else if (register_linenum(string_attr) == ERROR) {
+        else if (register_linenum(get_string_attr()) == ERROR) {
             return ERROR;
         }
 
@@ -421,7 +421,7 @@ static int parse_procedure_name(void) {
     if (definition_procedure_name) {
         struct TYPE *type;
         /* regist procedure name */
-        id_register_without_type(string_attr);
+        id_register_without_type(token_span.ptr, token_span.len);
         /* procedure name's type is TPPROC */
         type = std_type(TPPROC);
         /* error multiple definition or can not malloc */
@@ -429,14 +429,14 @@ static int parse_procedure_name(void) {
             return ERROR;
         }
 
-        set_procedure_name(string_attr);
+        set_procedure_name(get_string_attr());
     }
     /* reference */
     else {
-        if (register_linenum(string_attr) == ERROR) {
+        if (register_linenum(get_string_attr()) == ERROR) {
             return ERROR;
         }
-        id_procedure = search_procedure(string_attr);
+        id_procedure = search_procedure(get_string_attr());
     }
     token = scan();
 
@@ -691,9 +691,9 @@ static int parse_condition_statement(void) {
                 return ERROR;
             }
         }
-        fprintf(out_fp, "%s\n",if_end_label);
+        assemble_label(if_end_label);
     } else {
-        fprintf(out_fp, "%s\n",else_label);
+        assemble_label(else_label);
     }
     return NORMAL;
 }
@@ -709,7 +709,7 @@ static int parse_iteration_statement(void) {
     char *iteration_bottom_label = NULL;
 
     create_newlabel(&iteration_top_label);
-    fprintf(out_fp, "%s\n", iteration_top_label);
+    assemble_label(iteration_top_label);
     create_newlabel(&iteration_bottom_label);
     add_literal(&while_end_literal_root, iteration_bottom_label, "0"); /* No value is required. */
 
@@ -744,8 +744,7 @@ static int parse_iteration_statement(void) {
     }
     while_statement_level--;
 
-    fprintf(out_fp, "\tJUMP \t%s\n", iteration_top_label);
-    fprintf(out_fp, "%s\n", iteration_bottom_label);
+    assemble_iteration_end(iteration_top_label, iteration_bottom_label);
     pop_while_literal_list();
 
     return NORMAL;
@@ -873,7 +872,7 @@ static int parse_variable(void) {
         return error("Name is not found.");
     }
 
-    if ((id_type = register_linenum(string_attr)) == ERROR) {
+    if ((id_type = register_linenum(get_string_attr())) == ERROR) {
         return ERROR;
     }
 
@@ -887,7 +886,7 @@ static int parse_variable(void) {
         id_array_variable = id_variable;
 
         if (!(id_type & TPARRAY)) {
-            fprintf(stderr, "%s is not Array type.", string_attr);
+            fprintf(stderr, "%s is not Array type.", get_string_attr());
             return error("id is not Array type.");
         }
 
@@ -1034,8 +1033,8 @@ static int parse_output_format(void) {
     int exp_type = TPNONE;
     int is_expression_variable_only = 0;
 
-    if (token == TSTRING && strlen(string_attr) > 1) {
-        if (assemble_output_format_string(string_attr) == ERROR) {
+    if (token == TSTRING && strlen(get_string_attr()) > 1) {
+        if (assemble_output_format_string(token_span.ptr, token_span.len) == ERROR) {
             return ERROR;
         }
 
@@ -1180,7 +1179,7 @@ static int is_relational_operator(int _token) {
 static int parse_simple_expression(int *is_simple_expression_variable_only) {
     int term_type1 = TPNONE;
     int term_type2 = TPNONE;
-    int opr;
+    int opr, ret;
     int is_term_variable_only = 0;
     int sign_token = -1;
     *is_simple_expression_variable_only = true;
@@ -1212,8 +1211,8 @@ static int parse_simple_expression(int *is_simple_expression_variable_only) {
         is_term_variable_only = false;
     }
 
-    if (sign_token == TMINUS) {
-        assemble_minus_sign();
+    if (sign_token == TMINUS && assemble_minus_sign() == ERROR) {
+        return ERROR;
     }
 
     if (!is_term_variable_only) {
@@ -1254,11 +1253,14 @@ static int parse_simple_expression(int *is_simple_expression_variable_only) {
         }
 
         if (opr == TPLUS) {
-            assemble_ADDA();
+            ret = assemble_ADDA();
         } else if (opr == TMINUS) {
-            assemble_SUBA();
-        } else if (opr == TOR) {
-            assemble_OR();
+            ret = assemble_SUBA();
+        } else {
+            ret = assemble_OR();
+        }
+        if (ret == ERROR) {
+            return ERROR;
         }
     }
     return term_type1;
@@ -1271,7 +1273,7 @@ static int parse_simple_expression(int *is_simple_expression_variable_only) {
 static int parse_term(int *is_variable_only) {
     int term_type1 = TPNONE;
     int term_type2 = TPNONE;
-    int opr;
+    int opr, ret;
     int is_variable = 0;
     *is_variable_only = true;
 
@@ -1316,11 +1318,14 @@ static int parse_term(int *is_variable_only) {
         }
 
         if (opr == TSTAR) {
-            assemble_MULA();
+            ret = assemble_MULA();
         } else if (opr == TDIV) {
-            assemble_DIVA();
-        } else if (opr == TAND) {
-            assemble_AND();
+            ret = assemble_DIVA();
+        } else {
+            ret = assemble_AND();
+        }
+        if (ret == ERROR) {
+            return ERROR;
         }
     }
     return term_type1;
@@ -1438,6 +1443,8 @@ static int parse_factor(int *is_variable) {
 static int parse_constant(void) {
     int constant_type = NORMAL;
     int constant_value;
+    const char *string_value;
+    int string_len;
 
     switch (token) {
         case TNUMBER:
@@ -1451,11 +1458,12 @@ static int parse_constant(void) {
             constant_value = (token == TTRUE) ? 1 : 0;
             break;
         case TSTRING:
-            if (strlen(string_attr) != 1) {
+            string_value = get_string_value(&string_len);
+            if (string_len != 1) {
                 return error("Constant string length != 1");
             }
             constant_type = TPCHAR;
-            constant_value = (int)string_attr[0];
+            constant_value = (int)string_value[0];
             break;
         default:
             return error("Constant is not found.");
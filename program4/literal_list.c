@@ -23,7 +23,7 @@ int add_literal(struct LITERAL **root, char *label, char *value) {
     struct LITERAL *new_literal;
 
     /* struct LITERAL */
-    if ((new_literal = (struct LITERAL *)malloc(sizeof(struct LITERAL))) == NULL) {
+    if ((new_literal = (struct LITERAL *)arena_alloc(&compile_arena, sizeof(struct LITERAL))) == NULL) {
         return error("Can not malloc for struct LITERAL in add_literal.\n");
     }
     new_literal->label = label;
@@ -38,13 +38,10 @@ int add_literal(struct LITERAL **root, char *label, char *value) {
  * @brief Remove the first element from while_end_literal_root 
  */
 void pop_while_literal_list(void) {
-    struct LITERAL *p_literal;
     if (while_end_literal_root == NULL) {
         return;
     }
-    p_literal = while_end_literal_root->nextp;
-    free(while_end_literal_root);
-    while_end_literal_root = p_literal;
+    while_end_literal_root = while_end_literal_root->nextp;
 }
 
 /*!
@@ -56,16 +53,10 @@ void release_literal_lists(void) {
 }
 
 /*!
- * @brief Release the literal list
+ * @brief Release the literal list, whose elements are released with the arena of the compilation
  * @param[in] root The root of the list 
  */
 void release_literal(struct LITERAL **root) {
-    struct LITERAL *p_literal = *root;
-    while (p_literal != NULL) {
-        struct LITERAL *next_p = p_literal->nextp;
-        free(p_literal);
-        p_literal = next_p;
-    }
     *root = NULL;
 }
 
@@ -75,7 +66,7 @@ void release_literal(struct LITERAL **root) {
 void assemble_literals(void) {
     struct LITERAL *p_literal = literal_root;
     while (p_literal != NULL) {
-        fprintf(out_fp, "%s \tDC \t%s\n", p_literal->label, p_literal->value);
+        assemble_literal(p_literal->label, p_literal->value);
         p_literal = p_literal->nextp;
     }
 }
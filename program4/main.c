@@ -53,21 +53,61 @@ static char *file_name;
 
 /*!
  * @brief main function
+ * @details Usage: main [-j threads] [--token-cache | --no-token-cache] [--arena-stats] [-O] [--peephole window] [--peephole-stats] file
+ * The file "-" is the standard input, which is scanned as it is read.
+ * --token-cache keeps the tokens of the file in the token cache in token_cache_dir(), which
+ * --no-token-cache turns off again.
+ * --arena-stats outputs the statistics of the arena of the compilation to the standard error.
+ * -O evaluates the expressions in the general registers instead of the stack, and optimizes the object program
+ * with the peephole rules over PEEPHOLE_WINDOW instructions.
+ * --peephole sets the window of the peephole optimization, 0 disables it.
+ * --peephole-stats outputs the number of the rewrites of each peephole rule to the standard error.
  * @param[in] nc The number of arguments
- * @param[in] np File name to read
+ * @param[in] np Options and file name to read
  * @return int Returns 0 on success and 1 on failure.
  */
 int main(int nc, char *np[]) {
-    int ret;
-    if (nc < 2) {
+    int ret, argi, nthreads = 1, arena_stats = 0, peephole_stats = 0;
+    char *cache_dir = NULL;
+
+    for (argi = 1; argi < nc - 1 && np[argi][0] == '-'; argi++) {
+        if (strcmp(np[argi], "-j") == 0 && argi + 1 < nc - 1) {
+            /* tokenize the file by threads in advance */
+            nthreads = atoi(np[++argi]);
+        } else if (strcmp(np[argi], "--token-cache") == 0) {
+            cache_dir = token_cache_dir();
+        } else if (strcmp(np[argi], "--no-token-cache") == 0) {
+            cache_dir = NULL;
+        } else if (strcmp(np[argi], "--arena-stats") == 0) {
+            arena_stats = 1;
+        } else if (strcmp(np[argi], "-O") == 0) {
+            optimize = 1;
+            if (peephole_window == 0) {
+                peephole_window = PEEPHOLE_WINDOW;
+            }
+        } else if (strcmp(np[argi], "--peephole") == 0 && argi + 1 < nc - 1) {
+            peephole_window = atoi(np[++argi]);
+            if (peephole_window <= 0) {
+                /* not even -O turns it on */
+                peephole_window = -1;
+            }
+        } else if (strcmp(np[argi], "--peephole-stats") == 0) {
+            peephole_stats = 1;
+        } else {
+            error("function main()");
+            fprintf(stderr, "Unknown option %s.\n", np[argi]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argi >= nc) {
         error("function main()");
         fprintf(stderr, "File name id not given.\n");
         return EXIT_FAILURE;
     }
 
-    file_name = np[1];
+    file_name = np[argi];
 
-    if (init_scan(file_name) < 0) {
+    if (init_scan_tokens(file_name, nthreads, cache_dir) < 0) {
         fprintf(stderr, "File %s can not open.\n", file_name);
         return EXIT_FAILURE;
     }
@@ -97,6 +137,12 @@ int main(int nc, char *np[]) {
 
     fflush(stdout);
 
+    if (arena_stats) {
+        arena_print_stats(&compile_arena, stderr);
+    }
+    if (peephole_stats) {
+        peephole_print_stats(stderr);
+    }
     release_crtab();
     release_literal_lists();
     return ret;
@@ -9,7 +9,7 @@
 #define ERROR -1
 #define NORMAL 0
 
-/*! maximum length of a string */
+/*! initial size of the buffer of a scanned string, which grows as needed */
 #define MAXSTRSIZE 1024
 
 /*! @name definition of token code */
@@ -163,24 +163,175 @@ struct TYPE {
     int arraysize;       /*! size of array, if TPARRAY */
     struct TYPE *etp;    /*! pointer to element type if TPARRAY */
     struct TYPE *paratp; /*! pointer to parameter's type list if ttype is TPPROC */
+    struct TYPE *nextp;  /*! pointer next struct in the same bucket of the canonical types */
 };
 
 /*!
- * @brief List to store the line number
+ * @brief Vector to store the line numbers, in the order of registration
  */
 struct LINE {
-    int reflinenum;         /*! the line number */
-    struct LINE *nextlinep; /*! pointer to next struct */
+    int *reflinenums; /*! the line numbers */
+    int nrefs;        /*! number of the line numbers */
+    int size;         /*! allocated length of reflinenums */
 };
 
 struct ID {
-    char *name;         /*! name */
-    char *procname;     /* procedure name within which this name is defined, NULL if global name */
-    struct TYPE *itp;   /*! Type for the name */
-    int ispara;         /*! 1:formal parameter, 0:else(variable) */
-    int deflinenum;     /*! Name defined line number */
-    struct LINE *irefp; /*! List of line numbers where the name was referenced */
-    struct ID *nextp;   /*! pointer next struct */
+    char *name;           /*! name */
+    char *procname;       /* procedure name within which this name is defined, NULL if global name */
+    struct TYPE *itp;     /*! Type for the name */
+    int ispara;           /*! 1:formal parameter, 0:else(variable) */
+    int deflinenum;       /*! Name defined line number */
+    struct LINE irefs;    /*! Line numbers where the name was referenced */
+    struct ID *nextp;     /*! pointer next struct */
+    unsigned long hash;   /*! hash of the name */
+    struct ID *hashnextp; /*! pointer next struct in the same bucket */
+    struct ID *crnextp;   /*! pointer next struct in the cross reference table */
+};
+
+/*!
+ * @brief Symbol table of a scope, a list in the order of registration indexed by a hash table
+ */
+struct ID_TAB {
+    struct ID *root;     /*! names in the order of registration */
+    struct ID *tail;     /*! the last name of the list */
+    struct ID **buckets; /*! chains of the names by hashnextp, for each hash of the name */
+    int nbuckets;        /*! number of the buckets, a power of 2 */
+    int nids;            /*! number of the names */
+};
+
+/*!
+ * @brief Block of an arena, followed by the memory allocated from it
+ */
+struct ARENA_BLOCK {
+    struct ARENA_BLOCK *next; /*! block allocated before */
+    size_t used;              /*! bytes allocated from the block */
+    size_t size;              /*! bytes of the block */
+};
+
+/*!
+ * @brief Arena, whose memory is released all at once
+ */
+struct ARENA {
+    struct ARENA_BLOCK *blocks; /*! blocks, the current one first */
+    int nblocks;                /*! number of the blocks */
+    long nallocs;               /*! number of the allocations since the release */
+    size_t bytes;               /*! bytes allocated since the release */
+    size_t peak_bytes;          /*! the most bytes allocated at a time */
+};
+
+/*! @name kind of a node of an expression */
+/* @{ */
+/*! constant */
+#define EXPR_CONSTANT 1
+/*! right value of a variable */
+#define EXPR_VARIABLE 2
+/*! left value of a variable */
+#define EXPR_ADDRESS 3
+/*! +, -, *, div, and, or */
+#define EXPR_OPERATOR 4
+/*! relational operator */
+#define EXPR_RELATION 5
+/*! not */
+#define EXPR_NOT 6
+/*! type conversion */
+#define EXPR_CAST 7
+/*! address of a real parameter that does not have a left value */
+#define EXPR_PARAMETER 8
+/*! value whose code is generated, which is pushed on the stack of the object program */
+#define EXPR_STACKED 9
+/*! value whose code is generated, which is stored in a temporary of the object program */
+#define EXPR_TEMPORARY 10
+/* @} */
+
+/*!
+ * @brief Node of an expression, whose code is generated when its value is used
+ */
+struct EXPR {
+    int kind;           /*! EXPR_CONSTANT, EXPR_VARIABLE, ... */
+    int opr;            /*! token of the operator, or type to cast to */
+    int value;          /*! value of a constant, or type to cast from */
+    int need;           /*! number of the registers to evaluate it without spilling */
+    int depth;          /*! height of the tree, which is 1 for a leaf */
+    struct ID *id;      /*! variable */
+    char *label1;       /*! label created when it is parsed */
+    char *label2;       /*! second label created when it is parsed */
+    struct EXPR *left;  /*! left operand, operand, or index of an array */
+    struct EXPR *right; /*! right operand */
+    struct EXPR *nextp; /*! expression below it on the stack of the object program */
+};
+
+/*! @name opcodes of the instructions of the object program */
+/* @{ */
+/*! an instruction a pass removed, which is not output */
+#define OP_NONE 0
+#define OP_LD 1
+#define OP_ST 2
+#define OP_LAD 3
+#define OP_ADDA 4
+#define OP_SUBA 5
+#define OP_MULA 6
+#define OP_DIVA 7
+#define OP_AND 8
+#define OP_OR 9
+#define OP_XOR 10
+#define OP_CPA 11
+#define OP_JUMP 12
+#define OP_JPL 13
+#define OP_JMI 14
+#define OP_JNZ 15
+#define OP_JZE 16
+#define OP_JOV 17
+#define OP_PUSH 18
+#define OP_POP 19
+#define OP_CALL 20
+#define OP_RET 21
+#define OP_SVC 22
+/*! a line with only a label */
+#define OP_LABEL 23
+#define OP_START 24
+#define OP_END 25
+#define OP_DC 26
+#define OP_DS 27
+/*! the library, output as it is */
+#define OP_LIBRARY 28
+/*! number of the opcodes */
+#define NUMOFOPCODE 28
+/* @} */
+
+/*! @name kind of the address operand of an instruction */
+/* @{ */
+/*! no address, the second operand is the register x if there is one */
+#define ADR_NONE 0
+/*! a number */
+#define ADR_NUMBER 1
+/*! a name, such as a label or the value of a literal */
+#define ADR_NAME 2
+/* @} */
+
+/*!
+ * @brief Instruction of the object program
+ */
+struct CASL_INSTRUCTION {
+    unsigned char opcode; /*! OP_LD, OP_ST, ... */
+    signed char r;        /*! register operand, or -1 if there is none */
+    unsigned char x;      /*! index register or the second register operand, 0 if there is none */
+    unsigned char kind;   /*! ADR_NONE, ADR_NUMBER or ADR_NAME */
+    int adr;              /*! address operand, a number or a name */
+    int label;            /*! name of the label of the line, or -1 if there is none */
+};
+
+/*!
+ * @brief Object program, which is output when the compilation ends
+ */
+struct CASL_PROGRAM {
+    struct CASL_INSTRUCTION *insns; /*! the instructions */
+    int ninsns;                     /*! number of the instructions */
+    int size;                       /*! number of the instructions allocated */
+    char **names;                   /*! the names, indexed by the name */
+    int nnames;                     /*! number of the names */
+    int namesize;                   /*! number of the names allocated */
+    int *buckets;                   /*! hash table of the names, -1 if empty */
+    int nbuckets;                   /*! size of the hash table, a power of 2 */
 };
 
 /*!
@@ -192,8 +343,8 @@ struct LITERAL {
     struct LITERAL *nextp; /*! pointer next struct */
 };
 
-extern struct ID *crtabroot;
-extern struct ID *localidroot;
+extern struct ID_TAB crtab;
+extern struct ID_TAB localidtab;
 
 extern int error(char *mes);
 
@@ -201,8 +352,108 @@ extern int error(char *mes);
 /* @{ */
 extern FILE *fp;
 extern int num_attr;
-extern char string_attr[MAXSTRSIZE];
+/*!
+ * @brief View of the last scanned name, number or string in the source
+ */
+extern struct TOKEN_SPAN {
+    const char *ptr; /*! head of the token (a string excludes the enclosing quotes) */
+    int len;         /*! length of the token */
+    long offset;     /*! offset of the token from the head of the source */
+    int escaped;     /*! 1 if the string contains '' */
+} token_span;
+extern char *get_string_attr(void);
+extern const char *get_string_value(int *len);
+
+/*!
+ * @brief A scanned token, whose name, number or string is taken from the source
+ */
+struct TOKEN {
+    int code;     /*! token code */
+    int linenum;  /*! line number of the token */
+    int num_attr; /*! value of a number */
+    int escaped;  /*! 1 if the string contains '' */
+    long offset;  /*! offset of the head of the token (a string includes the enclosing quotes) */
+    int len;      /*! length of the token in the source */
+};
+
+/*!
+ * @brief Tokens of a source, in the order scan() returns them
+ */
+struct TOKEN_ARRAY {
+    struct TOKEN *tokens; /*! array of the tokens, NULL if empty */
+    int ntokens;          /*! number of the tokens */
+    int capacity;         /*! allocated length of tokens, 0 if they are mapped from the token cache */
+    long end_offset;      /*! offset just after the last token, from which scanning gives -1 */
+    int end_linenum;      /*! line number at end_offset */
+    const char *text;     /*! texts of the names, numbers and strings in order, NULL to take them from the source */
+};
+
+/*!
+ * @brief An edit of a source, which replaces removed_len bytes at offset with inserted_len bytes
+ */
+struct TEXT_EDIT {
+    long offset;       /*! offset of the edit */
+    long removed_len;  /*! length of the text removed */
+    long inserted_len; /*! length of the text inserted, which is at offset in the edited source */
+};
+
+/*!
+ * @brief Tokens replaced by re-lexing: [begin, old_end) of the old tokens became [begin, new_end)
+ */
+struct TOKEN_RANGE {
+    int begin;   /*! index of the first token replaced */
+    int old_end; /*! index just after the last old token replaced */
+    int new_end; /*! index just after the last new token */
+};
+
+/*!
+ * @brief Context of a scanner, so that several files can be scanned at the same time
+ */
+struct SCANNER {
+    FILE *fp;                         /*! file pointer of the loaded file */
+    const char *src_head;             /*! head of the source loaded into memory, NULL when streaming */
+    const char *src_pos;              /*! position of the character to be loaded next */
+    const char *src_end;              /*! end of the source loaded into memory */
+    int src_is_mapped;                /*! 1 if src_head is mapped by mmap(), 0 if it is allocated by malloc() */
+    int current_char;                 /*! the letter just loaded */
+    int next_char;                    /*! look-ahead character */
+    long current_offset;              /*! offset of current_char from the head of the source */
+    int linenum;                      /*! line number of the character just loaded */
+    int token_linenum;                /*! line number of the last token scanned */
+    int num_attr;                     /*! scanned unsigned integer */
+    char *string_attr;                /*! text of span copied by scanner_string_attr(), grown as needed */
+    int string_attr_len;              /*! length of string_attr */
+    int string_attr_size;             /*! allocated size of string_attr, 0 if not allocated */
+    int string_attr_valid;            /*! 1 if string_attr holds the text of span, 0 until it is copied */
+    struct TOKEN_SPAN span;           /*! view of the last scanned name, number or string */
+    char *string_value;               /*! unescaped value of the last scanned string, grown as needed */
+    int string_value_len;             /*! length of string_value, -1 if it is not built yet */
+    int string_value_size;            /*! allocated size of string_value, 0 if not allocated */
+    long token_offset;                /*! offset of the head of the last token scanned */
+    int quiet;                        /*! 1 if the scan errors are not reported */
+    struct TOKEN_ARRAY replay;        /*! tokens returned instead of scanning, set by init_scan_tokens() */
+    int replay_pos;                   /*! index of the token in replay to be returned next */
+    long replay_text;                 /*! offset in replay.text of the text of the next token */
+    void *cache_map;                  /*! token cache mapped by mmap(), NULL if not mapped */
+    long cache_map_size;              /*! size of cache_map */
+    unsigned char *stream_buf;        /*! block of the input read by fread() when streaming */
+    int stream_pos;                   /*! position in stream_buf of the character to be loaded next */
+    int stream_len;                   /*! number of the bytes in stream_buf */
+};
+extern struct SCANNER *scanner_open(char *filename);
+extern struct SCANNER *scanner_open_tokens(char *filename, int nthreads, char *cache_dir);
+extern int scanner_next(struct SCANNER *sc);
+extern int scanner_line(struct SCANNER *sc);
+extern const char *scanner_string_value(struct SCANNER *sc, int *len);
+extern char *scanner_string_attr(struct SCANNER *sc);
+extern int scanner_close(struct SCANNER *sc);
+extern int scanner_tokenize(struct SCANNER *sc, int nthreads, struct TOKEN_ARRAY *ta);
+extern void token_array_release(struct TOKEN_ARRAY *ta);
+extern int token_array_relex(struct TOKEN_ARRAY *ta, const char *src, long size, const struct TEXT_EDIT *edit,
+                             struct TOKEN_RANGE *changed);
 extern int init_scan(char *filename);
+extern int init_scan_tokens(char *filename, int nthreads, char *cache_dir);
+extern char *token_cache_dir(void);
 extern int scan(void);
 extern int get_linenum(void);
 extern int end_scan(void);
@@ -217,26 +468,39 @@ extern int is_formal_parameter;
 extern struct ID *id_variable;
 /* @} */
 
+/*! @name arena.c */
+/* @{ */
+extern struct ARENA compile_arena;
+extern void *arena_alloc(struct ARENA *arena, size_t size);
+extern char *arena_strndup(struct ARENA *arena, const char *s, size_t len);
+extern void arena_release(struct ARENA *arena);
+extern void arena_print_stats(struct ARENA *arena, FILE *fp);
+/* @} */
+
 /*! @name id-list.c */
 /* @{ */
-extern char current_procedure_name[MAXSTRSIZE];
+extern char *current_procedure_name;
 extern void set_procedure_name(char *name);
-extern int add_globalid_to_crtab(void);
 extern void init_crtab(void);
 extern void release_crtab(void);
 extern int release_localidroot(void);
-extern int id_register_without_type(char *name);
+extern int id_register_without_type(const char *name, int len);
 extern int id_register_as_type(struct TYPE **type);
+extern struct TYPE *intern_type(int ttype, int arraysize, struct TYPE *etp, struct TYPE *paratp);
 extern struct TYPE *std_type(int type);
 extern struct TYPE *array_type(int type);
 extern int register_linenum(char *name);
 extern struct ID *search_procedure(char *procname);
 extern void print_tab(struct ID *root);
+extern void print_sorted_tab(struct ID *root);
 /* @} */
 
 /*! @name output_assemble.c */
 /* @{ */
 extern FILE *out_fp;
+extern int optimize;
+extern struct CASL_PROGRAM casl_program;
+extern int casl_name(const char *name);
 extern int init_assemble(char *filename_mppl);
 extern int end_assemble(void);
 extern int assemble_start(char *program_name);
@@ -248,6 +512,8 @@ extern void assemble_procedure_end();
 extern void assemble_assign(void);
 extern void assemble_if_condition(char *else_label);
 extern void assemble_else(char *if_end_label, char *else_label);
+extern void assemble_label(char *label);
+extern void assemble_iteration_end(char *top_label, char *bottom_label);
 extern void assemble_iteration_condition(char *bottom_label);
 extern void assemble_break(void);
 extern void assemble_return(void);
@@ -257,24 +523,34 @@ extern void assemble_variable_reference_lval(struct ID *referenced_variable);
 extern void assemble_assign_real_param_to_address(void);
 extern void assemble_call(struct ID *id_procedure);
 extern void assemble_expression(int relational_operator_token);
-extern void assemble_minus_sign();
-extern void assemble_ADDA();
-extern void assemble_SUBA();
-extern void assemble_OR();
+extern int assemble_minus_sign();
+extern int assemble_ADDA();
+extern int assemble_SUBA();
+extern int assemble_OR();
 extern int assemble_constant(int constant_value);
 extern void assemble_not_factor(void);
 extern void assemble_cast(int to_type, int from_type);
-extern void assemble_MULA();
-extern void assemble_DIVA();
-extern void assemble_AND();
-extern int assemble_output_format_string(char *strings);
+extern int assemble_MULA();
+extern int assemble_DIVA();
+extern int assemble_AND();
+extern int assemble_output_format_string(const char *strings, int len);
 extern void assemble_output_format_standard_type(int type, int num);
 extern void assemble_output_line();
 extern void assemble_read(int type);
 extern void assemble_read_line();
+extern void assemble_literal(char *label, char *value);
 extern void assemble_library();
 /* @} */
 
+/*! @name peephole.c */
+/* @{ */
+/*! number of the instructions the rules look at when -O is given */
+#define PEEPHOLE_WINDOW 8
+extern int peephole_window;
+extern int peephole_optimize(struct CASL_PROGRAM *program);
+extern void peephole_print_stats(FILE *fp);
+/* @} */
+
 /*! @name literal_list.c */
 /* @{ */
 extern struct LITERAL *literal_root;
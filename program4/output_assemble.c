@@ -5,40 +5,655 @@
 
 /*! File pointer of the output file */
 FILE *out_fp;
+/*! Object program, which is output by end_assemble() */
+struct CASL_PROGRAM casl_program = {NULL, 0, 0, NULL, 0, 0, NULL, 0};
 /*! Count the number of labels created */
 int label_counter = 0;
+/*! 1 if the expressions are evaluated in the general registers, set by -O */
+int optimize = 0;
+
+/*! smallest value of an integer of the object program */
+#define MIN_INT_VALUE (-32768)
+/*! largest value of an integer of the object program */
+#define MAX_INT_VALUE 32767
+
+/*! number of the general registers for the expressions, gr1 to gr7 */
+#define NUM_REGISTERS 7
+/*! general registers for the expressions, the last one is used first */
+static int registers[NUM_REGISTERS] = {7, 6, 5, 4, 3, 2, 1};
+/*! index of the register the expression being generated leaves its value in */
+static int top = NUM_REGISTERS - 1;
+/*! height of an operand of -O, over which its code is generated and its value is stored in a temporary */
+#define MAX_EXPR_DEPTH 32
+/*! expressions whose code is not yet generated, the top of the stack of the object program first */
+static struct EXPR *pending_exprs = NULL;
+
+/*! buffer to build a label of the object program */
+static char *label_buffer = NULL;
+/*! size of label_buffer */
+static size_t label_buffer_size = 0;
+
+/*! text of the object program being output */
+static char *text = NULL;
+/*! length of text */
+static size_t text_len = 0;
+/*! size of text */
+static size_t text_size = 0;
+
+/*! mnemonics of the opcodes */
+static const char *opcode_names[NUMOFOPCODE + 1] = {
+    "", "LD", "ST", "LAD", "ADDA", "SUBA", "MULA", "DIVA", "AND", "OR", "XOR", "CPA", "JUMP", "JPL", "JMI",
+    "JNZ", "JZE", "JOV", "PUSH", "POP", "CALL", "RET", "SVC", "", "START", "END", "DC", "DS", ""};
+
+/*! the library routines of the object program */
+static const char *library[] = {
+    ";-- Library --",
+    "EOVF",
+    "  CALL  WRITELINE",
+    "  LAD  gr1, EOVF1",
+    "  LD  gr2, gr0",
+    "  CALL  WRITESTR",
+    "  CALL  WRITELINE",
+    "  SVC  1  ;  overflow error stop",
+    "EOVF1    DC  '***** Run-Time Error : Overflow *****'",
+    "E0DIV",
+    "  JNZ  EOVF",
+    "  CALL  WRITELINE",
+    "  LAD  gr1, E0DIV1",
+    "  LD  gr2, gr0",
+    "  CALL  WRITESTR",
+    "  CALL  WRITELINE",
+    "  SVC  2  ;  0-divide error stop",
+    "E0DIV1    DC  '***** Run-Time Error : Zero-Divide *****'",
+    "EROV",
+    "  CALL  WRITELINE",
+    "  LAD  gr1, EROV1",
+    "  LD  gr2, gr0",
+    "  CALL  WRITESTR",
+    "  CALL  WRITELINE",
+    "  SVC  3  ;  range-over error stop",
+    "EROV1    DC  '***** Run-Time Error : Range-Over in Array Index *****'",
+    "WRITECHAR",
+    "; gr1の値（文字）をgr2のけた数で出力する．",
+    "; gr2が0なら必要最小限の桁数で出力する",
+    "  RPUSH",
+    "  LD  gr6, SPACE",
+    "  LD  gr7, OBUFSIZE",
+    "WC1",
+    "  SUBA  gr2, ONE  ; while(--c > 0) {",
+    "  JZE  WC2",
+    "  JMI  WC2",
+    "  ST  gr6, OBUF,gr7  ;  *p++ = ' ';",
+    "  CALL  BOVFCHECK",
+    "  JUMP  WC1  ; }",
+    "WC2",
+    "  ST  gr1, OBUF,gr7  ; *p++ = gr1;",
+    "  CALL  BOVFCHECK",
+    "  ST  gr7, OBUFSIZE",
+    "  RPOP",
+    "  RET",
+    "WRITESTR",
+    "; gr1が指す文字列をgr2のけた数で出力する．",
+    "; gr2が0なら必要最小限の桁数で出力する",
+    "  RPUSH",
+    "  LD  gr6, gr1  ; p = gr1;",
+    "WS1",
+    "  LD  gr4, 0,gr6  ; while(*p != '\\0') {",
+    "  JZE  WS2",
+    "  ADDA  gr6, ONE  ;  p++;",
+    "  SUBA  gr2, ONE  ;  c--;",
+    "  JUMP  WS1  ; }",
+    "WS2",
+    "  LD  gr7, OBUFSIZE  ; q = OBUFSIZE;",
+    "  LD  gr5, SPACE",
+    "WS3",
+    "  SUBA  gr2, ONE  ; while(--c >= 0) {",
+    "  JMI  WS4",
+    "  ST  gr5, OBUF,gr7  ;  *q++ = ' ';",
+    "  CALL  BOVFCHECK",
+    "  JUMP  WS3  ; }",
+    "WS4",
+    "  LD  gr4, 0,gr1  ; while(*gr1 != '\\0') {",
+    "  JZE  WS5",
+    "  ST  gr4, OBUF,gr7  ;  *q++ = *gr1++;",
+    "  ADDA  gr1, ONE",
+    "  CALL  BOVFCHECK",
+    "  JUMP  WS4  ; }",
+    "WS5",
+    "  ST  gr7, OBUFSIZE  ; OBUFSIZE = q;",
+    "  RPOP",
+    "  RET",
+    "BOVFCHECK",
+    "    ADDA  gr7, ONE",
+    "    CPA   gr7, BOVFLEVEL",
+    "    JMI  BOVF1",
+    "    CALL  WRITELINE",
+    "    LD gr7, OBUFSIZE",
+    "BOVF1",
+    "    RET",
+    "BOVFLEVEL  DC 256",
+    "WRITEINT",
+    "; gr1の値（整数）をgr2のけた数で出力する．",
+    "; gr2が0なら必要最小限の桁数で出力する",
+    "  RPUSH",
+    "  LD  gr7, gr0  ; flag = 0;",
+    "  CPA  gr1, gr0  ; if(gr1>=0) goto WI1;",
+    "  JPL  WI1",
+    "  JZE  WI1",
+    "  LD  gr4, gr0  ; gr1= - gr1;",
+    "  SUBA  gr4, gr1",
+    "  CPA  gr4, gr1",
+    "  JZE  WI6",
+    "  LD  gr1, gr4",
+    "  LD  gr7, ONE  ; flag = 1;",
+    "WI1",
+    "  LD  gr6, SIX  ; p = INTBUF+6;",
+    "  ST  gr0, INTBUF,gr6  ; *p = '\\0';",
+    "  SUBA  gr6, ONE  ; p--;",
+    "  CPA  gr1, gr0  ; if(gr1 == 0)",
+    "  JNZ  WI2",
+    "  LD  gr4, ZERO  ;  *p = '0';",
+    "  ST  gr4, INTBUF,gr6",
+    "  JUMP  WI5  ; }",
+    "WI2      ; else {",
+    "  CPA  gr1, gr0  ;  while(gr1 != 0) {",
+    "  JZE  WI3",
+    "  LD  gr5, gr1  ;   gr5 = gr1 - (gr1 / 10) * 10;",
+    "  DIVA  gr1, TEN  ;   gr1 /= 10;",
+    "  LD  gr4, gr1",
+    "  MULA  gr4, TEN",
+    "  SUBA  gr5, gr4",
+    "  ADDA  gr5, ZERO  ;   gr5 += '0';",
+    "  ST  gr5, INTBUF,gr6  ;   *p = gr5;",
+    "  SUBA  gr6, ONE  ;   p--;",
+    "  JUMP  WI2  ;  }",
+    "WI3",
+    "  CPA  gr7, gr0  ;  if(flag != 0) {",
+    "  JZE  WI4",
+    "  LD  gr4, MINUS  ;   *p = '-';",
+    "  ST  gr4, INTBUF,gr6",
+    "  JUMP  WI5  ;  }",
+    "WI4",
+    "  ADDA  gr6, ONE  ;  else p++;",
+    "    ; }",
+    "WI5",
+    "  LAD  gr1, INTBUF,gr6  ; gr1 = p;",
+    "  CALL  WRITESTR  ; WRITESTR();",
+    "  RPOP",
+    "  RET",
+    "WI6",
+    "  LAD  gr1, MMINT",
+    "  CALL  WRITESTR  ; WRITESTR();",
+    "  RPOP",
+    "  RET",
+    "MMINT    DC  '-32768'",
+    "WRITEBOOL",
+    "; gr1の値（真理値）が0なら'FALSE'を",
+    "; 0以外なら'TRUE'をgr2のけた数で出力する．",
+    "; gr2が0なら必要最小限の桁数で出力する",
+    "  RPUSH",
+    "  CPA  gr1, gr0  ; if(gr1 != 0)",
+    "  JZE  WB1",
+    "  LAD  gr1, WBTRUE  ;  gr1 = \" TRUE \";",
+    "  JUMP  WB2",
+    "WB1      ; else",
+    "  LAD  gr1, WBFALSE  ;  gr1 = \" FALSE \";",
+    "WB2",
+    "  CALL  WRITESTR  ; WRITESTR();",
+    "  RPOP",
+    "  RET",
+    "WBTRUE    DC  'TRUE'",
+    "WBFALSE    DC  'FALSE'",
+    "WRITELINE",
+    "; 改行を出力する",
+    "  RPUSH",
+    "  LD  gr7, OBUFSIZE",
+    "  LD  gr6, NEWLINE",
+    "  ST  gr6, OBUF,gr7",
+    "  ADDA  gr7, ONE",
+    "  ST  gr7, OBUFSIZE",
+    "  OUT  OBUF, OBUFSIZE",
+    "  ST  gr0, OBUFSIZE",
+    "  RPOP",
+    "  RET",
+    "FLUSH",
+    "  RPUSH",
+    "  LD gr7, OBUFSIZE",
+    "  JZE FL1",
+    "  CALL WRITELINE",
+    "FL1",
+    "  RPOP",
+    "  RET",
+    "READCHAR",
+    "; gr1が指す番地に文字一つを読み込む",
+    "  RPUSH",
+    "  LD  gr5, RPBBUF  ; if(RPBBUF != '\\0') {",
+    "  JZE  RC0",
+    "  ST  gr5, 0,gr1  ;  *gr1 = RPBBUF;",
+    "  ST  gr0, RPBBUF  ;  RPBBUF = '\\0'",
+    "  JUMP  RC3  ;  return; }",
+    "RC0",
+    "  LD  gr7, INP  ; inp = INP;",
+    "  LD  gr6, IBUFSIZE  ; if(IBUFSIZE == 0) {",
+    "  JNZ  RC1",
+    "  IN  IBUF, IBUFSIZE  ;  IN();",
+    "  LD  gr7, gr0  ;  inp = 0;",
+    "    ; }",
+    "RC1",
+    "  CPA  gr7, IBUFSIZE  ; if(inp == IBUFSIZE) {",
+    "  JNZ  RC2",
+    "  LD  gr5, NEWLINE  ;  *gr1 = '\\n';",
+    "  ST  gr5, 0,gr1",
+    "  ST  gr0, IBUFSIZE  ;  IBUFSIZE = INP = 0;",
+    "  ST  gr0, INP",
+    "  JUMP  RC3  ; }",
+    "RC2      ; else {",
+    "  LD  gr5, IBUF,gr7  ;  *gr1 = *inp++;",
+    "  ADDA  gr7, ONE",
+    "  ST  gr5, 0,gr1",
+    "  ST  gr7, INP  ;  INP = inp;",
+    "RC3      ; }",
+    "  RPOP",
+    "  RET",
+    "READINT",
+    ";gr1が指す番地に整数値一つを読み込む",
+    "  RPUSH",
+    "RI1      ; do {",
+    "  CALL  READCHAR  ;  ch = READCHAR();",
+    "  LD  gr7, 0,gr1",
+    "  CPA  gr7, SPACE  ; } while(ch == ' ' || ch == '\\t' || ch == '\\n');",
+    "  JZE  RI1",
+    "  CPA  gr7, TAB",
+    "  JZE  RI1",
+    "  CPA  gr7, NEWLINE",
+    "  JZE  RI1",
+    "  LD  gr5, ONE  ; flag = 1",
+    "  CPA  gr7, MINUS  ; if(ch == '-') {",
+    "  JNZ  RI4",
+    "  LD  gr5, gr0  ;  flag = 0;",
+    "  CALL  READCHAR  ;  ch = READCHAR();",
+    "  LD  gr7, 0,gr1",
+    "RI4      ; }",
+    "  LD  gr6, gr0  ; v = 0;",
+    "RI2",
+    "  CPA  gr7, ZERO  ; while('0' <= ch && ch <= '9') {",
+    "  JMI  RI3",
+    "  CPA  gr7, NINE",
+    "  JPL  RI3",
+    "  MULA  gr6, TEN  ;  v = v*10+ch-'0';",
+    "  ADDA  gr6, gr7",
+    "  SUBA  gr6, ZERO",
+    "  CALL  READCHAR  ;  ch = READSCHAR();",
+    "  LD  gr7, 0,gr1",
+    "  JUMP  RI2  ; }",
+    "RI3",
+    "  ST  gr7, RPBBUF  ; ReadPushBack();",
+    "  ST  gr6, 0,gr1  ; *gr1 = v;",
+    "  CPA  gr5, gr0  ; if(flag == 0) {",
+    "  JNZ  RI5",
+    "  SUBA  gr5, gr6  ;  *gr1 = -v;",
+    "  ST  gr5, 0,gr1",
+    "RI5      ; }",
+    "  RPOP",
+    "  RET",
+    "READLINE",
+    "; 入力を改行コードまで（改行コードも含む）読み飛ばす",
+    "  ST  gr0, IBUFSIZE",
+    "  ST  gr0, INP",
+    "  ST  gr0, RPBBUF",
+    "  RET",
+    "ONE    DC  1",
+    "SIX    DC  6",
+    "TEN    DC  10",
+    "SPACE    DC  #0020  ; ' '",
+    "MINUS    DC  #002D  ; '-'",
+    "TAB    DC  #0009  ; '\\t'",
+    "ZERO    DC  #0030  ; '0'",
+    "NINE    DC  #0039  ; '9'",
+    "NEWLINE    DC  #000A  ; '\\n'",
+    "INTBUF    DS  8",
+    "OBUFSIZE  DC  0",
+    "IBUFSIZE  DC  0",
+    "INP    DC  0",
+    "OBUF    DS  257",
+    "IBUF    DS  257",
+    "RPBBUF    DC  0"};
+
+static void assemble_expr_stack(struct EXPR *e);
+static void assemble_expr_register(struct EXPR *e);
+static void assemble_pending_exprs(void);
+static void flush_exprs(void);
 
 /*!
  * @brief Initialize the output file
- * @param[in] filename MPPL source file name
+ * @param[in] filename MPPL source file name, or "-" to write to the standard output
  * @return int Returns 0 on success and -1 on failure.
  */
 int init_assemble(char *filename_mppl) {
-    char *filename = strtok(filename_mppl, ".");
+    char *filename;
     char filename_csl[128];
-    /* hoge.mpl -> hoge.csl */
-    sprintf(filename_csl, "%s.csl", filename);
 
-    if ((out_fp = fopen(filename_csl, "w")) == NULL) {
-        error("fopen() returns NULL");
-        error("function init_assemble()");
-        return -1;
+    if (strcmp(filename_mppl, "-") == 0) {
+        /* the standard input is compiled to the standard output */
+        out_fp = stdout;
+    } else {
+        filename = strtok(filename_mppl, ".");
+        /* hoge.mpl -> hoge.csl */
+        sprintf(filename_csl, "%s.csl", filename);
+
+        if ((out_fp = fopen(filename_csl, "w")) == NULL) {
+            error("fopen() returns NULL");
+            error("function init_assemble()");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*!
+ * @brief Hash of a name of the object program
+ * @param[in] s The name
+ * @return unsigned long Return the hash.
+ */
+static unsigned long hash_casl_name(const char *s) {
+    unsigned long h = 5381;
+
+    while (*s != '\0') {
+        h = h * 33 + (unsigned char)*s++;
+    }
+    return h;
+}
+
+/*!
+ * @brief Get the number of a name of the object program, registering it if it is new
+ * @param[in] name The name, such as a label or the value of a literal
+ * @return int Return the number of the name, or -1 on failure.
+ */
+int casl_name(const char *name) {
+    struct CASL_PROGRAM *p = &casl_program;
+    unsigned long h;
+    int i, nbuckets, *buckets;
+    char **names;
+
+    if (p->nnames * 2 >= p->nbuckets) {
+        nbuckets = (p->nbuckets == 0) ? 1024 : p->nbuckets * 2;
+        if ((buckets = (int *)malloc(sizeof(int) * nbuckets)) == NULL) {
+            return error("can not malloc in casl_name\n");
+        }
+        for (i = 0; i < nbuckets; i++) {
+            buckets[i] = -1;
+        }
+        for (i = 0; i < p->nnames; i++) {
+            h = hash_casl_name(p->names[i]) & (nbuckets - 1);
+            while (buckets[h] >= 0) {
+                h = (h + 1) & (nbuckets - 1);
+            }
+            buckets[h] = i;
+        }
+        free(p->buckets);
+        p->buckets = buckets;
+        p->nbuckets = nbuckets;
+    }
+
+    h = hash_casl_name(name) & (p->nbuckets - 1);
+    while ((i = p->buckets[h]) >= 0) {
+        if (strcmp(p->names[i], name) == 0) {
+            return i;
+        }
+        h = (h + 1) & (p->nbuckets - 1);
+    }
+
+    if (p->nnames == p->namesize) {
+        if ((names = (char **)realloc(p->names, sizeof(char *) * (p->namesize == 0 ? 1024 : p->namesize * 2))) ==
+            NULL) {
+            return error("can not malloc in casl_name\n");
+        }
+        p->names = names;
+        p->namesize = (p->namesize == 0) ? 1024 : p->namesize * 2;
+    }
+    if ((p->names[p->nnames] = arena_strndup(&compile_arena, name, strlen(name))) == NULL) {
+        return error("can not malloc in casl_name\n");
+    }
+    p->buckets[h] = p->nnames;
+    return p->nnames++;
+}
+
+/*!
+ * @brief Get the number of a label of a program, a procedure or a variable, as in $name%procname
+ * @param[in] prefix "$", or "$$" for the program
+ * @param[in] name The name
+ * @param[in] procname Name of the procedure the variable is declared in, or NULL
+ * @return int Return the number of the label, or -1 on failure.
+ */
+static int casl_label(const char *prefix, const char *name, const char *procname) {
+    size_t len = strlen(prefix) + strlen(name) + ((procname != NULL) ? strlen(procname) + 1 : 0) + 1;
+    char *buffer;
+
+    if (len > label_buffer_size) {
+        if ((buffer = (char *)realloc(label_buffer, len)) == NULL) {
+            return error("can not malloc in casl_label\n");
+        }
+        label_buffer = buffer;
+        label_buffer_size = len;
+    }
+    strcpy(label_buffer, prefix);
+    strcat(label_buffer, name);
+    if (procname != NULL) {
+        strcat(label_buffer, "%");
+        strcat(label_buffer, procname);
+    }
+    return casl_name(label_buffer);
+}
+
+/*!
+ * @brief Append an instruction to the object program
+ * @param[in] opcode The opcode
+ * @param[in] r The register operand, or -1 if there is none
+ * @param[in] kind Kind of the address operand
+ * @param[in] adr The address operand, a number or a name
+ * @param[in] x The index register or the second register operand, 0 if there is none
+ * @return struct CASL_INSTRUCTION* Return the instruction, or NULL on failure.
+ */
+static struct CASL_INSTRUCTION *emit(int opcode, int r, int kind, int adr, int x) {
+    struct CASL_PROGRAM *p = &casl_program;
+    struct CASL_INSTRUCTION *insn;
+
+    if (kind == ADR_NAME && adr < 0) {
+        /* the name could not be registered */
+        return NULL;
+    }
+    if (p->ninsns == p->size) {
+        if ((insn = (struct CASL_INSTRUCTION *)realloc(
+                 p->insns, sizeof(struct CASL_INSTRUCTION) * (p->size == 0 ? 4096 : p->size * 2))) == NULL) {
+            error("can not malloc in emit\n");
+            return NULL;
+        }
+        p->insns = insn;
+        p->size = (p->size == 0) ? 4096 : p->size * 2;
+    }
+    insn = &p->insns[p->ninsns++];
+    insn->opcode = opcode;
+    insn->r = r;
+    insn->x = x;
+    insn->kind = kind;
+    insn->adr = adr;
+    insn->label = -1;
+    return insn;
+}
+
+/*!
+ * @brief Append an instruction whose address operand is a name
+ * @param[in] opcode The opcode
+ * @param[in] r The register operand, or -1 if there is none
+ * @param[in] name The name
+ * @param[in] x The index register, 0 if there is none
+ */
+static void emit_name(int opcode, int r, char *name, int x) {
+    emit(opcode, r, ADR_NAME, casl_name(name), x);
+}
+
+/*!
+ * @brief Append a line with only a label
+ * @param[in] label The label
+ */
+static void emit_label(char *label) {
+    struct CASL_INSTRUCTION *insn;
+    int name = casl_name(label);
+
+    if (name >= 0 && (insn = emit(OP_LABEL, -1, ADR_NONE, 0, 0)) != NULL) {
+        insn->label = name;
     }
+}
 
+/*!
+ * @brief Append text to the object program being output
+ * @param[in] s The text
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int append_text(const char *s) {
+    size_t n = strlen(s);
+    size_t size = text_size;
+    char *grown;
+
+    while (text_len + n > size) {
+        size = (size == 0) ? 64 * 1024 : size * 2;
+    }
+    if (size != text_size) {
+        if ((grown = (char *)realloc(text, size)) == NULL) {
+            return error("can not malloc in append_text\n");
+        }
+        text = grown;
+        text_size = size;
+    }
+    memcpy(text + text_len, s, n);
+    text_len += n;
     return 0;
 }
 
 /*!
- * @brief Close the output file
+ * @brief Append a line of the object program to the text being output
+ * @param[in] insn The instruction
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int append_instruction(struct CASL_INSTRUCTION *insn) {
+    char **names = casl_program.names;
+    char operand[32];
+    const char *sep = " \t";
+    int k, ret = 0;
+
+    switch (insn->opcode) {
+        case OP_NONE:
+            return 0;
+        case OP_LABEL:
+            return (append_text(names[insn->label]) == 0) ? append_text("\n") : -1;
+        case OP_LIBRARY:
+            for (k = 0; k < (int)(sizeof(library) / sizeof(library[0])) && ret == 0; k++) {
+                if ((ret = append_text(library[k])) == 0) {
+                    ret = append_text("\n");
+                }
+            }
+            return ret;
+    }
+
+    if (insn->label >= 0 && (append_text(names[insn->label]) < 0 || append_text(" ") < 0)) {
+        return -1;
+    }
+    if (append_text("\t") < 0 || append_text(opcode_names[insn->opcode]) < 0) {
+        return -1;
+    }
+    if (insn->r >= 0) {
+        sprintf(operand, "%sgr%d", sep, insn->r);
+        ret |= append_text(operand);
+        sep = ", \t";
+    }
+    if (insn->kind == ADR_NUMBER) {
+        sprintf(operand, "%s%d", sep, insn->adr);
+        ret |= append_text(operand);
+    } else if (insn->kind == ADR_NAME) {
+        ret |= append_text(sep);
+        ret |= append_text(names[insn->adr]);
+    } else if (insn->r >= 0 && insn->opcode != OP_POP) {
+        /* the second operand is a register, as in LD gr1, gr2 */
+        sprintf(operand, "%sgr%d", sep, insn->x);
+        ret |= append_text(operand);
+    }
+    if (insn->kind != ADR_NONE && insn->x > 0) {
+        sprintf(operand, ", \tgr%d", insn->x);
+        ret |= append_text(operand);
+    }
+    ret |= append_text("\n");
+    return ret;
+}
+
+/*!
+ * @brief Output the object program in one write
+ * @param[in] fp The output file
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int write_program(FILE *fp) {
+    int i, ret = 0;
+
+    text_len = 0;
+    for (i = 0; i < casl_program.ninsns && ret == 0; i++) {
+        ret = append_instruction(&casl_program.insns[i]);
+    }
+    if (ret == 0 && text_len > 0 && fwrite(text, 1, text_len, fp) != text_len) {
+        ret = error("can not write the object program in write_program\n");
+    }
+    return ret;
+}
+
+/*!
+ * @brief Release the object program, whose names are released with the arena of the compilation
+ */
+static void release_program(void) {
+    free(casl_program.insns);
+    free(casl_program.names);
+    free(casl_program.buckets);
+    casl_program.insns = NULL;
+    casl_program.ninsns = 0;
+    casl_program.size = 0;
+    casl_program.names = NULL;
+    casl_program.nnames = 0;
+    casl_program.namesize = 0;
+    casl_program.buckets = NULL;
+    casl_program.nbuckets = 0;
+    free(label_buffer);
+    label_buffer = NULL;
+    label_buffer_size = 0;
+    free(text);
+    text = NULL;
+    text_len = 0;
+    text_size = 0;
+}
+
+/*!
+ * @brief Output the object program and close the output file
  * @return int Returns 0 on success and -1 on failure.
  */
 int end_assemble(void) {
+    int ret;
+
+    /* the expressions left by a syntax error */
+    flush_exprs();
+    if (peephole_window > 0 && peephole_optimize(&casl_program) < 0) {
+        error("function end_assemble()");
+    }
+    ret = write_program(out_fp);
+    release_program();
+    if (ret < 0) {
+        error("function end_assemble()");
+    }
+    if (out_fp == stdout) {
+        return (fflush(out_fp) == EOF || ret < 0) ? -1 : 0;
+    }
     if (fclose(out_fp) == EOF) {
         error("function end_assemble()");
         fprintf(stderr, "fclose() returns EOF.");
         return -1;
     }
-    return 0;
+    return ret;
 }
 
 /*!
@@ -47,11 +662,17 @@ int end_assemble(void) {
  * @return int Returns 0 on success and -1 on failure.
  */
 int assemble_start(char *program_name) {
-    fprintf(out_fp, "$$%s \tSTART\n", program_name);
-    fprintf(out_fp, "\tLAD \tgr0, \t0\n");
-    fprintf(out_fp, "\tCALL \tL0001\n");
-    fprintf(out_fp, "\tCALL \tFLUSH\n");
-    fprintf(out_fp, "\tSVC \t0\n");
+    struct CASL_INSTRUCTION *insn;
+    int label = casl_label("$$", program_name, NULL);
+
+    if (label < 0 || (insn = emit(OP_START, -1, ADR_NONE, 0, 0)) == NULL) {
+        return -1;
+    }
+    insn->label = label;
+    emit(OP_LAD, 0, ADR_NUMBER, 0, 0);
+    emit_name(OP_CALL, -1, "L0001", 0);
+    emit_name(OP_CALL, -1, "FLUSH", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
 
     return 0;
 }
@@ -62,31 +683,33 @@ int assemble_start(char *program_name) {
  * @return int Returns 0 on success and -1 on failure.
  */
 int create_newlabel(char **out) {
-    char *new_label;
-
-    /* char for newlabel */
-    if ((new_label = (char *)malloc(sizeof(char) * (LABEL_SIZE + 1))) == NULL) {
-        return error("can not malloc in create_newlabel\n");
-    }
+    char new_label[LABEL_SIZE + 1];
 
     label_counter++;
 
     sprintf(new_label, "L%04d", label_counter);
-    *out = new_label;
+    /* char for newlabel */
+    if ((*out = arena_strndup(&compile_arena, new_label, strlen(new_label))) == NULL) {
+        return error("can not malloc in create_newlabel\n");
+    }
 
     return 0;
 }
 
 void assemble_block_end(void) {
-    fprintf(out_fp, "\tRET\n");
+    emit(OP_RET, -1, ADR_NONE, 0, 0);
 }
 
 /*!
  * @brief Generating assembly code for procedure definition
  */
 void assemble_procedure_definition(void) {
-    /* fprintf(out_fp, ";procedure declaration\n"); */
-    fprintf(out_fp, "$%s\n", current_procedure_name);
+    struct CASL_INSTRUCTION *insn;
+    int label = casl_label("$", current_procedure_name, NULL);
+
+    if (label >= 0 && (insn = emit(OP_LABEL, -1, ADR_NONE, 0, 0)) != NULL) {
+        insn->label = label;
+    }
 }
 
 /*!
@@ -98,12 +721,12 @@ int assemble_procedure_begin(void) {
     struct ID *p_id_list = NULL;
 
     /* Reverse the order of the parameters. */
-    p_id = localidroot;
+    p_id = localidtab.root;
     if (p_id != NULL) {
         while (p_id != NULL && p_id->ispara == 1) {
             struct ID *p_id_temp = NULL;
             /* struct ID */
-            if ((p_id_temp = (struct ID *)malloc(sizeof(struct ID))) == NULL) {
+            if ((p_id_temp = (struct ID *)arena_alloc(&compile_arena, sizeof(struct ID))) == NULL) {
                 return error("can not malloc1 for struct ID in id_register_to_tab\n");
             }
             p_id_temp->name = p_id->name;
@@ -116,17 +739,17 @@ int assemble_procedure_begin(void) {
         return 0;
     }
 
-    fprintf(out_fp, "\tPOP\t gr2\n"); /* gr2: return pointer */
+    emit(OP_POP, 2, ADR_NONE, 0, 0); /* gr2: return pointer */
     /* Set a value to parameters */
     p_id = p_id_list;
     while (p_id != NULL) {
-        fprintf(out_fp, "\tPOP gr1\n");
-        fprintf(out_fp, "\tST \tgr1, \t$%s%c%s\n", p_id->name, '%', current_procedure_name);
+        emit(OP_POP, 1, ADR_NONE, 0, 0);
+        emit(OP_ST, 1, ADR_NAME, casl_label("$", p_id->name, current_procedure_name), 0);
         p_id = p_id->nextp;
     }
 
     /* push a return pointer */
-    fprintf(out_fp, "\tPUSH \t0, \tgr2\n");
+    emit(OP_PUSH, -1, ADR_NUMBER, 0, 2);
     return 0;
 }
 
@@ -134,7 +757,7 @@ int assemble_procedure_begin(void) {
  * @brief Generating assembly code for end of procedure statement
  */
 void assemble_procedure_end() {
-    fprintf(out_fp, "\tRET\n");
+    emit(OP_RET, -1, ADR_NONE, 0, 0);
 }
 
 /*!
@@ -142,16 +765,206 @@ void assemble_procedure_end() {
  * @param[in] else_label Label to jump to else
  */
 void assemble_variable_declaration(char *variable_name, char *procname, struct TYPE **type) {
-    /* fprintf(out_fp, ";variable declaration\n"); */
-    fprintf(out_fp, "$%s", variable_name);
-    if (procname != NULL) {
-        fprintf(out_fp, "%c%s", '%', procname);
+    struct CASL_INSTRUCTION *insn;
+    int label = casl_label("$", variable_name, procname);
+
+    if (label < 0) {
+        return;
     }
     if ((*type)->ttype & TPARRAY) {
-        fprintf(out_fp, " \tDS \t%d\n", (*type)->arraysize);
+        insn = emit(OP_DS, -1, ADR_NUMBER, (*type)->arraysize, 0);
     } else {
-        fprintf(out_fp, " \tDC \t0\n");
+        insn = emit(OP_DC, -1, ADR_NUMBER, 0, 0);
+    }
+    if (insn != NULL) {
+        insn->label = label;
+    }
+}
+
+/*!
+ * @brief Take the expression on the top of the stack of the object program
+ * @return struct EXPR* Return the expression, or NULL if there is none.
+ */
+static struct EXPR *pop_expr(void) {
+    struct EXPR *e = pending_exprs;
+
+    if (e != NULL) {
+        pending_exprs = e->nextp;
+        e->nextp = NULL;
+    }
+    return e;
+}
+
+/*!
+ * @brief Height of an expression
+ * @param[in] e The expression
+ * @return int Return the height, or 0 if there is no expression.
+ */
+static int depth_of(struct EXPR *e) {
+    return (e != NULL) ? e->depth : 0;
+}
+
+/*!
+ * @brief Generating assembly code for an expression whose value is pushed on the stack, and make it a leaf
+ * @param[in] e The expression, which is not on the stack of the expressions
+ */
+static void stack_expr(struct EXPR *e) {
+    if (e == NULL || e->kind == EXPR_STACKED) {
+        return;
+    }
+    if (optimize) {
+        assemble_expr_register(e);
+        emit(OP_PUSH, -1, ADR_NUMBER, 0, registers[top]);
+    } else {
+        assemble_expr_stack(e);
+    }
+    e->kind = EXPR_STACKED;
+    e->left = NULL;
+    e->right = NULL;
+    e->need = 1;
+    e->depth = 1;
+}
+
+/*!
+ * @brief Generating assembly code for a deep expression of -O whose value is stored in a temporary, and make it a leaf
+ * It keeps the recursion of assemble_expr_register() shallow.
+ * @param[in] e The expression, which is not on the stack of the expressions
+ */
+static void store_expr(struct EXPR *e) {
+    char *label = NULL;
+
+    if (e == NULL || e->depth < MAX_EXPR_DEPTH) {
+        return;
     }
+    create_newlabel(&label);
+    add_literal(&literal_root, label, "0");
+    assemble_expr_register(e);
+    emit_name(OP_ST, registers[top], label, 0);
+    e->kind = EXPR_TEMPORARY;
+    e->label1 = label;
+    e->left = NULL;
+    e->right = NULL;
+    e->need = 1;
+    e->depth = 1;
+}
+
+/*!
+ * @brief Create an expression and push it on the stack of the object program
+ * Without -O, the code of an operand that is not a leaf is generated at once, so the trees are at most 2 high.
+ * @param[in] kind Kind of the expression
+ * @param[in] opr Token of the operator, or type to cast to
+ * @param[in] left Left operand, operand, or index of an array
+ * @param[in] right Right operand
+ * @return struct EXPR* Return the expression, or NULL on failure.
+ */
+static struct EXPR *push_expr(int kind, int opr, struct EXPR *left, struct EXPR *right) {
+    struct EXPR *e;
+
+    if (optimize) {
+        store_expr(left);
+        store_expr(right);
+    } else if (depth_of(left) > 1 || depth_of(right) > 1) {
+        /* the values below the operands are pushed first */
+        assemble_pending_exprs();
+        stack_expr(left);
+        stack_expr(right);
+    }
+    if ((e = (struct EXPR *)arena_alloc(&compile_arena, sizeof(struct EXPR))) == NULL) {
+        error("can not malloc for struct EXPR in push_expr\n");
+        return NULL;
+    }
+    e->kind = kind;
+    e->opr = opr;
+    e->value = 0;
+    e->need = 1;
+    e->depth = 1 + ((depth_of(left) > depth_of(right)) ? depth_of(left) : depth_of(right));
+    e->id = NULL;
+    e->label1 = NULL;
+    e->label2 = NULL;
+    e->left = left;
+    e->right = right;
+    e->nextp = pending_exprs;
+    pending_exprs = e;
+    return e;
+}
+
+/*!
+ * @brief Push an expression taken by pop_expr() back on the stack of the object program
+ * @param[in] e The expression
+ */
+static void repush_expr(struct EXPR *e) {
+    if (e != NULL) {
+        e->nextp = pending_exprs;
+        pending_exprs = e;
+    }
+}
+
+/*!
+ * @brief Whether an expression is a constant
+ * @param[in] e The expression
+ * @return int Return 1 if it is, 0 if it is not.
+ */
+static int is_constant(struct EXPR *e) {
+    return e != NULL && e->kind == EXPR_CONSTANT;
+}
+
+/*!
+ * @brief Whether an expression is a constant of a value
+ * @param[in] e The expression
+ * @param[in] value The value
+ * @return int Return 1 if it is, 0 if it is not.
+ */
+static int is_constant_of(struct EXPR *e, int value) {
+    return is_constant(e) && e->value == value;
+}
+
+/*!
+ * @brief Number of the registers to evaluate an expression without spilling
+ * @param[in] e The expression
+ * @return int Return the number of the registers.
+ */
+static int need_of(struct EXPR *e) {
+    return (e != NULL) ? e->need : 1;
+}
+
+/*!
+ * @brief Whether an expression is a variable the instructions can take as a memory operand
+ * @param[in] e The expression
+ * @return int Return 1 if it is, 0 if it is not.
+ */
+static int is_memory_operand(struct EXPR *e) {
+    return e != NULL && (e->kind == EXPR_VARIABLE || e->kind == EXPR_ADDRESS) && e->left == NULL &&
+           !e->id->ispara;
+}
+
+/*!
+ * @brief Number of the registers to evaluate a binary operator without spilling
+ * @param[in] left Left operand
+ * @param[in] right Right operand, which is taken from the memory if it is a simple variable
+ * @return int Return the number of the registers.
+ */
+static int binary_need(struct EXPR *left, struct EXPR *right) {
+    int l = need_of(left);
+    int r = need_of(right);
+
+    if (right != NULL && right->kind == EXPR_VARIABLE && is_memory_operand(right)) {
+        return l;
+    }
+    if (l == r) {
+        return l + 1;
+    }
+    return (l > r) ? l : r;
+}
+
+/*!
+ * @brief Generating an instruction whose operand is the label of a variable
+ * @param[in] opcode The opcode
+ * @param[in] reg The general register
+ * @param[in] id The variable
+ * @param[in] index The index register, or 0 if there is none
+ */
+static void assemble_memory_operand(int opcode, int reg, struct ID *id, int index) {
+    emit(opcode, reg, ADR_NAME, casl_label("$", id->name, id->procname), index);
 }
 
 /*!
@@ -159,26 +972,19 @@ void assemble_variable_declaration(char *variable_name, char *procname, struct T
  * @param[in] referenced_variable referenced variable
  */
 void assemble_variable_reference_lval(struct ID *referenced_variable) {
-    if (referenced_variable->ispara) {
-        /* if id is parameter, id has procname */
-        fprintf(out_fp, "\tLD \tgr1, \t$%s%%%s\n", referenced_variable->name, referenced_variable->procname);
-    } else if (referenced_variable->procname != NULL) {
-        fprintf(out_fp, "\tLAD \tgr1, \t$%s%%%s\n", referenced_variable->name, referenced_variable->procname);
-    } else {
-        fprintf(out_fp, "\tLAD \tgr1, \t$%s\n", referenced_variable->name);
-    }
+    struct EXPR *index = NULL;
+    struct EXPR *e;
 
     if (referenced_variable->itp->ttype & TPARRAY) {
-        /* gr1 is head */
-        fprintf(out_fp, "\tPOP \tgr2\n"); /* gr2 is index */                             /* Check for out-of-array references */
-        fprintf(out_fp, "\tLAD \tgr3, \t%d\n", referenced_variable->itp->arraysize - 1); /* gr3 is max index */
-        fprintf(out_fp, "\tCPA \tgr2, \tgr3\n");                                         /* gr2 - gr3 */
-        fprintf(out_fp, "\tJPL \tEROV\n");                                               /* if gr2 - gr3 is positive, it is an out-of-array reference */
-        fprintf(out_fp, "\tADDA \tgr1, \tgr2\n");                                        /* gr1 <- address(gr1(head) + gr2(index)) */
-        fprintf(out_fp, "\tJOV \tEOVF\n");
+        index = pop_expr();
+    }
+    if ((e = push_expr(EXPR_ADDRESS, 0, index, NULL)) != NULL) {
+        e->id = referenced_variable;
+        if (index != NULL) {
+            /* a register for the max index */
+            e->need = (index->need > 2) ? index->need : 2;
+        }
     }
-
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
 }
 
 /*!
@@ -186,23 +992,18 @@ void assemble_variable_reference_lval(struct ID *referenced_variable) {
  * @param[in] referenced_variable referenced variable
  */
 void assemble_variable_reference_rval(struct ID *referenced_variable) {
+    struct EXPR *index = NULL;
+    struct EXPR *e;
+
     if (referenced_variable->itp->ttype & TPARRAY) {
-        assemble_variable_reference_lval(referenced_variable); /* get address */
-        fprintf(out_fp, "\tPOP \tgr1\n");
-        fprintf(out_fp, "\tLD \tgr1, \t0, \tgr1\n"); /* get rval from address */
-    } else {
-        if (referenced_variable->ispara) {
-            /* if id is parameter, id has procname */
-            fprintf(out_fp, "\tLD \tgr1, \t$%s%%%s\n", referenced_variable->name, referenced_variable->procname);
-            fprintf(out_fp, "\tLD \tgr1, \t0, \tgr1\n");
-        } else if (referenced_variable->procname != NULL) {
-            fprintf(out_fp, "\tLD \tgr1, \t$%s%%%s\n", referenced_variable->name, referenced_variable->procname);
-        } else {
-            fprintf(out_fp, "\tLD \tgr1, \t$%s\n", referenced_variable->name);
+        index = pop_expr();
+    }
+    if ((e = push_expr(EXPR_VARIABLE, 0, index, NULL)) != NULL) {
+        e->id = referenced_variable;
+        if (index != NULL) {
+            e->need = (index->need > 2) ? index->need : 2;
         }
     }
-
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
 }
 
 /*!
@@ -211,21 +1012,486 @@ void assemble_variable_reference_rval(struct ID *referenced_variable) {
  */
 void assemble_assign_real_param_to_address(void) {
     char *label = NULL;
+    struct EXPR *value = pop_expr();
+    struct EXPR *e;
+
     create_newlabel(&label);
     add_literal(&literal_root, label, "0");
-    fprintf(out_fp, "\tLAD \tgr2, \t%s\n", label);
-    fprintf(out_fp, "\tPOP \tgr1\n");
-    fprintf(out_fp, "\tST \tgr1, \t0, \tgr2\n");
-    fprintf(out_fp, "\tPUSH \t0, \tgr2\n");
+    if ((e = push_expr(EXPR_PARAMETER, 0, value, NULL)) != NULL) {
+        e->label1 = label;
+        e->need = need_of(value);
+    }
+}
+
+/*!
+ * @brief Generating stack code for an expression, which pushes its value on the stack of the object program
+ * @param[in] e The expression
+ */
+static void assemble_expr_stack(struct EXPR *e) {
+    struct ID *id;
+
+    if (e == NULL) {
+        return;
+    }
+    assemble_expr_stack(e->left);
+    assemble_expr_stack(e->right);
+
+    switch (e->kind) {
+        case EXPR_CONSTANT:
+            emit(OP_LAD, 1, ADR_NUMBER, e->value, 0);
+            emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+            break;
+        case EXPR_VARIABLE:
+            /* FALLTHROUGH */
+        case EXPR_ADDRESS:
+            id = e->id;
+            if (e->kind == EXPR_ADDRESS || (id->itp->ttype & TPARRAY)) {
+                /* if id is parameter, id has procname */
+                assemble_memory_operand(id->ispara ? OP_LD : OP_LAD, 1, id, 0);
+
+                if (id->itp->ttype & TPARRAY) {
+                    /* gr1 is head */
+                    emit(OP_POP, 2, ADR_NONE, 0, 0); /* gr2 is index */                 /* Check for out-of-array references */
+                    emit(OP_LAD, 3, ADR_NUMBER, id->itp->arraysize - 1, 0); /* gr3 is max index */
+                    emit(OP_CPA, 2, ADR_NONE, 0, 3); /* gr2 - gr3 */
+                    emit_name(OP_JPL, -1, "EROV", 0); /* if gr2 - gr3 is positive, it is an out-of-array reference */
+                    emit(OP_ADDA, 1, ADR_NONE, 0, 2); /* gr1 <- address(gr1(head) + gr2(index)) */
+                    emit_name(OP_JOV, -1, "EOVF", 0);
+                }
+                emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+                if (e->kind == EXPR_ADDRESS) {
+                    break;
+                }
+                emit(OP_POP, 1, ADR_NONE, 0, 0);
+                emit(OP_LD, 1, ADR_NUMBER, 0, 1); /* get rval from address */
+            } else {
+                assemble_memory_operand(OP_LD, 1, id, 0);
+                if (id->ispara) {
+                    /* if id is parameter, id has procname */
+                    emit(OP_LD, 1, ADR_NUMBER, 0, 1);
+                }
+            }
+            emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+            break;
+        case EXPR_OPERATOR:
+            emit(OP_POP, 2, ADR_NONE, 0, 0);
+            emit(OP_POP, 1, ADR_NONE, 0, 0);
+            switch (e->opr) {
+                case TPLUS:
+                    emit(OP_ADDA, 1, ADR_NONE, 0, 2);
+                    emit_name(OP_JOV, -1, "EOVF", 0);
+                    break;
+                case TMINUS:
+                    emit(OP_SUBA, 1, ADR_NONE, 0, 2);
+                    emit_name(OP_JOV, -1, "EOVF", 0);
+                    break;
+                case TSTAR:
+                    emit(OP_MULA, 1, ADR_NONE, 0, 2);
+                    emit_name(OP_JOV, -1, "EOVF", 0);
+                    break;
+                case TDIV:
+                    emit(OP_DIVA, 1, ADR_NONE, 0, 2);
+                    emit_name(OP_JOV, -1, "E0DIV", 0);
+                    break;
+                case TAND:
+                    emit(OP_AND, 1, ADR_NONE, 0, 2);
+                    break;
+                case TOR:
+                    emit(OP_OR, 1, ADR_NONE, 0, 2);
+                    break;
+            }
+            emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+            break;
+        case EXPR_RELATION:
+            emit(OP_POP, 2, ADR_NONE, 0, 0);
+            emit(OP_POP, 1, ADR_NONE, 0, 0);
+            emit(OP_CPA, 1, ADR_NONE, 0, 2);
+
+            switch (e->opr) {
+                case TEQUAL: /* = */
+                    emit_name(OP_JZE, -1, e->label1, 0);
+                    break;
+                case TNOTEQ: /* <> */
+                    emit_name(OP_JNZ, -1, e->label1, 0);
+                    break;
+                case TLE: /* < */
+                    emit_name(OP_JMI, -1, e->label1, 0);
+                    break;
+                case TLEEQ: /* <= */
+                    emit_name(OP_JMI, -1, e->label1, 0);
+                    emit_name(OP_JZE, -1, e->label1, 0);
+                    break;
+                case TGR: /* > */
+                    emit_name(OP_JPL, -1, e->label1, 0);
+                    break;
+                case TGREQ: /* >= */
+                    emit_name(OP_JPL, -1, e->label1, 0);
+                    emit_name(OP_JZE, -1, e->label1, 0);
+                    break;
+            }
+
+            emit(OP_LD, 1, ADR_NONE, 0, 0); /* return 0 */
+            emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+            emit_name(OP_JUMP, -1, e->label2, 0);
+
+            emit_label(e->label1);
+            emit(OP_LAD, 1, ADR_NUMBER, 1, 0); /* return 1 */
+            emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+            emit_label(e->label2);
+            break;
+        case EXPR_NOT:
+            emit(OP_POP, 1, ADR_NONE, 0, 0); /* factor value */
+            emit(OP_CPA, 1, ADR_NONE, 0, 0);
+            emit_name(OP_JNZ, -1, e->label1, 0); /* expression value != 0 ? 0(false) : 1(true) */
+            emit(OP_LAD, 1, ADR_NUMBER, 1, 0); /* return 1 */
+            emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+            emit_name(OP_JUMP, -1, e->label2, 0);
+
+            emit_label(e->label1);
+            emit(OP_LD, 1, ADR_NONE, 0, 0); /* return 0 */
+            emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+            emit_label(e->label2);
+            break;
+        case EXPR_CAST:
+            emit(OP_POP, 1, ADR_NONE, 0, 0); /* expression value */
+            if (e->opr == TPCHAR) {
+                emit(OP_LAD, 2, ADR_NUMBER, 0x007F, 0);
+                emit(OP_AND, 1, ADR_NONE, 0, 2);
+                emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+                break;
+            }
+            emit(OP_CPA, 1, ADR_NONE, 0, 0);
+            emit_name(OP_JNZ, -1, e->label1, 0); /* expression value != 0 ? 1(true) : 0(false) */
+            emit(OP_LD, 1, ADR_NONE, 0, 0); /* return 0 */
+            emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+            emit_name(OP_JUMP, -1, e->label2, 0);
+
+            emit_label(e->label1);
+            emit(OP_LAD, 1, ADR_NUMBER, 1, 0); /* return 1 */
+            emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+            emit_label(e->label2);
+            break;
+        case EXPR_PARAMETER:
+            emit_name(OP_LAD, 2, e->label1, 0);
+            emit(OP_POP, 1, ADR_NONE, 0, 0);
+            emit(OP_ST, 1, ADR_NUMBER, 0, 2);
+            emit(OP_PUSH, -1, ADR_NUMBER, 0, 2);
+            break;
+        case EXPR_STACKED:
+            /* the value is on the stack */
+            break;
+    }
+}
+
+/*!
+ * @brief Generating register code for the operands of a binary operator
+ * The operand that needs more registers is evaluated first, and the right one is spilled to the stack
+ * only if both need more registers than there are.
+ * @param[in] left Left operand, which is evaluated in the current register
+ * @param[in] right Right operand
+ * @param[in] memory 1 if a simple variable of the right operand is left in the memory
+ * @return int Return the register of the right operand, or 0 if it is left in the memory.
+ */
+static int assemble_operands(struct EXPR *left, struct EXPR *right, int memory) {
+    int l = need_of(left);
+    int r = need_of(right);
+    int reg;
+
+    if (memory && right != NULL && right->kind == EXPR_VARIABLE && is_memory_operand(right)) {
+        assemble_expr_register(left);
+        return 0;
+    }
+    if (l >= r && r <= top) {
+        assemble_expr_register(left);
+        top--;
+        assemble_expr_register(right);
+        reg = registers[top];
+        top++;
+    } else if (r > l && l <= top) {
+        /* evaluate the right one first in the register below */
+        reg = registers[top];
+        registers[top] = registers[top - 1];
+        registers[top - 1] = reg;
+        assemble_expr_register(right);
+        top--;
+        assemble_expr_register(left);
+        top++;
+        reg = registers[top];
+        registers[top] = registers[top - 1];
+        registers[top - 1] = reg;
+    } else {
+        assemble_expr_register(right);
+        emit(OP_PUSH, -1, ADR_NUMBER, 0, registers[top]);
+        assemble_expr_register(left);
+        reg = registers[top - 1];
+        emit(OP_POP, reg, ADR_NONE, 0, 0);
+    }
+    return reg;
+}
+
+/*!
+ * @brief Generating register code for an expression, which leaves its value in the current register
+ * @param[in] e The expression
+ */
+static void assemble_expr_register(struct EXPR *e) {
+    int reg, sub, opcode;
+
+    if (e == NULL) {
+        return;
+    }
+    reg = registers[top];
+
+    switch (e->kind) {
+        case EXPR_CONSTANT:
+            emit(OP_LAD, reg, ADR_NUMBER, e->value, 0);
+            break;
+        case EXPR_VARIABLE:
+            /* FALLTHROUGH */
+        case EXPR_ADDRESS:
+            if (e->left != NULL) {
+                assemble_expr_register(e->left); /* index */
+                sub = registers[top - 1];
+                emit(OP_LAD, sub, ADR_NUMBER, e->id->itp->arraysize - 1, 0);
+                emit(OP_CPA, reg, ADR_NONE, 0, sub);
+                emit_name(OP_JPL, -1, "EROV", 0);
+                assemble_memory_operand((e->kind == EXPR_VARIABLE) ? OP_LD : OP_LAD, reg, e->id, reg);
+            } else if (e->id->ispara) {
+                assemble_memory_operand(OP_LD, reg, e->id, 0);
+                if (e->kind == EXPR_VARIABLE) {
+                    emit(OP_LD, reg, ADR_NUMBER, 0, reg);
+                }
+            } else {
+                assemble_memory_operand((e->kind == EXPR_VARIABLE) ? OP_LD : OP_LAD, reg, e->id, 0);
+            }
+            break;
+        case EXPR_OPERATOR:
+            /* FALLTHROUGH */
+        case EXPR_RELATION:
+            switch (e->opr) {
+                case TPLUS:
+                    opcode = OP_ADDA;
+                    break;
+                case TMINUS:
+                    opcode = OP_SUBA;
+                    break;
+                case TSTAR:
+                    opcode = OP_MULA;
+                    break;
+                case TDIV:
+                    opcode = OP_DIVA;
+                    break;
+                case TAND:
+                    opcode = OP_AND;
+                    break;
+                case TOR:
+                    opcode = OP_OR;
+                    break;
+                default:
+                    opcode = OP_CPA;
+                    break;
+            }
+            if ((sub = assemble_operands(e->left, e->right, 1)) == 0) {
+                assemble_memory_operand(opcode, reg, e->right->id, 0);
+            } else {
+                emit(opcode, reg, ADR_NONE, 0, sub);
+            }
+            if (e->opr == TPLUS || e->opr == TMINUS || e->opr == TSTAR) {
+                emit_name(OP_JOV, -1, "EOVF", 0);
+            } else if (e->opr == TDIV) {
+                emit_name(OP_JOV, -1, "E0DIV", 0);
+            } else if (e->kind == EXPR_RELATION) {
+                /* LAD does not change the flags */
+                emit(OP_LAD, reg, ADR_NUMBER, 1, 0);
+                switch (e->opr) {
+                    case TEQUAL:
+                        emit_name(OP_JZE, -1, e->label1, 0);
+                        break;
+                    case TNOTEQ:
+                        emit_name(OP_JNZ, -1, e->label1, 0);
+                        break;
+                    case TLE:
+                        emit_name(OP_JMI, -1, e->label1, 0);
+                        break;
+                    case TLEEQ:
+                        emit_name(OP_JMI, -1, e->label1, 0);
+                        emit_name(OP_JZE, -1, e->label1, 0);
+                        break;
+                    case TGR:
+                        emit_name(OP_JPL, -1, e->label1, 0);
+                        break;
+                    case TGREQ:
+                        emit_name(OP_JPL, -1, e->label1, 0);
+                        emit_name(OP_JZE, -1, e->label1, 0);
+                        break;
+                }
+                emit(OP_LD, reg, ADR_NONE, 0, 0);
+                emit_label(e->label1);
+            }
+            break;
+        case EXPR_NOT:
+            assemble_expr_register(e->left);
+            emit(OP_CPA, reg, ADR_NONE, 0, 0);
+            emit(OP_LAD, reg, ADR_NUMBER, 0, 0);
+            emit_name(OP_JNZ, -1, e->label1, 0);
+            emit(OP_LAD, reg, ADR_NUMBER, 1, 0);
+            emit_label(e->label1);
+            break;
+        case EXPR_CAST:
+            assemble_expr_register(e->left);
+            if (e->opr == TPCHAR) {
+                sub = registers[top - 1];
+                emit(OP_LAD, sub, ADR_NUMBER, 0x007F, 0);
+                emit(OP_AND, reg, ADR_NONE, 0, sub);
+                break;
+            }
+            emit(OP_CPA, reg, ADR_NONE, 0, 0);
+            emit(OP_LAD, reg, ADR_NUMBER, 1, 0);
+            emit_name(OP_JNZ, -1, e->label1, 0);
+            emit(OP_LD, reg, ADR_NONE, 0, 0);
+            emit_label(e->label1);
+            break;
+        case EXPR_PARAMETER:
+            assemble_expr_register(e->left);
+            emit_name(OP_ST, reg, e->label1, 0);
+            emit_name(OP_LAD, reg, e->label1, 0);
+            break;
+        case EXPR_STACKED:
+            emit(OP_POP, reg, ADR_NONE, 0, 0);
+            break;
+        case EXPR_TEMPORARY:
+            emit_name(OP_LD, reg, e->label1, 0);
+            break;
+    }
+}
+
+/*!
+ * @brief Generating assembly code for the expressions not yet generated, whose values are pushed on the stack
+ * They are left on the stack of the expressions as EXPR_STACKED.
+ */
+static void assemble_pending_exprs(void) {
+    struct EXPR *bottom = NULL;
+    struct EXPR *e, *next;
+
+    /* reverse the stack to generate the bottom first */
+    for (e = pending_exprs; e != NULL; e = next) {
+        next = e->nextp;
+        e->nextp = bottom;
+        bottom = e;
+    }
+    pending_exprs = NULL;
+    for (e = bottom; e != NULL; e = next) {
+        next = e->nextp;
+        stack_expr(e);
+        e->nextp = pending_exprs;
+        pending_exprs = e;
+    }
+}
+
+/*!
+ * @brief Generating assembly code for all the expressions not yet generated
+ */
+static void flush_exprs(void) {
+    assemble_pending_exprs();
+    pending_exprs = NULL;
 }
 
 /*!
  * @brief Generating assembly code for assignment statement
  */
 void assemble_assign(void) {
-    fprintf(out_fp, "\tPOP \tgr2\n");
-    fprintf(out_fp, "\tPOP \tgr1\n");
-    fprintf(out_fp, "\tST \tgr2, \t0, \tgr1\n");
+    struct EXPR *value, *address;
+    int reg;
+
+    if (!optimize) {
+        flush_exprs();
+        emit(OP_POP, 2, ADR_NONE, 0, 0);
+        emit(OP_POP, 1, ADR_NONE, 0, 0);
+        emit(OP_ST, 2, ADR_NUMBER, 0, 1);
+        return;
+    }
+    value = pop_expr();
+    address = pop_expr();
+    if (is_memory_operand(address)) {
+        assemble_expr_register(value);
+        assemble_memory_operand(OP_ST, registers[top], address->id, 0);
+    } else {
+        reg = assemble_operands(address, value, 0);
+        emit(OP_ST, reg, ADR_NUMBER, 0, registers[top]);
+    }
+}
+
+/*!
+ * @brief Generating the jumps to a label if a relational operator does not hold after CPA
+ * @param[in] opr Token of the relational operator
+ * @param[in] false_label Label to jump to
+ */
+static void assemble_false_jump(int opr, char *false_label) {
+    switch (opr) {
+        case TEQUAL: /* = */
+            emit_name(OP_JNZ, -1, false_label, 0);
+            break;
+        case TNOTEQ: /* <> */
+            emit_name(OP_JZE, -1, false_label, 0);
+            break;
+        case TLE: /* < */
+            emit_name(OP_JPL, -1, false_label, 0);
+            emit_name(OP_JZE, -1, false_label, 0);
+            break;
+        case TLEEQ: /* <= */
+            emit_name(OP_JPL, -1, false_label, 0);
+            break;
+        case TGR: /* > */
+            emit_name(OP_JMI, -1, false_label, 0);
+            emit_name(OP_JZE, -1, false_label, 0);
+            break;
+        case TGREQ: /* >= */
+            emit_name(OP_JMI, -1, false_label, 0);
+            break;
+    }
+}
+
+/*!
+ * @brief Generating assembly code for a condition, which jumps if it is false
+ * A relational operator compares its operands and jumps without making the value 0 or 1,
+ * and a constant condition jumps always or never.
+ * @param[in] false_label Label to jump to
+ */
+static void assemble_condition(char *false_label) {
+    struct EXPR *e = pop_expr();
+    int reg = registers[top];
+    int sub;
+
+    if (is_constant(e)) {
+        if (e->value == 0) {
+            emit_name(OP_JUMP, -1, false_label, 0);
+        }
+        return;
+    }
+    if (e != NULL && e->kind == EXPR_RELATION) {
+        if (!optimize) {
+            flush_exprs();
+            assemble_expr_stack(e->left);
+            assemble_expr_stack(e->right);
+            emit(OP_POP, 2, ADR_NONE, 0, 0);
+            emit(OP_POP, 1, ADR_NONE, 0, 0);
+            emit(OP_CPA, 1, ADR_NONE, 0, 2);
+        } else if ((sub = assemble_operands(e->left, e->right, 1)) == 0) {
+            assemble_memory_operand(OP_CPA, reg, e->right->id, 0);
+        } else {
+            emit(OP_CPA, reg, ADR_NONE, 0, sub);
+        }
+        assemble_false_jump(e->opr, false_label);
+        return;
+    }
+    if (!optimize) {
+        repush_expr(e);
+        flush_exprs();
+        emit(OP_POP, 1, ADR_NONE, 0, 0);
+    } else {
+        assemble_expr_register(e);
+    }
+    emit(OP_CPA, reg, ADR_NONE, 0, 0);
+    emit_name(OP_JZE, -1, false_label, 0);
 }
 
 /*!
@@ -234,9 +1500,7 @@ void assemble_assign(void) {
  */
 void assemble_if_condition(char *else_label) {
     /* fprintf(out_fp, ";if condition\n"); */
-    fprintf(out_fp, "\tPOP \tgr1\n");
-    fprintf(out_fp, "\tCPA \tgr1, \tgr0\n");
-    fprintf(out_fp, "\tJZE \t%s\n", else_label);
+    assemble_condition(else_label);
 }
 
 /*!
@@ -246,24 +1510,40 @@ void assemble_if_condition(char *else_label) {
  */
 void assemble_else(char *if_end_label, char *else_label) {
     /* fprintf(out_fp, ";else\n"); */
-    fprintf(out_fp, "\tJUMP \t%s\n", if_end_label);
-    fprintf(out_fp, "%s\n", else_label);
+    emit_name(OP_JUMP, -1, if_end_label, 0);
+    emit_label(else_label);
+}
+
+/*!
+ * @brief Generating assembly code for a label
+ * @param[in] label The label
+ */
+void assemble_label(char *label) {
+    emit_label(label);
 }
 
 /*!
  * @brief Generating assembly code for condition of iteration statement
  */
 void assemble_iteration_condition(char *bottom_label) {
-    fprintf(out_fp, "\tPOP \tgr1\n");
-    fprintf(out_fp, "\tCPA \tgr1, \tgr0\n");
-    fprintf(out_fp, "\tJZE \t%s\n", bottom_label);
+    assemble_condition(bottom_label);
+}
+
+/*!
+ * @brief Generating assembly code for end of iteration statement
+ * @param[in] top_label Label of the condition
+ * @param[in] bottom_label Label to exit the iteration
+ */
+void assemble_iteration_end(char *top_label, char *bottom_label) {
+    emit_name(OP_JUMP, -1, top_label, 0);
+    emit_label(bottom_label);
 }
 
 /*!
  * @brief Generating assembly code for break 
  */
 void assemble_break(void) {
-    fprintf(out_fp, "\tJUMP \t%s\n", while_end_literal_root->label);
+    emit_name(OP_JUMP, -1, while_end_literal_root->label, 0);
 }
 
 /*!
@@ -271,9 +1551,9 @@ void assemble_break(void) {
  */
 void assemble_return(void) {
     if (in_subprogram_declaration) {
-        fprintf(out_fp, "\tRET\n");
+        emit(OP_RET, -1, ADR_NONE, 0, 0);
     } else {
-        fprintf(out_fp, "\tSVC \t0\n");
+        emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
     }
 }
 
@@ -281,7 +1561,34 @@ void assemble_return(void) {
  * @brief Generating assembly code for call statemnt
  */
 void assemble_call(struct ID *id_procedure) {
-    fprintf(out_fp, "\tCALL $%s\n", id_procedure->name);
+    /* push the addresses of the real parameters */
+    flush_exprs();
+    emit(OP_CALL, -1, ADR_NAME, casl_label("$", id_procedure->name, NULL), 0);
+}
+
+/*!
+ * @brief Value of a relational operator over constants
+ * @param[in] opr Token of the operator
+ * @param[in] left Left operand
+ * @param[in] right Right operand
+ * @return int Return 1 if it holds, 0 if it does not.
+ */
+static int fold_relation(int opr, int left, int right) {
+    switch (opr) {
+        case TEQUAL:
+            return left == right;
+        case TNOTEQ:
+            return left != right;
+        case TLE:
+            return left < right;
+        case TLEEQ:
+            return left <= right;
+        case TGR:
+            return left > right;
+        case TGREQ:
+            return left >= right;
+    }
+    return 0;
 }
 
 /*!
@@ -290,85 +1597,130 @@ void assemble_call(struct ID *id_procedure) {
 void assemble_expression(int relational_operator_token) {
     char *jmp_true_label = NULL;
     char *jmp_false_label = NULL;
+    struct EXPR *right, *left, *e;
+
+    right = pop_expr();
+    left = pop_expr();
+    if (is_constant(left) && is_constant(right)) {
+        assemble_constant(fold_relation(relational_operator_token, left->value, right->value));
+        return;
+    }
     create_newlabel(&jmp_true_label);
     create_newlabel(&jmp_false_label);
+    if ((e = push_expr(EXPR_RELATION, relational_operator_token, left, right)) != NULL) {
+        e->label1 = jmp_true_label;
+        e->label2 = jmp_false_label;
+        e->need = binary_need(left, right);
+    }
+}
+
+/*!
+ * @brief Generating assembly code for multiply the negatives
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int assemble_minus_sign() {
+    if (assemble_constant(-1) == ERROR) {
+        return ERROR;
+    }
+    return assemble_MULA();
+}
 
-    fprintf(out_fp, "\tPOP \tgr2\n");
-    fprintf(out_fp, "\tPOP \tgr1\n");
-    fprintf(out_fp, "\tCPA \tgr1, \tgr2\n");
+/*!
+ * @brief Generating a constant for a binary operator over constants
+ * The overflow and the division by zero, which stop the object program, are reported as compile errors.
+ * @param[in] opr Token of the operator
+ * @param[in] left Left operand
+ * @param[in] right Right operand
+ * @return int Returns 0 on success and -1 on failure.
+ */
+static int fold_operator(int opr, int left, int right) {
+    long value = 0;
 
-    switch (relational_operator_token) {
-        case TEQUAL: /* = */
-            fprintf(out_fp, "\tJZE \t%s\n", jmp_true_label);
+    switch (opr) {
+        case TPLUS:
+            value = (long)left + right;
             break;
-        case TNOTEQ: /* <> */
-            fprintf(out_fp, "\tJNZ \t%s\n", jmp_true_label);
+        case TMINUS:
+            value = (long)left - right;
             break;
-        case TLE: /* < */
-            fprintf(out_fp, "\tJMI \t%s\n", jmp_true_label);
+        case TSTAR:
+            value = (long)left * right;
             break;
-        case TLEEQ: /* <= */
-            fprintf(out_fp, "\tJMI \t%s\n", jmp_true_label);
-            fprintf(out_fp, "\tJZE \t%s\n", jmp_true_label);
+        case TDIV:
+            if (right == 0) {
+                return error("Division by zero in the constant expression.");
+            }
+            /* DIVA rounds toward zero */
+            value = labs(left) / labs(right);
+            if ((left < 0) != (right < 0)) {
+                value = -value;
+            }
             break;
-        case TGR: /* > */
-            fprintf(out_fp, "\tJPL \t%s\n", jmp_true_label);
+        case TAND:
+            value = left & right;
             break;
-        case TGREQ: /* >= */
-            fprintf(out_fp, "\tJPL \t%s\n", jmp_true_label);
-            fprintf(out_fp, "\tJZE \t%s\n", jmp_true_label);
+        case TOR:
+            value = left | right;
             break;
     }
-
-    fprintf(out_fp, "\tLD \tgr1, \tgr0\n"); /* return 0 */
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
-    fprintf(out_fp, "\tJUMP \t%s\n", jmp_false_label);
-
-    fprintf(out_fp, "%s\n", jmp_true_label);
-    fprintf(out_fp, "\tLAD \tgr1, \t1\n"); /* return 1 */
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
-    fprintf(out_fp, "%s\n", jmp_false_label);
+    if (value < MIN_INT_VALUE || value > MAX_INT_VALUE) {
+        return error("Overflow in the constant expression.");
+    }
+    return assemble_constant((int)value);
 }
 
 /*!
- * @brief Generating assembly code for multiply the negatives
+ * @brief Generating assembly code for a binary operator
+ * The operators over constants are folded, and x + 0, 0 + x, x - 0, x * 1, 1 * x and x div 1 are left as x.
+ * @param[in] opr Token of the operator
+ * @return int Returns 0 on success and -1 on failure.
  */
-void assemble_minus_sign() {
-    fprintf(out_fp, "\tLAD \tgr1, \t-1\n");
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
-    assemble_MULA();
+static int assemble_operator(int opr) {
+    struct EXPR *right = pop_expr();
+    struct EXPR *left = pop_expr();
+    struct EXPR *e;
+
+    if (is_constant(left) && is_constant(right)) {
+        return fold_operator(opr, left->value, right->value);
+    }
+    if (((opr == TPLUS || opr == TMINUS) && is_constant_of(right, 0)) ||
+        ((opr == TSTAR || opr == TDIV) && is_constant_of(right, 1))) {
+        repush_expr(left);
+        return 0;
+    }
+    if ((opr == TPLUS && is_constant_of(left, 0)) || (opr == TSTAR && is_constant_of(left, 1))) {
+        repush_expr(right);
+        return 0;
+    }
+    if ((e = push_expr(EXPR_OPERATOR, opr, left, right)) == NULL) {
+        return ERROR;
+    }
+    e->need = binary_need(left, right);
+    return 0;
 }
 
 /*!
  * @brief Generating assembly code for ADDA
+ * @return int Returns 0 on success and -1 on failure.
  */
-void assemble_ADDA() {
-    fprintf(out_fp, "\tPOP \tgr2\n");
-    fprintf(out_fp, "\tPOP \tgr1\n");
-    fprintf(out_fp, "\tADDA \tgr1, \tgr2\n");
-    fprintf(out_fp, "\tJOV \tEOVF\n");
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
+int assemble_ADDA() {
+    return assemble_operator(TPLUS);
 }
 
 /*!
  * @brief Generating assembly code for SUBA
+ * @return int Returns 0 on success and -1 on failure.
  */
-void assemble_SUBA() {
-    fprintf(out_fp, "\tPOP \tgr2\n");
-    fprintf(out_fp, "\tPOP \tgr1\n");
-    fprintf(out_fp, "\tSUBA \tgr1, \tgr2\n");
-    fprintf(out_fp, "\tJOV \tEOVF\n");
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
+int assemble_SUBA() {
+    return assemble_operator(TMINUS);
 }
 
 /*!
  * @brief Generating assembly code for OR
+ * @return int Returns 0 on success and -1 on failure.
  */
-void assemble_OR() {
-    fprintf(out_fp, "\tPOP \tgr2\n");
-    fprintf(out_fp, "\tPOP \tgr1\n");
-    fprintf(out_fp, "\tOR \tgr1, \tgr2\n");
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
+int assemble_OR() {
+    return assemble_operator(TOR);
 }
 
 /*!
@@ -376,8 +1728,12 @@ void assemble_OR() {
  * @param[in] param right value of constant
  */
 int assemble_constant(int value) {
-    fprintf(out_fp, "\tLAD \tgr1, \t%d\n", value);
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
+    struct EXPR *e;
+
+    if ((e = push_expr(EXPR_CONSTANT, 0, NULL, NULL)) == NULL) {
+        return -1;
+    }
+    e->value = value;
     return 0;
 }
 
@@ -387,129 +1743,101 @@ int assemble_constant(int value) {
 void assemble_not_factor(void) {
     char *jmp_zero_label = NULL;
     char *jmp_not_end_label = NULL;
+    struct EXPR *factor = pop_expr();
+    struct EXPR *e;
+
+    if (is_constant(factor)) {
+        assemble_constant(factor->value == 0);
+        return;
+    }
     create_newlabel(&jmp_zero_label);
     create_newlabel(&jmp_not_end_label);
 
-    fprintf(out_fp, "\tPOP \tgr1\n"); /* factor value */
-    fprintf(out_fp, "\tCPA \tgr1, \tgr0\n");
-    fprintf(out_fp, "\tJNZ \t%s\n", jmp_zero_label); /* expression value != 0 ? 0(false) : 1(true) */
-    fprintf(out_fp, "\tLAD \tgr1, 1\n");             /* return 1 */
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
-    fprintf(out_fp, "\tJUMP \t%s\n", jmp_not_end_label);
-
-    fprintf(out_fp, "%s\n", jmp_zero_label);
-    fprintf(out_fp, "\tLD \tgr1, \tgr0\n"); /* return 0 */
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
-    fprintf(out_fp, "%s\n", jmp_not_end_label);
+    if ((e = push_expr(EXPR_NOT, 0, factor, NULL)) != NULL) {
+        e->label1 = jmp_zero_label;
+        e->label2 = jmp_not_end_label;
+        e->need = need_of(factor);
+    }
 }
 
 /*!
  * @brief Generating assembly code for type conversion
  */
 void assemble_cast(int to_type, int from_type) {
-    if (from_type == TPINT) {
-        if (to_type == TPINT) {
-            /* no operation */
-        } else if (to_type == TPBOOL) {
-            char *jmp_true_label = NULL;
-            char *jmp_cast_end_label = NULL;
-            create_newlabel(&jmp_true_label);
-            create_newlabel(&jmp_cast_end_label);
-
-            fprintf(out_fp, "\tPOP \tgr1\n"); /* expression value */
-            fprintf(out_fp, "\tCPA \tgr1, \tgr0\n");
-            fprintf(out_fp, "\tJNZ \t%s\n", jmp_true_label); /* expression value != 0 ? 1(true) : 0(false) */
-            fprintf(out_fp, "\tLD \tgr1, \tgr0\n");          /* return 0 */
-            fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
-            fprintf(out_fp, "\tJUMP \t%s\n", jmp_cast_end_label);
-
-            fprintf(out_fp, "%s\n", jmp_true_label);
-            fprintf(out_fp, "\tLAD \tgr1, \t1\n"); /* return 1 */
-            fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
-            fprintf(out_fp, "%s\n", jmp_cast_end_label);
-        } else if (to_type == TPCHAR) {
-            fprintf(out_fp, "\tPOP \tgr1\n"); /* expression value */
-            fprintf(out_fp, "\tLAD \tgr2, \t#007F\n");
-            fprintf(out_fp, "\tAND \tgr1, \tgr2\n");
-            fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
-        }
-    } else if (from_type == TPBOOL) {
+    char *jmp_true_label = NULL;
+    char *jmp_cast_end_label = NULL;
+    struct EXPR *value, *e;
+
+    if (!((from_type == TPINT && (to_type == TPBOOL || to_type == TPCHAR)) ||
+          (from_type == TPCHAR && to_type == TPBOOL))) {
         /* no operation */
-    } else if (from_type == TPCHAR) {
-        if (to_type == TPBOOL) {
-            char *jmp_true_label = NULL;
-            char *jmp_cast_end_label = NULL;
-            create_newlabel(&jmp_true_label);
-            create_newlabel(&jmp_cast_end_label);
-
-            fprintf(out_fp, "\tPOP \tgr1\n"); /* expression value */
-            fprintf(out_fp, "\tCPA \tgr1, \tgr0\n");
-            fprintf(out_fp, "\tJNZ \t%s\n", jmp_true_label); /* expression value != 0 ? 1(true) : 0(false) */
-            fprintf(out_fp, "\tLD \tgr1, \tgr0\n");          /* return 0 */
-            fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
-            fprintf(out_fp, "\tJUMP \t%s\n", jmp_cast_end_label);
-
-            fprintf(out_fp, "%s\n", jmp_true_label);
-            fprintf(out_fp, "\tLAD \tgr1, \t1\n"); /* return 1 */
-            fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
-            fprintf(out_fp, "%s\n", jmp_cast_end_label);
-        } else if (to_type == TPINT || to_type == TPCHAR) {
-            /* no operation */
-        }
+        return;
+    }
+    value = pop_expr();
+    if (is_constant(value)) {
+        assemble_constant((to_type == TPCHAR) ? (value->value & 0x007F) : (value->value != 0));
+        return;
+    }
+    if (to_type == TPBOOL) {
+        create_newlabel(&jmp_true_label);
+        create_newlabel(&jmp_cast_end_label);
+    }
+    if ((e = push_expr(EXPR_CAST, to_type, value, NULL)) != NULL) {
+        e->value = from_type;
+        e->label1 = jmp_true_label;
+        e->label2 = jmp_cast_end_label;
+        /* int to char needs a register for the mask */
+        e->need = (to_type == TPCHAR && need_of(value) < 2) ? 2 : need_of(value);
     }
 }
 
 /*!
  * @brief Generating assembly code for product operation
+ * @return int Returns 0 on success and -1 on failure.
  */
-void assemble_MULA() {
-    fprintf(out_fp, "\tPOP \tgr2\n");
-    fprintf(out_fp, "\tPOP \tgr1\n");
-    fprintf(out_fp, "\tMULA \tgr1, \tgr2\n");
-    fprintf(out_fp, "\tJOV \tEOVF\n");
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
+int assemble_MULA() {
+    return assemble_operator(TSTAR);
 }
 
 /*!
  * @brief Generating assembly code for division operation
+ * @return int Returns 0 on success and -1 on failure.
  */
-void assemble_DIVA() {
-    fprintf(out_fp, "\tPOP \tgr2\n");
-    fprintf(out_fp, "\tPOP \tgr1\n");
-    fprintf(out_fp, "\tDIVA \tgr1, \tgr2\n");
-    fprintf(out_fp, "\tJOV \tE0DIV\n");
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
+int assemble_DIVA() {
+    return assemble_operator(TDIV);
 }
 
 /*!
  * @brief Generating assembly code for AND operation
+ * @return int Returns 0 on success and -1 on failure.
  */
-void assemble_AND() {
-    fprintf(out_fp, "\tPOP \tgr2\n");
-    fprintf(out_fp, "\tPOP \tgr1\n");
-    fprintf(out_fp, "\tAND \tgr1, \tgr2\n");
-    fprintf(out_fp, "\tPUSH \t0, \tgr1\n");
+int assemble_AND() {
+    return assemble_operator(TAND);
 }
 
 /*!
  * @brief Generating assembly code for output strings
- * @param [in] strings the output strings 
+ * @param [in] strings the output strings, which need not be null-terminated
+ * @param [in] len length of the output strings
  * @return int Returns 0 on success and -1 on failure.
  */
-int assemble_output_format_string(char *strings) {
+int assemble_output_format_string(const char *strings, int len) {
     char *label;
     char *surrounded_strings;
 
-    if ((surrounded_strings = (char *)malloc(sizeof(char) * strlen(strings) + 2)) == NULL) {
+    if ((surrounded_strings = (char *)arena_alloc(&compile_arena, sizeof(char) * len + 3)) == NULL) {
         return error("Can not malloc for char in assemble_output_format_string.\n");
     }
     create_newlabel(&label);
-    sprintf(surrounded_strings, "'%s'", strings);
+    surrounded_strings[0] = '\'';
+    memcpy(surrounded_strings + 1, strings, len);
+    surrounded_strings[len + 1] = '\'';
+    surrounded_strings[len + 2] = '\0';
     add_literal(&literal_root, label, surrounded_strings);
 
-    fprintf(out_fp, "\tLAD \tgr1, %s\n", label);
-    fprintf(out_fp, "\tLD \tgr2, \tgr0\n");
-    fprintf(out_fp, "\tCALL \tWRITESTR\n");
+    emit_name(OP_LAD, 1, label, 0);
+    emit(OP_LD, 2, ADR_NONE, 0, 0);
+    emit_name(OP_CALL, -1, "WRITESTR", 0);
     return 0;
 }
 
@@ -519,18 +1847,23 @@ int assemble_output_format_string(char *strings) {
  * @param [in] num Number of digits to display the content
  */
 void assemble_output_format_standard_type(int type, int num) {
-    fprintf(out_fp, "\tPOP \tgr1\n");
-    fprintf(out_fp, "\tLAD \tgr2, \t%d\n", num);
+    if (!optimize) {
+        flush_exprs();
+        emit(OP_POP, 1, ADR_NONE, 0, 0);
+    } else {
+        assemble_expr_register(pop_expr());
+    }
+    emit(OP_LAD, 2, ADR_NUMBER, num, 0);
 
     switch (type) {
         case TPINT:
-            fprintf(out_fp, "\tCALL \tWRITEINT\n");
+            emit_name(OP_CALL, -1, "WRITEINT", 0);
             break;
         case TPCHAR:
-            fprintf(out_fp, "\tCALL \tWRITECHAR\n");
+            emit_name(OP_CALL, -1, "WRITECHAR", 0);
             break;
         case TPBOOL:
-            fprintf(out_fp, "\tCALL \tWRITEBOOL\n");
+            emit_name(OP_CALL, -1, "WRITEBOOL", 0);
             break;
     }
 }
@@ -539,20 +1872,25 @@ void assemble_output_format_standard_type(int type, int num) {
  * @brief Generating assembly code for newline
  */
 void assemble_output_line() {
-    fprintf(out_fp, "\tCALL \tWRITELINE\n");
+    emit_name(OP_CALL, -1, "WRITELINE", 0);
 }
 
 /*!
  * @brief Generating assembly code read statemnt
  */
 void assemble_read(int type) {
-    fprintf(out_fp, "\tPOP \tgr1\n");
+    if (!optimize) {
+        flush_exprs();
+        emit(OP_POP, 1, ADR_NONE, 0, 0);
+    } else {
+        assemble_expr_register(pop_expr());
+    }
     switch (type) {
         case TPINT:
-            fprintf(out_fp, "\tCALL \tREADINT\n");
+            emit_name(OP_CALL, -1, "READINT", 0);
             break;
         case TPCHAR:
-            fprintf(out_fp, "\tCALL \tREADCHAR\n");
+            emit_name(OP_CALL, -1, "READCHAR", 0);
             break;
     }
 }
@@ -561,283 +1899,27 @@ void assemble_read(int type) {
  * @brief Generating assembly code read with new line
  */
 void assemble_read_line() {
-    fprintf(out_fp, "\tCALL \tREADLINE\n");
+    emit_name(OP_CALL, -1, "READLINE", 0);
+}
+
+/*!
+ * @brief Generating assembly code for a literal
+ * @param[in] label Label of the literal
+ * @param[in] value Value of the literal, such as 0 or a string in quotes
+ */
+void assemble_literal(char *label, char *value) {
+    struct CASL_INSTRUCTION *insn;
+    int name = casl_name(label);
+
+    if (name >= 0 && (insn = emit(OP_DC, -1, ADR_NAME, casl_name(value), 0)) != NULL) {
+        insn->label = name;
+    }
 }
 
 /*!
  * @brief Generating library
  */
 void assemble_library() {
-    fprintf(out_fp, ";-- Library --\n");
-    fprintf(out_fp, "EOVF\n");
-    fprintf(out_fp, "  CALL  WRITELINE\n");
-    fprintf(out_fp, "  LAD  gr1, EOVF1\n");
-    fprintf(out_fp, "  LD  gr2, gr0\n");
-    fprintf(out_fp, "  CALL  WRITESTR\n");
-    fprintf(out_fp, "  CALL  WRITELINE\n");
-    fprintf(out_fp, "  SVC  1  ;  overflow error stop\n");
-    fprintf(out_fp, "EOVF1    DC  '***** Run-Time Error : Overflow *****'\n");
-    fprintf(out_fp, "E0DIV\n");
-    fprintf(out_fp, "  JNZ  EOVF\n");
-    fprintf(out_fp, "  CALL  WRITELINE\n");
-    fprintf(out_fp, "  LAD  gr1, E0DIV1\n");
-    fprintf(out_fp, "  LD  gr2, gr0\n");
-    fprintf(out_fp, "  CALL  WRITESTR\n");
-    fprintf(out_fp, "  CALL  WRITELINE\n");
-    fprintf(out_fp, "  SVC  2  ;  0-divide error stop\n");
-    fprintf(out_fp, "E0DIV1    DC  '***** Run-Time Error : Zero-Divide *****'\n");
-    fprintf(out_fp, "EROV\n");
-    fprintf(out_fp, "  CALL  WRITELINE\n");
-    fprintf(out_fp, "  LAD  gr1, EROV1\n");
-    fprintf(out_fp, "  LD  gr2, gr0\n");
-    fprintf(out_fp, "  CALL  WRITESTR\n");
-    fprintf(out_fp, "  CALL  WRITELINE\n");
-    fprintf(out_fp, "  SVC  3  ;  range-over error stop\n");
-    fprintf(out_fp, "EROV1    DC  '***** Run-Time Error : Range-Over in Array Index *****'\n");
-    fprintf(out_fp, "WRITECHAR\n");
-    fprintf(out_fp, "; gr1の値（文字）をgr2のけた数で出力する．\n");
-    fprintf(out_fp, "; gr2が0なら必要最小限の桁数で出力する\n");
-    fprintf(out_fp, "  RPUSH\n");
-    fprintf(out_fp, "  LD  gr6, SPACE\n");
-    fprintf(out_fp, "  LD  gr7, OBUFSIZE\n");
-    fprintf(out_fp, "WC1\n");
-    fprintf(out_fp, "  SUBA  gr2, ONE  ; while(--c > 0) {\n");
-    fprintf(out_fp, "  JZE  WC2\n");
-    fprintf(out_fp, "  JMI  WC2\n");
-    fprintf(out_fp, "  ST  gr6, OBUF,gr7  ;  *p++ = ' ';\n");
-    fprintf(out_fp, "  CALL  BOVFCHECK\n");
-    fprintf(out_fp, "  JUMP  WC1  ; }\n");
-    fprintf(out_fp, "WC2\n");
-    fprintf(out_fp, "  ST  gr1, OBUF,gr7  ; *p++ = gr1;\n");
-    fprintf(out_fp, "  CALL  BOVFCHECK\n");
-    fprintf(out_fp, "  ST  gr7, OBUFSIZE\n");
-    fprintf(out_fp, "  RPOP\n");
-    fprintf(out_fp, "  RET\n");
-    fprintf(out_fp, "WRITESTR\n");
-    fprintf(out_fp, "; gr1が指す文字列をgr2のけた数で出力する．\n");
-    fprintf(out_fp, "; gr2が0なら必要最小限の桁数で出力する\n");
-    fprintf(out_fp, "  RPUSH\n");
-    fprintf(out_fp, "  LD  gr6, gr1  ; p = gr1;\n");
-    fprintf(out_fp, "WS1\n");
-    fprintf(out_fp, "  LD  gr4, 0,gr6  ; while(*p != '\\0') {\n");
-    fprintf(out_fp, "  JZE  WS2\n");
-    fprintf(out_fp, "  ADDA  gr6, ONE  ;  p++;\n");
-    fprintf(out_fp, "  SUBA  gr2, ONE  ;  c--;\n");
-    fprintf(out_fp, "  JUMP  WS1  ; }\n");
-    fprintf(out_fp, "WS2\n");
-    fprintf(out_fp, "  LD  gr7, OBUFSIZE  ; q = OBUFSIZE;\n");
-    fprintf(out_fp, "  LD  gr5, SPACE\n");
-    fprintf(out_fp, "WS3\n");
-    fprintf(out_fp, "  SUBA  gr2, ONE  ; while(--c >= 0) {\n");
-    fprintf(out_fp, "  JMI  WS4\n");
-    fprintf(out_fp, "  ST  gr5, OBUF,gr7  ;  *q++ = ' ';\n");
-    fprintf(out_fp, "  CALL  BOVFCHECK\n");
-    fprintf(out_fp, "  JUMP  WS3  ; }\n");
-    fprintf(out_fp, "WS4\n");
-    fprintf(out_fp, "  LD  gr4, 0,gr1  ; while(*gr1 != '\\0') {\n");
-    fprintf(out_fp, "  JZE  WS5\n");
-    fprintf(out_fp, "  ST  gr4, OBUF,gr7  ;  *q++ = *gr1++;\n");
-    fprintf(out_fp, "  ADDA  gr1, ONE\n");
-    fprintf(out_fp, "  CALL  BOVFCHECK\n");
-    fprintf(out_fp, "  JUMP  WS4  ; }\n");
-    fprintf(out_fp, "WS5\n");
-    fprintf(out_fp, "  ST  gr7, OBUFSIZE  ; OBUFSIZE = q;\n");
-    fprintf(out_fp, "  RPOP\n");
-    fprintf(out_fp, "  RET\n");
-    fprintf(out_fp, "BOVFCHECK\n");
-    fprintf(out_fp, "    ADDA  gr7, ONE\n");
-    fprintf(out_fp, "    CPA   gr7, BOVFLEVEL\n");
-    fprintf(out_fp, "    JMI  BOVF1\n");
-    fprintf(out_fp, "    CALL  WRITELINE\n");
-    fprintf(out_fp, "    LD gr7, OBUFSIZE\n");
-    fprintf(out_fp, "BOVF1\n");
-    fprintf(out_fp, "    RET\n");
-    fprintf(out_fp, "BOVFLEVEL  DC 256\n");
-    fprintf(out_fp, "WRITEINT\n");
-    fprintf(out_fp, "; gr1の値（整数）をgr2のけた数で出力する．\n");
-    fprintf(out_fp, "; gr2が0なら必要最小限の桁数で出力する\n");
-    fprintf(out_fp, "  RPUSH\n");
-    fprintf(out_fp, "  LD  gr7, gr0  ; flag = 0;\n");
-    fprintf(out_fp, "  CPA  gr1, gr0  ; if(gr1>=0) goto WI1;\n");
-    fprintf(out_fp, "  JPL  WI1\n");
-    fprintf(out_fp, "  JZE  WI1\n");
-    fprintf(out_fp, "  LD  gr4, gr0  ; gr1= - gr1;\n");
-    fprintf(out_fp, "  SUBA  gr4, gr1\n");
-    fprintf(out_fp, "  CPA  gr4, gr1\n");
-    fprintf(out_fp, "  JZE  WI6\n");
-    fprintf(out_fp, "  LD  gr1, gr4\n");
-    fprintf(out_fp, "  LD  gr7, ONE  ; flag = 1;\n");
-    fprintf(out_fp, "WI1\n");
-    fprintf(out_fp, "  LD  gr6, SIX  ; p = INTBUF+6;\n");
-    fprintf(out_fp, "  ST  gr0, INTBUF,gr6  ; *p = '\\0';\n");
-    fprintf(out_fp, "  SUBA  gr6, ONE  ; p--;\n");
-    fprintf(out_fp, "  CPA  gr1, gr0  ; if(gr1 == 0)\n");
-    fprintf(out_fp, "  JNZ  WI2\n");
-    fprintf(out_fp, "  LD  gr4, ZERO  ;  *p = '0';\n");
-    fprintf(out_fp, "  ST  gr4, INTBUF,gr6\n");
-    fprintf(out_fp, "  JUMP  WI5  ; }\n");
-    fprintf(out_fp, "WI2      ; else {\n");
-    fprintf(out_fp, "  CPA  gr1, gr0  ;  while(gr1 != 0) {\n");
-    fprintf(out_fp, "  JZE  WI3\n");
-    fprintf(out_fp, "  LD  gr5, gr1  ;   gr5 = gr1 - (gr1 / 10) * 10;\n");
-    fprintf(out_fp, "  DIVA  gr1, TEN  ;   gr1 /= 10;\n");
-    fprintf(out_fp, "  LD  gr4, gr1\n");
-    fprintf(out_fp, "  MULA  gr4, TEN\n");
-    fprintf(out_fp, "  SUBA  gr5, gr4\n");
-    fprintf(out_fp, "  ADDA  gr5, ZERO  ;   gr5 += '0';\n");
-    fprintf(out_fp, "  ST  gr5, INTBUF,gr6  ;   *p = gr5;\n");
-    fprintf(out_fp, "  SUBA  gr6, ONE  ;   p--;\n");
-    fprintf(out_fp, "  JUMP  WI2  ;  }\n");
-    fprintf(out_fp, "WI3\n");
-    fprintf(out_fp, "  CPA  gr7, gr0  ;  if(flag != 0) {\n");
-    fprintf(out_fp, "  JZE  WI4\n");
-    fprintf(out_fp, "  LD  gr4, MINUS  ;   *p = '-';\n");
-    fprintf(out_fp, "  ST  gr4, INTBUF,gr6\n");
-    fprintf(out_fp, "  JUMP  WI5  ;  }\n");
-    fprintf(out_fp, "WI4\n");
-    fprintf(out_fp, "  ADDA  gr6, ONE  ;  else p++;\n");
-    fprintf(out_fp, "    ; }\n");
-    fprintf(out_fp, "WI5\n");
-    fprintf(out_fp, "  LAD  gr1, INTBUF,gr6  ; gr1 = p;\n");
-    fprintf(out_fp, "  CALL  WRITESTR  ; WRITESTR();\n");
-    fprintf(out_fp, "  RPOP\n");
-    fprintf(out_fp, "  RET\n");
-    fprintf(out_fp, "WI6\n");
-    fprintf(out_fp, "  LAD  gr1, MMINT\n");
-    fprintf(out_fp, "  CALL  WRITESTR  ; WRITESTR();\n");
-    fprintf(out_fp, "  RPOP\n");
-    fprintf(out_fp, "  RET\n");
-    fprintf(out_fp, "MMINT    DC  '-32768'\n");
-    fprintf(out_fp, "WRITEBOOL\n");
-    fprintf(out_fp, "; gr1の値（真理値）が0なら'FALSE'を\n");
-    fprintf(out_fp, "; 0以外なら'TRUE'をgr2のけた数で出力する．\n");
-    fprintf(out_fp, "; gr2が0なら必要最小限の桁数で出力する\n");
-    fprintf(out_fp, "  RPUSH\n");
-    fprintf(out_fp, "  CPA  gr1, gr0  ; if(gr1 != 0)\n");
-    fprintf(out_fp, "  JZE  WB1\n");
-    fprintf(out_fp, "  LAD  gr1, WBTRUE  ;  gr1 = \" TRUE \";\n");
-    fprintf(out_fp, "  JUMP  WB2\n");
-    fprintf(out_fp, "WB1      ; else\n");
-    fprintf(out_fp, "  LAD  gr1, WBFALSE  ;  gr1 = \" FALSE \";\n");
-    fprintf(out_fp, "WB2\n");
-    fprintf(out_fp, "  CALL  WRITESTR  ; WRITESTR();\n");
-    fprintf(out_fp, "  RPOP\n");
-    fprintf(out_fp, "  RET\n");
-    fprintf(out_fp, "WBTRUE    DC  'TRUE'\n");
-    fprintf(out_fp, "WBFALSE    DC  'FALSE'\n");
-    fprintf(out_fp, "WRITELINE\n");
-    fprintf(out_fp, "; 改行を出力する\n");
-    fprintf(out_fp, "  RPUSH\n");
-    fprintf(out_fp, "  LD  gr7, OBUFSIZE\n");
-    fprintf(out_fp, "  LD  gr6, NEWLINE\n");
-    fprintf(out_fp, "  ST  gr6, OBUF,gr7\n");
-    fprintf(out_fp, "  ADDA  gr7, ONE\n");
-    fprintf(out_fp, "  ST  gr7, OBUFSIZE\n");
-    fprintf(out_fp, "  OUT  OBUF, OBUFSIZE\n");
-    fprintf(out_fp, "  ST  gr0, OBUFSIZE\n");
-    fprintf(out_fp, "  RPOP\n");
-    fprintf(out_fp, "  RET\n");
-    fprintf(out_fp, "FLUSH\n");
-    fprintf(out_fp, "  RPUSH\n");
-    fprintf(out_fp, "  LD gr7, OBUFSIZE\n");
-    fprintf(out_fp, "  JZE FL1\n");
-    fprintf(out_fp, "  CALL WRITELINE\n");
-    fprintf(out_fp, "FL1\n");
-    fprintf(out_fp, "  RPOP\n");
-    fprintf(out_fp, "  RET\n");
-    fprintf(out_fp, "READCHAR\n");
-    fprintf(out_fp, "; gr1が指す番地に文字一つを読み込む\n");
-    fprintf(out_fp, "  RPUSH\n");
-    fprintf(out_fp, "  LD  gr5, RPBBUF  ; if(RPBBUF != '\\0') {\n");
-    fprintf(out_fp, "  JZE  RC0\n");
-    fprintf(out_fp, "  ST  gr5, 0,gr1  ;  *gr1 = RPBBUF;\n");
-    fprintf(out_fp, "  ST  gr0, RPBBUF  ;  RPBBUF = '\\0'\n");
-    fprintf(out_fp, "  JUMP  RC3  ;  return; }\n");
-    fprintf(out_fp, "RC0\n");
-    fprintf(out_fp, "  LD  gr7, INP  ; inp = INP;\n");
-    fprintf(out_fp, "  LD  gr6, IBUFSIZE  ; if(IBUFSIZE == 0) {\n");
-    fprintf(out_fp, "  JNZ  RC1\n");
-    fprintf(out_fp, "  IN  IBUF, IBUFSIZE  ;  IN();\n");
-    fprintf(out_fp, "  LD  gr7, gr0  ;  inp = 0;\n");
-    fprintf(out_fp, "    ; }\n");
-    fprintf(out_fp, "RC1\n");
-    fprintf(out_fp, "  CPA  gr7, IBUFSIZE  ; if(inp == IBUFSIZE) {\n");
-    fprintf(out_fp, "  JNZ  RC2\n");
-    fprintf(out_fp, "  LD  gr5, NEWLINE  ;  *gr1 = '\\n';\n");
-    fprintf(out_fp, "  ST  gr5, 0,gr1\n");
-    fprintf(out_fp, "  ST  gr0, IBUFSIZE  ;  IBUFSIZE = INP = 0;\n");
-    fprintf(out_fp, "  ST  gr0, INP\n");
-    fprintf(out_fp, "  JUMP  RC3  ; }\n");
-    fprintf(out_fp, "RC2      ; else {\n");
-    fprintf(out_fp, "  LD  gr5, IBUF,gr7  ;  *gr1 = *inp++;\n");
-    fprintf(out_fp, "  ADDA  gr7, ONE\n");
-    fprintf(out_fp, "  ST  gr5, 0,gr1\n");
-    fprintf(out_fp, "  ST  gr7, INP  ;  INP = inp;\n");
-    fprintf(out_fp, "RC3      ; }\n");
-    fprintf(out_fp, "  RPOP\n");
-    fprintf(out_fp, "  RET\n");
-    fprintf(out_fp, "READINT\n");
-    fprintf(out_fp, ";gr1が指す番地に整数値一つを読み込む\n");
-    fprintf(out_fp, "  RPUSH\n");
-    fprintf(out_fp, "RI1      ; do {\n");
-    fprintf(out_fp, "  CALL  READCHAR  ;  ch = READCHAR();\n");
-    fprintf(out_fp, "  LD  gr7, 0,gr1\n");
-    fprintf(out_fp, "  CPA  gr7, SPACE  ; } while(ch == ' ' || ch == '\\t' || ch == '\\n');\n");
-    fprintf(out_fp, "  JZE  RI1\n");
-    fprintf(out_fp, "  CPA  gr7, TAB\n");
-    fprintf(out_fp, "  JZE  RI1\n");
-    fprintf(out_fp, "  CPA  gr7, NEWLINE\n");
-    fprintf(out_fp, "  JZE  RI1\n");
-    fprintf(out_fp, "  LD  gr5, ONE  ; flag = 1\n");
-    fprintf(out_fp, "  CPA  gr7, MINUS  ; if(ch == '-') {\n");
-    fprintf(out_fp, "  JNZ  RI4\n");
-    fprintf(out_fp, "  LD  gr5, gr0  ;  flag = 0;\n");
-    fprintf(out_fp, "  CALL  READCHAR  ;  ch = READCHAR();\n");
-    fprintf(out_fp, "  LD  gr7, 0,gr1\n");
-    fprintf(out_fp, "RI4      ; }\n");
-    fprintf(out_fp, "  LD  gr6, gr0  ; v = 0;\n");
-    fprintf(out_fp, "RI2\n");
-    fprintf(out_fp, "  CPA  gr7, ZERO  ; while('0' <= ch && ch <= '9') {\n");
-    fprintf(out_fp, "  JMI  RI3\n");
-    fprintf(out_fp, "  CPA  gr7, NINE\n");
-    fprintf(out_fp, "  JPL  RI3\n");
-    fprintf(out_fp, "  MULA  gr6, TEN  ;  v = v*10+ch-'0';\n");
-    fprintf(out_fp, "  ADDA  gr6, gr7\n");
-    fprintf(out_fp, "  SUBA  gr6, ZERO\n");
-    fprintf(out_fp, "  CALL  READCHAR  ;  ch = READSCHAR();\n");
-    fprintf(out_fp, "  LD  gr7, 0,gr1\n");
-    fprintf(out_fp, "  JUMP  RI2  ; }\n");
-    fprintf(out_fp, "RI3\n");
-    fprintf(out_fp, "  ST  gr7, RPBBUF  ; ReadPushBack();\n");
-    fprintf(out_fp, "  ST  gr6, 0,gr1  ; *gr1 = v;\n");
-    fprintf(out_fp, "  CPA  gr5, gr0  ; if(flag == 0) {\n");
-    fprintf(out_fp, "  JNZ  RI5\n");
-    fprintf(out_fp, "  SUBA  gr5, gr6  ;  *gr1 = -v;\n");
-    fprintf(out_fp, "  ST  gr5, 0,gr1\n");
-    fprintf(out_fp, "RI5      ; }\n");
-    fprintf(out_fp, "  RPOP\n");
-    fprintf(out_fp, "  RET\n");
-    fprintf(out_fp, "READLINE\n");
-    fprintf(out_fp, "; 入力を改行コードまで（改行コードも含む）読み飛ばす\n");
-    fprintf(out_fp, "  ST  gr0, IBUFSIZE\n");
-    fprintf(out_fp, "  ST  gr0, INP\n");
-    fprintf(out_fp, "  ST  gr0, RPBBUF\n");
-    fprintf(out_fp, "  RET\n");
-    fprintf(out_fp, "ONE    DC  1\n");
-    fprintf(out_fp, "SIX    DC  6\n");
-    fprintf(out_fp, "TEN    DC  10\n");
-    fprintf(out_fp, "SPACE    DC  #0020  ; ' '\n");
-    fprintf(out_fp, "MINUS    DC  #002D  ; '-'\n");
-    fprintf(out_fp, "TAB    DC  #0009  ; '\\t'\n");
-    fprintf(out_fp, "ZERO    DC  #0030  ; '0'\n");
-    fprintf(out_fp, "NINE    DC  #0039  ; '9'\n");
-    fprintf(out_fp, "NEWLINE    DC  #000A  ; '\\n'\n");
-    fprintf(out_fp, "INTBUF    DS  8\n");
-    fprintf(out_fp, "OBUFSIZE  DC  0\n");
-    fprintf(out_fp, "IBUFSIZE  DC  0\n");
-    fprintf(out_fp, "INP    DC  0\n");
-    fprintf(out_fp, "OBUF    DS  257\n");
-    fprintf(out_fp, "IBUF    DS  257\n");
-    fprintf(out_fp, "RPBBUF    DC  0\n");
-    fprintf(out_fp, "	END\n");
+    emit(OP_LIBRARY, -1, ADR_NONE, 0, 0);
+    emit(OP_END, -1, ADR_NONE, 0, 0);
 }
@@ -0,0 +1,540 @@
+#include "mppl_compiler.h"
+
+/*! number of the instructions the rules look at, 0 disables the peephole optimization */
+int peephole_window = 0;
+
+/*! maximum number of the passes over the instructions */
+#define PEEPHOLE_MAX_PASSES 16
+
+/*! @name attributes of an opcode */
+/* @{ */
+/*! reads the register operand r */
+#define READ_R 0x01
+/*! writes the register operand r */
+#define WRITE_R 0x02
+/*! sets the flag register */
+#define SET_FR 0x04
+/*! reads the flag register */
+#define READ_FR 0x08
+/*! jumps to the address operand */
+#define BRANCH 0x10
+/*! the rules do not look past it */
+#define STOP 0x20
+/* @} */
+
+/*! attributes of the opcodes */
+static const int opcode_attr[NUMOFOPCODE + 1] = {
+    0,                                   /* OP_NONE */
+    WRITE_R | SET_FR,                    /* OP_LD */
+    READ_R,                              /* OP_ST */
+    WRITE_R,                             /* OP_LAD */
+    READ_R | WRITE_R | SET_FR,           /* OP_ADDA */
+    READ_R | WRITE_R | SET_FR,           /* OP_SUBA */
+    READ_R | WRITE_R | SET_FR,           /* OP_MULA */
+    READ_R | WRITE_R | SET_FR,           /* OP_DIVA */
+    READ_R | WRITE_R | SET_FR,           /* OP_AND */
+    READ_R | WRITE_R | SET_FR,           /* OP_OR */
+    READ_R | WRITE_R | SET_FR,           /* OP_XOR */
+    READ_R | SET_FR,                     /* OP_CPA */
+    BRANCH,                              /* OP_JUMP */
+    BRANCH | READ_FR,                    /* OP_JPL */
+    BRANCH | READ_FR,                    /* OP_JMI */
+    BRANCH | READ_FR,                    /* OP_JNZ */
+    BRANCH | READ_FR,                    /* OP_JZE */
+    BRANCH | READ_FR,                    /* OP_JOV */
+    0,                                   /* OP_PUSH */
+    WRITE_R,                             /* OP_POP */
+    STOP,                                /* OP_CALL */
+    STOP,                                /* OP_RET */
+    STOP,                                /* OP_SVC */
+    0,                                   /* OP_LABEL */
+    STOP,                                /* OP_START */
+    STOP,                                /* OP_END */
+    STOP,                                /* OP_DC */
+    STOP,                                /* OP_DS */
+    STOP};                               /* OP_LIBRARY */
+
+
+/*! run-time error routines of the library, which stop the program */
+static char *exit_label_names[] = {"EOVF", "E0DIV", "EROV"};
+
+/*! number of the run-time error routines */
+#define NUM_EXIT_LABELS ((int)(sizeof(exit_label_names) / sizeof(exit_label_names[0])))
+
+/*!
+ * @brief Object program under the peephole optimization
+ */
+struct PEEPHOLE {
+    struct CASL_INSTRUCTION *insns;   /*! the instructions, OP_NONE if a rule removed it */
+    int ninsns;                       /*! number of the instructions */
+    int *labels;                      /*! index of the line with only the label of each name, -1 if there is none */
+    int nnames;                       /*! number of the names */
+    int exit_labels[NUM_EXIT_LABELS]; /*! names of the run-time error routines */
+};
+
+static int rule_push_pop(struct PEEPHOLE *p, int i);
+static int rule_load_push(struct PEEPHOLE *p, int i);
+static int rule_load_copy(struct PEEPHOLE *p, int i);
+static int rule_store_load(struct PEEPHOLE *p, int i);
+static int rule_jump_next(struct PEEPHOLE *p, int i);
+static int rule_jump_chain(struct PEEPHOLE *p, int i);
+
+/*!
+ * @brief Rule of the peephole optimization
+ */
+static struct PEEPHOLE_RULE {
+    char *name;                              /*! name in the statistics */
+    int length;                              /*! fewest instructions the rule looks at */
+    int (*apply)(struct PEEPHOLE *p, int i); /*! rewrite at the i-th line, return 1 if it does */
+    long hits;                               /*! number of the rewrites */
+} rules[] = {
+    {"push-pop", 2, rule_push_pop, 0},
+    {"load-push", 2, rule_load_push, 0},
+    {"load-copy", 2, rule_load_copy, 0},
+    {"store-load", 2, rule_store_load, 0},
+    {"jump-next", 2, rule_jump_next, 0},
+    {"jump-chain", 2, rule_jump_chain, 0},
+};
+
+/*! number of the chains of labels merged into one */
+static long label_chain_hits = 0;
+
+/*!
+ * @brief Find a line with only a label
+ * @param[in] p The object program
+ * @param[in] label The name of the label
+ * @return int Return the index of the line, or -1 if there is none.
+ */
+static int find_label(struct PEEPHOLE *p, int label) {
+    return (label >= 0 && label < p->nnames) ? p->labels[label] : -1;
+}
+
+/*!
+ * @brief Register the lines with only a label
+ * @param[in] p The object program
+ */
+static void index_labels(struct PEEPHOLE *p) {
+    int i;
+
+    for (i = 0; i < p->nnames; i++) {
+        p->labels[i] = -1;
+    }
+    for (i = 0; i < p->ninsns; i++) {
+        if (p->insns[i].opcode == OP_LABEL && p->labels[p->insns[i].label] < 0) {
+            p->labels[p->insns[i].label] = i;
+        }
+    }
+}
+
+/*!
+ * @brief Index of the next line that is not removed
+ * @param[in] p The object program
+ * @param[in] i Index of the line
+ * @return int Return the index, or the number of the lines if there is none.
+ */
+static int next_insn(struct PEEPHOLE *p, int i) {
+    for (i++; i < p->ninsns && p->insns[i].opcode == OP_NONE; i++) {
+    }
+    return i;
+}
+
+/*!
+ * @brief Index of the next instruction after the labels
+ * @param[in] p The object program
+ * @param[in] i Index of the line
+ * @return int Return the index, or the number of the lines if there is none.
+ */
+static int next_instruction(struct PEEPHOLE *p, int i) {
+    for (i = next_insn(p, i); i < p->ninsns && p->insns[i].opcode == OP_LABEL; i = next_insn(p, i)) {
+    }
+    return i;
+}
+
+/*!
+ * @brief Whether a label is a run-time error routine, which stops the program
+ * @param[in] p The object program
+ * @param[in] label The name of the label
+ * @return int Return 1 if it is, 0 if it is not.
+ */
+static int is_exit_label(struct PEEPHOLE *p, int label) {
+    int i;
+
+    for (i = 0; i < NUM_EXIT_LABELS; i++) {
+        if (label == p->exit_labels[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*!
+ * @brief Whether an instruction reads a register
+ * @param[in] insn The instruction
+ * @param[in] reg The register
+ * @return int Return 1 if it does, 0 if it does not.
+ */
+static int reads_register(struct CASL_INSTRUCTION *insn, int reg) {
+    return ((opcode_attr[insn->opcode] & READ_R) && insn->r == reg) || insn->x == reg;
+}
+
+/*!
+ * @brief Whether a register and the flags are written before they are read after a line
+ * Jumps are followed, and the search gives up after the window.
+ * @param[in] p The object program
+ * @param[in] i Index of the line
+ * @param[in] reg The register, or 0 if only the flags are asked
+ * @param[in] flags 1 if the flags are asked too
+ * @param[in] budget number of the instructions to look at
+ * @return int Return 1 if they are dead, 0 if they may be read.
+ */
+static int is_dead(struct PEEPHOLE *p, int i, int reg, int flags, int budget) {
+    struct CASL_INSTRUCTION *insn;
+    int attr, target;
+
+    for (i = next_insn(p, i); i < p->ninsns && budget > 0; i = next_insn(p, i)) {
+        insn = &p->insns[i];
+        attr = opcode_attr[insn->opcode];
+        if (insn->opcode == OP_LABEL) {
+            continue;
+        }
+        budget--;
+        if (insn->opcode == OP_SVC) {
+            return 1;
+        }
+        if ((attr & STOP) || (reg > 0 && reads_register(insn, reg)) || (flags && (attr & READ_FR))) {
+            return 0;
+        }
+        if ((attr & WRITE_R) && insn->r == reg) {
+            reg = 0;
+        }
+        if (attr & SET_FR) {
+            flags = 0;
+        }
+        if (reg == 0 && !flags) {
+            return 1;
+        }
+        if (attr & BRANCH) {
+            if (insn->x > 0) {
+                return 0;
+            }
+            if (is_exit_label(p, insn->adr)) {
+                target = -1;
+            } else if ((target = find_label(p, insn->adr)) < 0) {
+                return 0;
+            }
+            if (insn->opcode == OP_JUMP) {
+                if (target < 0) {
+                    return 1;
+                }
+                i = target;
+            } else if (target >= 0 && !is_dead(p, target, reg, flags, budget)) {
+                return 0;
+            }
+        }
+    }
+    return 0;
+}
+
+/*!
+ * @brief Rewrite an instruction in place
+ * @param[in] insn The instruction
+ * @param[in] opcode New opcode
+ * @param[in] r New register operand
+ * @param[in] kind Kind of the new address operand
+ * @param[in] adr New address operand
+ * @param[in] x New index register or second register operand
+ */
+static void rewrite(struct CASL_INSTRUCTION *insn, int opcode, int r, int kind, int adr, int x) {
+    insn->opcode = opcode;
+    insn->r = r;
+    insn->kind = kind;
+    insn->adr = adr;
+    insn->x = x;
+}
+
+/*!
+ * @brief Whether the address operand of an instruction is 0, as in PUSH 0, gr1
+ * @param[in] insn The instruction
+ * @return int Return 1 if it is, 0 if it is not.
+ */
+static int is_zero_address(struct CASL_INSTRUCTION *insn) {
+    return insn->kind == ADR_NUMBER && insn->adr == 0;
+}
+
+/*!
+ * @brief PUSH adr,x ... POP r -> LAD r,adr,x (LD r,x, or nothing if r is x)
+ * The instructions in between must not touch the stack, write x, or jump except to a run-time error.
+ */
+static int rule_push_pop(struct PEEPHOLE *p, int i) {
+    struct CASL_INSTRUCTION *push = &p->insns[i];
+    struct CASL_INSTRUCTION *insn;
+    int j, n, attr;
+
+    if (push->opcode != OP_PUSH) {
+        return 0;
+    }
+    for (j = next_insn(p, i), n = 1; j < p->ninsns && n < peephole_window; j = next_insn(p, j), n++) {
+        insn = &p->insns[j];
+        attr = opcode_attr[insn->opcode];
+        if (insn->opcode == OP_POP) {
+            break;
+        }
+        if (insn->opcode == OP_PUSH || insn->opcode == OP_LABEL || (attr & STOP) ||
+            ((attr & BRANCH) && (insn->opcode == OP_JUMP || insn->x > 0 || !is_exit_label(p, insn->adr))) ||
+            ((attr & WRITE_R) && push->x > 0 && insn->r == push->x)) {
+            return 0;
+        }
+    }
+    if (j >= p->ninsns || n >= peephole_window || p->insns[j].opcode != OP_POP) {
+        /* POP is not in the window */
+        return 0;
+    }
+    insn = &p->insns[j];
+    push->opcode = OP_NONE;
+    if (!is_zero_address(push) || push->x == 0) {
+        rewrite(insn, OP_LAD, insn->r, push->kind, push->adr, push->x);
+    } else if (insn->r == push->x) {
+        insn->opcode = OP_NONE;
+    } else if (is_dead(p, j, 0, 1, peephole_window)) {
+        rewrite(insn, OP_LD, insn->r, ADR_NONE, 0, push->x);
+    } else {
+        /* POP does not set the flags, nor does LAD */
+        rewrite(insn, OP_LAD, insn->r, ADR_NUMBER, 0, push->x);
+    }
+    return 1;
+}
+
+/*!
+ * @brief LAD r,adr,x; PUSH 0,r -> PUSH adr,x and LD r,x; PUSH 0,r -> PUSH 0,x if r is not read after
+ */
+static int rule_load_push(struct PEEPHOLE *p, int i) {
+    struct CASL_INSTRUCTION *load = &p->insns[i];
+    struct CASL_INSTRUCTION *push;
+    int j = next_insn(p, i);
+
+    if (j >= p->ninsns || !(load->opcode == OP_LAD || (load->opcode == OP_LD && load->kind == ADR_NONE))) {
+        return 0;
+    }
+    push = &p->insns[j];
+    if (push->opcode != OP_PUSH || push->x != load->r || !is_zero_address(push) ||
+        !is_dead(p, j, load->r, load->opcode == OP_LD, peephole_window)) {
+        return 0;
+    }
+    if (load->kind == ADR_NONE) {
+        rewrite(push, OP_PUSH, -1, ADR_NUMBER, 0, load->x);
+    } else {
+        rewrite(push, OP_PUSH, -1, load->kind, load->adr, load->x);
+    }
+    load->opcode = OP_NONE;
+    return 1;
+}
+
+/*!
+ * @brief LD a,adr,x; LD b,a -> LD b,adr,x if a is not read after
+ */
+static int rule_load_copy(struct PEEPHOLE *p, int i) {
+    struct CASL_INSTRUCTION *load = &p->insns[i];
+    struct CASL_INSTRUCTION *copy;
+    int j = next_insn(p, i);
+
+    if (j >= p->ninsns || (load->opcode != OP_LD && load->opcode != OP_LAD)) {
+        return 0;
+    }
+    copy = &p->insns[j];
+    if (copy->opcode != OP_LD || copy->kind != ADR_NONE || copy->x != load->r || copy->r == load->r ||
+        !is_dead(p, j, load->r, load->opcode == OP_LAD, peephole_window)) {
+        return 0;
+    }
+    load->r = copy->r;
+    copy->opcode = OP_NONE;
+    return 1;
+}
+
+/*!
+ * @brief ST r,adr,x; LD s,adr,x -> ST r,adr,x (LD s,r if s is not r)
+ */
+static int rule_store_load(struct PEEPHOLE *p, int i) {
+    struct CASL_INSTRUCTION *store = &p->insns[i];
+    struct CASL_INSTRUCTION *load;
+    int j = next_insn(p, i);
+
+    if (j >= p->ninsns || store->opcode != OP_ST) {
+        return 0;
+    }
+    load = &p->insns[j];
+    if (load->opcode != OP_LD || load->kind != store->kind || load->adr != store->adr || load->x != store->x) {
+        return 0;
+    }
+    if (load->r != store->r) {
+        rewrite(load, OP_LD, load->r, ADR_NONE, 0, store->r);
+    } else if (is_dead(p, j, 0, 1, peephole_window)) {
+        load->opcode = OP_NONE;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/*!
+ * @brief JUMP L; L -> L
+ */
+static int rule_jump_next(struct PEEPHOLE *p, int i) {
+    struct CASL_INSTRUCTION *jump = &p->insns[i];
+    int j;
+
+    if (jump->opcode != OP_JUMP || jump->x > 0) {
+        return 0;
+    }
+    for (j = next_insn(p, i); j < p->ninsns && p->insns[j].opcode == OP_LABEL; j = next_insn(p, j)) {
+        if (p->insns[j].label == jump->adr) {
+            jump->opcode = OP_NONE;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*!
+ * @brief Jcc L1; ... L1 JUMP L2 -> Jcc L2
+ */
+static int rule_jump_chain(struct PEEPHOLE *p, int i) {
+    struct CASL_INSTRUCTION *jump = &p->insns[i];
+    struct CASL_INSTRUCTION *target;
+    int j;
+
+    if (!(opcode_attr[jump->opcode] & BRANCH) || jump->x > 0 || (j = find_label(p, jump->adr)) < 0 ||
+        (j = next_instruction(p, j)) >= p->ninsns) {
+        return 0;
+    }
+    target = &p->insns[j];
+    if (target->opcode != OP_JUMP || target->x > 0 || target->adr == jump->adr || j == i) {
+        return 0;
+    }
+    jump->adr = target->adr;
+    return 1;
+}
+
+/*!
+ * @brief Whether a label is of the compiled code, which the library never refers to
+ * @param[in] label The label
+ * @return int Return 1 if it is, 0 if it is a label of the library.
+ */
+static int is_code_label(const char *label) {
+    if (label[0] == '$') {
+        return 1;
+    }
+    if (label[0] != 'L' || label[1] == '\0') {
+        return 0;
+    }
+    for (label++; *label != '\0'; label++) {
+        if (*label < '0' || *label > '9') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*!
+ * @brief Merge the labels of the code on consecutive lines into the first one
+ * The jumps and the calls to the others are rewritten to the first one.
+ * @param[in] p The object program
+ * @param[in] names The names of the object program
+ * @return int Return the number of the labels merged.
+ */
+static int merge_label_chains(struct PEEPHOLE *p, char **names) {
+    struct CASL_INSTRUCTION *insn;
+    int *aliases;
+    int i, j, merged = 0;
+
+    if ((aliases = (int *)malloc(sizeof(int) * (p->nnames > 0 ? p->nnames : 1))) == NULL) {
+        return 0;
+    }
+    for (i = 0; i < p->nnames; i++) {
+        aliases[i] = -1;
+    }
+    for (i = 0; i < p->ninsns; i = j) {
+        j = next_insn(p, i);
+        if (p->insns[i].opcode != OP_LABEL) {
+            continue;
+        }
+        for (; j < p->ninsns && p->insns[j].opcode == OP_LABEL && is_code_label(names[p->insns[j].label]);
+             j = next_insn(p, j)) {
+            if (p->insns[j].label != p->insns[i].label) {
+                aliases[p->insns[j].label] = p->insns[i].label;
+            }
+            p->insns[j].opcode = OP_NONE;
+            merged++;
+        }
+    }
+    if (merged > 0) {
+        for (i = 0; i < p->ninsns; i++) {
+            insn = &p->insns[i];
+            if (insn->kind == ADR_NAME && ((opcode_attr[insn->opcode] & BRANCH) || insn->opcode == OP_CALL) &&
+                aliases[insn->adr] >= 0) {
+                insn->adr = aliases[insn->adr];
+            }
+        }
+    }
+    free(aliases);
+    return merged;
+}
+
+/*!
+ * @brief Peephole optimization of an object program
+ * The rules are applied over the instructions in place until none of them rewrites any.
+ * @param[in,out] program The object program
+ * @return int Returns 0 on success and -1 on failure.
+ */
+int peephole_optimize(struct CASL_PROGRAM *program) {
+    struct PEEPHOLE p;
+    int i, k, changed, passes;
+
+    for (i = 0; i < NUM_EXIT_LABELS; i++) {
+        if ((p.exit_labels[i] = casl_name(exit_label_names[i])) < 0) {
+            return -1;
+        }
+    }
+    p.insns = program->insns;
+    p.ninsns = program->ninsns;
+    p.nnames = program->nnames;
+    if ((p.labels = (int *)malloc(sizeof(int) * (p.nnames > 0 ? p.nnames : 1))) == NULL) {
+        return error("can not malloc in peephole_optimize\n");
+    }
+
+    for (passes = 0, changed = 1; changed && passes < PEEPHOLE_MAX_PASSES; passes++) {
+        changed = 0;
+        if ((k = merge_label_chains(&p, program->names)) > 0) {
+            label_chain_hits += k;
+            changed = 1;
+        }
+        index_labels(&p);
+        for (i = 0; i < p.ninsns; i = next_insn(&p, i)) {
+            if (p.insns[i].opcode == OP_NONE) {
+                continue;
+            }
+            for (k = 0; k < (int)(sizeof(rules) / sizeof(rules[0])); k++) {
+                if (rules[k].length <= peephole_window && rules[k].apply(&p, i)) {
+                    rules[k].hits++;
+                    changed = 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    free(p.labels);
+    return 0;
+}
+
+/*!
+ * @brief Output the number of the rewrites of each rule of the peephole optimization
+ * @param[in] fp The output file
+ */
+void peephole_print_stats(FILE *fp) {
+    int k;
+
+    for (k = 0; k < (int)(sizeof(rules) / sizeof(rules[0])); k++) {
+        fprintf(fp, "peephole %-12s %ld\n", rules[k].name, rules[k].hits);
+    }
+    fprintf(fp, "peephole %-12s %ld\n", "label-chain", label_chain_hits);
+}
@@ -2,15 +2,1392 @@
 #include <CUnit/CUnit.h>
 #include <CUnit/TestDB.h>
 #include <CUnit/TestRun.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <unistd.h>
 
 // clang-format off
 #include "mppl_compiler.h"
+#include "arena.c"
 #include "cross_reference.c"
 #include "id-list.c"
 #include "literal_list.c"
 #include "output_assemble.c"
-#undef main
+#include "peephole.c"
 #include "main.c"
 #include "scan.c"
 // clang-format on
+
+/*! @name 実行結果 */
+/* @{ */
+#define RUN_OK 0
+#define RUN_EOVF 1
+#define RUN_EROV 2
+#define RUN_E0DIV 3
+#define RUN_ABORT 4
+/* @} */
+
+/*! compile() の opt, のぞき穴最適化をしない -O */
+#define OPT_NO_PEEPHOLE 2
+
+/*! シミュレータのメモリの語数 */
+#define SIM_MEMORY 65536
+/*! シミュレータが実行する命令数の上限 */
+#define SIM_MAX_STEPS 1000000
+
+void need_test(void);
+void expr_depth_test(void);
+void long_expression_test(void);
+void spill_test(void);
+void array_bounds_test(void);
+void char_cast_test(void);
+void parameter_test(void);
+void register_mode_test(void);
+
+void fold_div_test(void);
+void fold_error_test(void);
+void fold_identity_test(void);
+void fold_relation_test(void);
+
+void condition_jump_test(void);
+void condition_constant_test(void);
+
+void peephole_push_pop_test(void);
+void peephole_flags_test(void);
+void peephole_branch_test(void);
+void peephole_jump_test(void);
+void peephole_label_chain_test(void);
+
+void test_init(void);
+void test_end(void);
+int compile(const char *source, int opt);
+int compile_statement(const char *statement, int opt);
+char *program_text(void);
+int contains(const char *code);
+int count_opcode(int opcode);
+int run_program(void);
+int value_of(char *label, int index);
+void optimize_program(int window);
+
+/*! compile() や program_text() で得た目的プログラム (タブを除いたもの) */
+static char *object_text = NULL;
+/*! compile() の標準エラー出力 */
+static char *error_text = NULL;
+/*! シミュレータのメモリ */
+static int sim_mem[SIM_MEMORY];
+/*! 各番地の命令の添字, 命令でなければ -1 */
+static int sim_insn[SIM_MEMORY];
+/*! 各名前の番地, ライブラリの名前なら -1 */
+static int *sim_names = NULL;
+/*! sim_names の名前の数 */
+static int sim_nnames = 0;
+/*! run_program() が実行した命令数 */
+static long sim_steps = 0;
+
+#undef main
+int main() {
+    CU_pSuite suite;
+
+    CU_initialize_registry();
+
+    suite = CU_add_suite("output_assemble test", NULL, NULL);
+    CU_add_test(suite, "need_test", need_test);
+    CU_add_test(suite, "expr_depth_test", expr_depth_test);
+    CU_add_test(suite, "long_expression_test", long_expression_test);
+    CU_add_test(suite, "spill_test", spill_test);
+    CU_add_test(suite, "array_bounds_test", array_bounds_test);
+    CU_add_test(suite, "char_cast_test", char_cast_test);
+    CU_add_test(suite, "parameter_test", parameter_test);
+    CU_add_test(suite, "register_mode_test", register_mode_test);
+
+    suite = CU_add_suite("constant folding test", NULL, NULL);
+    CU_add_test(suite, "fold_div_test", fold_div_test);
+    CU_add_test(suite, "fold_error_test", fold_error_test);
+    CU_add_test(suite, "fold_identity_test", fold_identity_test);
+    CU_add_test(suite, "fold_relation_test", fold_relation_test);
+
+    suite = CU_add_suite("condition test", NULL, NULL);
+    CU_add_test(suite, "condition_jump_test", condition_jump_test);
+    CU_add_test(suite, "condition_constant_test", condition_constant_test);
+
+    suite = CU_add_suite("peephole test", NULL, NULL);
+    CU_add_test(suite, "peephole_push_pop_test", peephole_push_pop_test);
+    CU_add_test(suite, "peephole_flags_test", peephole_flags_test);
+    CU_add_test(suite, "peephole_branch_test", peephole_branch_test);
+    CU_add_test(suite, "peephole_jump_test", peephole_jump_test);
+    CU_add_test(suite, "peephole_label_chain_test", peephole_label_chain_test);
+
+    CU_basic_run_tests();
+    /* CU_console_run_tests(); */
+
+    int ret = CU_get_number_of_failures();
+
+    CU_cleanup_registry();
+
+    if (ret != 0) {
+        return ret;
+    } else {
+        return 0;
+    }
+}
+
+/*!
+ * @brief 式の評価に必要なレジスタ数のテスト
+ */
+void need_test(void) {
+    struct TYPE int_type = {TPINT, 0, NULL, NULL, NULL};
+    struct TYPE array_type = {TPARRAYINT, 10, &int_type, NULL, NULL};
+    struct ID a, para, v;
+    struct EXPR c, x, p, t2, t3;
+
+    test_init();
+    memset(&a, 0, sizeof(a));
+    a.name = "a";
+    a.itp = &int_type;
+    para = a;
+    para.name = "p";
+    para.ispara = 1;
+    v = a;
+    v.name = "v";
+    v.itp = &array_type;
+
+    memset(&c, 0, sizeof(c));
+    c.kind = EXPR_CONSTANT;
+    c.need = 1;
+    x = c;
+    x.kind = EXPR_VARIABLE;
+    x.id = &a;
+    p = x;
+    p.id = &para;
+    t2 = c;
+    t2.kind = EXPR_OPERATOR;
+    t2.need = 2;
+    t3 = t2;
+    t3.need = 3;
+
+    CU_ASSERT_EQUAL(need_of(NULL), 1);
+    CU_ASSERT_EQUAL(need_of(&t3), 3);
+    // 右の単純変数はメモリオペランドのまま使う
+    CU_ASSERT_EQUAL(binary_need(&c, &x), 1);
+    CU_ASSERT_EQUAL(binary_need(&t3, &x), 3);
+    // 引数は番地をレジスタに読むのでメモリオペランドにならない
+    CU_ASSERT_EQUAL(binary_need(&x, &p), 2);
+    CU_ASSERT_EQUAL(binary_need(&c, &c), 2);
+    CU_ASSERT_EQUAL(binary_need(&t2, &c), 2);
+    CU_ASSERT_EQUAL(binary_need(&c, &t2), 2);
+    CU_ASSERT_EQUAL(binary_need(&t2, &t2), 3);
+    CU_ASSERT_EQUAL(binary_need(&t3, &t2), 3);
+    CU_ASSERT_EQUAL(binary_need(&t2, &t3), 3);
+
+    // 式を組み立てたときの必要数
+    optimize = 1;
+    assemble_constant(3);
+    assemble_variable_reference_rval(&v);
+    CU_ASSERT_EQUAL(pending_exprs->need, 2); // 添字と最大の添字
+    assemble_variable_reference_rval(&a);
+    assemble_ADDA();
+    CU_ASSERT_EQUAL(pending_exprs->need, 2);
+    assemble_variable_reference_rval(&para);
+    assemble_MULA();
+    CU_ASSERT_EQUAL(pending_exprs->need, 2);
+    assemble_variable_reference_rval(&a);
+    assemble_constant(2);
+    assemble_MULA();
+    assemble_variable_reference_rval(&a);
+    assemble_constant(5);
+    assemble_SUBA();
+    assemble_DIVA();
+    CU_ASSERT_EQUAL(pending_exprs->need, 3);
+    assemble_SUBA();
+    CU_ASSERT_EQUAL(pending_exprs->need, 3);
+    assemble_variable_reference_rval(&v);
+    CU_ASSERT_EQUAL(pending_exprs->need, 3);
+    CU_ASSERT_EQUAL(pending_exprs->left->need, 3);
+    pending_exprs = NULL;
+
+    test_end();
+}
+
+/*!
+ * @brief 長い式でも木が深くならないことのテスト
+ */
+void expr_depth_test(void) {
+    struct TYPE int_type = {TPINT, 0, NULL, NULL, NULL};
+    struct ID a;
+    const char *expected = "LAD gr1, $a\nPUSH 0, gr1\n"
+                           "LD gr1, $a\nPUSH 0, gr1\nLD gr1, $a\nPUSH 0, gr1\n"
+                           "POP gr2\nPOP gr1\nADDA gr1, gr2\nJOV EOVF\nPUSH 0, gr1\n"
+                           "LD gr1, $a\nPUSH 0, gr1\n"
+                           "POP gr2\nPOP gr1\nADDA gr1, gr2\nJOV EOVF\nPUSH 0, gr1\n";
+    int i;
+
+    memset(&a, 0, sizeof(a));
+    a.name = "a";
+    a.itp = &int_type;
+
+    // スタックで評価するときは, 葉でない被演算子はすぐに生成する
+    test_init();
+    optimize = 0;
+    assemble_variable_reference_lval(&a);
+    assemble_variable_reference_rval(&a);
+    for (i = 0; i < 100; i++) {
+        assemble_variable_reference_rval(&a);
+        assemble_ADDA();
+        CU_ASSERT(pending_exprs->depth <= 2);
+        // 下の値は積んである
+        CU_ASSERT(i == 0 || pending_exprs->nextp->kind == EXPR_STACKED);
+    }
+    assemble_assign();
+    CU_ASSERT_PTR_NULL(pending_exprs);
+    free(object_text);
+    object_text = program_text();
+    CU_ASSERT_EQUAL(count_opcode(OP_ADDA), 100);
+    CU_ASSERT_EQUAL(count_opcode(OP_PUSH), count_opcode(OP_POP));
+    CU_ASSERT_EQUAL(strncmp(object_text, expected, strlen(expected)), 0);
+    test_end();
+
+    // -O では深くなった部分式を一時領域に格納する
+    test_init();
+    optimize = 1;
+    assemble_variable_reference_rval(&a);
+    for (i = 0; i < 100; i++) {
+        assemble_variable_reference_rval(&a);
+        assemble_ADDA();
+        CU_ASSERT(pending_exprs->depth <= MAX_EXPR_DEPTH);
+    }
+    free(object_text);
+    object_text = program_text();
+    CU_ASSERT_EQUAL(count_opcode(OP_ST), 3);
+    CU_ASSERT_EQUAL(count_opcode(OP_ADDA), 3 * (MAX_EXPR_DEPTH - 1));
+    CU_ASSERT(contains("ADDA gr1, $a\nJOV EOVF\nST gr1, L0001\n"));
+    pending_exprs = NULL;
+    test_end();
+}
+
+/*!
+ * @brief 項の多い式をコンパイルできるかテスト
+ */
+void long_expression_test(void) {
+    int nterms = 100000;
+    char *source, *s;
+    int i, opt;
+
+    source = (char *)malloc(nterms * 4 + 256);
+    s = source;
+    s += sprintf(s, "program long; var a : integer; begin a := 1; a := a");
+    for (i = 0; i < nterms; i++) {
+        s += sprintf(s, " + a");
+    }
+    sprintf(s, "; a := a - a end.");
+
+    for (opt = 0; opt <= 1; opt++) {
+        test_init();
+        CU_ASSERT_EQUAL(compile(source, opt), 0);
+        CU_ASSERT_EQUAL(count_opcode(OP_ADDA), nterms);
+        test_end();
+    }
+    free(source);
+}
+
+/*!
+ * @brief 配列の要素を葉とする平衡木の式を書く
+ * @param[out] s 書く先
+ * @param[in] first 最初の葉の番号
+ * @param[in] n 葉の数
+ * @return char* 書いた文字列の終わり
+ */
+static char *balanced_sum(char *s, int first, int n) {
+    if (n == 1) {
+        return s + sprintf(s, "v[%d]", first % 10);
+    }
+    *s++ = '(';
+    s = balanced_sum(s, first, n / 2);
+    s += sprintf(s, " %c ", (first / 2 % 2 == 0) ? '+' : '-');
+    s = balanced_sum(s, first + n / 2, n - n / 2);
+    *s++ = ')';
+    *s = '\0';
+    return s;
+}
+
+/*!
+ * @brief レジスタが足りない式をスタックに退避するテスト
+ */
+void spill_test(void) {
+    char source[4096];
+    char *s;
+    int nleaves, results[2], opt;
+
+    for (nleaves = 32; nleaves <= 64; nleaves *= 2) {
+        s = source + sprintf(source, "program spill; var i, r : integer; v : array[10] of integer;\n"
+                                     "begin i := 0; while i < 10 do begin v[i] := i * 3 - 7; i := i + 1 end;\n"
+                                     "r := ");
+        s = balanced_sum(s, 0, nleaves);
+        sprintf(s, " end.");
+
+        for (opt = 0; opt <= 1; opt++) {
+            test_init();
+            CU_ASSERT_EQUAL(compile(source, opt), 0);
+            if (opt) {
+                // 葉が32個なら7個のレジスタで足り, 64個なら足りない
+                CU_ASSERT_EQUAL(count_opcode(OP_PUSH), (nleaves == 32) ? 0 : 1);
+                CU_ASSERT_EQUAL(count_opcode(OP_POP), (nleaves == 32) ? 0 : 1);
+            }
+            CU_ASSERT_EQUAL(run_program(), RUN_OK);
+            results[opt] = value_of("$r", 0);
+            test_end();
+        }
+        CU_ASSERT_EQUAL(results[0], results[1]);
+        CU_ASSERT_NOT_EQUAL(results[1], 0);
+    }
+}
+
+/*!
+ * @brief 配列の添字の範囲の検査のテスト
+ */
+void array_bounds_test(void) {
+    char source[256];
+    int opt;
+
+    for (opt = 0; opt <= 1; opt++) {
+        test_init();
+        CU_ASSERT_EQUAL(compile("program bounds; var i, r : integer; v : array[10] of integer;\n"
+                                "begin i := 9; v[i] := 5; r := v[i] + v[i - 9] end.",
+                                opt),
+                        0);
+        CU_ASSERT_EQUAL(run_program(), RUN_OK);
+        CU_ASSERT_EQUAL(value_of("$r", 0), 5);
+        CU_ASSERT_EQUAL(value_of("$v", 9), 5);
+        if (opt) {
+            CU_ASSERT(contains("LD gr1, $i\nLAD gr2, 9\nCPA gr1, gr2\nJPL EROV\nLD gr1, $v, gr1\n"));
+        }
+        test_end();
+
+        sprintf(source, "program bounds; var i, r : integer; v : array[10] of integer;\n"
+                        "begin i := 10; %s end.",
+                "r := v[i]");
+        test_init();
+        CU_ASSERT_EQUAL(compile(source, opt), 0);
+        CU_ASSERT_EQUAL(run_program(), RUN_EROV);
+        test_end();
+
+        sprintf(source, "program bounds; var i, r : integer; v : array[10] of integer;\n"
+                        "begin i := 10; %s end.",
+                "v[i] := 1");
+        test_init();
+        CU_ASSERT_EQUAL(compile(source, opt), 0);
+        CU_ASSERT_EQUAL(run_program(), RUN_EROV);
+        test_end();
+    }
+}
+
+/*!
+ * @brief char への型変換で下位7ビットを取り出すテスト
+ */
+void char_cast_test(void) {
+    struct TYPE int_type = {TPINT, 0, NULL, NULL, NULL};
+    struct ID a;
+
+    memset(&a, 0, sizeof(a));
+    a.name = "a";
+    a.itp = &int_type;
+
+    test_init();
+    optimize = 1;
+    assemble_variable_reference_rval(&a);
+    assemble_cast(TPCHAR, TPINT);
+    CU_ASSERT_EQUAL(pending_exprs->kind, EXPR_CAST);
+    CU_ASSERT_EQUAL(pending_exprs->need, 2); // マスクのレジスタ
+    assemble_expr_register(pop_expr());
+    free(object_text);
+    object_text = program_text();
+    CU_ASSERT_STRING_EQUAL(object_text, "LD gr1, $a\nLAD gr2, 127\nAND gr1, gr2\n");
+    test_end();
+
+    test_init();
+    optimize = 0;
+    assemble_variable_reference_rval(&a);
+    assemble_cast(TPCHAR, TPINT);
+    flush_exprs();
+    free(object_text);
+    object_text = program_text();
+    CU_ASSERT_STRING_EQUAL(object_text, "LD gr1, $a\nPUSH 0, gr1\nPOP gr1\nLAD gr2, 127\nAND gr1, gr2\nPUSH 0, gr1\n");
+    test_end();
+}
+
+/*!
+ * @brief 左辺値のない実引数をレジスタで評価するテスト
+ */
+void parameter_test(void) {
+    int opt;
+
+    for (opt = 0; opt <= 1; opt++) {
+        test_init();
+        CU_ASSERT_EQUAL(compile("program param; var a, r, s : integer;\n"
+                                "procedure p(x : integer); begin r := x * 2; x := 0 end;\n"
+                                "begin a := 4; call p(a + 1); s := r; call p(a) end.",
+                                opt),
+                        0);
+        if (opt) {
+            // 一時領域に値を格納してその番地を積む
+            CU_ASSERT(contains("LAD gr2, 1\nADDA gr1, gr2\nJOV EOVF\nST gr1, L0002\nLAD gr1, L0002\nPUSH 0, gr1\nCALL $p\n"));
+        }
+        CU_ASSERT_EQUAL(run_program(), RUN_OK);
+        CU_ASSERT_EQUAL(value_of("$s", 0), 10);
+        CU_ASSERT_EQUAL(value_of("$r", 0), 8);
+        CU_ASSERT_EQUAL(value_of("$a", 0), 0);
+        test_end();
+    }
+}
+
+/*!
+ * @brief -O とスタックで評価した目的プログラムの実行結果が等しいかテスト
+ */
+void register_mode_test(void) {
+    const char *source = "program modes; var i, s, t, q : integer; b, c : boolean; v : array[8] of integer;\n"
+                         "procedure p(m, n : integer); begin t := t + m * n - (m - n) div 3 end;\n"
+                         "begin\n"
+                         "  i := 0; s := 0; t := 0;\n"
+                         "  while i < 8 do begin v[i] := i * i - 5 * i; i := i + 1 end;\n"
+                         "  i := 0;\n"
+                         "  while i <= 7 do begin\n"
+                         "    if (v[i] > 0) and not (i = 6) or (i >= 7) then s := s + v[i] * (i + 1)\n"
+                         "    else s := s - v[7 - i] div 2;\n"
+                         "    call p(i, v[i] + 1);\n"
+                         "    i := i + 1\n"
+                         "  end;\n"
+                         "  b := not (s <> t); c := s < t;\n"
+                         "  q := ((s + 1) * (t - 2) - i * 3) div (v[2] - v[1] * 2 - (v[3] div 2)) - i\n"
+                         "end.";
+    char *labels[] = {"$i", "$s", "$t", "$q", "$b", "$c"};
+    int values[2][6 + 8];
+    long steps[2];
+    int opt, k;
+
+    for (opt = 0; opt <= 1; opt++) {
+        test_init();
+        CU_ASSERT_EQUAL(compile(source, opt), 0);
+        CU_ASSERT_EQUAL(run_program(), RUN_OK);
+        steps[opt] = sim_steps;
+        for (k = 0; k < 6; k++) {
+            values[opt][k] = value_of(labels[k], 0);
+        }
+        for (k = 0; k < 8; k++) {
+            values[opt][6 + k] = value_of("$v", k);
+        }
+        test_end();
+    }
+    for (k = 0; k < 6 + 8; k++) {
+        CU_ASSERT_EQUAL(values[0][k], values[1][k]);
+    }
+    CU_ASSERT_EQUAL(values[1][0], 8);
+    CU_ASSERT_EQUAL(values[1][1], 112);
+    CU_ASSERT_EQUAL(values[1][2], 106);
+    CU_ASSERT_EQUAL(values[1][3], 2337);
+    CU_ASSERT_EQUAL(values[1][6 + 7], 14);
+    CU_ASSERT(steps[1] < steps[0]);
+}
+
+/*!
+ * @brief 定数の div が DIVA と同じく0の方へ丸めるテスト
+ */
+void fold_div_test(void) {
+    char *cases[][2] = {{"(-7) div 2", "-3"}, {"7 div (-2)", "-3"}, {"(-7) div (-2)", "3"}, {"7 div 2", "3"},
+                        {"-7 div 2", "-3"},   {"0 div (-5)", "0"}};
+    char statement[128], code[64];
+    int opt, k;
+
+    for (opt = 0; opt <= 1; opt++) {
+        for (k = 0; k < (int)(sizeof(cases) / sizeof(cases[0])); k++) {
+            sprintf(statement, "r := %s", cases[k][0]);
+            sprintf(code, "LAD gr1, %s\n", cases[k][1]);
+            test_init();
+            CU_ASSERT_EQUAL(compile_statement(statement, opt), 0);
+            CU_ASSERT(contains(code));
+            CU_ASSERT_EQUAL(count_opcode(OP_DIVA), 0);
+            CU_ASSERT_EQUAL(count_opcode(OP_MULA), 0);
+            CU_ASSERT_EQUAL(run_program(), RUN_OK);
+            CU_ASSERT_EQUAL(value_of("$r", 0), atoi(cases[k][1]));
+            test_end();
+        }
+
+        // 実行時の DIVA と同じ値
+        test_init();
+        CU_ASSERT_EQUAL(compile_statement("a := -7; r := a div 2", opt), 0);
+        CU_ASSERT_EQUAL(count_opcode(OP_DIVA), 1);
+        CU_ASSERT_EQUAL(run_program(), RUN_OK);
+        CU_ASSERT_EQUAL(value_of("$r", 0), -3);
+        test_end();
+    }
+}
+
+/*!
+ * @brief 定数式の桁あふれと0除算をコンパイル時のエラーにするテスト
+ */
+void fold_error_test(void) {
+    char *overflows[] = {"32767 + 1", "-32767 - 2", "200 * 200", "(-32767 - 1) * (-1)", "(-32767 - 1) div (-1)"};
+    char statement[128];
+    int k;
+
+    for (k = 0; k < (int)(sizeof(overflows) / sizeof(overflows[0])); k++) {
+        sprintf(statement, "r := %s", overflows[k]);
+        test_init();
+        CU_ASSERT_EQUAL(compile_statement(statement, 0), ERROR);
+        CU_ASSERT_PTR_NOT_NULL(strstr(error_text, "Overflow in the constant expression."));
+        test_end();
+    }
+
+    test_init();
+    CU_ASSERT_EQUAL(compile_statement("r := 5 div (3 - 3)", 0), ERROR);
+    CU_ASSERT_PTR_NOT_NULL(strstr(error_text, "Division by zero in the constant expression."));
+    test_end();
+
+    // -32768 は範囲内
+    test_init();
+    CU_ASSERT_EQUAL(compile_statement("r := -32767 - 1", 0), 0);
+    CU_ASSERT_STRING_EQUAL(error_text, "");
+    CU_ASSERT(contains("LAD gr1, -32768\n"));
+    CU_ASSERT_EQUAL(run_program(), RUN_OK);
+    CU_ASSERT_EQUAL(value_of("$r", 0), -32768);
+    test_end();
+
+    // 変数を含む式は実行時に調べる
+    test_init();
+    CU_ASSERT_EQUAL(compile_statement("a := 0; r := 5 div a", 0), 0);
+    CU_ASSERT_EQUAL(run_program(), RUN_E0DIV);
+    test_end();
+}
+
+/*!
+ * @brief x + 0 などを x にするテスト
+ */
+void fold_identity_test(void) {
+    char *identities[] = {"a + 0", "0 + a", "a - 0", "a * 1", "1 * a", "a div 1", "(a + 0) * 1 - 0"};
+    char statement[128];
+    char *expected;
+    int opt, k;
+
+    for (opt = 0; opt <= 1; opt++) {
+        test_init();
+        compile_statement("r := a", opt);
+        expected = object_text;
+        object_text = NULL;
+        test_end();
+
+        for (k = 0; k < (int)(sizeof(identities) / sizeof(identities[0])); k++) {
+            sprintf(statement, "r := %s", identities[k]);
+            test_init();
+            CU_ASSERT_EQUAL(compile_statement(statement, opt), 0);
+            CU_ASSERT_STRING_EQUAL(object_text, expected);
+            test_end();
+        }
+
+        // 0 - x は -x なので残す
+        test_init();
+        CU_ASSERT_EQUAL(compile_statement("a := 5; r := 0 - a", opt), 0);
+        CU_ASSERT_EQUAL(count_opcode(OP_SUBA), 1);
+        CU_ASSERT_EQUAL(run_program(), RUN_OK);
+        CU_ASSERT_EQUAL(value_of("$r", 0), -5);
+        test_end();
+        free(expected);
+    }
+}
+
+/*!
+ * @brief 定数の関係演算, not, 型変換を畳み込むテスト
+ */
+void fold_relation_test(void) {
+    char *trues[] = {"3 < 5", "5 <= 5", "6 > 5", "5 >= 5", "5 = 5", "4 <> 5", "not false", "not (1 = 2)", "not not true"};
+    char *falses[] = {"5 < 3", "6 <= 5", "5 > 5", "4 >= 5", "4 = 5", "5 <> 5", "not true", "not (2 > 1)"};
+    char statement[128];
+    char *expected[2];
+    int opt, k, value;
+
+    for (opt = 0; opt <= 1; opt++) {
+        for (value = 0; value <= 1; value++) {
+            test_init();
+            compile_statement(value ? "b := true" : "b := false", opt);
+            expected[value] = object_text;
+            object_text = NULL;
+            test_end();
+        }
+        for (k = 0; k < (int)(sizeof(trues) / sizeof(trues[0])); k++) {
+            sprintf(statement, "b := %s", trues[k]);
+            test_init();
+            CU_ASSERT_EQUAL(compile_statement(statement, opt), 0);
+            CU_ASSERT_STRING_EQUAL(object_text, expected[1]);
+            test_end();
+        }
+        for (k = 0; k < (int)(sizeof(falses) / sizeof(falses[0])); k++) {
+            sprintf(statement, "b := %s", falses[k]);
+            test_init();
+            CU_ASSERT_EQUAL(compile_statement(statement, opt), 0);
+            CU_ASSERT_STRING_EQUAL(object_text, expected[0]);
+            test_end();
+        }
+        free(expected[0]);
+        free(expected[1]);
+    }
+
+    // 型変換
+    test_init();
+    assemble_constant(200);
+    assemble_cast(TPCHAR, TPINT);
+    CU_ASSERT(is_constant_of(pending_exprs, 72));
+    assemble_cast(TPBOOL, TPCHAR);
+    CU_ASSERT(is_constant_of(pending_exprs, 1));
+    assemble_constant(0);
+    assemble_cast(TPBOOL, TPINT);
+    CU_ASSERT(is_constant_of(pending_exprs, 0));
+    assemble_constant(-5);
+    assemble_cast(TPBOOL, TPINT);
+    CU_ASSERT(is_constant_of(pending_exprs, 1));
+    assemble_constant(-5);
+    assemble_cast(TPINT, TPINT);
+    CU_ASSERT(is_constant_of(pending_exprs, -5));
+    CU_ASSERT_EQUAL(casl_program.ninsns, 0);
+    pending_exprs = NULL;
+    test_end();
+}
+
+/*!
+ * @brief 関係演算の条件が成り立たないときの分岐のテスト
+ */
+void condition_jump_test(void) {
+    struct {
+        char *opr;
+        char *jumps;
+        int holds[3]; /* a が b より小さい, 等しい, 大きいとき */
+    } cases[] = {{"=", "JNZ L0004\n", {0, 1, 0}},           {"<>", "JZE L0004\n", {1, 0, 1}},
+                 {"<", "JPL L0004\nJZE L0004\n", {1, 0, 0}}, {"<=", "JPL L0004\n", {1, 1, 0}},
+                 {">", "JMI L0004\nJZE L0004\n", {0, 0, 1}}, {">=", "JMI L0004\n", {0, 1, 1}}};
+    char statement[128], code[256];
+    int opt, k, a;
+
+    for (opt = 0; opt <= 1; opt++) {
+        for (k = 0; k < (int)(sizeof(cases) / sizeof(cases[0])); k++) {
+            for (a = 1; a <= 3; a++) {
+                sprintf(statement, "a := %d; r := 0; if a %s 2 then r := 1", a, cases[k].opr);
+                test_init();
+                CU_ASSERT_EQUAL(compile_statement(statement, opt), 0);
+                if (opt) {
+                    sprintf(code, "LD gr1, $a\nLAD gr2, 2\nCPA gr1, gr2\n%sLAD gr1, 1\nST gr1, $r\n", cases[k].jumps);
+                } else {
+                    sprintf(code, "POP gr2\nPOP gr1\nCPA gr1, gr2\n%sLAD gr1, $r\n", cases[k].jumps);
+                }
+                CU_ASSERT(contains(code));
+                CU_ASSERT_EQUAL(run_program(), RUN_OK);
+                CU_ASSERT_EQUAL(value_of("$r", 0), cases[k].holds[a - 1]);
+                test_end();
+            }
+        }
+
+        // while の条件も同じ
+        test_init();
+        CU_ASSERT_EQUAL(compile_statement("r := 0; while r < 5 do r := r + 1", opt), 0);
+        CU_ASSERT(contains("CPA gr1, gr2\nJPL L0003\nJZE L0003\n"));
+        CU_ASSERT_EQUAL(run_program(), RUN_OK);
+        CU_ASSERT_EQUAL(value_of("$r", 0), 5);
+        test_end();
+    }
+}
+
+/*!
+ * @brief 定数の条件では比較しないテスト
+ */
+void condition_constant_test(void) {
+    struct {
+        char *statement;
+        int compares; /* CPA の数 */
+        int jumps;    /* JUMP の数 */
+        int r;
+    } cases[] = {
+        {"if true then r := 1 else r := 2", 0, 1, 1},
+        {"if 1 < 2 then r := 1 else r := 2", 0, 1, 1},
+        {"if false then r := 1 else r := 2", 0, 2, 2},
+        {"if 2 * 3 = 7 then r := 1", 0, 1, 0},
+        {"while false do r := 1", 0, 2, 0},
+        {"while 1 > 2 do r := 1", 0, 2, 0},
+        {"while true do begin r := r + 1; if r = 5 then break end", 1, 2, 5},
+    };
+    int opt, k;
+
+    for (opt = 0; opt <= 1; opt++) {
+        for (k = 0; k < (int)(sizeof(cases) / sizeof(cases[0])); k++) {
+            test_init();
+            CU_ASSERT_EQUAL(compile_statement(cases[k].statement, opt), 0);
+            CU_ASSERT_EQUAL(run_program(), RUN_OK);
+            CU_ASSERT_EQUAL(value_of("$r", 0), cases[k].r);
+            test_end();
+
+            // のぞき穴最適化は分岐を書き換えるので使わない
+            test_init();
+            CU_ASSERT_EQUAL(compile_statement(cases[k].statement, opt ? OPT_NO_PEEPHOLE : 0), 0);
+            CU_ASSERT_EQUAL(count_opcode(OP_CPA), cases[k].compares);
+            CU_ASSERT_EQUAL(count_opcode(OP_JNZ), cases[k].compares); // r = 5 の分岐だけ
+            CU_ASSERT_EQUAL(count_opcode(OP_JZE) + count_opcode(OP_JPL) + count_opcode(OP_JMI), 0);
+            CU_ASSERT_EQUAL(count_opcode(OP_JUMP), cases[k].jumps);
+            test_end();
+        }
+    }
+}
+
+/*!
+ * @brief PUSH と POP の組を書き換える規則のテスト
+ */
+void peephole_push_pop_test(void) {
+    int window;
+
+    // 窓が1なら規則は働かない
+    for (window = 1; window <= 2; window++) {
+        test_init();
+        emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+        emit(OP_POP, 2, ADR_NONE, 0, 0);
+        emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+        optimize_program(window);
+        CU_ASSERT_STRING_EQUAL(object_text, (window == 1) ? "PUSH 0, gr1\nPOP gr2\nSVC 0\n" : "LD gr2, gr1\nSVC 0\n");
+        test_end();
+    }
+
+    // 間に命令が1つあれば窓は3必要
+    for (window = 2; window <= 3; window++) {
+        test_init();
+        emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+        emit(OP_LAD, 3, ADR_NUMBER, 1, 0);
+        emit(OP_POP, 2, ADR_NONE, 0, 0);
+        emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+        optimize_program(window);
+        CU_ASSERT_STRING_EQUAL(object_text, (window == 2) ? "PUSH 0, gr1\nLAD gr3, 1\nPOP gr2\nSVC 0\n"
+                                                          : "LAD gr3, 1\nLD gr2, gr1\nSVC 0\n");
+        test_end();
+    }
+
+    // 実行時エラーへの分岐は間にあってよい
+    test_init();
+    emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+    emit(OP_ADDA, 3, ADR_NONE, 0, 4);
+    emit_name(OP_JOV, -1, "EOVF", 0);
+    emit(OP_POP, 2, ADR_NONE, 0, 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "ADDA gr3, gr4\nJOV EOVF\nLD gr2, gr1\nSVC 0\n");
+    test_end();
+
+    // ほかのラベルへの分岐はだめ
+    test_init();
+    emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+    emit(OP_ADDA, 3, ADR_NONE, 0, 4);
+    emit_name(OP_JOV, -1, "L0001", 0);
+    emit(OP_POP, 2, ADR_NONE, 0, 0);
+    emit_label("L0001");
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "PUSH 0, gr1\nADDA gr3, gr4\nJOV L0001\nPOP gr2\nL0001\nSVC 0\n");
+    test_end();
+
+    // 積んだレジスタを間で書き換えるのもだめ
+    test_init();
+    emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+    emit(OP_LAD, 1, ADR_NUMBER, 5, 0);
+    emit(OP_POP, 2, ADR_NONE, 0, 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "PUSH 0, gr1\nLAD gr1, 5\nPOP gr2\nSVC 0\n");
+    test_end();
+
+    // 同じレジスタなら両方消える
+    test_init();
+    emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+    emit(OP_POP, 1, ADR_NONE, 0, 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "SVC 0\n");
+    test_end();
+}
+
+/*!
+ * @brief フラグが後で読まれるときは, フラグを変える書き換えをしないテスト
+ */
+void peephole_flags_test(void) {
+    // POP のあとでフラグを読むなら LD ではなく LAD にする
+    test_init();
+    emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+    emit(OP_POP, 2, ADR_NONE, 0, 0);
+    emit_name(OP_JZE, -1, "L0001", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    emit_label("L0001");
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "LAD gr2, 0, gr1\nJZE L0001\nSVC 0\nL0001\nSVC 0\n");
+    test_end();
+
+    // LD r,x のフラグを読むなら LD を消さない
+    test_init();
+    emit(OP_LD, 1, ADR_NONE, 0, 2);
+    emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+    emit_name(OP_JZE, -1, "L0001", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    emit_label("L0001");
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "LD gr1, gr2\nPUSH 0, gr1\nJZE L0001\nSVC 0\nL0001\nSVC 0\n");
+    test_end();
+
+    // 間で CPA がフラグを変えるなら消せる
+    test_init();
+    emit(OP_LD, 1, ADR_NONE, 0, 2);
+    emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+    emit(OP_CPA, 3, ADR_NONE, 0, 4);
+    emit_name(OP_JZE, -1, "L0001", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    emit_label("L0001");
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "PUSH 0, gr2\nCPA gr3, gr4\nJZE L0001\nSVC 0\nL0001\nSVC 0\n");
+    test_end();
+
+    // ST r,adr の直後の LD r,adr はフラグを読まないときだけ消す
+    test_init();
+    emit_name(OP_ST, 1, "$a", 0);
+    emit_name(OP_LD, 1, "$a", 0);
+    emit_name(OP_JMI, -1, "L0001", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    emit_label("L0001");
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "ST gr1, $a\nLD gr1, $a\nJMI L0001\nSVC 0\nL0001\nSVC 0\n");
+    test_end();
+
+    test_init();
+    emit_name(OP_ST, 1, "$a", 0);
+    emit_name(OP_LD, 1, "$a", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "ST gr1, $a\nSVC 0\n");
+    test_end();
+
+    // LAD のあとの LD b,a はフラグを変えるので, フラグを読むなら LAD b にしない
+    test_init();
+    emit(OP_LAD, 1, ADR_NUMBER, 5, 0);
+    emit(OP_LD, 2, ADR_NONE, 0, 1);
+    emit_name(OP_JZE, -1, "L0001", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    emit_label("L0001");
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "LAD gr1, 5\nLD gr2, gr1\nJZE L0001\nSVC 0\nL0001\nSVC 0\n");
+    test_end();
+
+    test_init();
+    emit_name(OP_LD, 1, "$a", 0);
+    emit(OP_LD, 2, ADR_NONE, 0, 1);
+    emit_name(OP_JZE, -1, "L0001", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    emit_label("L0001");
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "LD gr2, $a\nJZE L0001\nSVC 0\nL0001\nSVC 0\n");
+    test_end();
+}
+
+/*!
+ * @brief 条件分岐の先でレジスタを読むときは書き換えないテスト
+ */
+void peephole_branch_test(void) {
+    int read;
+
+    for (read = 0; read <= 1; read++) {
+        test_init();
+        emit(OP_LAD, 1, ADR_NUMBER, 5, 0);
+        emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+        emit_name(OP_JZE, -1, "L0001", 0);
+        emit(OP_LAD, 1, ADR_NUMBER, 0, 0);
+        emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+        emit_label("L0001");
+        if (!read) {
+            emit(OP_LAD, 1, ADR_NUMBER, 1, 0);
+        }
+        emit_name(OP_ST, 1, "$a", 0);
+        emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+        optimize_program(PEEPHOLE_WINDOW);
+        if (read) {
+            CU_ASSERT_STRING_EQUAL(object_text, "LAD gr1, 5\nPUSH 0, gr1\nJZE L0001\nLAD gr1, 0\nSVC 0\n"
+                                                "L0001\nST gr1, $a\nSVC 0\n");
+        } else {
+            CU_ASSERT_STRING_EQUAL(object_text, "PUSH 5\nJZE L0001\nLAD gr1, 0\nSVC 0\n"
+                                                "L0001\nLAD gr1, 1\nST gr1, $a\nSVC 0\n");
+        }
+        test_end();
+    }
+
+    // 分岐先が分からなければ読むとみなす
+    test_init();
+    emit(OP_LAD, 1, ADR_NUMBER, 5, 0);
+    emit(OP_PUSH, -1, ADR_NUMBER, 0, 1);
+    emit_name(OP_JZE, -1, "FLUSH", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "LAD gr1, 5\nPUSH 0, gr1\nJZE FLUSH\nSVC 0\n");
+    test_end();
+}
+
+/*!
+ * @brief 分岐の規則のテスト
+ */
+void peephole_jump_test(void) {
+    int window;
+
+    // 直後のラベルへの JUMP は消す, 窓が1なら消さない
+    for (window = 1; window <= 2; window++) {
+        test_init();
+        emit_name(OP_JUMP, -1, "L0001", 0);
+        emit_label("L0001");
+        emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+        optimize_program(window);
+        CU_ASSERT_STRING_EQUAL(object_text, (window == 1) ? "JUMP L0001\nL0001\nSVC 0\n" : "L0001\nSVC 0\n");
+        test_end();
+    }
+
+    // JUMP への分岐は行き先へ直接分岐する
+    test_init();
+    emit_name(OP_JZE, -1, "L0001", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    emit_label("L0001");
+    emit_name(OP_JUMP, -1, "L0002", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    emit_label("L0002");
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "JZE L0002\nSVC 0\nL0001\nJUMP L0002\nSVC 0\nL0002\nSVC 0\n");
+    test_end();
+
+    // 循環する JUMP でも止まり, 無限ループのまま
+    test_init();
+    emit_label("L0001");
+    emit_name(OP_JUMP, -1, "L0002", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    emit_label("L0002");
+    emit_name(OP_JUMP, -1, "L0001", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "L0001\nJUMP L0001\nSVC 0\nL0002\nJUMP L0001\nSVC 0\n");
+    test_end();
+
+    test_init();
+    emit_label("L0001");
+    emit_name(OP_JUMP, -1, "L0001", 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "L0001\nJUMP L0001\n");
+    test_end();
+}
+
+/*!
+ * @brief 連続するラベルをまとめるテスト
+ */
+void peephole_label_chain_test(void) {
+    int window;
+
+    // 窓によらず, CALL と分岐の行き先も書き換える
+    for (window = 1; window <= 2; window++) {
+        test_init();
+        emit_name(OP_CALL, -1, "L0003", 0);
+        emit_name(OP_JZE, -1, "L0003", 0);
+        emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+        emit_label("L0002");
+        emit_label("L0003");
+        emit(OP_RET, -1, ADR_NONE, 0, 0);
+        optimize_program(window);
+        CU_ASSERT_STRING_EQUAL(object_text, "CALL L0002\nJZE L0002\nSVC 0\nL0002\nRET\n");
+        test_end();
+    }
+
+    // ライブラリのラベルはまとめない
+    test_init();
+    emit_name(OP_CALL, -1, "FLUSH", 0);
+    emit(OP_SVC, -1, ADR_NUMBER, 0, 0);
+    emit_label("L0002");
+    emit_label("FLUSH");
+    emit(OP_RET, -1, ADR_NONE, 0, 0);
+    optimize_program(PEEPHOLE_WINDOW);
+    CU_ASSERT_STRING_EQUAL(object_text, "CALL FLUSH\nSVC 0\nL0002\nFLUSH\nRET\n");
+    test_end();
+}
+
+void test_init(void) {
+    init_crtab();
+    init_literal_list();
+    in_subprogram_declaration = 0;
+    in_variable_declaration = 0;
+    in_call_statement = 0;
+    is_array_type = 0;
+    is_formal_parameter = 0;
+    definition_procedure_name = 0;
+    exists_empty_statement = 0;
+    while_statement_level = 0;
+    label_counter = 0;
+    optimize = 0;
+    peephole_window = 0;
+    pending_exprs = NULL;
+    top = NUM_REGISTERS - 1;
+}
+
+void test_end(void) {
+    release_program();
+    release_crtab();
+    release_literal_lists();
+    free(object_text);
+    object_text = NULL;
+    free(error_text);
+    error_text = NULL;
+}
+
+/*!
+ * @brief ファイルの内容を読む
+ * @param[in] fp ファイル
+ * @return char* 内容, タブは除く
+ */
+static char *read_text(FILE *fp) {
+    char *buf;
+    long size;
+    int c, n = 0;
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    rewind(fp);
+    buf = (char *)malloc(size + 1);
+    while ((c = getc(fp)) != EOF) {
+        if (c != '\t') {
+            buf[n++] = (char)c;
+        }
+    }
+    buf[n] = '\0';
+    return buf;
+}
+
+/*!
+ * @brief MPPLのプログラムをコンパイルして, 目的プログラムを casl_program と object_text に残す
+ * @param[in] source プログラム
+ * @param[in] opt 1なら -O, OPT_NO_PEEPHOLE なら -O --peephole 0
+ * @return int parse_program() の返り値
+ */
+int compile(const char *source, int opt) {
+    static char mpl[] = "test_tmp.mpl";
+    FILE *fp;
+    int ret, saved, fd;
+
+    fp = fopen("test_tmp.mpl", "w");
+    fputs(source, fp);
+    fclose(fp);
+    strcpy(mpl, "test_tmp.mpl");
+    file_name = mpl;
+    optimize = opt != 0;
+    peephole_window = (opt == 1) ? PEEPHOLE_WINDOW : 0;
+
+    // エラーの出力を取っておく
+    fflush(stderr);
+    saved = dup(2);
+    fd = open("test_tmp.err", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, 2);
+    close(fd);
+
+    init_scan_tokens(mpl, 1, NULL);
+    init_assemble(mpl);
+    token = scan();
+    ret = parse_program();
+    end_scan();
+    flush_exprs();
+    if (peephole_window > 0) {
+        peephole_optimize(&casl_program);
+    }
+    fclose(out_fp);
+
+    fflush(stderr);
+    dup2(saved, 2);
+    close(saved);
+    fp = fopen("test_tmp.err", "r");
+    free(error_text);
+    error_text = read_text(fp);
+    fclose(fp);
+    remove("test_tmp.err");
+    remove("test_tmp.mpl");
+    remove("test_tmp.csl");
+
+    free(object_text);
+    object_text = program_text();
+    return ret;
+}
+
+/*!
+ * @brief 変数 a, r, b を宣言したプログラムの文をコンパイルする
+ * @param[in] statement 文
+ * @param[in] opt 1なら -O
+ * @return int parse_program() の返り値
+ */
+int compile_statement(const char *statement, int opt) {
+    char source[1024];
+
+    sprintf(source, "program p; var a, r : integer; b : boolean;\nbegin %s end.", statement);
+    return compile(source, opt);
+}
+
+/*!
+ * @brief 手で組み立てた目的プログラムにのぞき穴最適化をかけ, object_text に残す
+ * @param[in] window 窓
+ */
+void optimize_program(int window) {
+    peephole_window = window;
+    peephole_optimize(&casl_program);
+    free(object_text);
+    object_text = program_text();
+}
+
+/*!
+ * @brief 目的プログラムのテキスト
+ * @return char* テキスト, タブは除く
+ */
+char *program_text(void) {
+    FILE *fp = tmpfile();
+    char *buf;
+
+    write_program(fp);
+    buf = read_text(fp);
+    fclose(fp);
+    return buf;
+}
+
+/*!
+ * @brief 目的プログラムが命令の並びを含むか
+ * @param[in] code 命令の並び, タブは除く
+ * @return int 含めば1
+ */
+int contains(const char *code) {
+    return object_text != NULL && strstr(object_text, code) != NULL;
+}
+
+/*!
+ * @brief 目的プログラムの命令を数える
+ * @param[in] opcode 命令
+ * @return int 命令の数
+ */
+int count_opcode(int opcode) {
+    int i, n = 0;
+
+    for (i = 0; i < casl_program.ninsns; i++) {
+        if (casl_program.insns[i].opcode == opcode) {
+            n++;
+        }
+    }
+    return n;
+}
+
+/*!
+ * @brief 値を1語に切り詰める
+ * @param[in] value 値
+ * @return int -32768 から 32767 の値
+ */
+static int sim_word(long value) {
+    value = ((value % 65536) + 65536) % 65536;
+    return (int)((value >= 32768) ? value - 65536 : value);
+}
+
+/*!
+ * @brief casl_program を実行する
+ * ライブラリは実行せず, 入出力の CALL は何もしない. 実行時エラーのルーチンへの分岐で止まる.
+ * @return int RUN_OK, RUN_EOVF, RUN_EROV, RUN_E0DIV, RUN_ABORT
+ */
+int run_program(void) {
+    struct CASL_INSTRUCTION *insn;
+    int gr[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    int sp = SIM_MEMORY, zf = 0, sf = 0, of = 0;
+    int i, a = 0, pc = -1, adr, value, jump, library;
+    long result;
+    char *name;
+
+    free(sim_names);
+    sim_nnames = casl_program.nnames;
+    sim_names = (int *)malloc(sizeof(int) * (sim_nnames + 1));
+    for (i = 0; i < sim_nnames; i++) {
+        sim_names[i] = -1;
+    }
+    for (i = 0; i < SIM_MEMORY; i++) {
+        sim_mem[i] = 0;
+        sim_insn[i] = -1;
+    }
+    for (i = 0; i < casl_program.ninsns; i++) {
+        insn = &casl_program.insns[i];
+        if (a + ((insn->opcode == OP_DS) ? insn->adr : 1) > SIM_MEMORY) {
+            return RUN_ABORT;
+        }
+        if (insn->opcode != OP_NONE && insn->label >= 0) {
+            sim_names[insn->label] = a;
+        }
+        switch (insn->opcode) {
+            case OP_NONE:
+            case OP_LABEL:
+            case OP_END:
+            case OP_LIBRARY:
+                break;
+            case OP_START:
+                pc = a;
+                break;
+            case OP_DS:
+                a += insn->adr;
+                break;
+            case OP_DC:
+                sim_mem[a++] = (insn->kind == ADR_NUMBER) ? insn->adr : atoi(casl_program.names[insn->adr]);
+                break;
+            default:
+                sim_insn[a++] = i;
+                break;
+        }
+    }
+
+    for (sim_steps = 0; sim_steps < SIM_MAX_STEPS; sim_steps++) {
+        if (pc < 0 || pc >= SIM_MEMORY || sim_insn[pc] < 0) {
+            return RUN_ABORT;
+        }
+        insn = &casl_program.insns[sim_insn[pc++]];
+        library = insn->kind == ADR_NAME && sim_names[insn->adr] < 0;
+        adr = (insn->kind == ADR_NAME) ? sim_names[insn->adr] : insn->adr;
+        if (insn->kind != ADR_NONE && insn->x > 0) {
+            adr += gr[insn->x];
+        }
+        if (insn->kind == ADR_NONE) {
+            value = gr[insn->x];
+        } else if (adr >= 0 && adr < SIM_MEMORY) {
+            value = sim_mem[adr];
+        } else {
+            value = 0;
+        }
+        jump = 0;
+        result = 0;
+        switch (insn->opcode) {
+            case OP_LD:
+                result = value;
+                break;
+            case OP_ST:
+                if (adr < 0 || adr >= SIM_MEMORY) {
+                    return RUN_ABORT;
+                }
+                sim_mem[adr] = gr[insn->r];
+                continue;
+            case OP_LAD:
+                gr[insn->r] = sim_word(adr);
+                continue;
+            case OP_ADDA:
+                result = (long)gr[insn->r] + value;
+                break;
+            case OP_SUBA:
+                result = (long)gr[insn->r] - value;
+                break;
+            case OP_MULA:
+                result = (long)gr[insn->r] * value;
+                break;
+            case OP_DIVA:
+                if (value == 0) {
+                    of = 1;
+                    continue;
+                }
+                result = labs(gr[insn->r]) / labs(value);
+                if ((gr[insn->r] < 0) != (value < 0)) {
+                    result = -result;
+                }
+                break;
+            case OP_AND:
+                result = gr[insn->r] & value;
+                break;
+            case OP_OR:
+                result = gr[insn->r] | value;
+                break;
+            case OP_XOR:
+                result = gr[insn->r] ^ value;
+                break;
+            case OP_CPA:
+                result = (long)gr[insn->r] - value;
+                zf = result == 0;
+                sf = result < 0;
+                of = 0;
+                continue;
+            case OP_JUMP:
+                jump = 1;
+                break;
+            case OP_JPL:
+                jump = !sf && !zf;
+                break;
+            case OP_JMI:
+                jump = sf;
+                break;
+            case OP_JNZ:
+                jump = !zf;
+                break;
+            case OP_JZE:
+                jump = zf;
+                break;
+            case OP_JOV:
+                jump = of;
+                break;
+            case OP_PUSH:
+                sim_mem[--sp] = sim_word(adr);
+                continue;
+            case OP_POP:
+                gr[insn->r] = sim_mem[sp++];
+                continue;
+            case OP_CALL:
+                if (library) {
+                    // 入出力は実行しない
+                    continue;
+                }
+                sim_mem[--sp] = pc;
+                pc = adr;
+                continue;
+            case OP_RET:
+                pc = sim_mem[sp++];
+                continue;
+            case OP_SVC:
+                return RUN_OK;
+            default:
+                return RUN_ABORT;
+        }
+        if (opcode_attr[insn->opcode] & BRANCH) {
+            if (!jump) {
+                continue;
+            }
+            if (library) {
+                name = casl_program.names[insn->adr];
+                if (strcmp(name, "EOVF") == 0) {
+                    return RUN_EOVF;
+                } else if (strcmp(name, "EROV") == 0) {
+                    return RUN_EROV;
+                } else if (strcmp(name, "E0DIV") == 0) {
+                    return RUN_E0DIV;
+                }
+                return RUN_ABORT;
+            }
+            pc = adr;
+            continue;
+        }
+        // 演算の結果
+        gr[insn->r] = sim_word(result);
+        of = result < MIN_INT_VALUE || result > MAX_INT_VALUE;
+        if (insn->opcode == OP_LD || insn->opcode == OP_AND || insn->opcode == OP_OR || insn->opcode == OP_XOR) {
+            of = 0;
+        }
+        zf = gr[insn->r] == 0;
+        sf = gr[insn->r] < 0;
+    }
+    return RUN_ABORT;
+}
+
+/*!
+ * @brief run_program() の後の変数の値
+ * @param[in] label 変数のラベル
+ * @param[in] index 配列の添字, 配列でなければ0
+ * @return int 値, 変数がなければ -99999
+ */
+int value_of(char *label, int index) {
+    int name = casl_name(label);
+
+    if (name < 0 || name >= sim_nnames || sim_names[name] < 0) {
+        return -99999;
+    }
+    return sim_mem[sim_names[name] + index];
+}